@@ -1940,10 +1940,6 @@ typedef unsigned long uintptr_t;
 #endif
 #endif
 
-#ifndef BAIK_INIT_OFFSET_SIZE
-#define BAIK_INIT_OFFSET_SIZE 1
-#endif
-
 #endif
 #ifndef BAIK_FEATURES_H_
 #define BAIK_FEATURES_H_
@@ -1956,6 +1952,18 @@ typedef unsigned long uintptr_t;
 #define BAIK_MEMORY_STATS 0
 #endif
 
+#if !defined(BAIK_GC_THREADS)
+#define BAIK_GC_THREADS 0
+#endif
+
+#if !defined(BAIK_QUICKEN_STATS)
+#define BAIK_QUICKEN_STATS 0
+#endif
+
+#if !defined(BAIK_GC_COMPACT)
+#define BAIK_GC_COMPACT 0
+#endif
+
 
 #if !defined(BAIK_GENERATE_INAC)
 #if defined(BAIK_EM_MMAP)
@@ -2005,6 +2013,8 @@ typedef enum baik_err {
   BAIK_NOT_IMPLEMENTED_ERROR,
   BAIK_FILE_READ_ERROR,
   BAIK_BAD_ARGS_ERROR,
+  BAIK_SUSPENDED,
+  BAIK_INTERRUPTED,
   BAIK_ERRS_CNT
 } baik_err_t;
 struct baik;
@@ -2015,6 +2025,7 @@ struct baik_create_opts {
 
 struct baik *baik_create_opt(struct baik_create_opts opts);
 void baik_destroy(struct baik *baik);
+baik_err_t baik_reset(struct baik *baik);
 baik_val_t baik_get_global(struct baik *baik);
 void baik_own(struct baik *baik, baik_val_t *v);
 int baik_disown(struct baik *baik, baik_val_t *v);
@@ -2028,6 +2039,15 @@ void baik_set_generate_jsc(struct baik *baik, int generate_jsc);
 int baik_nargs(struct baik *baik);
 baik_val_t baik_arg(struct baik *baik, int n);
 void baik_return(struct baik *baik, baik_val_t v);
+
+/* Counted only when built with BAIK_QUICKEN_STATS */
+struct baik_quicken_stats {
+  unsigned long generic;     /* runs of quickenable opcodes left generic */
+  unsigned long specialized; /* runs of their specialized forms */
+  unsigned long deopts;      /* specialized forms whose guard failed */
+};
+
+void baik_get_quicken_stats(struct baik *baik, struct baik_quicken_stats *st);
 #if defined(__cplusplus)
 }
 #endif
@@ -2175,6 +2195,7 @@ extern "C" {
 #endif
 
 struct baik;
+struct gc_helper;
 
 typedef void (*gc_cell_destructor_t)(struct baik *baik, void *);
 
@@ -2182,14 +2203,25 @@ struct gc_block {
   struct gc_block *next;
   struct gc_cell *base;
   size_t size;
+  uint8_t *marks;
 };
 
 struct gc_arena {
   struct gc_block *blocks;
+  struct gc_block **sweep;
   size_t size_increment;
   struct gc_cell *free;
   size_t cell_size;
 
+#if BAIK_GC_THREADS
+  // While `bg` is set the helper sweeps in the background and `sweep`,
+  // `swept` and `swept_tail` are only touched under the helper lock. Only
+  // the mutator clears `bg`, once it took everything the helper swept.
+  struct gc_cell *swept;
+  struct gc_cell *swept_tail;
+  int bg;
+#endif
+
 #if BAIK_MEMORY_STATS
   unsigned long allocations;
   unsigned long garbage;    
@@ -2229,13 +2261,20 @@ BAIK_PRIVATE struct baik_object *new_object(struct baik *);
 BAIK_PRIVATE struct baik_property *new_property(struct baik *);
 BAIK_PRIVATE struct baik_ffi_sig *new_ffi_sig(struct baik *baik);
 BAIK_PRIVATE void gc_mark(struct baik *baik, baik_val_t *val);
+BAIK_PRIVATE void gc_mark_bcode(struct baik *baik, baik_val_t v);
 BAIK_PRIVATE void gc_arena_init(struct gc_arena *, size_t, size_t, size_t);
 BAIK_PRIVATE void gc_arena_destroy(struct baik *, struct gc_arena *a);
-BAIK_PRIVATE void gc_sweep(struct baik *, struct gc_arena *, size_t);
+BAIK_PRIVATE void gc_arena_reset(struct baik *, struct gc_arena *a);
+BAIK_PRIVATE void gc_reset(struct baik *baik);
+BAIK_PRIVATE size_t gc_arena_cells(const struct gc_arena *a);
+BAIK_PRIVATE void gc_arena_grow(struct gc_arena *a, size_t cells);
+BAIK_PRIVATE void gc_sweep(struct baik *, struct gc_arena *);
 BAIK_PRIVATE void *gc_alloc_cell(struct baik *, struct gc_arena *);
+#if BAIK_GC_THREADS
+BAIK_PRIVATE struct gc_helper *gc_helper_create(struct baik *baik);
+BAIK_PRIVATE void gc_helper_destroy(struct gc_helper *h);
+#endif
 BAIK_PRIVATE uint64_t gc_string_baik_val_to_offset(baik_val_t v);
-BAIK_PRIVATE int gc_check_val(struct baik *baik, baik_val_t v);
-BAIK_PRIVATE int gc_check_ptr(const struct gc_arena *a, const void *p);
 
 #if defined(__cplusplus)
 }
@@ -2270,6 +2309,7 @@ enum baik_call_stack_frame_item {
   CALL_STACK_FRAME_ITEM_LOOP_ADDR_IDX,
   CALL_STACK_FRAME_ITEM_SCOPE_IDX,
   CALL_STACK_FRAME_ITEM_RETURN_ADDR,
+  CALL_STACK_FRAME_ITEM_RETURN_PART,
   CALL_STACK_FRAME_ITEM_THIS,
   CALL_STACK_FRAME_ITEMS_CNT
 };
@@ -2311,8 +2351,77 @@ struct baik_bcode_part {
     size_t len;   
   } data;
 
+  // Set when data belongs to a shared code object instead of this instance.
+  struct baik_code *code;
+
   baik_err_t exec_res : 4;
   unsigned in_rom : 1;
+  unsigned referenced : 1;
+};
+
+#ifndef BAIK_TIMER_SLOTS
+#define BAIK_TIMER_SLOTS 32
+#endif
+#ifndef BAIK_TIMER_TICK_MS
+#define BAIK_TIMER_TICK_MS 10
+#endif
+#ifndef BAIK_POLL_MAX_EVENTS
+#define BAIK_POLL_MAX_EVENTS 32
+#endif
+
+struct baik_event {
+  struct baik_event *next;
+  baik_event_cb_t cb;
+  void *user_data;
+  baik_val_t func;
+  baik_val_t arg;
+  uint64_t posted_us;
+};
+
+struct baik_timer {
+  struct baik_timer *next;
+  int id;
+  uint64_t due_us;
+  uint32_t period_ms;
+  baik_val_t func;
+};
+
+struct baik_exec_state {
+  size_t off;
+  size_t start_off;
+  int stack_len;
+  int call_stack_len;
+  int arg_stack_len;
+  int scopes_len;
+  int loop_addresses_len;
+  uint64_t wake_us;
+  uint8_t prev_opcode;
+};
+
+// Everything a script thread owns; the heap, globals and bytecode are
+// shared. Switching threads copies one of these in and out of struct baik.
+struct baik_ctx {
+  struct mbuf stack;
+  struct mbuf call_stack;
+  struct mbuf arg_stack;
+  struct mbuf scopes;
+  struct mbuf loop_addresses;
+  struct baik_exec_state susp;
+  baik_val_t this_obj;
+  baik_val_t last_getprop_obj;
+  size_t cur_bcode_offset;
+  int call_stack_base;
+  enum baik_err error;
+  unsigned suspended : 1;
+  unsigned saved : 1;
+};
+
+struct baik_task {
+  struct baik_task *next;
+  struct baik_ctx ctx;
+  baik_val_t func;
+  int id;
+  unsigned started : 1;
 };
 
 struct baik {
@@ -2335,14 +2444,55 @@ struct baik {
   // baik_ffi_resolver_t *dlsym; 
   // ffi_cb_args_t *ffi_cb_args;
   size_t cur_bcode_offset;
+  size_t bcode_unreclaimed;
+  size_t bcode_optimized; /* bytes the peephole pass removed */
+  struct baik_quicken_stats quicken;
+  struct baik_property *scope_prop; /* what the last OP_FIND_SCOPE found */
+
+  struct baik_exec_state susp;
+  unsigned long budget_ticks;
+  unsigned long budget_ms;
+  unsigned long ticks_used;
+  uint32_t budget_start;
+  volatile int interrupted;
+  int call_stack_base;
+  int exec_depth;
+  uint64_t wake_us;
+
+  struct baik_task *tasks;
+  int task_seq;
+  int tasks_cnt;
+  struct baik_ctx parked;
+  struct baik_ctx scratch;
+
+  struct baik_event *ev_head;
+  struct baik_event *ev_tail;
+  struct baik_event ev_stub;
+  struct baik_timer *timers[BAIK_TIMER_SLOTS];
+  struct baik_timer *timers_due; /* the batch being fired, in due order */
+  uint64_t timer_tick;
+  int timer_seq;
+  int timers_cnt;
+  int timer_firing;
+  struct baik_event_stats ev_stats;
+  struct baik_chan *chan_tx;
+  struct baik_chan *chan_rx;
 
   struct gc_arena object_arena;
   struct gc_arena property_arena;
   struct gc_arena ffi_sig_arena;
+#if BAIK_GC_THREADS
+  struct gc_helper *gc_helper;
+#endif
 
   unsigned inhibit_gc : 1;
   unsigned need_gc : 1;
   unsigned generate_jsc : 1;
+  unsigned bcode_reclaim : 1;
+  unsigned suspended : 1;
+  unsigned budget_out : 1;
+  unsigned resumable : 1;
+  unsigned yield_req : 1;
 };
 
 
@@ -2475,6 +2625,9 @@ BAIK_PRIVATE struct baik_property *baik_get_own_property(struct baik *baik,
 BAIK_PRIVATE struct baik_property *baik_get_own_property_v(struct baik *baik,
                                                         baik_val_t obj,
                                                         baik_val_t key);
+BAIK_PRIVATE struct baik_property *baik_mk_property(struct baik *baik,
+                                                 baik_val_t name,
+                                                 baik_val_t value);
 BAIK_PRIVATE baik_err_t baik_set_internal(struct baik *baik, baik_val_t obj,
                                        baik_val_t name_v, char *name,
                                        size_t name_len, baik_val_t val);
@@ -2725,6 +2878,58 @@ enum baik_opcode {
   OP_BCODE_HEADER,
   OP_ARGS,        
   OP_FOR_IN_NEXT, 
+  OP_JMP_FALSE_LT,
+  OP_JMP_FALSE_GT,
+  OP_JMP_FALSE_LE,
+  OP_JMP_FALSE_GE,
+  OP_JMP_FALSE_EQ,
+  OP_JMP_FALSE_NE,
+  OP_ADD_NUM,
+  OP_SUB_NUM,
+  OP_MUL_NUM,
+  OP_GET_ARRAY_INDEX,
+  OP_GET_OWN_CACHED,
+  /* Operators; both runs of eleven follow s_arith_toks[] */
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_REM,
+  OP_XOR,
+  OP_AND,
+  OP_OR,
+  OP_LSHIFT,
+  OP_RSHIFT,
+  OP_URSHIFT,
+  OP_ADD_ASSIGN,
+  OP_SUB_ASSIGN,
+  OP_MUL_ASSIGN,
+  OP_DIV_ASSIGN,
+  OP_REM_ASSIGN,
+  OP_XOR_ASSIGN,
+  OP_AND_ASSIGN,
+  OP_OR_ASSIGN,
+  OP_LSHIFT_ASSIGN,
+  OP_RSHIFT_ASSIGN,
+  OP_URSHIFT_ASSIGN,
+  OP_LT,
+  OP_GT,
+  OP_LE,
+  OP_GE,
+  OP_EQ_EQ,
+  OP_NE_NE,
+  OP_EQ,
+  OP_NE,
+  OP_NEG,
+  OP_NOT,
+  OP_BIT_NOT,
+  OP_TYPEOF,
+  OP_ASSIGN,
+  OP_INC,
+  OP_DEC,
+  OP_POST_INC,
+  OP_POST_DEC,
+  OP_PUSH_F64,
   OP_MAX
 };
 
@@ -2734,15 +2939,21 @@ struct baik;
 BAIK_PRIVATE void emit_byte(struct pstate *pstate, uint8_t byte);
 BAIK_PRIVATE void emit_int(struct pstate *pstate, int64_t n);
 BAIK_PRIVATE void emit_str(struct pstate *pstate, const char *ptr, size_t len);
-BAIK_PRIVATE int baik_bcode_insert_offset(struct pstate *p, struct baik *baik,
-                                        size_t offset, size_t v);
+BAIK_PRIVATE void emit_dbl(struct pstate *pstate, double d);
+BAIK_PRIVATE void baik_bcode_set_offset(struct pstate *p, size_t reloc,
+                                      size_t from, size_t to);
+BAIK_PRIVATE void baik_bcode_hoist(struct pstate *p, size_t start, size_t mid);
+BAIK_PRIVATE baik_err_t baik_bcode_resolve(struct pstate *p);
+BAIK_PRIVATE void baik_bcode_optimize(struct pstate *p);
 BAIK_PRIVATE void baik_bcode_part_add(struct baik *baik,
                                     const struct baik_bcode_part *bp);
 BAIK_PRIVATE struct baik_bcode_part *baik_bcode_part_get(struct baik *baik, int num);
 BAIK_PRIVATE struct baik_bcode_part *baik_bcode_part_get_by_offset(struct baik *baik,
                                                                 size_t offset);
+BAIK_PRIVATE int baik_bcode_part_idx_by_offset(struct baik *baik, size_t offset);
 BAIK_PRIVATE int baik_bcode_parts_cnt(struct baik *baik);
 BAIK_PRIVATE void baik_bcode_commit(struct baik *baik);
+BAIK_PRIVATE void baik_bcode_reclaim(struct baik *baik, baik_val_t *res);
 
 #if defined(__cplusplus)
 }
@@ -2820,10 +3031,6 @@ typedef unsigned long uintptr_t;
 #endif
 #endif
 
-#ifndef BAIK_INIT_OFFSET_SIZE
-#define BAIK_INIT_OFFSET_SIZE 1
-#endif
-
 #endif
 
 #ifndef BAIK_TOK_H_
@@ -2837,6 +3044,49 @@ struct tok {
   int tok;
   int len;
   const char *ptr;
+  double num; /* value of a TOK_NUM */
+};
+
+/*
+ * Jump offsets are emitted as one-byte placeholders and sized by
+ * baik_bcode_resolve() once the whole script is parsed, so the emitter only
+ * ever appends to bcode_gen.
+ */
+struct baik_reloc {
+  int slot; /* placeholder position in bcode_gen */
+  int dist; /* encoded distance while every placeholder is one byte */
+  int from; /* first relocation at or past each end of `dist`, -1 until set */
+  int to;
+  int grow; /* bytes added by the relocations before this one */
+  uint8_t len;
+};
+
+struct baik_lineno_item {
+  int offset;
+  int line_no;
+};
+
+/* Tokens the parser may look past the current one; see ppeek() */
+#ifndef BAIK_LOOKAHEAD
+#define BAIK_LOOKAHEAD 2
+#endif
+
+/* Constant pushes the compiler remembers for folding; see fold_op() */
+#ifndef BAIK_FOLD_DEPTH
+#define BAIK_FOLD_DEPTH 8
+#endif
+
+/* Code in [start, end) of bcode_gen that pushes a constant */
+struct baik_const_span {
+  int start;
+  int end;
+};
+
+/* A lexed token and the lexer position right after it */
+struct baik_lexeme {
+  struct tok tok;
+  const char *pos;
+  int line_no;
 };
 
 struct pstate {
@@ -2845,13 +3095,22 @@ struct pstate {
   const char *pos;      
   int line_no;          
   int last_emitted_line_no;
-  struct mbuf offset_lineno_map;
+  struct mbuf offset_lineno_map; /* of struct baik_lineno_item */
+  struct mbuf relocs;            /* of struct baik_reloc, sorted by slot */
   int prev_tok;  
   struct tok tok;
   struct baik *baik;
   int start_bcode_idx;
   int cur_idx;
   int depth;
+  struct baik_lexeme ahead[BAIK_LOOKAHEAD]; /* ring of tokens after `tok` */
+  int ahead_head;
+  int ahead_len;
+  struct baik_const_span consts[BAIK_FOLD_DEPTH]; /* adjacent, up to cur_idx */
+  int nconsts;
+  int last_label; /* furthest jump target so far */
+  int last_cmp;   /* offset of the last comparison opcode */
+  int declared;   /* something may be created in the current scope */
 };
 
 enum {
@@ -2951,6 +3210,7 @@ enum {
 
 BAIK_PRIVATE void pinit(const char *file_name, const char *buf, struct pstate *);
 BAIK_PRIVATE int pnext(struct pstate *);
+BAIK_PRIVATE int ppeek(struct pstate *, int k);
 BAIK_PRIVATE int baik_is_ident(int c);
 BAIK_PRIVATE int baik_is_digit(int c);
 
@@ -3000,6 +3260,76 @@ baik_err_t baik_apply(struct baik *baik, baik_val_t *res, baik_val_t func,
 baik_err_t baik_call(struct baik *baik, baik_val_t *res, baik_val_t func,
                    baik_val_t this_val, int nargs, ...);
 baik_val_t baik_get_this(struct baik *baik);
+baik_err_t baik_resume(struct baik *baik, baik_val_t *res);
+void baik_set_budget(struct baik *baik, unsigned long ticks, unsigned long ms);
+void baik_interrupt(struct baik *baik);
+
+struct baik_code;
+
+baik_err_t baik_compile(struct baik *baik, const char *path, const char *src,
+                        struct baik_code **code);
+struct baik_code *baik_code_from_rom(const void *bcode, size_t len);
+void baik_code_unref(struct baik_code *code);
+baik_err_t baik_exec_code(struct baik *baik, struct baik_code *code,
+                          baik_val_t *res);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
+
+#ifndef BAIK_EVENTS_PUBLIC_H_
+#define BAIK_EVENTS_PUBLIC_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef void (*baik_event_cb_t)(struct baik *baik, void *user_data);
+
+struct baik_event_stats {
+  unsigned long events;
+  unsigned long latency_max_us;
+  unsigned long long latency_sum_us;
+  unsigned long timers;
+  unsigned long jitter_max_us;
+  unsigned long long jitter_sum_us;
+};
+
+int baik_post(struct baik *baik, baik_val_t func, baik_val_t arg);
+int baik_post_cb(struct baik *baik, baik_event_cb_t cb, void *user_data);
+int baik_poll(struct baik *baik, unsigned long *wait_ms);
+int baik_events_pending(struct baik *baik);
+void baik_get_event_stats(struct baik *baik, struct baik_event_stats *st);
+
+struct baik_chan;
+
+struct baik_chan *baik_chan_create(size_t capacity);
+void baik_chan_destroy(struct baik_chan *ch);
+int baik_chan_send(struct baik *baik, struct baik_chan *ch, baik_val_t v);
+int baik_chan_recv(struct baik *baik, struct baik_chan *ch, baik_val_t *v);
+void baik_set_kanal(struct baik *baik, struct baik_chan *tx,
+                    struct baik_chan *rx);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
+
+#ifndef BAIK_SNAPSHOT_PUBLIC_H_
+#define BAIK_SNAPSHOT_PUBLIC_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+baik_err_t baik_snapshot_save(struct baik *baik, const char *path);
+baik_err_t baik_snapshot_load(struct baik *baik, const char *path);
+baik_err_t baik_snapshot_save_buf(struct baik *baik, char **buf, size_t *len);
+baik_err_t baik_snapshot_load_buf(struct baik *baik, const void *buf,
+                                  size_t len);
 
 #if defined(__cplusplus)
 }
@@ -3010,6 +3340,7 @@ baik_val_t baik_get_this(struct baik *baik);
 #ifndef BAIK_EXEC_H_
 #define BAIK_EXEC_H_
 #define BAIK_BCODE_OFFSET_EXIT ((size_t) 0x7fffffff)
+#define BAIK_BCODE_OFFSET_RESUME ((size_t) 0x7ffffffe)
 
 #if defined(__cplusplus)
 extern "C" {
@@ -3053,7 +3384,8 @@ baik_json_parse(struct baik *baik, const char *str, size_t len, baik_val_t *res)
 extern "C" {
 #endif
 
-void baik_init_builtin(struct baik *baik, baik_val_t obj);
+BAIK_PRIVATE struct baik_property *baik_builtin_materialize(
+    struct baik *baik, baik_val_t global, const char *name, size_t len);
 
 #if defined(__cplusplus)
 }
@@ -4369,13 +4701,13 @@ static int json_parse_value(struct frozen *f) {
       TRY(json_parse_array(f));
       break;
 #endif
-    case 'n':
-      TRY(json_expect(f, "kosong", 4, JSON_TYPE_NULL));
+    case 'k':
+      TRY(json_expect(f, "kosong", 6, JSON_TYPE_NULL));
       break;
-    case 't':
-      TRY(json_expect(f, "benar", 4, JSON_TYPE_TRUE));
+    case 'b':
+      TRY(json_expect(f, "benar", 5, JSON_TYPE_TRUE));
       break;
-    case 'f':
+    case 's':
       TRY(json_expect(f, "salah", 5, JSON_TYPE_FALSE));
       break;
     case '-':
@@ -6158,27 +6490,17 @@ clean:
 
 static void add_lineno_map_item(struct pstate *pstate) {
   if (pstate->last_emitted_line_no < pstate->line_no) {
-    int offset = pstate->cur_idx - pstate->start_bcode_idx;
-    size_t offset_llen = BAIK_EM_varint_llen(offset);
-    size_t lineno_llen = BAIK_EM_varint_llen(pstate->line_no);
-    mbuf_resize(&pstate->offset_lineno_map,
-                pstate->offset_lineno_map.size + offset_llen + lineno_llen);
-    BAIK_EM_varint_encode(offset, (uint8_t *) pstate->offset_lineno_map.buf +
-                                 pstate->offset_lineno_map.len,
-                     offset_llen);
-    pstate->offset_lineno_map.len += offset_llen;
-    BAIK_EM_varint_encode(pstate->line_no,
-                     (uint8_t *) pstate->offset_lineno_map.buf +
-                         pstate->offset_lineno_map.len,
-                     lineno_llen);
-    pstate->offset_lineno_map.len += lineno_llen;
+    struct baik_lineno_item it;
+    it.offset = pstate->cur_idx;
+    it.line_no = pstate->line_no;
+    mbuf_append(&pstate->offset_lineno_map, &it, sizeof(it));
     pstate->last_emitted_line_no = pstate->line_no;
   }
 }
 
 BAIK_PRIVATE void emit_byte(struct pstate *pstate, uint8_t byte) {
   add_lineno_map_item(pstate);
-  mbuf_insert(&pstate->baik->bcode_gen, pstate->cur_idx, &byte, sizeof(byte));
+  mbuf_append(&pstate->baik->bcode_gen, &byte, sizeof(byte));
   pstate->cur_idx += sizeof(byte);
 }
 
@@ -6186,7 +6508,7 @@ BAIK_PRIVATE void emit_int(struct pstate *pstate, int64_t n) {
   struct mbuf *b = &pstate->baik->bcode_gen;
   size_t llen = BAIK_EM_varint_llen(n);
   add_lineno_map_item(pstate);
-  mbuf_insert(b, pstate->cur_idx, NULL, llen);
+  mbuf_append(b, NULL, llen);
   BAIK_EM_varint_encode(n, (uint8_t *) b->buf + pstate->cur_idx, llen);
   pstate->cur_idx += llen;
 }
@@ -6195,31 +6517,620 @@ BAIK_PRIVATE void emit_str(struct pstate *pstate, const char *ptr, size_t len) {
   struct mbuf *b = &pstate->baik->bcode_gen;
   size_t llen = BAIK_EM_varint_llen(len);
   add_lineno_map_item(pstate);
-  mbuf_insert(b, pstate->cur_idx, NULL, llen + len);
+  mbuf_append(b, NULL, llen + len);
   BAIK_EM_varint_encode(len, (uint8_t *) b->buf + pstate->cur_idx, llen);
   memcpy(b->buf + pstate->cur_idx + llen, ptr, len);
   pstate->cur_idx += llen + len;
 }
 
-BAIK_PRIVATE int baik_bcode_insert_offset(struct pstate *p, struct baik *baik,
-                                        size_t offset, size_t v) {
-  int llen = (int) BAIK_EM_varint_llen(v);
-  int diff = llen - BAIK_INIT_OFFSET_SIZE;
-  assert(offset < baik->bcode_gen.len);
-  if (diff > 0) {
-    mbuf_resize(&baik->bcode_gen, baik->bcode_gen.size + diff);
+/* The operand of OP_PUSH_F64: the double itself, in host byte order */
+BAIK_PRIVATE void emit_dbl(struct pstate *pstate, double d) {
+  add_lineno_map_item(pstate);
+  mbuf_append(&pstate->baik->bcode_gen, &d, sizeof(d));
+  pstate->cur_idx += sizeof(d);
+}
+
+/* Index of the first relocation whose slot is at or after `pos` */
+static size_t bcode_reloc_find(struct pstate *p, size_t pos) {
+  struct baik_reloc *r = (struct baik_reloc *) p->relocs.buf;
+  size_t lo = 0, hi = p->relocs.len / sizeof(*r);
+  /* Jumps mostly land on the code being emitted */
+  if (hi == 0 || (size_t) r[hi - 1].slot < pos) return hi;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((size_t) r[mid].slot < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
- 
-  memmove(baik->bcode_gen.buf + offset + llen,
-          baik->bcode_gen.buf + offset + BAIK_INIT_OFFSET_SIZE,
-          baik->bcode_gen.len - offset - BAIK_INIT_OFFSET_SIZE);
-  baik->bcode_gen.len += diff;
-  BAIK_EM_varint_encode(v, (uint8_t *) baik->bcode_gen.buf + offset, llen);
+  return lo;
+}
+
+BAIK_PRIVATE void baik_bcode_set_offset(struct pstate *p, size_t reloc,
+                                      size_t from, size_t to) {
+  struct baik_reloc *r = (struct baik_reloc *) p->relocs.buf + reloc;
+  r->dist = (int) (to - from);
+  r->from = (size_t) r->slot + 1 == from ? (int) reloc + 1
+                                         : (int) bcode_reloc_find(p, from);
+  r->to = (int) bcode_reloc_find(p, to);
+  if ((int) to > p->last_label) p->last_label = (int) to;
+}
+
+static void mem_reverse(char *a, size_t n) {
+  char *b = a + n;
+  while (a + 1 < b) {
+    char c = *a;
+    *a++ = *--b;
+    *b = c;
+  }
+}
+
+/* Swaps the adjacent ranges [buf, buf + n1) and [buf + n1, buf + n1 + n2) */
+static void mem_rotate(char *buf, size_t n1, size_t n2) {
+  mem_reverse(buf, n1);
+  mem_reverse(buf + n1, n2);
+  mem_reverse(buf, n1 + n2);
+}
+
+/*
+ * Moves the code emitted since `mid` in front of the code in [start, mid),
+ * along with its relocations and line map entries. Both ranges must hold
+ * complete expressions, i.e. no relocation in them is still unset.
+ */
+BAIK_PRIVATE void baik_bcode_hoist(struct pstate *p, size_t start, size_t mid) {
+  struct mbuf *b = &p->baik->bcode_gen;
+  struct baik_reloc *r = (struct baik_reloc *) p->relocs.buf;
+  struct baik_lineno_item *l =
+      (struct baik_lineno_item *) p->offset_lineno_map.buf;
+  size_t nr = p->relocs.len / sizeof(*r);
+  size_t nl = p->offset_lineno_map.len / sizeof(*l);
+  size_t rs = bcode_reloc_find(p, start), rm = bcode_reloc_find(p, mid);
+  size_t ls = nl, lm = nl, i;
+  int head = (int) (mid - start), tail = (int) (b->len - mid);
+
+  for (i = rs; i < nr; i++) {
+    int moved = i < rm ? (int) (nr - rm) : -(int) (rm - rs);
+    assert(r[i].to >= 0);
+    r[i].slot += i < rm ? tail : -head;
+    r[i].from += moved;
+    r[i].to += moved;
+  }
+  while (ls > 0 && l[ls - 1].offset >= (int) start) {
+    ls--;
+    if (l[ls].offset >= (int) mid) {
+      l[ls].offset -= head;
+      lm = ls;
+    } else {
+      l[ls].offset += tail;
+    }
+  }
+
+  mem_rotate(b->buf + start, head, tail);
+  mem_rotate((char *) (r + rs), (rm - rs) * sizeof(*r), (nr - rm) * sizeof(*r));
+  mem_rotate((char *) (l + ls), (lm - ls) * sizeof(*l), (nl - lm) * sizeof(*l));
+
+  /* Code moved under any remembered constant or jump target */
+  p->nconsts = 0;
+  p->last_label = (int) b->len;
+}
+
+/* Final distance encoded by relocation `i`, given the current sizes */
+static int bcode_reloc_val(const struct baik_reloc *r, size_t i) {
+  return r[i].dist + r[r[i].to].grow - r[r[i].from].grow;
+}
+
+/*
+ * Sizes every relocation to the varint of its final distance, then expands
+ * the placeholders in one backward pass over bcode_gen. A distance grows by
+ * the extra bytes of the relocations between its ends, and sizes only ever
+ * grow from one round to the next, so the loop settles after a few rounds.
+ */
+BAIK_PRIVATE baik_err_t baik_bcode_resolve(struct pstate *p) {
+  struct mbuf *b = &p->baik->bcode_gen;
+  struct baik_lineno_item *l =
+      (struct baik_lineno_item *) p->offset_lineno_map.buf;
+  size_t nl = p->offset_lineno_map.len / sizeof(*l);
+  size_t n = p->relocs.len / sizeof(struct baik_reloc), i, j;
+  size_t src = b->len, dst;
+  struct baik_reloc *r, end;
+  int changed, grow;
+
+  /* A sentinel past the code carries the total growth */
+  memset(&end, 0, sizeof(end));
+  end.slot = INT_MAX;
+  mbuf_append(&p->relocs, &end, sizeof(end));
+  if (p->relocs.len != (n + 1) * sizeof(end)) goto oom;
+  r = (struct baik_reloc *) p->relocs.buf;
+
+  for (i = 0; i <= n; i++) r[i].len = 1;
+  do {
+    changed = 0;
+    for (i = 0, grow = 0; i <= n; i++) {
+      r[i].grow = grow;
+      grow += r[i].len - 1;
+    }
+    for (i = 0; i < n; i++) {
+      uint8_t len = (uint8_t) BAIK_EM_varint_llen(bcode_reloc_val(r, i));
+      if (len != r[i].len) {
+        r[i].len = len;
+        changed = 1;
+      }
+    }
+  } while (changed);
+
+  /* Line map offsets become relative to the final code */
+  for (i = 0, j = 0; i < nl; i++) {
+    while (r[j].slot < l[i].offset) j++;
+    l[i].offset += r[j].grow - p->start_bcode_idx;
+  }
+
+  mbuf_resize(b, b->len + grow);
+  if (b->size < b->len + grow) goto oom;
+  dst = b->len + grow;
+  for (i = n; i-- > 0;) {
+    size_t seg = src - (r[i].slot + 1);
+    dst -= seg;
+    memmove(b->buf + dst, b->buf + r[i].slot + 1, seg);
+    dst -= r[i].len;
+    BAIK_EM_varint_encode(bcode_reloc_val(r, i), (uint8_t *) b->buf + dst,
+                          r[i].len);
+    src = r[i].slot;
+  }
+  b->len += grow;
+  p->cur_idx = b->len;
+  return BAIK_OK;
+
+oom:
+  return baik_set_errorf(p->baik, BAIK_OUT_OF_MEMORY, "kehabisan memori");
+}
+
+#ifndef BAIK_ENABLE_PEEPHOLE
+#define BAIK_ENABLE_PEEPHOLE 1
+#endif
 
-  if (p->cur_idx >= (int) offset) {
-    p->cur_idx += diff;
+/* Size of the instruction at `i`, jump offsets being one-byte placeholders */
+static int bcode_insn_len(const uint8_t *code, int i) {
+  int l1, l2, n;
+  switch (code[i]) {
+    case OP_PUSH_INT:
+    case OP_PUSH_FUNC:
+    case OP_JMP:
+    case OP_JMP_TRUE:
+    case OP_JMP_NEUTRAL_TRUE:
+    case OP_JMP_FALSE:
+    case OP_JMP_NEUTRAL_FALSE:
+    case OP_JMP_FALSE_LT:
+    case OP_JMP_FALSE_GT:
+    case OP_JMP_FALSE_LE:
+    case OP_JMP_FALSE_GE:
+    case OP_JMP_FALSE_EQ:
+    case OP_JMP_FALSE_NE:
+      BAIK_EM_varint_decode_unsafe(code + i + 1, &l1);
+      return 1 + l1;
+    case OP_PUSH_STR:
+    case OP_PUSH_DBL:
+      n = (int) BAIK_EM_varint_decode_unsafe(code + i + 1, &l1);
+      return 1 + l1 + n;
+    case OP_SET_ARG:
+      BAIK_EM_varint_decode_unsafe(code + i + 1, &l1);
+      n = (int) BAIK_EM_varint_decode_unsafe(code + i + 1 + l1, &l2);
+      return 1 + l1 + l2 + n;
+    case OP_LOOP:
+      BAIK_EM_varint_decode_unsafe(code + i + 1, &l1);
+      BAIK_EM_varint_decode_unsafe(code + i + 1 + l1, &l2);
+      return 1 + l1 + l2;
+    case OP_PUSH_F64:
+      return 1 + (int) sizeof(double);
+    case OP_EXPR:
+      return 2;
+    default:
+      return 1;
   }
-  return diff;
+}
+
+/* Marks of the peephole pass, one set per instruction */
+enum {
+  PEEP_LIVE = 1,  /* reachable from the entry */
+  PEEP_LABEL = 2, /* a live jump lands here */
+  PEEP_DEL = 4    /* removed */
+};
+
+/* A relocation as a jump between instructions */
+struct peep_jump {
+  int at;
+  int tgt;
+};
+
+/* Instructions are numbered in code order; `ins` has their offsets */
+struct peep {
+  struct pstate *p;
+  uint8_t *code;
+  int *ins;            /* n + 1 entries, the last one is the end */
+  uint8_t *fl;         /* n entries */
+  struct peep_jump *j; /* parallel to p->relocs */
+  int *work;           /* instructions left to walk, one per jump at most */
+  int n, nwork;
+  size_t nr;
+  uint8_t rule_end[OP_MAX]; /* second opcodes of s_peep_rules */
+};
+
+/*
+ * Adjacent instructions and what they turn into, OP_NOP meaning removed.
+ * Each pair leaves the stacks as they were, or as the replacement would.
+ */
+static const struct peep_rule {
+  uint8_t op[2];
+  uint8_t to[2];
+} s_peep_rules[] = {
+    {{OP_PUSH_UNDEF, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_NULL, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_TRUE, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_FALSE, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_INT, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_F64, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_STR, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_THIS, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_SCOPE, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_DUP, OP_DROP}, {OP_NOP, OP_NOP}},
+    {{OP_SWAP, OP_SWAP}, {OP_NOP, OP_NOP}},
+    {{OP_NEW_SCOPE, OP_DEL_SCOPE}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_TRUE, OP_JMP_FALSE}, {OP_NOP, OP_NOP}},
+    {{OP_PUSH_FALSE, OP_JMP_FALSE}, {OP_PUSH_UNDEF, OP_JMP}},
+};
+
+/* Jumps that leave undefined on the stack when taken */
+static int peep_pushes_undef(uint8_t op) {
+  return op == OP_JMP_FALSE || (op >= OP_JMP_FALSE_LT && op <= OP_JMP_FALSE_NE);
+}
+
+static int peep_is_jump(uint8_t op) {
+  return op == OP_JMP || op == OP_JMP_NEUTRAL_TRUE ||
+         op == OP_JMP_NEUTRAL_FALSE || peep_pushes_undef(op);
+}
+
+static int peep_ends_flow(uint8_t op) {
+  return op == OP_JMP || op == OP_RETURN || op == OP_BREAK ||
+         op == OP_CONTINUE || op == OP_EXIT;
+}
+
+static uint8_t peep_op(const struct peep *pp, int i) {
+  return pp->code[pp->ins[i]];
+}
+
+/* First instruction from `i` on that is still there */
+static int peep_skip(const struct peep *pp, int i) {
+  while (i < pp->n && (pp->fl[i] & PEEP_DEL)) i++;
+  return i;
+}
+
+static int peep_next(const struct peep *pp, int i) {
+  return peep_skip(pp, i + 1);
+}
+
+static struct peep_jump *peep_jump_at(const struct peep *pp, int i) {
+  return &pp->j[bcode_reloc_find(pp->p, pp->ins[i] + 1)];
+}
+
+/*
+ * OP_GET and OP_ARGS look at the opcode run before them, so code right in
+ * front of them stays.
+ */
+static int peep_can_cut_before(const struct peep *pp, int i) {
+  return i >= pp->n ||
+         (peep_op(pp, i) != OP_GET && peep_op(pp, i) != OP_ARGS);
+}
+
+static void peep_cut(struct peep *pp, int i) {
+  if (pp->fl[i] & PEEP_LABEL) {
+    int n = peep_next(pp, i);
+    if (n < pp->n) pp->fl[n] |= PEEP_LABEL;
+  }
+  pp->fl[i] |= PEEP_DEL;
+}
+
+static int peep_has_reloc(uint8_t op) {
+  return peep_is_jump(op) || op == OP_JMP_TRUE || op == OP_LOOP ||
+         op == OP_PUSH_FUNC;
+}
+
+/* Marks `i` reachable, queueing it unless it already was */
+static void peep_reach(struct peep *pp, int i) {
+  if (i >= pp->n || (pp->fl[i] & PEEP_LIVE)) return;
+  pp->fl[i] |= PEEP_LIVE;
+  pp->work[pp->nwork++] = i;
+}
+
+/*
+ * Marks what the entry reaches and where live jumps land, walking straight
+ * runs of code and queueing the targets of their jumps.
+ */
+static void peep_mark(struct peep *pp) {
+  int i, t;
+  size_t k;
+
+  for (i = 0; i < pp->n; i++) pp->fl[i] &= ~(PEEP_LIVE | PEEP_LABEL);
+  pp->nwork = 0;
+  peep_reach(pp, peep_skip(pp, 0));
+  peep_reach(pp, pp->n - 1); /* OP_EXIT */
+  while (pp->nwork > 0) {
+    i = pp->work[--pp->nwork];
+    for (;;) {
+      uint8_t op = peep_op(pp, i);
+      if (peep_has_reloc(op)) {
+        k = bcode_reloc_find(pp->p, pp->ins[i]);
+        for (; k < pp->nr && pp->j[k].at == i; k++) {
+          t = peep_skip(pp, pp->j[k].tgt);
+          if (t < pp->n) pp->fl[t] |= PEEP_LABEL;
+          peep_reach(pp, t);
+        }
+      }
+      if (peep_ends_flow(op)) break;
+      i = peep_next(pp, i);
+      if (i >= pp->n || (pp->fl[i] & PEEP_LIVE)) break;
+      pp->fl[i] |= PEEP_LIVE;
+    }
+  }
+}
+
+/* Where the jump at `i` to `tgt` ends up once the jumps it lands on run */
+static int peep_thread(const struct peep *pp, int i, int tgt) {
+  uint8_t op = peep_op(pp, i), top;
+  /* The value left on top when a conditional jump is taken */
+  int falsy = op != OP_JMP_NEUTRAL_TRUE;
+  int hops, t;
+
+  for (hops = 0; hops < 8; hops++) {
+    t = peep_skip(pp, tgt);
+    if (t >= pp->n) break;
+    top = peep_op(pp, t);
+    if (top == OP_JMP) {
+      tgt = peep_jump_at(pp, t)->tgt;
+    } else if (op == OP_JMP) {
+      break;
+    } else if (top == OP_JMP_NEUTRAL_TRUE || top == OP_JMP_NEUTRAL_FALSE) {
+      tgt = falsy == (top == OP_JMP_NEUTRAL_FALSE) ? peep_jump_at(pp, t)->tgt
+                                                   : t + 1;
+    } else if (top == OP_JMP_FALSE && peep_pushes_undef(op)) {
+      /* It finds the undefined the first one pushed */
+      tgt = peep_jump_at(pp, t)->tgt;
+    } else {
+      break;
+    }
+  }
+  return tgt;
+}
+
+static const struct peep_rule *peep_rule_find(uint8_t op1, uint8_t op2) {
+  size_t i;
+  for (i = 0; i < ARRAY_SIZE(s_peep_rules); i++) {
+    if (s_peep_rules[i].op[0] == op1 && s_peep_rules[i].op[1] == op2) {
+      return &s_peep_rules[i];
+    }
+  }
+  return NULL;
+}
+
+/* Removes the code peep_mark() found unreachable; returns 1 if there was any */
+static int peep_sweep(struct peep *pp) {
+  int i, changed = 0;
+
+  peep_mark(pp);
+  for (i = 0; i < pp->n; i++) {
+    if (!(pp->fl[i] & (PEEP_LIVE | PEEP_DEL))) {
+      pp->fl[i] |= PEEP_DEL;
+      changed = 1;
+    }
+  }
+  return changed;
+}
+
+/* The instruction to look at again once the one at `i` went away */
+static int peep_back(const struct peep *pp, int i) {
+  while (i > 0 && (pp->fl[i - 1] & PEEP_DEL)) i--;
+  return i > 0 ? i - 1 : i;
+}
+
+/*
+ * Threads the jumps, drops OP_NOP and applies s_peep_rules, looking again
+ * at the code in front of each change so that rules cascade. Returns 1 if a jump changed
+ * in a way that can leave more code unreachable.
+ */
+static int peep_rules(struct peep *pp) {
+  int i = 0, n, flow = 0;
+  size_t k = 0; /* first jump at or after `i` */
+
+  while (i < pp->n) {
+    const struct peep_rule *rule;
+    uint8_t op = peep_op(pp, i);
+    if (pp->fl[i] & PEEP_DEL) {
+      i++;
+      continue;
+    }
+    n = peep_next(pp, i);
+    if (op == OP_NOP && peep_can_cut_before(pp, n)) {
+      peep_cut(pp, i);
+      i = peep_back(pp, i);
+      continue;
+    }
+    while (k > 0 && pp->j[k - 1].at >= i) k--;
+    while (k < pp->nr && pp->j[k].at < i) k++;
+
+    if (peep_is_jump(op)) {
+      struct peep_jump *jp = &pp->j[k];
+      int t = peep_skip(pp, peep_thread(pp, i, jp->tgt));
+      if (t != peep_skip(pp, jp->tgt)) {
+        jp->tgt = t;
+        if (t < pp->n) pp->fl[t] |= PEEP_LABEL;
+        flow = 1;
+      }
+      /* A jump to the next instruction, except that one pushes */
+      if (t == n && !peep_pushes_undef(op) && peep_can_cut_before(pp, n)) {
+        peep_cut(pp, i);
+        i = peep_back(pp, i);
+        continue;
+      }
+    }
+
+    rule = NULL;
+    if (n < pp->n && !(pp->fl[n] & PEEP_LABEL) && pp->rule_end[peep_op(pp, n)]) {
+      rule = peep_rule_find(op, peep_op(pp, n));
+    }
+    if (rule == NULL ||
+        (rule->to[1] == OP_NOP && !peep_can_cut_before(pp, peep_next(pp, n)))) {
+      i++;
+      continue;
+    }
+    if (peep_is_jump(peep_op(pp, n))) flow = 1;
+    if (rule->to[0] == OP_NOP) {
+      peep_cut(pp, i);
+    } else {
+      pp->code[pp->ins[i]] = rule->to[0];
+    }
+    if (rule->to[1] == OP_NOP) {
+      peep_cut(pp, n);
+    } else {
+      pp->code[pp->ins[n]] = rule->to[1];
+    }
+    i = peep_back(pp, i);
+  }
+  return flow;
+}
+
+/* Instruction holding offset `off` */
+static int peep_find(const struct peep *pp, int off) {
+  int lo = 0, hi = pp->n;
+  while (lo + 1 < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (pp->ins[mid] <= off) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/*
+ * Removes what the passes marked and moves the relocations and the line
+ * map along. A jump target or a line map entry on removed code passes to
+ * the code that follows. Returns the number of bytes removed.
+ */
+static int peep_apply(struct peep *pp) {
+  struct pstate *p = pp->p;
+  struct baik_reloc *r = (struct baik_reloc *) p->relocs.buf;
+  struct baik_lineno_item *l =
+      (struct baik_lineno_item *) p->offset_lineno_map.buf;
+  size_t nl = p->offset_lineno_map.len / sizeof(*l), li = 0, lw, k = 0, kw = 0;
+  int i, dst = pp->ins[0], run = dst, removed;
+
+  while (li < nl && l[li].offset < pp->ins[0]) li++;
+  for (i = 0, lw = li; i < pp->n; i++) {
+    int src = pp->ins[i], len = pp->ins[i + 1] - src;
+    int del = pp->fl[i] & PEEP_DEL;
+    for (; li < nl && l[li].offset < src + len; li++) {
+      int off = del ? dst : dst + l[li].offset - src;
+      if (lw > 0 && l[lw - 1].offset == off) lw--;
+      l[lw].offset = off;
+      l[lw].line_no = l[li].line_no;
+      lw++;
+    }
+    for (; k < pp->nr && r[k].slot < src + len; k++) {
+      if (del) continue;
+      r[kw] = r[k];
+      r[kw].slot = dst + r[k].slot - src;
+      pp->j[kw++] = pp->j[k];
+    }
+    pp->ins[i] = dst;
+    if (del) {
+      /* Kept code moves down a run at a time */
+      memmove(pp->code + dst - (src - run), pp->code + run, src - run);
+      run = src + len;
+    } else {
+      dst += len;
+    }
+  }
+  memmove(pp->code + dst - (pp->ins[pp->n] - run), pp->code + run,
+          pp->ins[pp->n] - run);
+  removed = pp->ins[pp->n] - dst;
+  pp->ins[pp->n] = dst;
+  p->offset_lineno_map.len = lw * sizeof(*l);
+  p->relocs.len = kw * sizeof(*r);
+  p->baik->bcode_gen.len -= removed;
+  p->cur_idx -= removed;
+
+  for (k = 0; k < kw; k++) {
+    int at = pp->ins[pp->j[k].at], tgt = pp->ins[pp->j[k].tgt];
+    if (pp->code[at] == OP_PUSH_FUNC) {
+      baik_bcode_set_offset(p, k, tgt, at);
+    } else {
+      baik_bcode_set_offset(p, k, r[k].slot + 1, tgt);
+    }
+  }
+  return removed;
+}
+
+/*
+ * Peephole pass over a finished script, before its jumps are resolved:
+ * drops code nothing reaches, threads jumps landing on jumps and applies
+ * s_peep_rules, until nothing changes. Out of memory it leaves the code
+ * as it is.
+ */
+BAIK_PRIVATE void baik_bcode_optimize(struct pstate *p) {
+  struct baik_reloc *r = (struct baik_reloc *) p->relocs.buf;
+  struct peep pp;
+  int i, off, removed;
+  size_t k;
+
+  if (!BAIK_ENABLE_PEEPHOLE || p->cur_idx <= p->start_bcode_idx) return;
+  memset(&pp, 0, sizeof(pp));
+  pp.p = p;
+  pp.code = (uint8_t *) p->baik->bcode_gen.buf;
+  pp.nr = p->relocs.len / sizeof(*r);
+  for (k = 0; k < ARRAY_SIZE(s_peep_rules); k++) {
+    pp.rule_end[s_peep_rules[k].op[1]] = 1;
+  }
+  for (off = p->start_bcode_idx; off < p->cur_idx;) {
+    off += bcode_insn_len(pp.code, off);
+    pp.n++;
+  }
+  /* One block: ins, j, work, then the flags */
+  k = (pp.n + 1 + 3 * pp.nr + 4) * sizeof(int) + pp.n;
+  pp.ins = (int *) calloc(k, 1);
+  if (pp.ins == NULL) return;
+  pp.j = (struct peep_jump *) (pp.ins + pp.n + 1);
+  pp.work = (int *) (pp.j + pp.nr + 1);
+  pp.fl = (uint8_t *) (pp.work + pp.nr + 2);
+
+  for (i = 0, k = 0, off = p->start_bcode_idx; i <= pp.n; i++) {
+    pp.ins[i] = off;
+    if (i == pp.n) break;
+    off += bcode_insn_len(pp.code, off);
+    for (; k < pp.nr && r[k].slot < off; k++) pp.j[k].at = i;
+  }
+  for (k = 0; k < pp.nr; k++) {
+    int at = pp.ins[pp.j[k].at], tgt;
+    if (pp.code[at] == OP_PUSH_FUNC) {
+      tgt = at - r[k].dist;
+    } else {
+      tgt = r[k].slot + 1 + r[k].dist;
+    }
+    pp.j[k].tgt = peep_find(&pp, tgt);
+    if (pp.ins[pp.j[k].tgt] != tgt) goto clean;
+  }
+
+  /* The cap only matters for jumps that form a cycle */
+  for (i = 0; i < 16; i++) {
+    if (!peep_sweep(&pp) && i > 0) break;
+    if (!peep_rules(&pp)) break;
+  }
+  removed = peep_apply(&pp);
+  p->baik->bcode_optimized += removed;
+  LOG(LL_DEBUG, ("%s: peephole removed %d of %d bytes", p->file_name,
+                 removed, p->cur_idx + removed - p->start_bcode_idx));
+
+clean:
+  free(pp.ins);
 }
 
 BAIK_PRIVATE void baik_bcode_part_add(struct baik *baik,
@@ -6234,26 +7145,35 @@ BAIK_PRIVATE struct baik_bcode_part *baik_bcode_part_get(struct baik *baik,
                                     num * sizeof(struct baik_bcode_part));
 }
 
-BAIK_PRIVATE struct baik_bcode_part *baik_bcode_part_get_by_offset(struct baik *baik,
-                                                                size_t offset) {
-  int i;
-  int parts_cnt = baik_bcode_parts_cnt(baik);
-  struct baik_bcode_part *bp = NULL;
+BAIK_PRIVATE int baik_bcode_part_idx_by_offset(struct baik *baik,
+                                              size_t offset) {
+  int lo = 0, hi = baik_bcode_parts_cnt(baik), mid;
+  struct baik_bcode_part *bp;
 
   if (offset >= baik->bcode_len) {
-    return NULL;
+    return -1;
   }
 
-  for (i = 0; i < parts_cnt; i++) {
-    bp = baik_bcode_part_get(baik, i);
+  // Parts are sorted by start_idx; find the first one ending past offset.
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    bp = baik_bcode_part_get(baik, mid);
     if (offset < bp->start_idx + bp->data.len) {
-      break;
+      hi = mid;
+    } else {
+      lo = mid + 1;
     }
   }
 
-  assert(i < parts_cnt);
+  assert(lo < baik_bcode_parts_cnt(baik));
+
+  return lo;
+}
 
-  return bp;
+BAIK_PRIVATE struct baik_bcode_part *baik_bcode_part_get_by_offset(struct baik *baik,
+                                                                size_t offset) {
+  int i = baik_bcode_part_idx_by_offset(baik, offset);
+  return i < 0 ? NULL : baik_bcode_part_get(baik, i);
 }
 
 BAIK_PRIVATE int baik_bcode_parts_cnt(struct baik *baik) {
@@ -6276,20 +7196,94 @@ BAIK_PRIVATE void baik_bcode_commit(struct baik *baik) {
   baik->bcode_len += bp.data.len;
 }
 
-static void baik_print(struct baik *baik) {
-  size_t i, num_args = baik_nargs(baik);
-  for (i = 0; i < num_args; i++) {
-    baik_fprintf(baik_arg(baik, i), baik, stdout);
-    putchar(' ');
+// Compiled bytecode that any number of instances can run. It is never
+// written after compilation; everything an instance learns about it
+// (exec_res, reclaim marks) stays in that instance's baik_bcode_part.
+struct baik_code {
+  int refs;
+  const char *p;
+  size_t len;
+  unsigned in_rom : 1;
+};
+
+void baik_code_unref(struct baik_code *code) {
+  if (code == NULL || __atomic_sub_fetch(&code->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
   }
-  putchar('\n');
-  baik_return(baik, BAIK_UNDEFINED);
+  if (!code->in_rom) {
+    free((void *) code->p);
+  }
+  free(code);
 }
 
-static struct baik_bcode_part *baik_get_loaded_file_bcode(struct baik *baik,
-                                                        const char *filename) {
-  int parts_cnt = baik_bcode_parts_cnt(baik);
-  int i;
+static void baik_bcode_part_release(struct baik_bcode_part *bp) {
+  if (bp->code != NULL) {
+    baik_code_unref(bp->code);
+  } else if (!bp->in_rom) {
+    free((void *) bp->data.p);
+  }
+}
+
+#ifndef BAIK_BCODE_RECLAIM_THRESHOLD
+#define BAIK_BCODE_RECLAIM_THRESHOLD 1024
+#endif
+
+// Parts run through baik_exec ("<stdin>") are dropped once no live function
+// points into them. Offsets are global and never reused, so the remaining
+// parts keep their start_idx. File parts stay: `muat` uses them as its cache.
+BAIK_PRIVATE void baik_bcode_reclaim(struct baik *baik, baik_val_t *res) {
+  int i, n = baik_bcode_parts_cnt(baik);
+  struct baik_bcode_part *bp;
+  char *dst;
+
+  // Other threads' frames point into bytecode without holding a function.
+  if (baik->inhibit_gc || baik->suspended || baik->call_stack.len != 0 ||
+      baik->tasks != NULL || baik->parked.saved ||
+      BAIK_BCODE_RECLAIM_THRESHOLD == 0 ||
+      baik->bcode_unreclaimed < BAIK_BCODE_RECLAIM_THRESHOLD) {
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    baik_bcode_part_get(baik, i)->referenced = 0;
+  }
+  // The result is on no stack any more but still goes to the caller.
+  baik_own(baik, res);
+  baik->bcode_reclaim = 1;
+  baik_gc(baik, 0);
+  gc_mark_bcode(baik, *res);
+  baik->bcode_reclaim = 0;
+  baik_disown(baik, res);
+
+  dst = baik->bcode_parts.buf;
+  for (i = 0; i < n; i++) {
+    bp = baik_bcode_part_get(baik, i);
+    if (!bp->referenced && !bp->in_rom &&
+        strcmp(baik_get_bcode_filename(baik, bp), "<stdin>") == 0) {
+      baik_bcode_part_release(bp);
+      continue;
+    }
+    memmove(dst, bp, sizeof(*bp));
+    dst += sizeof(*bp);
+  }
+  baik->bcode_parts.len = dst - baik->bcode_parts.buf;
+  baik->bcode_unreclaimed = 0;
+}
+
+static void baik_print(struct baik *baik) {
+  size_t i, num_args = baik_nargs(baik);
+  for (i = 0; i < num_args; i++) {
+    baik_fprintf(baik_arg(baik, i), baik, stdout);
+    putchar(' ');
+  }
+  putchar('\n');
+  baik_return(baik, BAIK_UNDEFINED);
+}
+
+static struct baik_bcode_part *baik_get_loaded_file_bcode(struct baik *baik,
+                                                        const char *filename) {
+  int parts_cnt = baik_bcode_parts_cnt(baik);
+  int i;
 
   if (filename == NULL) {
     return 0;
@@ -6375,1020 +7369,2018 @@ static void baik_s2o(struct baik *baik) {
                                    baik, baik_arg(baik, 1))));
 }
 
-void baik_init_builtin(struct baik *baik, baik_val_t obj) {
-  baik_val_t v;
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
-  baik_set(baik, obj, "global", ~0, obj);
-  baik_set(baik, obj, "muat", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_load));
-  baik_set(baik, obj, "tulis", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_print));
-  // baik_set(baik, obj, "ffi", ~0,
-  //         baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_ffi_call));
-  // baik_set(baik, obj, "ffi_cb_free", ~0,
-  //         baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_ffi_cb_free));
-  baik_set(baik, obj, "mkstr", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_mkstr));
-  baik_set(baik, obj, "getBAIK", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_get_baik));
-  baik_set(baik, obj, "die", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_die));
-  baik_set(baik, obj, "gc", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_do_gc));
-  baik_set(baik, obj, "chr", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_chr));
-  baik_set(baik, obj, "s2o", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_s2o));
-  v = baik_mk_object(baik);
-  baik_set(baik, v, "stringify", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_op_json_stringify));
-  baik_set(baik, v, "parse", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_op_json_parse));
-  baik_set(baik, obj, "JSON", ~0, v);
-  v = baik_mk_object(baik);
-  baik_set(baik, v, "create", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_op_create_object));
-  baik_set(baik, obj, "Object", ~0, v);
-  baik_set(baik, obj, "NaN", ~0, BAIK_TAG_NAN);
-  baik_set(baik, obj, "isNaN", ~0,
-          baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_op_isnan));
+static uint64_t baik_uptime_us(void) {
+  return (uint64_t) esp_timer_get_time();
 }
 
-BAIK_PRIVATE baik_err_t baik_to_string(struct baik *baik, baik_val_t *v, char **p,
-                                    size_t *sizep, int *need_free) {
-  baik_err_t ret = BAIK_OK;
-
-  *p = NULL;
-  *sizep = 0;
-  *need_free = 0;
-
-  if (baik_is_string(*v)) {
-    *p = (char *) baik_get_string(baik, v, sizep);
-  } else if (baik_is_number(*v)) {
-    char buf[50] = "";
-    struct json_out out = JSON_OUT_BUF(buf, sizeof(buf));
-    baik_jprintf(*v, baik, &out);
-    *sizep = strlen(buf);
-    *p = malloc(*sizep + 1);
-    if (*p == NULL) {
-      ret = BAIK_OUT_OF_MEMORY;
-      goto clean;
-    }
-    memmove(*p, buf, *sizep + 1);
-    *need_free = 1;
-  } else if (baik_is_boolean(*v)) {
-    if (baik_get_bool(baik, *v)) {
-      *p = "benar";
-      *sizep = 4;
-    } else {
-      *p = "salah";
-      *sizep = 5;
-    }
-  } else if (baik_is_undefined(*v)) {
-    *p = "takterdefinisi";
-    *sizep = 9;
-  } else if (baik_is_null(*v)) {
-    *p = "kosong";
-    *sizep = 4;
-  } else if (baik_is_object(*v)) {
-    ret = BAIK_TYPE_ERROR;
-    baik_set_errorf(baik, ret,
-                   "conversion from object to string is not supported");
-  } else if (baik_is_foreign(*v)) {
-    *p = "TODO_foreign";
-    *sizep = 12;
-  } else {
-    ret = BAIK_TYPE_ERROR;
-    baik_set_errorf(baik, ret, "unknown type to convert to string");
-  }
-
-clean:
-  return ret;
+static void baik_sleep_ms(uint32_t ms) {
+  TickType_t ticks = pdMS_TO_TICKS(ms);
+  vTaskDelay(ticks > 0 ? ticks : 1);
 }
-
-BAIK_PRIVATE baik_val_t baik_to_boolean_v(struct baik *baik, baik_val_t v) {
-  size_t len;
-  int is_truthy;
-
-  is_truthy =
-      ((baik_is_boolean(v) && baik_get_bool(baik, v)) ||
-       (baik_is_number(v) && baik_get_double(baik, v) != 0.0) ||
-       (baik_is_string(v) && baik_get_string(baik, &v, &len) && len > 0) ||
-       (baik_is_function(v)) || (baik_is_foreign(v)) || (baik_is_object(v))) &&
-      v != BAIK_TAG_NAN;
-
-  return baik_mk_boolean(baik, is_truthy);
+#else
+static uint64_t baik_uptime_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
-BAIK_PRIVATE int baik_is_truthy(struct baik *baik, baik_val_t v) {
-  return baik_get_bool(baik, baik_to_boolean_v(baik, v));
+static void baik_sleep_ms(uint32_t ms) {
+  struct timeval tv;
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  select(0, NULL, NULL, NULL, &tv);
 }
-
-#ifndef BAIK_OBJECT_ARENA_SIZE
-#define BAIK_OBJECT_ARENA_SIZE 20
-#endif
-#ifndef BAIK_PROPERTY_ARENA_SIZE
-#define BAIK_PROPERTY_ARENA_SIZE 20
-#endif
-#ifndef BAIK_FUNC_FFI_ARENA_SIZE
-#define BAIK_FUNC_FFI_ARENA_SIZE 20
-#endif
-#ifndef BAIK_OBJECT_ARENA_INC_SIZE
-#define BAIK_OBJECT_ARENA_INC_SIZE 10
-#endif
-#ifndef BAIK_PROPERTY_ARENA_INC_SIZE
-#define BAIK_PROPERTY_ARENA_INC_SIZE 10
-#endif
-#ifndef BAIK_FUNC_FFI_ARENA_INC_SIZE
-#define BAIK_FUNC_FFI_ARENA_INC_SIZE 10
 #endif
 
-void baik_destroy(struct baik *baik) {
-  {
-    int parts_cnt = baik_bcode_parts_cnt(baik);
-    int i;
-    for (i = 0; i < parts_cnt; i++) {
-      struct baik_bcode_part *bp = baik_bcode_part_get(baik, i);
-      if (!bp->in_rom) {
-        free((void *) bp->data.p);
-      }
-    }
-  }
+static uint32_t baik_uptime_ms(void) {
+  return (uint32_t)(baik_uptime_us() / 1000);
+}
 
-  mbuf_free(&baik->bcode_gen);
-  mbuf_free(&baik->bcode_parts);
-  mbuf_free(&baik->stack);
-  mbuf_free(&baik->call_stack);
-  mbuf_free(&baik->arg_stack);
-  mbuf_free(&baik->owned_strings);
-  mbuf_free(&baik->foreign_strings);
-  mbuf_free(&baik->owned_values);
-  mbuf_free(&baik->scopes);
-  mbuf_free(&baik->loop_addresses);
-  mbuf_free(&baik->json_visited_stack);
-  free(baik->error_msg);
-  free(baik->stack_trace);
-  //baik_ffi_args_free_list(baik);
-  gc_arena_destroy(baik, &baik->object_arena);
-  gc_arena_destroy(baik, &baik->property_arena);
-  gc_arena_destroy(baik, &baik->ffi_sig_arena);
-  free(baik);
+// Events posted from other tasks go through an intrusive multi-producer,
+// single-consumer queue: producers only swap ev_head, the interpreter task
+// alone walks from ev_tail. Timers hang off a hashed wheel of
+// BAIK_TIMER_SLOTS slots, BAIK_TIMER_TICK_MS wide each.
+
+static void baik_ev_push(struct baik *baik, struct baik_event *ev) {
+  struct baik_event *prev;
+  __atomic_store_n(&ev->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&baik->ev_head, ev, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, ev, __ATOMIC_RELEASE);
 }
 
-struct baik *baik_create(void) {
-  baik_val_t global_object;
-  struct baik *baik = calloc(1, sizeof(*baik));
-  mbuf_init(&baik->stack, 0);
-  mbuf_init(&baik->call_stack, 0);
-  mbuf_init(&baik->arg_stack, 0);
-  mbuf_init(&baik->owned_strings, 0);
-  mbuf_init(&baik->foreign_strings, 0);
-  mbuf_init(&baik->bcode_gen, 0);
-  mbuf_init(&baik->bcode_parts, 0);
-  mbuf_init(&baik->owned_values, 0);
-  mbuf_init(&baik->scopes, 0);
-  mbuf_init(&baik->loop_addresses, 0);
-  mbuf_init(&baik->json_visited_stack, 0);
+static struct baik_event *baik_ev_pop(struct baik *baik) {
+  struct baik_event *tail = baik->ev_tail;
+  struct baik_event *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
 
-  baik->bcode_len = 0;
- 
-  {
-    char z = 0;
-    mbuf_append(&baik->owned_strings, &z, 1);
+  if (tail == &baik->ev_stub) {
+    if (next == NULL) return NULL;
+    baik->ev_tail = tail = next;
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
   }
+  if (next == NULL) {
+    // tail is the last node; push the stub behind it so it can be taken,
+    // unless a producer is halfway through linking a newer one.
+    if (tail != __atomic_load_n(&baik->ev_head, __ATOMIC_ACQUIRE)) return NULL;
+    baik_ev_push(baik, &baik->ev_stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next == NULL) return NULL;
+  }
+  baik->ev_tail = next;
+  return tail;
+}
 
-  gc_arena_init(&baik->object_arena, sizeof(struct baik_object),
-                BAIK_OBJECT_ARENA_SIZE, BAIK_OBJECT_ARENA_INC_SIZE);
-  gc_arena_init(&baik->property_arena, sizeof(struct baik_property),
-                BAIK_PROPERTY_ARENA_SIZE, BAIK_PROPERTY_ARENA_INC_SIZE);
-  // gc_arena_init(&baik->ffi_sig_arena, sizeof(struct baik_ffi_sig),
-  //               BAIK_FUNC_FFI_ARENA_SIZE, BAIK_FUNC_FFI_ARENA_INC_SIZE);
-  // baik->ffi_sig_arena.destructor = baik_ffi_sig_destructor;
-
-  global_object = baik_mk_object(baik);
-  baik_init_builtin(baik, global_object);
-  // baik_set_ffi_resolver(baik, dlsym);
-  push_baik_val(&baik->scopes, global_object);
-  baik->vals.this_obj = BAIK_UNDEFINED;
-  baik->vals.dataview_proto = BAIK_UNDEFINED;
+static int baik_ev_empty(struct baik *baik) {
+  return baik->ev_tail == &baik->ev_stub &&
+         __atomic_load_n(&baik->ev_head, __ATOMIC_ACQUIRE) == &baik->ev_stub;
+}
 
-  return baik;
+static int baik_ev_enqueue(struct baik *baik, baik_event_cb_t cb, void *ud,
+                           baik_val_t func, baik_val_t arg) {
+  struct baik_event *ev = (struct baik_event *) calloc(1, sizeof(*ev));
+  if (ev == NULL) return 0;
+  ev->cb = cb;
+  ev->user_data = ud;
+  ev->func = func;
+  ev->arg = arg;
+  ev->posted_us = baik_uptime_us();
+  baik_ev_push(baik, ev);
+  return 1;
 }
 
-baik_err_t baik_set_errorf(struct baik *baik, baik_err_t err, const char *fmt, ...) {
-  va_list ap;
-  va_start(ap, fmt);
-  free(baik->error_msg);
-  baik->error_msg = NULL;
-  baik->error = err;
-  if (fmt != NULL) {
-    baik_generic_avprintf(&baik->error_msg, 0, fmt, ap);
-  }
-  va_end(ap);
-  return err;
+// Safe to call from any task. `arg` must not refer to heap values: only
+// the interpreter task may create those.
+int baik_post(struct baik *baik, baik_val_t func, baik_val_t arg) {
+  return baik_ev_enqueue(baik, NULL, NULL, func, arg);
 }
 
-baik_err_t baik_prepend_errorf(struct baik *baik, baik_err_t err, const char *fmt,
-                             ...) {
-  char *old_error_msg = baik->error_msg;
-  char *new_error_msg = NULL;
-  va_list ap;
-  va_start(ap, fmt);
+int baik_post_cb(struct baik *baik, baik_event_cb_t cb, void *user_data) {
+  return baik_ev_enqueue(baik, cb, user_data, BAIK_UNDEFINED, BAIK_UNDEFINED);
+}
 
-  assert(err != BAIK_OK);
+static void baik_timer_link(struct baik *baik, struct baik_timer *t) {
+  struct baik_timer **slot =
+      &baik->timers[(t->due_us / 1000 / BAIK_TIMER_TICK_MS) % BAIK_TIMER_SLOTS];
+  t->next = *slot;
+  *slot = t;
+}
 
-  baik->error_msg = NULL;
- 
-  if (baik->error == BAIK_OK) {
-    baik->error = err;
+static int baik_timer_add(struct baik *baik, uint32_t delay_ms,
+                          uint32_t period_ms, baik_val_t func) {
+  struct baik_timer *t = (struct baik_timer *) calloc(1, sizeof(*t));
+  if (t == NULL) return 0;
+  if (baik->timers_cnt == 0) {
+    baik->timer_tick = baik_uptime_us() / 1000 / BAIK_TIMER_TICK_MS;
   }
-  baik_generic_avprintf(&new_error_msg, 0, fmt, ap);
-  va_end(ap);
+  t->id = ++baik->timer_seq;
+  t->due_us = baik_uptime_us() + (uint64_t) delay_ms * 1000;
+  t->period_ms = period_ms;
+  t->func = func;
+  baik_timer_link(baik, t);
+  baik->timers_cnt++;
+  return t->id;
+}
 
-  if (old_error_msg != NULL) {
-    baik_generic_asprintf(&baik->error_msg, 0, "%s: %s", new_error_msg, old_error_msg);
-    free(new_error_msg);
-    free(old_error_msg);
-  } else {
-    baik->error_msg = new_error_msg;
+static int baik_timer_unlink(struct baik *baik, struct baik_timer **tp,
+                             int id) {
+  for (; *tp != NULL; tp = &(*tp)->next) {
+    if ((*tp)->id == id) {
+      struct baik_timer *t = *tp;
+      *tp = t->next;
+      free(t);
+      baik->timers_cnt--;
+      return 1;
+    }
   }
-  return err;
+  return 0;
 }
 
-void baik_print_error(struct baik *baik, FILE *fp, const char *msg,
-                     int print_stack_trace) {
-  if (print_stack_trace && baik->stack_trace != NULL) {
-    fprintf(fp, "%s", baik->stack_trace);
+static int baik_timer_cancel(struct baik *baik, int id) {
+  int i;
+  if (id != 0 && id == baik->timer_firing) {
+    baik->timer_firing = -1;
+    return 1;
   }
-
-  if (msg == NULL) {
-    msg = "BAIK galat";
+  // A callback may cancel a timer due in the same batch as itself.
+  if (baik_timer_unlink(baik, &baik->timers_due, id)) return 1;
+  for (i = 0; i < BAIK_TIMER_SLOTS; i++) {
+    if (baik_timer_unlink(baik, &baik->timers[i], id)) return 1;
   }
+  return 0;
+}
 
-  fprintf(fp, "%s: %s\n", msg, baik_strerror(baik, baik->error));
+static void baik_event_report(struct baik *baik) {
+  if (baik->error != BAIK_OK) {
+    baik_print_error(baik, stdout, NULL, 1);
+  }
 }
 
-BAIK_PRIVATE void baik_die(struct baik *baik) {
-  baik_val_t msg_v = BAIK_UNDEFINED;
-  const char *msg = NULL;
-  size_t msg_len = 0;
+static int baik_run_timers(struct baik *baik, uint64_t now) {
+  struct baik_timer **tp, **dp, *t;
+  uint64_t tick = now / 1000 / BAIK_TIMER_TICK_MS;
+  uint64_t from = baik->timer_tick;
+  int n = 0;
 
-  if (!baik_check_arg(baik, 0, "msg", BAIK_TYPE_STRING, &msg_v)) {
-    goto clean;
+  if (tick - from >= BAIK_TIMER_SLOTS) from = tick - BAIK_TIMER_SLOTS + 1;
+  for (; from <= tick; from++) {
+    tp = &baik->timers[from % BAIK_TIMER_SLOTS];
+    while ((t = *tp) != NULL) {
+      if (t->due_us <= now) {
+        *tp = t->next;
+        for (dp = &baik->timers_due; *dp != NULL; dp = &(*dp)->next) {
+          if ((*dp)->due_us > t->due_us ||
+              ((*dp)->due_us == t->due_us && (*dp)->id > t->id)) {
+            break;
+          }
+        }
+        t->next = *dp;
+        *dp = t;
+      } else {
+        tp = &t->next;
+      }
+    }
   }
+  // The current tick stays open: timers due later within it are left.
+  baik->timer_tick = tick;
 
-  msg = baik_get_string(baik, &msg_v, &msg_len);
+  while ((t = baik->timers_due) != NULL) {
+    unsigned long jitter = (unsigned long) (baik_uptime_us() - t->due_us);
+    baik->timers_due = t->next;
+    baik->ev_stats.timers++;
+    baik->ev_stats.jitter_sum_us += jitter;
+    if (jitter > baik->ev_stats.jitter_max_us) {
+      baik->ev_stats.jitter_max_us = jitter;
+    }
 
-  baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "%.*s", (int) msg_len, msg);
+    baik->timer_firing = t->id;
+    baik_apply(baik, NULL, t->func, BAIK_UNDEFINED, 0, NULL);
+    baik_event_report(baik);
+    n++;
 
-clean:
-  baik_return(baik, BAIK_UNDEFINED);
+    if (t->period_ms != 0 && baik->timer_firing == t->id) {
+      t->due_us += (uint64_t) t->period_ms * 1000;
+      if (t->due_us <= now) {
+        t->due_us = now + (uint64_t) t->period_ms * 1000;
+      }
+      baik_timer_link(baik, t);
+    } else {
+      free(t);
+      baik->timers_cnt--;
+    }
+    baik->timer_firing = 0;
+  }
+  return n;
 }
 
-const char *baik_strerror(struct baik *baik, enum baik_err err) {
-  const char *err_names[] = {
-      "NO_ERROR",        "SYNTAX_ERROR",    "REFERENCE_ERROR",
-      "TYPE_ERROR",      "OUT_OF_MEMORY",   "INTERNAL_ERROR",
-      "NOT_IMPLEMENTED", "FILE_OPEN_ERROR", "BAD_ARGUMENTS"};
-  return baik->error_msg == NULL || baik->error_msg[0] == '\0' ? err_names[err]
-                                                             : baik->error_msg;
+static unsigned long baik_timer_wait(struct baik *baik, uint64_t now) {
+  uint64_t next = (uint64_t) -1;
+  struct baik_timer *t;
+  int i;
+  for (i = 0; i < BAIK_TIMER_SLOTS; i++) {
+    for (t = baik->timers[i]; t != NULL; t = t->next) {
+      if (t->due_us < next) next = t->due_us;
+    }
+  }
+  if (next == (uint64_t) -1) return (unsigned long) -1;
+  return next <= now ? 0 : (unsigned long) ((next - now + 999) / 1000);
+}
+
+// Script threads ("tugas") share the heap and globals but each has its own
+// stacks in a struct baik_ctx. They are scheduled cooperatively from
+// baik_poll: a task keeps the interpreter until it calls tunggu(), runs
+// out of budget, finishes or fails.
+
+static void gc_mark_mbuf_val(struct baik *baik, const struct mbuf *mbuf);
+static void call_stack_push_frame(struct baik *baik, size_t offset, int part,
+                                  baik_val_t retval_stack_idx);
+
+static void baik_ctx_init(struct baik_ctx *c, baik_val_t global,
+                          int call_stack_base) {
+  memset(c, 0, sizeof(*c));
+  mbuf_init(&c->stack, 0);
+  mbuf_init(&c->call_stack, 0);
+  mbuf_init(&c->arg_stack, 0);
+  mbuf_init(&c->scopes, 0);
+  mbuf_init(&c->loop_addresses, 0);
+  push_baik_val(&c->scopes, global);
+  c->this_obj = BAIK_UNDEFINED;
+  c->last_getprop_obj = BAIK_UNDEFINED;
+  c->call_stack_base = call_stack_base;
+  c->saved = 1;
+}
+
+static void baik_ctx_free(struct baik_ctx *c) {
+  mbuf_free(&c->stack);
+  mbuf_free(&c->call_stack);
+  mbuf_free(&c->arg_stack);
+  mbuf_free(&c->scopes);
+  mbuf_free(&c->loop_addresses);
+}
+
+static void baik_ctx_save(struct baik *baik, struct baik_ctx *c) {
+  c->stack = baik->stack;
+  c->call_stack = baik->call_stack;
+  c->arg_stack = baik->arg_stack;
+  c->scopes = baik->scopes;
+  c->loop_addresses = baik->loop_addresses;
+  c->susp = baik->susp;
+  c->this_obj = baik->vals.this_obj;
+  c->last_getprop_obj = baik->vals.last_getprop_obj;
+  c->cur_bcode_offset = baik->cur_bcode_offset;
+  c->call_stack_base = baik->call_stack_base;
+  c->error = baik->error;
+  c->suspended = baik->suspended;
+  c->saved = 1;
+}
+
+static void baik_ctx_load(struct baik *baik, struct baik_ctx *c) {
+  baik->stack = c->stack;
+  baik->call_stack = c->call_stack;
+  baik->arg_stack = c->arg_stack;
+  baik->scopes = c->scopes;
+  baik->loop_addresses = c->loop_addresses;
+  baik->susp = c->susp;
+  baik->vals.this_obj = c->this_obj;
+  baik->vals.last_getprop_obj = c->last_getprop_obj;
+  baik->cur_bcode_offset = c->cur_bcode_offset;
+  baik->call_stack_base = c->call_stack_base;
+  baik->error = c->error;
+  baik->suspended = c->suspended;
+  c->saved = 0;
+}
+
+static void baik_ctx_mark(struct baik *baik, struct baik_ctx *c) {
+  if (!c->saved) return;
+  gc_mark_mbuf_val(baik, &c->scopes);
+  gc_mark_mbuf_val(baik, &c->stack);
+  gc_mark_mbuf_val(baik, &c->call_stack);
+  gc_mark_mbuf_val(baik, &c->arg_stack);
+  gc_mark(baik, &c->this_obj);
+  gc_mark(baik, &c->last_getprop_obj);
+}
+
+static baik_err_t baik_task_step(struct baik *baik, struct baik_task *t) {
+  baik_val_t r;
+  if (t->started) {
+    return baik_execute(baik, BAIK_BCODE_OFFSET_RESUME, &r);
+  }
+  // Enter the function the way baik_apply does, over an exit frame that
+  // becomes the task's call_stack_base.
+  t->started = 1;
+  baik_push(baik, t->func);
+  push_baik_val(&baik->arg_stack, BAIK_UNDEFINED);
+  call_stack_push_frame(
+      baik, BAIK_BCODE_OFFSET_EXIT, -1,
+      baik_mk_number(baik, (double) baik_stack_size(&baik->stack)));
+  return baik_execute(baik, baik_get_func_addr(t->func), &r);
+}
+
+// Gives each runnable task one slice, in spawn order. Returns the number
+// of slices run; *wait_us gets the time until the next task wakes up.
+static int baik_run_tasks(struct baik *baik, uint64_t *wait_us) {
+  struct baik_ctx *home = baik->parked.saved ? &baik->scratch : &baik->parked;
+  struct baik_task **tp = &baik->tasks, *t;
+  uint64_t now = baik_uptime_us();
+  int n = 0;
+
+  baik_ctx_save(baik, home);
+  while ((t = *tp) != NULL) {
+    if (t->ctx.susp.wake_us > now && !baik->interrupted) {
+      if (t->ctx.susp.wake_us - now < *wait_us) {
+        *wait_us = t->ctx.susp.wake_us - now;
+      }
+      tp = &t->next;
+      continue;
+    }
+    baik_ctx_load(baik, &t->ctx);
+    if (baik_task_step(baik, t) == BAIK_SUSPENDED) {
+      baik_ctx_save(baik, &t->ctx);
+      *wait_us = 0;
+      tp = &t->next;
+    } else {
+      baik_event_report(baik);
+      baik_ctx_save(baik, &t->ctx);
+      *tp = t->next;
+      baik_ctx_free(&t->ctx);
+      free(t);
+      baik->tasks_cnt--;
+    }
+    n++;
+    now = baik_uptime_us();
+  }
+  baik_ctx_load(baik, home);
+  return n;
 }
 
-BAIK_PRIVATE size_t baik_get_func_addr(baik_val_t v) {
-  return v & ~BAIK_TAG_MASK;
+static void baik_tugas(struct baik *baik) {
+  baik_val_t fn = baik_arg(baik, 0);
+  struct baik_task *t, **tp;
+  int id = 0;
+  if (!baik_is_function(fn)) {
+    baik_set_errorf(baik, BAIK_TYPE_ERROR, "argumen harus fungsi");
+  } else if ((t = (struct baik_task *) calloc(1, sizeof(*t))) != NULL) {
+    baik_ctx_init(&t->ctx, baik_get_global(baik),
+                  CALL_STACK_FRAME_ITEMS_CNT * sizeof(baik_val_t));
+    t->func = fn;
+    t->id = id = ++baik->task_seq;
+    for (tp = &baik->tasks; *tp != NULL; tp = &(*tp)->next) {
+    }
+    *tp = t;
+    baik->tasks_cnt++;
+  }
+  baik_return(baik, baik_mk_number(baik, id));
 }
 
-BAIK_PRIVATE enum baik_type baik_get_type(baik_val_t v) {
-  int tag;
-  if (baik_is_number(v)) {
-    return BAIK_TYPE_NUMBER;
+static void baik_tunggu(struct baik *baik) {
+  baik_val_t ms = baik_arg(baik, 0);
+  double d = baik_is_number(ms) ? baik_get_double(baik, ms) : 0;
+  uint32_t delay = d > 0 ? (uint32_t) d : 0;
+  if (baik->exec_depth == 1 && baik->resumable) {
+    baik->wake_us = baik_uptime_us() + (uint64_t) delay * 1000;
+    baik->yield_req = 1;
+  } else if (delay > 0) {
+    // Nothing above a nested run could resume it, so just block.
+    baik_sleep_ms(delay);
   }
-  tag = (v & BAIK_TAG_MASK) >> 48;
-  switch (tag) {
-    case BAIK_TAG_FOREIGN >> 48:
-      return BAIK_TYPE_FOREIGN;
-    case BAIK_TAG_UNDEFINED >> 48:
-      return BAIK_TYPE_UNDEFINED;
-    case BAIK_TAG_OBJECT >> 48:
-      return BAIK_TYPE_OBJECT_GENERIC;
-    case BAIK_TAG_ARRAY >> 48:
-      return BAIK_TYPE_OBJECT_ARRAY;
-    case BAIK_TAG_FUNCTION >> 48:
-      return BAIK_TYPE_OBJECT_FUNCTION;
-    case BAIK_TAG_STRING_I >> 48:
-    case BAIK_TAG_STRING_O >> 48:
-    case BAIK_TAG_STRING_F >> 48:
-    case BAIK_TAG_STRING_D >> 48:
-    case BAIK_TAG_STRING_5 >> 48:
-      return BAIK_TYPE_STRING;
-    case BAIK_TAG_BOOLEAN >> 48:
-      return BAIK_TYPE_BOOLEAN;
-    case BAIK_TAG_NULL >> 48:
-      return BAIK_TYPE_NULL;
-    default:
-      abort();
-      return BAIK_TYPE_UNDEFINED;
+  baik_return(baik, BAIK_UNDEFINED);
+}
+
+static void baik_tasks_destroy(struct baik *baik) {
+  struct baik_task *t;
+  while ((t = baik->tasks) != NULL) {
+    baik->tasks = t->next;
+    baik_ctx_free(&t->ctx);
+    free(t);
   }
+  baik->tasks_cnt = 0;
 }
 
-baik_val_t baik_get_global(struct baik *baik) {
-  return *vptr(&baik->scopes, 0);
+static void baik_tasks_mark(struct baik *baik) {
+  struct baik_task *t;
+  for (t = baik->tasks; t != NULL; t = t->next) {
+    baik_ctx_mark(baik, &t->ctx);
+    gc_mark(baik, &t->func);
+  }
+  baik_ctx_mark(baik, &baik->parked);
+  baik_ctx_mark(baik, &baik->scratch);
 }
 
-static void baik_append_stack_trace_line(struct baik *baik, size_t offset) {
-  if (offset != BAIK_BCODE_OFFSET_EXIT) {
-    const char *filename = baik_get_bcode_filename_by_offset(baik, offset);
-    int line_no = baik_get_lineno_by_offset(baik, offset);
-    char *new_line = NULL;
-    const char *fmt = "  at %s:%d\n";
-    if (filename == NULL) {
-      fprintf(stderr,
-              "ERROR during stack trace generation: wrong bcode offset %d\n",
-              (int) offset);
-      filename = "<unknown-filename>";
+// Runs due timers and the events queued so far, each through baik_apply,
+// then a slice of every runnable script task, all on the calling
+// (interpreter) task. Returns the number of callbacks and slices run;
+// *wait_ms gets the time until the next timer or task wake-up, or
+// ULONG_MAX if none.
+int baik_poll(struct baik *baik, unsigned long *wait_ms) {
+  struct baik_event *ev, *last;
+  uint64_t now, task_wait = (uint64_t) -1;
+  int n = 0, left = BAIK_POLL_MAX_EVENTS, parked;
+
+  if (baik->exec_depth != 0) {
+    if (wait_ms != NULL) *wait_ms = 0;
+    return 0;
+  }
+  // A suspended run is parked while callbacks use the scratch context,
+  // where nothing can suspend.
+  parked = baik->suspended;
+  if (parked) {
+    baik_ctx_save(baik, &baik->parked);
+    baik_ctx_load(baik, &baik->scratch);
+  }
+
+  now = baik_uptime_us();
+  if (baik->timers_cnt > 0) {
+    n += baik_run_timers(baik, now);
+  }
+
+  // Events posted while these run wait for the next poll, and so does
+  // anything past BAIK_POLL_MAX_EVENTS, to keep timers on schedule.
+  last = __atomic_load_n(&baik->ev_head, __ATOMIC_ACQUIRE);
+  while (left-- > 0 && (ev = baik_ev_pop(baik)) != NULL) {
+    unsigned long latency = (unsigned long) (baik_uptime_us() - ev->posted_us);
+    baik->ev_stats.events++;
+    baik->ev_stats.latency_sum_us += latency;
+    if (latency > baik->ev_stats.latency_max_us) {
+      baik->ev_stats.latency_max_us = latency;
     }
-    baik_generic_asprintf(&new_line, 0, fmt, filename, line_no);
 
-    if (baik->stack_trace != NULL) {
-      char *old = baik->stack_trace;
-      baik_generic_asprintf(&baik->stack_trace, 0, "%s%s", baik->stack_trace, new_line);
-      free(old);
-      free(new_line);
+    if (ev->cb != NULL) {
+      ev->cb(baik, ev->user_data);
     } else {
-      baik->stack_trace = new_line;
+      baik_apply(baik, NULL, ev->func, BAIK_UNDEFINED, 1, &ev->arg);
+      baik_event_report(baik);
+    }
+    n++;
+    if (ev == last) {
+      free(ev);
+      break;
     }
+    free(ev);
   }
-}
-
-BAIK_PRIVATE void baik_gen_stack_trace(struct baik *baik, size_t offset) {
-  baik_append_stack_trace_line(baik, offset);
-  while (baik->call_stack.len >=
-         sizeof(baik_val_t) * CALL_STACK_FRAME_ITEMS_CNT) {
-    int i;
 
-    offset = baik_get_int(
-        baik, *vptr(&baik->call_stack, -1 - CALL_STACK_FRAME_ITEM_RETURN_ADDR));
+  if (baik->tasks != NULL) {
+    n += baik_run_tasks(baik, &task_wait);
+  }
+  if (parked) {
+    baik_ctx_save(baik, &baik->scratch);
+    baik_ctx_load(baik, &baik->parked);
+  }
 
-    for (i = 0; i < CALL_STACK_FRAME_ITEMS_CNT; i++) {
-      baik_pop_val(&baik->call_stack);
+  if (wait_ms != NULL) {
+    *wait_ms = baik_ev_empty(baik) ? baik_timer_wait(baik, baik_uptime_us())
+                                   : 0;
+    if (task_wait != (uint64_t) -1 && task_wait / 1000 < *wait_ms) {
+      *wait_ms = (unsigned long) (task_wait / 1000);
     }
-
-    baik_append_stack_trace_line(baik, offset);
   }
+  return n;
 }
 
-void baik_own(struct baik *baik, baik_val_t *v) {
-  mbuf_append(&baik->owned_values, &v, sizeof(v));
+int baik_events_pending(struct baik *baik) {
+  return baik->timers_cnt + baik->tasks_cnt + !baik_ev_empty(baik);
 }
 
-int baik_disown(struct baik *baik, baik_val_t *v) {
-  baik_val_t **vp = (baik_val_t **) (baik->owned_values.buf +
-                                   baik->owned_values.len - sizeof(v));
+void baik_get_event_stats(struct baik *baik, struct baik_event_stats *st) {
+  *st = baik->ev_stats;
+}
 
-  for (; (char *) vp >= baik->owned_values.buf; vp--) {
-    if (*vp == v) {
-      *vp = *(baik_val_t **) (baik->owned_values.buf + baik->owned_values.len -
-                             sizeof(v));
-      baik->owned_values.len -= sizeof(v);
-      return 1;
-    }
-  }
+void baik_get_quicken_stats(struct baik *baik, struct baik_quicken_stats *st) {
+  *st = baik->quicken;
+}
 
-  return 0;
+static void baik_timer_builtin(struct baik *baik, int periodic) {
+  baik_val_t ms = baik_arg(baik, 0), fn = baik_arg(baik, 1);
+  int id = 0;
+  if (!baik_is_number(ms) || !baik_is_function(fn)) {
+    baik_set_errorf(baik, BAIK_TYPE_ERROR, "argumen harus (angka, fungsi)");
+  } else {
+    double d = baik_get_double(baik, ms);
+    uint32_t delay = d > 0 ? (uint32_t) d : 0;
+    if (periodic && delay == 0) delay = 1;
+    id = baik_timer_add(baik, delay, periodic ? delay : 0, fn);
+  }
+  baik_return(baik, baik_mk_number(baik, id));
 }
 
+static void baik_setelah(struct baik *baik) {
+  baik_timer_builtin(baik, 0);
+}
 
-BAIK_PRIVATE int baik_getretvalpos(struct baik *baik) {
-  int pos;
-  baik_val_t *ppos = vptr(&baik->call_stack, -1);
-  
-  assert(ppos != NULL && baik_is_number(*ppos));
-  pos = baik_get_int(baik, *ppos) - 1;
-  assert(pos < (int) baik_stack_size(&baik->stack));
-  return pos;
+static void baik_setiap(struct baik *baik) {
+  baik_timer_builtin(baik, 1);
 }
 
-int baik_nargs(struct baik *baik) {
-  int top = baik_stack_size(&baik->stack);
-  int pos = baik_getretvalpos(baik) + 1;
-  
-  return pos > 0 && pos < top ? top - pos : 0;
+static void baik_batalkan(struct baik *baik) {
+  baik_val_t id = baik_arg(baik, 0);
+  int ok = baik_is_number(id) && baik_timer_cancel(baik, baik_get_int(baik, id));
+  baik_return(baik, baik_mk_boolean(baik, ok));
 }
 
-baik_val_t baik_arg(struct baik *baik, int arg_index) {
-  baik_val_t res = BAIK_UNDEFINED;
-  int top = baik_stack_size(&baik->stack);
-  int pos = baik_getretvalpos(baik) + 1;
-  
-  if (pos > 0 && pos + arg_index < top) {
-    res = *vptr(&baik->stack, pos + arg_index);
-  }
+#ifndef BAIK_CACHE_LINE
+#define BAIK_CACHE_LINE 64
+#endif
 
-  return res;
-}
+// A channel is a bounded single-producer, single-consumer ring between two
+// instances, usually on different cores. The sender serializes a value
+// into one allocation whose ownership then moves through the ring; the
+// receiver rebuilds the value in its own heap. Each side keeps its index
+// and a cached copy of the other's on its own cache line.
 
-void baik_return(struct baik *baik, baik_val_t v) {
-  int pos = baik_getretvalpos(baik);
-  
-  baik->stack.len = sizeof(baik_val_t) * pos;
-  baik_push(baik, v);
-}
+enum baik_msg_type {
+  BAIK_MSG_UNDEFINED,
+  BAIK_MSG_NUMBER,
+  BAIK_MSG_STRING,
+  BAIK_MSG_JSON
+};
 
-BAIK_PRIVATE baik_val_t vtop(struct mbuf *m) {
-  size_t size = baik_stack_size(m);
-  return size > 0 ? *vptr(m, size - 1) : BAIK_UNDEFINED;
+struct baik_msg {
+  uint8_t type;
+  size_t len;
+  char data[];
+};
+
+struct baik_chan {
+  struct baik_msg **slots;
+  size_t mask;
+  char pad0[BAIK_CACHE_LINE];
+  size_t head;
+  size_t tail_cache;
+  char pad1[BAIK_CACHE_LINE];
+  size_t tail;
+  size_t head_cache;
+  char pad2[BAIK_CACHE_LINE];
+};
+
+struct baik_chan *baik_chan_create(size_t capacity) {
+  struct baik_chan *ch = (struct baik_chan *) calloc(1, sizeof(*ch));
+  size_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  if (ch == NULL) return NULL;
+  ch->slots = (struct baik_msg **) calloc(cap, sizeof(*ch->slots));
+  if (ch->slots == NULL) {
+    free(ch);
+    return NULL;
+  }
+  ch->mask = cap - 1;
+  return ch;
 }
 
-BAIK_PRIVATE size_t baik_stack_size(const struct mbuf *m) {
-  return m->len / sizeof(baik_val_t);
+// Only once neither end is in use any more.
+void baik_chan_destroy(struct baik_chan *ch) {
+  if (ch == NULL) return;
+  for (; ch->tail != ch->head; ch->tail++) {
+    free(ch->slots[ch->tail & ch->mask]);
+  }
+  free(ch->slots);
+  free(ch);
 }
 
-BAIK_PRIVATE baik_val_t *vptr(struct mbuf *m, int idx) {
-  int size = baik_stack_size(m);
-  if (idx < 0) idx = size + idx;
-  return idx >= 0 && idx < size ? &((baik_val_t *) m->buf)[idx] : NULL;
+static int should_skip_for_json(enum baik_type type);
+
+/* Whether object `v` holds itself somewhere below, which JSON cannot carry */
+static int baik_msg_cyclic(struct baik *baik, baik_val_t v, struct mbuf *path) {
+  struct baik_property *p;
+  baik_val_t *vp;
+  int found = 0;
+
+  for (vp = (baik_val_t *) path->buf; (char *) vp < path->buf + path->len;
+       vp++) {
+    if (*vp == v) return 1;
+  }
+  mbuf_append(path, &v, sizeof(v));
+  for (p = get_object_struct(v)->properties; p != NULL && !found;
+       p = p->next) {
+    found = baik_is_object(p->value) && baik_msg_cyclic(baik, p->value, path);
+  }
+  path->len -= sizeof(v);
+  return found;
 }
 
-BAIK_PRIVATE baik_val_t baik_pop(struct baik *baik) {
-  if (baik->stack.len == 0) {
-    baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "stack underflow");
-    return BAIK_UNDEFINED;
+// NULL if `v` has no encoding (see baik_chan_send) or memory ran out.
+static struct baik_msg *baik_msg_encode(struct baik *baik, baik_val_t v) {
+  struct baik_msg *m;
+  const char *p = NULL;
+  char *json = NULL;
+  size_t len = 0;
+  double d = 0;
+  uint8_t type;
+
+  if (baik_is_number(v)) {
+    type = BAIK_MSG_NUMBER;
+    d = baik_get_double(baik, v);
+    p = (const char *) &d;
+    len = sizeof(d);
+  } else if (baik_is_string(v)) {
+    type = BAIK_MSG_STRING;
+    p = baik_get_string(baik, &v, &len);
+  } else if (baik_is_undefined(v)) {
+    type = BAIK_MSG_UNDEFINED;
   } else {
-    return baik_pop_val(&baik->stack);
+    struct mbuf path;
+    int cyclic = 0;
+    if (should_skip_for_json(baik_get_type(v))) return NULL;
+    if (baik_is_object(v)) {
+      mbuf_init(&path, 0);
+      cyclic = baik_msg_cyclic(baik, v, &path);
+      mbuf_free(&path);
+    }
+    if (cyclic) return NULL;
+    type = BAIK_MSG_JSON;
+    if (baik_json_stringify(baik, v, NULL, 0, &json) != BAIK_OK) return NULL;
+    p = json;
+    len = strlen(json);
   }
-}
 
-BAIK_PRIVATE void push_baik_val(struct mbuf *m, baik_val_t v) {
-  mbuf_append(m, &v, sizeof(v));
+  m = (struct baik_msg *) malloc(sizeof(*m) + len);
+  if (m != NULL) {
+    m->type = type;
+    m->len = len;
+    if (len > 0) memcpy(m->data, p, len);
+  }
+  free(json);
+  return m;
 }
 
-BAIK_PRIVATE baik_val_t baik_pop_val(struct mbuf *m) {
+static baik_val_t baik_msg_decode(struct baik *baik, const struct baik_msg *m) {
   baik_val_t v = BAIK_UNDEFINED;
-  assert(m->len >= sizeof(v));
-  if (m->len >= sizeof(v)) {
-    memcpy(&v, m->buf + m->len - sizeof(v), sizeof(v));
-    m->len -= sizeof(v);
+  double d;
+  switch (m->type) {
+    case BAIK_MSG_NUMBER:
+      memcpy(&d, m->data, sizeof(d));
+      v = baik_mk_number(baik, d);
+      break;
+    case BAIK_MSG_STRING:
+      v = baik_mk_string(baik, m->data, m->len, 1);
+      break;
+    case BAIK_MSG_JSON:
+      baik_json_parse(baik, m->data, m->len, &v);
+      break;
   }
   return v;
 }
 
-BAIK_PRIVATE void baik_push(struct baik *baik, baik_val_t v) {
-  push_baik_val(&baik->stack, v);
-}
-
-void baik_set_generate_jsc(struct baik *baik, int generate_jsc) {
-  baik->generate_jsc = generate_jsc;
-}
-
-void *baik_mem_to_ptr(unsigned val) {
-  return (void *) (uintptr_t) val;
+// Producer side. Returns 1 once `v` is queued, 0 if the channel is full,
+// or -1 if `v` cannot be sent: functions, foreign pointers and objects that
+// hold themselves have no encoding. Sending it again will not help.
+int baik_chan_send(struct baik *baik, struct baik_chan *ch, baik_val_t v) {
+  size_t head = ch->head;
+  struct baik_msg *m;
+  if (head - ch->tail_cache > ch->mask) {
+    ch->tail_cache = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+    if (head - ch->tail_cache > ch->mask) return 0;
+  }
+  if ((m = baik_msg_encode(baik, v)) == NULL) return -1;
+  ch->slots[head & ch->mask] = m;
+  __atomic_store_n(&ch->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
 }
 
-void *baik_mem_get_ptr(void *base, int offset) {
-  return (char *) base + offset;
+// Consumer side. Returns 0 if the channel is empty.
+int baik_chan_recv(struct baik *baik, struct baik_chan *ch, baik_val_t *v) {
+  size_t tail = ch->tail;
+  struct baik_msg *m;
+  if (tail == ch->head_cache) {
+    ch->head_cache = __atomic_load_n(&ch->head, __ATOMIC_ACQUIRE);
+    if (tail == ch->head_cache) return 0;
+  }
+  m = ch->slots[tail & ch->mask];
+  __atomic_store_n(&ch->tail, tail + 1, __ATOMIC_RELEASE);
+  *v = baik_msg_decode(baik, m);
+  free(m);
+  return 1;
 }
 
-void baik_mem_set_ptr(void *ptr, void *val) {
-  *(void **) ptr = val;
+// Values sent with kanal.kirim go to tx, kanal.terima takes them from rx.
+// The instance must be the only producer of tx and consumer of rx.
+void baik_set_kanal(struct baik *baik, struct baik_chan *tx,
+                    struct baik_chan *rx) {
+  baik->chan_tx = tx;
+  baik->chan_rx = rx;
 }
 
-double baik_mem_get_dbl(void *ptr) {
-  double v;
-  memcpy(&v, ptr, sizeof(v));
-  return v;
+static void baik_kanal_kirim(struct baik *baik) {
+  int sent = 0;
+  if (baik->chan_tx != NULL) {
+    sent = baik_chan_send(baik, baik->chan_tx, baik_arg(baik, 0));
+  }
+  if (sent < 0) {
+    baik_set_errorf(baik, BAIK_TYPE_ERROR,
+                    "nilai ini tidak bisa dikirim lewat kanal");
+  }
+  baik_return(baik, baik_mk_boolean(baik, sent > 0));
 }
 
-void baik_mem_set_dbl(void *ptr, double val) {
-  memcpy(ptr, &val, sizeof(val));
+static void baik_kanal_terima(struct baik *baik) {
+  baik_val_t v = BAIK_UNDEFINED;
+  if (baik->chan_rx != NULL) {
+    baik_chan_recv(baik, baik->chan_rx, &v);
+  }
+  baik_return(baik, v);
 }
 
-double baik_mem_get_uint(void *ptr, int size, int bigendian) {
-  uint8_t *p = (uint8_t *) ptr;
-  int i, inc = bigendian ? 1 : -1;
-  unsigned int res = 0;
-  p += bigendian ? 0 : size - 1;
-  for (i = 0; i < size; i++, p += inc) {
-    res <<= 8;
-    res |= *p;
+static void baik_events_destroy(struct baik *baik) {
+  struct baik_event *ev;
+  struct baik_timer *t;
+  int i;
+  while ((ev = baik_ev_pop(baik)) != NULL) {
+    if (ev != &baik->ev_stub) free(ev);
+  }
+  for (i = 0; i < BAIK_TIMER_SLOTS; i++) {
+    while ((t = baik->timers[i]) != NULL) {
+      baik->timers[i] = t->next;
+      free(t);
+    }
+  }
+  while ((t = baik->timers_due) != NULL) {
+    baik->timers_due = t->next;
+    free(t);
   }
-  return res;
 }
 
-double baik_mem_get_int(void *ptr, int size, int bigendian) {
-  uint8_t *p = (uint8_t *) ptr;
-  int i, inc = bigendian ? 1 : -1;
-  int res = 0;
-  p += bigendian ? 0 : size - 1;
-
-  for (i = 0; i < size; i++, p += inc) {
-    res <<= 8;
-    res |= *p;
+static void baik_events_mark(struct baik *baik) {
+  struct baik_event *ev;
+  struct baik_timer *t;
+  int i;
+  for (i = 0; i < BAIK_TIMER_SLOTS; i++) {
+    for (t = baik->timers[i]; t != NULL; t = t->next) {
+      gc_mark(baik, &t->func);
+    }
   }
-
-  {
-    int extra = sizeof(res) - size;
-    for (i = 0; i < extra; i++) res <<= 8;
-    for (i = 0; i < extra; i++) res >>= 8;
+  for (t = baik->timers_due; t != NULL; t = t->next) {
+    gc_mark(baik, &t->func);
+  }
+  for (ev = baik->ev_tail; ev != NULL;
+       ev = __atomic_load_n(&ev->next, __ATOMIC_ACQUIRE)) {
+    gc_mark_bcode(baik, ev->func);
   }
-
-  return res;
 }
 
-void baik_mem_set_uint(void *ptr, unsigned int val, int size, int bigendian) {
-  uint8_t *p = (uint8_t *) ptr + (bigendian ? size - 1 : 0);
-  int i, inc = bigendian ? -1 : 1;
-  for (i = 0; i < size; i++, p += inc) {
-    *p = val & 0xff;
-    val >>= 8;
-  }
-}
-
-void baik_mem_set_int(void *ptr, int val, int size, int bigendian) {
-  baik_mem_set_uint(ptr, val, size, bigendian);
-}
-
-#if BAIK_GENERATE_INAC && defined(BAIK_EM_MMAP)
-#include <sys/mman.h>
-#endif
-
-static void call_stack_push_frame(struct baik *baik, size_t offset,
-                                  baik_val_t retval_stack_idx) {
- 
-  baik_val_t this_obj = baik_pop_val(&baik->arg_stack);
-  push_baik_val(&baik->call_stack, baik->vals.this_obj);
-  baik->vals.this_obj = this_obj;
-  push_baik_val(&baik->call_stack, baik_mk_number(baik, (double) offset));
-  push_baik_val(&baik->call_stack,
-               baik_mk_number(baik, (double) baik_stack_size(&baik->scopes)));
-  push_baik_val(
-      &baik->call_stack,
-      baik_mk_number(baik, (double) baik_stack_size(&baik->loop_addresses)));
-  push_baik_val(&baik->call_stack, retval_stack_idx);
-}
-
-
-static size_t call_stack_restore_frame(struct baik *baik) {
-  size_t retval_stack_idx, return_address, scope_index, loop_addr_index;
-  assert(baik_stack_size(&baik->call_stack) >= CALL_STACK_FRAME_ITEMS_CNT);
+// Globals every instance starts with. The tables stay in flash; an entry
+// becomes a property of the global object the first time a script looks
+// its name up, so an instance only spends RAM on the builtins it uses.
+enum baik_builtin_kind {
+  BAIK_BUILTIN_FUNC,
+  BAIK_BUILTIN_OBJECT,
+  BAIK_BUILTIN_GLOBAL,
+  BAIK_BUILTIN_NAN
+};
 
-  retval_stack_idx = baik_get_int(baik, baik_pop_val(&baik->call_stack));
-  loop_addr_index = baik_get_int(baik, baik_pop_val(&baik->call_stack));
-  scope_index = baik_get_int(baik, baik_pop_val(&baik->call_stack));
-  return_address = baik_get_int(baik, baik_pop_val(&baik->call_stack));
-  baik->vals.this_obj = baik_pop_val(&baik->call_stack);
+struct baik_builtin {
+  const char *name;
+  enum baik_builtin_kind kind;
+  baik_func_ptr_t fn;
+  const struct baik_builtin *members;
+};
 
-  while (baik_stack_size(&baik->scopes) > scope_index) {
-    baik_pop_val(&baik->scopes);
-  }
+#define BAIK_BUILTIN_FN(name, fn) \
+  { name, BAIK_BUILTIN_FUNC, (baik_func_ptr_t) fn, NULL }
+#define BAIK_BUILTIN_OBJ(name, members) \
+  { name, BAIK_BUILTIN_OBJECT, NULL, members }
+#define BAIK_BUILTIN_END \
+  { NULL, BAIK_BUILTIN_FUNC, NULL, NULL }
+
+static const struct baik_builtin baik_json_builtins[] = {
+    BAIK_BUILTIN_FN("stringify", baik_op_json_stringify),
+    BAIK_BUILTIN_FN("parse", baik_op_json_parse),
+    BAIK_BUILTIN_END,
+};
 
-  while (baik_stack_size(&baik->loop_addresses) > loop_addr_index) {
-    baik_pop_val(&baik->loop_addresses);
-  }
+static const struct baik_builtin baik_kanal_builtins[] = {
+    BAIK_BUILTIN_FN("kirim", baik_kanal_kirim),
+    BAIK_BUILTIN_FN("terima", baik_kanal_terima),
+    BAIK_BUILTIN_END,
+};
 
-  baik->stack.len = retval_stack_idx * sizeof(baik_val_t);
+static const struct baik_builtin baik_object_builtins[] = {
+    BAIK_BUILTIN_FN("create", baik_op_create_object),
+    BAIK_BUILTIN_END,
+};
 
-  return return_address;
-}
+static const struct baik_builtin baik_global_builtins[] = {
+    {"global", BAIK_BUILTIN_GLOBAL, NULL, NULL},
+    BAIK_BUILTIN_FN("muat", baik_load),
+    BAIK_BUILTIN_FN("tulis", baik_print),
+    BAIK_BUILTIN_FN("mkstr", baik_mkstr),
+    BAIK_BUILTIN_FN("getBAIK", baik_get_baik),
+    BAIK_BUILTIN_FN("die", baik_die),
+    BAIK_BUILTIN_FN("gc", baik_do_gc),
+    BAIK_BUILTIN_FN("chr", baik_chr),
+    BAIK_BUILTIN_FN("setelah", baik_setelah),
+    BAIK_BUILTIN_FN("setiap", baik_setiap),
+    BAIK_BUILTIN_FN("batalkan", baik_batalkan),
+    BAIK_BUILTIN_FN("tugas", baik_tugas),
+    BAIK_BUILTIN_FN("tunggu", baik_tunggu),
+    BAIK_BUILTIN_FN("s2o", baik_s2o),
+    BAIK_BUILTIN_OBJ("JSON", baik_json_builtins),
+    BAIK_BUILTIN_OBJ("kanal", baik_kanal_builtins),
+    BAIK_BUILTIN_OBJ("Object", baik_object_builtins),
+    {"NaN", BAIK_BUILTIN_NAN, NULL, NULL},
+    BAIK_BUILTIN_FN("isNaN", baik_op_isnan),
+    BAIK_BUILTIN_END,
+};
 
-static baik_val_t baik_find_scope(struct baik *baik, baik_val_t key) {
-  size_t num_scopes = baik_stack_size(&baik->scopes);
-  while (num_scopes > 0) {
-    baik_val_t scope = *vptr(&baik->scopes, num_scopes - 1);
-    num_scopes--;
-    if (baik_get_own_property_v(baik, scope, key) != NULL) return scope;
+static const struct baik_builtin *baik_builtin_find(
+    const struct baik_builtin *t, const char *name, size_t len) {
+  for (; t->name != NULL; t++) {
+    if (t->name[0] == name[0] && strlen(t->name) == len &&
+        memcmp(t->name, name, len) == 0) {
+      return t;
+    }
   }
-  baik_set_errorf(baik, BAIK_REFERENCE_ERROR, "[%s] tidak terdefinisikan",
-                 baik_get_cstring(baik, &key));
-  return BAIK_UNDEFINED;
+  return NULL;
 }
 
-baik_val_t baik_get_this(struct baik *baik) {
-  return baik->vals.this_obj;
+// Adds a property named after a table entry to an object that does not
+// have it yet. Long names point into the table instead of being copied.
+static struct baik_property *baik_builtin_add(struct baik *baik,
+                                              baik_val_t obj,
+                                              const char *name,
+                                              baik_val_t v) {
+  size_t len = strlen(name);
+  struct baik_object *o = get_object_struct(obj);
+  struct baik_property *p =
+      baik_mk_property(baik, baik_mk_string(baik, name, len, len <= 5), v);
+  p->next = o->properties;
+  o->properties = p;
+  return p;
 }
 
-static double do_arith_op(double da, double db, int op, bool *resnan) {
-  *resnan = false;
+BAIK_PRIVATE struct baik_property *baik_builtin_materialize(
+    struct baik *baik, baik_val_t global, const char *name, size_t len) {
+  const struct baik_builtin *b, *m;
+  baik_val_t v;
 
-  if (isnan(da) || isnan(db)) {
-    *resnan = true;
-    return 0;
+  if (len == 0 || (b = baik_builtin_find(baik_global_builtins, name, len)) == NULL) {
+    return NULL;
   }
- 
-  switch (op) {
-    case TOK_MINUS:   return da - db;
-    case TOK_PLUS:    return da + db;
-    case TOK_MUL:     return da * db;
-    case TOK_DIV:
-      if (db != 0) {
-        return da / db;
-      } else {
-       
-        *resnan = true;
-        return 0;
-      }
-    case TOK_REM:
-     
-      db = (int) db;
-      if (db != 0) {
-        bool neg = false;
-        if (da < 0) {
-          neg = true;
-          da = -da;
-        }
-        if (db < 0) {
-          db = -db;
-        }
-        da = (double) ((int64_t) da % (int64_t) db);
-        if (neg) {
-          da = -da;
-        }
-        return da;
-      } else {
-        *resnan = true;
-        return 0;
+  switch (b->kind) {
+    case BAIK_BUILTIN_OBJECT:
+      v = baik_mk_object(baik);
+      for (m = b->members; m->name != NULL; m++) {
+        baik_builtin_add(baik, v, m->name, baik_mk_foreign_func(baik, m->fn));
       }
-    case TOK_AND:     return (double) ((int64_t) da & (int64_t) db);
-    case TOK_OR:      return (double) ((int64_t) da | (int64_t) db);
-    case TOK_XOR:     return (double) ((int64_t) da ^ (int64_t) db);
-    case TOK_LSHIFT:  return (double) ((int64_t) da << (int64_t) db);
-    case TOK_RSHIFT:  return (double) ((int64_t) da >> (int64_t) db);
-    case TOK_URSHIFT: return (double) ((uint32_t) da >> (uint32_t) db);
+      break;
+    case BAIK_BUILTIN_GLOBAL:
+      v = global;
+      break;
+    case BAIK_BUILTIN_NAN:
+      v = BAIK_TAG_NAN;
+      break;
+    default:
+      v = baik_mk_foreign_func(baik, b->fn);
+      break;
   }
- 
-  *resnan = true;
-  return 0;
+  return baik_builtin_add(baik, global, b->name, v);
 }
 
-static void set_no_autoconversion_error(struct baik *baik) {
-  baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
-                     "galat : konversi tipe implisit dilarang");
-}
+BAIK_PRIVATE baik_err_t baik_to_string(struct baik *baik, baik_val_t *v, char **p,
+                                    size_t *sizep, int *need_free) {
+  baik_err_t ret = BAIK_OK;
 
-static baik_val_t do_op(struct baik *baik, baik_val_t a, baik_val_t b, int op) {
-  baik_val_t ret = BAIK_UNDEFINED;
-  bool resnan = false;
-  if ((baik_is_foreign(a) || baik_is_number(a)) &&
-      (baik_is_foreign(b) || baik_is_number(b))) {
-    int is_result_ptr = 0;
-    double da, db, result;
+  *p = NULL;
+  *sizep = 0;
+  *need_free = 0;
 
-    if (baik_is_foreign(a) && baik_is_foreign(b)) {
-      if (op != TOK_MINUS) {
-        baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : operan tidak valid");
-      }
-    } else if (baik_is_foreign(a) || baik_is_foreign(b)) {
-      if (op != TOK_MINUS && op != TOK_PLUS) {
-        baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : operan tidak valid");
-      }
-      is_result_ptr = 1;
+  if (baik_is_string(*v)) {
+    *p = (char *) baik_get_string(baik, v, sizep);
+  } else if (baik_is_number(*v)) {
+    char buf[50] = "";
+    struct json_out out = JSON_OUT_BUF(buf, sizeof(buf));
+    baik_jprintf(*v, baik, &out);
+    *sizep = strlen(buf);
+    *p = malloc(*sizep + 1);
+    if (*p == NULL) {
+      ret = BAIK_OUT_OF_MEMORY;
+      goto clean;
     }
-    da = baik_is_number(a) ? baik_get_double(baik, a)
-                          : (double) (uintptr_t) baik_get_ptr(baik, a);
-    db = baik_is_number(b) ? baik_get_double(baik, b)
-                          : (double) (uintptr_t) baik_get_ptr(baik, b);
-    result = do_arith_op(da, db, op, &resnan);
-    if (resnan) {
-      ret = BAIK_TAG_NAN;
+    memmove(*p, buf, *sizep + 1);
+    *need_free = 1;
+  } else if (baik_is_boolean(*v)) {
+    if (baik_get_bool(baik, *v)) {
+      *p = "benar";
+      *sizep = 5;
     } else {
-     
-      ret = is_result_ptr ? baik_mk_foreign(baik, (void *) (uintptr_t) result)
-                          : baik_mk_number(baik, result);
+      *p = "salah";
+      *sizep = 5;
     }
-  } else if (baik_is_string(a) && baik_is_string(b) && (op == TOK_PLUS)) {
-    ret = s_concat(baik, a, b);
+  } else if (baik_is_undefined(*v)) {
+    *p = "takterdefinisi";
+    *sizep = 14;
+  } else if (baik_is_null(*v)) {
+    *p = "kosong";
+    *sizep = 6;
+  } else if (baik_is_object(*v)) {
+    ret = BAIK_TYPE_ERROR;
+    baik_set_errorf(baik, ret,
+                   "conversion from object to string is not supported");
+  } else if (baik_is_foreign(*v)) {
+    *p = "TODO_foreign";
+    *sizep = 12;
   } else {
-    set_no_autoconversion_error(baik);
+    ret = BAIK_TYPE_ERROR;
+    baik_set_errorf(baik, ret, "unknown type to convert to string");
   }
+
+clean:
   return ret;
 }
 
-static void op_assign(struct baik *baik, int op) {
-  baik_val_t val = baik_pop(baik);
-  baik_val_t obj = baik_pop(baik);
-  baik_val_t key = baik_pop(baik);
-  if (baik_is_object(obj) && baik_is_string(key)) {
-    baik_val_t v = baik_get_v(baik, obj, key);
-    baik_set_v(baik, obj, key, do_op(baik, v, val, op));
-    baik_push(baik, v);
-  } else {
-    baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand");
-  }
+BAIK_PRIVATE baik_val_t baik_to_boolean_v(struct baik *baik, baik_val_t v) {
+  size_t len;
+  int is_truthy;
+
+  is_truthy =
+      ((baik_is_boolean(v) && baik_get_bool(baik, v)) ||
+       (baik_is_number(v) && baik_get_double(baik, v) != 0.0) ||
+       (baik_is_string(v) && baik_get_string(baik, &v, &len) && len > 0) ||
+       (baik_is_function(v)) || (baik_is_foreign(v)) || (baik_is_object(v))) &&
+      v != BAIK_TAG_NAN;
+
+  return baik_mk_boolean(baik, is_truthy);
 }
 
-static int check_equal(struct baik *baik, baik_val_t a, baik_val_t b) {
-  int ret = 0;
-  if (a == BAIK_TAG_NAN && b == BAIK_TAG_NAN) {
-    ret = 0;
-  } else if (a == b) {
-    ret = 1;
-  } else if (baik_is_number(a) && baik_is_number(b)) {
-    ret = 0;
-  } else if (baik_is_string(a) && baik_is_string(b)) {
-    ret = s_cmp(baik, a, b) == 0;
-  } else if (baik_is_foreign(a) && b == BAIK_NULL) {
-    ret = baik_get_ptr(baik, a) == NULL;
-  } else if (a == BAIK_NULL && baik_is_foreign(b)) {
-    ret = baik_get_ptr(baik, b) == NULL;
-  } else {
-    ret = 0;
-  }
-  return ret;
+BAIK_PRIVATE int baik_is_truthy(struct baik *baik, baik_val_t v) {
+  return baik_get_bool(baik, baik_to_boolean_v(baik, v));
 }
 
-static void exec_expr(struct baik *baik, int op) {
-  switch (op) {
-    case TOK_DOT:
-      break;
-    case TOK_MINUS:
-    case TOK_PLUS:
-    case TOK_MUL:
-    case TOK_DIV:
-    case TOK_REM:
-    case TOK_XOR:
-    case TOK_AND:
-    case TOK_OR:
-    case TOK_LSHIFT:
-    case TOK_RSHIFT:
-    case TOK_URSHIFT: {
-      baik_val_t b = baik_pop(baik);
-      baik_val_t a = baik_pop(baik);
-      baik_push(baik, do_op(baik, a, b, op));
-      break;
-    }
-    case TOK_UNARY_MINUS: {
-      double a = baik_get_double(baik, baik_pop(baik));
-      baik_push(baik, baik_mk_number(baik, -a));
-      break;
-    }
-    case TOK_NOT: {
-      baik_val_t val = baik_pop(baik);
-      baik_push(baik, baik_mk_boolean(baik, !baik_is_truthy(baik, val)));
-      break;
-    }
-    case TOK_TILDA: {
-      double a = baik_get_double(baik, baik_pop(baik));
-      baik_push(baik, baik_mk_number(baik, (double) (~(int64_t) a)));
-      break;
-    }
-    case TOK_UNARY_PLUS:
-      break;
-    case TOK_EQ:
-      baik_set_errorf(baik, BAIK_NOT_IMPLEMENTED_ERROR, "Use ===, not ==");
-      break;
-    case TOK_NE:
-      baik_set_errorf(baik, BAIK_NOT_IMPLEMENTED_ERROR, "Use !==, not !=");
-      break;
-    case TOK_EQ_EQ: {
-      baik_val_t a = baik_pop(baik);
-      baik_val_t b = baik_pop(baik);
-      baik_push(baik, baik_mk_boolean(baik, check_equal(baik, a, b)));
-      break;
-    }
-    case TOK_NE_NE: {
-      baik_val_t a = baik_pop(baik);
-      baik_val_t b = baik_pop(baik);
-      baik_push(baik, baik_mk_boolean(baik, !check_equal(baik, a, b)));
-      break;
-    }
-    case TOK_LT: {
-      double b = baik_get_double(baik, baik_pop(baik));
-      double a = baik_get_double(baik, baik_pop(baik));
-      baik_push(baik, baik_mk_boolean(baik, a < b));
-      break;
-    }
-    case TOK_GT: {
-      double b = baik_get_double(baik, baik_pop(baik));
-      double a = baik_get_double(baik, baik_pop(baik));
-      baik_push(baik, baik_mk_boolean(baik, a > b));
-      break;
-    }
-    case TOK_LE: {
-      double b = baik_get_double(baik, baik_pop(baik));
-      double a = baik_get_double(baik, baik_pop(baik));
-      baik_push(baik, baik_mk_boolean(baik, a <= b));
-      break;
-    }
-    case TOK_GE: {
-      double b = baik_get_double(baik, baik_pop(baik));
-      double a = baik_get_double(baik, baik_pop(baik));
-      baik_push(baik, baik_mk_boolean(baik, a >= b));
-      break;
-    }
-    case TOK_ASSIGN: {
-      baik_val_t val = baik_pop(baik);
-      baik_val_t obj = baik_pop(baik);
-      baik_val_t key = baik_pop(baik);
-      if (baik_is_object(obj)) {
-        baik_set_v(baik, obj, key, val);
-      } else if (baik_is_foreign(obj)) {
-       
-
-        int ikey = baik_get_int(baik, key);
-        int ival = baik_get_int(baik, val);
+#ifndef BAIK_OBJECT_ARENA_SIZE
+#define BAIK_OBJECT_ARENA_SIZE 20
+#endif
+#ifndef BAIK_PROPERTY_ARENA_SIZE
+#define BAIK_PROPERTY_ARENA_SIZE 20
+#endif
+#ifndef BAIK_FUNC_FFI_ARENA_SIZE
+#define BAIK_FUNC_FFI_ARENA_SIZE 20
+#endif
+#ifndef BAIK_OBJECT_ARENA_INC_SIZE
+#define BAIK_OBJECT_ARENA_INC_SIZE 10
+#endif
+#ifndef BAIK_PROPERTY_ARENA_INC_SIZE
+#define BAIK_PROPERTY_ARENA_INC_SIZE 10
+#endif
+#ifndef BAIK_FUNC_FFI_ARENA_INC_SIZE
+#define BAIK_FUNC_FFI_ARENA_INC_SIZE 10
+#endif
 
-        if (!baik_is_number(key)) {
-          baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : index harus angka");
-          val = BAIK_UNDEFINED;
-        } else if (!baik_is_number(val) || ival < 0 || ival > 0xff) {
-          baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
-                             "GALAT : hanya angka 0 .. 255 yang bisa digunakan");
-          val = BAIK_UNDEFINED;
-        } else {
-          uint8_t *ptr = (uint8_t *) baik_get_ptr(baik, obj);
-          *(ptr + ikey) = (uint8_t) ival;
-        }
-      } else {
-        baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tipe objek tidak didukung");
-      }
-      baik_push(baik, val);
-      break;
-    }
-    case TOK_POSTFIX_PLUS: {
-      baik_val_t obj = baik_pop(baik);
-      baik_val_t key = baik_pop(baik);
-      if (baik_is_object(obj) && baik_is_string(key)) {
-        baik_val_t v = baik_get_v(baik, obj, key);
-        baik_val_t v1 = do_op(baik, v, baik_mk_number(baik, 1), TOK_PLUS);
-        baik_set_v(baik, obj, key, v1);
-        baik_push(baik, v);
-      } else {
-        baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand for ++");
-      }
-      break;
-    }
-    case TOK_POSTFIX_MINUS: {
-      baik_val_t obj = baik_pop(baik);
-      baik_val_t key = baik_pop(baik);
-      if (baik_is_object(obj) && baik_is_string(key)) {
-        baik_val_t v = baik_get_v(baik, obj, key);
-        baik_val_t v1 = do_op(baik, v, baik_mk_number(baik, 1), TOK_MINUS);
-        baik_set_v(baik, obj, key, v1);
-        baik_push(baik, v);
-      } else {
-        baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand for --");
-      }
-      break;
-    }
-    case TOK_MINUS_MINUS: {
-      baik_val_t obj = baik_pop(baik);
-      baik_val_t key = baik_pop(baik);
-      if (baik_is_object(obj) && baik_is_string(key)) {
-        baik_val_t v = baik_get_v(baik, obj, key);
-        v = do_op(baik, v, baik_mk_number(baik, 1), TOK_MINUS);
-        baik_set_v(baik, obj, key, v);
-        baik_push(baik, v);
-      } else {
-        baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand for --");
-      }
-      break;
-    }
-    case TOK_PLUS_PLUS: {
-      baik_val_t obj = baik_pop(baik);
-      baik_val_t key = baik_pop(baik);
-      if (baik_is_object(obj) && baik_is_string(key)) {
-        baik_val_t v = baik_get_v(baik, obj, key);
-        v = do_op(baik, v, baik_mk_number(baik, 1), TOK_PLUS);
-        baik_set_v(baik, obj, key, v);
-        baik_push(baik, v);
-      } else {
-        baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand for ++");
-      }
-      break;
+void baik_destroy(struct baik *baik) {
+  {
+    int parts_cnt = baik_bcode_parts_cnt(baik);
+    int i;
+    for (i = 0; i < parts_cnt; i++) {
+      baik_bcode_part_release(baik_bcode_part_get(baik, i));
     }
-   
-
-   
-    case TOK_MINUS_ASSIGN:    op_assign(baik, TOK_MINUS);    break;
-    case TOK_PLUS_ASSIGN:     op_assign(baik, TOK_PLUS);     break;
-    case TOK_MUL_ASSIGN:      op_assign(baik, TOK_MUL);      break;
-    case TOK_DIV_ASSIGN:      op_assign(baik, TOK_DIV);      break;
-    case TOK_REM_ASSIGN:      op_assign(baik, TOK_REM);      break;
-    case TOK_AND_ASSIGN:      op_assign(baik, TOK_AND);      break;
-    case TOK_OR_ASSIGN:       op_assign(baik, TOK_OR);       break;
-    case TOK_XOR_ASSIGN:      op_assign(baik, TOK_XOR);      break;
-    case TOK_LSHIFT_ASSIGN:   op_assign(baik, TOK_LSHIFT);   break;
-    case TOK_RSHIFT_ASSIGN:   op_assign(baik, TOK_RSHIFT);   break;
-    case TOK_URSHIFT_ASSIGN:  op_assign(baik, TOK_URSHIFT);  break;
-    case TOK_COMMA: break;
-   
-    case TOK_KEYWORD_TIPE:
-      baik_push(baik, baik_mk_string(baik, baik_typeof(baik_pop(baik)), ~0, 1));
-      break;
-    default:
-      LOG(LL_ERROR, ("Unknown expr: %d", op));
-      break;
   }
+
+  mbuf_free(&baik->bcode_gen);
+  mbuf_free(&baik->bcode_parts);
+  mbuf_free(&baik->stack);
+  mbuf_free(&baik->call_stack);
+  mbuf_free(&baik->arg_stack);
+  mbuf_free(&baik->owned_strings);
+  mbuf_free(&baik->foreign_strings);
+  mbuf_free(&baik->owned_values);
+  mbuf_free(&baik->scopes);
+  mbuf_free(&baik->loop_addresses);
+  mbuf_free(&baik->json_visited_stack);
+  free(baik->error_msg);
+  free(baik->stack_trace);
+  baik_events_destroy(baik);
+  baik_tasks_destroy(baik);
+  baik_ctx_free(&baik->scratch);
+  //baik_ffi_args_free_list(baik);
+#if BAIK_GC_THREADS
+  gc_helper_destroy(baik->gc_helper);
+#endif
+  gc_arena_destroy(baik, &baik->object_arena);
+  gc_arena_destroy(baik, &baik->property_arena);
+  gc_arena_destroy(baik, &baik->ffi_sig_arena);
+  free(baik);
 }
 
-static int getprop_builtin_string(struct baik *baik, baik_val_t val,
-                                  const char *name, size_t name_len,
-                                  baik_val_t *res) {
-  int isnum = 0;
-  int idx = cstr_to_ulong(name, name_len, &isnum);
+struct baik *baik_create(void) {
+  baik_val_t global_object;
+  struct baik *baik = calloc(1, sizeof(*baik));
+  baik->ev_head = baik->ev_tail = &baik->ev_stub;
+  mbuf_init(&baik->stack, 0);
+  mbuf_init(&baik->call_stack, 0);
+  mbuf_init(&baik->arg_stack, 0);
+  mbuf_init(&baik->owned_strings, 0);
+  mbuf_init(&baik->foreign_strings, 0);
+  mbuf_init(&baik->bcode_gen, 0);
+  mbuf_init(&baik->bcode_parts, 0);
+  mbuf_init(&baik->owned_values, 0);
+  mbuf_init(&baik->scopes, 0);
+  mbuf_init(&baik->loop_addresses, 0);
+  mbuf_init(&baik->json_visited_stack, 0);
 
-  if (strcmp(name, "panjang") == 0) {
-    size_t val_len;
-    baik_get_string(baik, &val, &val_len);
-    *res = baik_mk_number(baik, (double) val_len);
-    return 1;
-  } else if (strcmp(name, "at") == 0 || strcmp(name, "charCodeAt") == 0) {
-    *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_string_char_code_at);
-    return 1;
-  } else if (strcmp(name, "indexOf") == 0) {
-    *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_string_index_of);
-    return 1;
-  } else if (strcmp(name, "slice") == 0) {
-    *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_string_slice);
-    return 1;
-  } else if (isnum) {
-   
-    size_t val_len;
-    const char *str = baik_get_string(baik, &val, &val_len);
-    if (idx >= 0 && idx < (int) val_len) {
-      *res = baik_mk_string(baik, str + idx, 1, 1);
-    } else {
-      *res = BAIK_UNDEFINED;
-    }
-    return 1;
+  baik->bcode_len = 0;
+ 
+  {
+    char z = 0;
+    mbuf_append(&baik->owned_strings, &z, 1);
   }
-  return 0;
-}
 
-static int getprop_builtin_array(struct baik *baik, baik_val_t val,
-                                 const char *name, size_t name_len,
-                                 baik_val_t *res) {
-  if (strcmp(name, "splice") == 0) {
-    *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_array_splice);
-    return 1;
-  } else if (strcmp(name, "push") == 0) {
-    *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_array_push_internal);
-    return 1;
-  } else if (strcmp(name, "panjang") == 0) {
-    *res = baik_mk_number(baik, baik_array_length(baik, val));
-    return 1;
-  }
+  gc_arena_init(&baik->object_arena, sizeof(struct baik_object),
+                BAIK_OBJECT_ARENA_SIZE, BAIK_OBJECT_ARENA_INC_SIZE);
+  gc_arena_init(&baik->property_arena, sizeof(struct baik_property),
+                BAIK_PROPERTY_ARENA_SIZE, BAIK_PROPERTY_ARENA_INC_SIZE);
+  // gc_arena_init(&baik->ffi_sig_arena, sizeof(struct baik_ffi_sig),
+  //               BAIK_FUNC_FFI_ARENA_SIZE, BAIK_FUNC_FFI_ARENA_INC_SIZE);
+  // baik->ffi_sig_arena.destructor = baik_ffi_sig_destructor;
+#if BAIK_GC_THREADS
+  baik->gc_helper = gc_helper_create(baik);
+#endif
 
-  (void) name_len;
-  return 0;
+  global_object = baik_mk_object(baik);
+  // baik_set_ffi_resolver(baik, dlsym);
+  push_baik_val(&baik->scopes, global_object);
+  baik_ctx_init(&baik->scratch, global_object, -1);
+  baik->vals.this_obj = BAIK_UNDEFINED;
+  baik->vals.dataview_proto = BAIK_UNDEFINED;
+
+  return baik;
 }
 
-static int getprop_builtin_foreign(struct baik *baik, baik_val_t val,
-                                   const char *name, size_t name_len,
-                                   baik_val_t *res) {
-  int isnum = 0;
-  int idx = cstr_to_ulong(name, name_len, &isnum);
+static void baik_ctx_reset(struct baik_ctx *c, baik_val_t global,
+                           int call_stack_base) {
+  c->stack.len = 0;
+  c->call_stack.len = 0;
+  c->arg_stack.len = 0;
+  c->scopes.len = 0;
+  c->loop_addresses.len = 0;
+  push_baik_val(&c->scopes, global);
+  c->this_obj = BAIK_UNDEFINED;
+  c->last_getprop_obj = BAIK_UNDEFINED;
+  c->cur_bcode_offset = 0;
+  c->call_stack_base = call_stack_base;
+  c->error = BAIK_OK;
+  memset(&c->susp, 0, sizeof(c->susp));
+  c->suspended = 0;
+  c->saved = 1;
+}
+
+// Drops everything the scripts left behind, builtins included.
+static void baik_reset_state(struct baik *baik) {
+  int i;
 
-  if (!isnum) {
-    baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : index harus angka");
-  } else {
-    uint8_t *ptr = (uint8_t *) baik_get_ptr(baik, val);
-    *res = baik_mk_number(baik, *(ptr + idx));
+  for (i = 0; i < baik_bcode_parts_cnt(baik); i++) {
+    baik_bcode_part_release(baik_bcode_part_get(baik, i));
   }
-  return 1;
+  baik->bcode_parts.len = 0;
+  baik->bcode_gen.len = 0;
+  baik->bcode_len = 0;
+  baik->bcode_unreclaimed = 0;
+  baik->stack.len = 0;
+  baik->call_stack.len = 0;
+  baik->arg_stack.len = 0;
+  baik->scopes.len = 0;
+  baik->loop_addresses.len = 0;
+  baik->owned_strings.len = 1;
+  baik->foreign_strings.len = 0;
+  baik->owned_values.len = 0;
+  baik->json_visited_stack.len = 0;
+
+  free(baik->error_msg);
+  free(baik->stack_trace);
+  baik->error_msg = NULL;
+  baik->stack_trace = NULL;
+  baik->error = BAIK_OK;
+  baik->cur_bcode_offset = 0;
+
+  memset(&baik->susp, 0, sizeof(baik->susp));
+  baik->ticks_used = 0;
+  baik->interrupted = 0;
+  baik->call_stack_base = 0;
+  baik->wake_us = 0;
+
+  baik_tasks_destroy(baik);
+  baik->task_seq = 0;
+  memset(&baik->parked, 0, sizeof(baik->parked));
+
+  // No other task may post events while the instance is being reset.
+  baik_events_destroy(baik);
+  baik->ev_stub.next = NULL;
+  baik->ev_head = baik->ev_tail = &baik->ev_stub;
+  baik->timer_tick = 0;
+  baik->timer_seq = 0;
+  baik->timers_cnt = 0;
+  baik->timer_firing = 0;
+  memset(&baik->ev_stats, 0, sizeof(baik->ev_stats));
+  memset(&baik->quicken, 0, sizeof(baik->quicken));
+
+  baik->inhibit_gc = 0;
+  baik->need_gc = 0;
+  baik->bcode_reclaim = 0;
+  baik->suspended = 0;
+  baik->budget_out = 0;
+  baik->resumable = 0;
+  baik->yield_req = 0;
+
+  gc_reset(baik);
+  memset(&baik->vals, 0, sizeof(baik->vals));
+}
+
+// Brings the instance back to what baik_create returns, but keeps the arena
+// blocks, stacks and string heap it has grown so nothing is reallocated.
+// Settings made by the host (budget, kanal, .inac generation) survive.
+// Values owned with baik_own are forgotten.
+baik_err_t baik_reset(struct baik *baik) {
+  baik_val_t global_object;
+
+  if (baik->exec_depth != 0) {
+    return baik_set_errorf(baik, BAIK_INTERNAL_ERROR,
+                           "tidak bisa reset saat skrip berjalan");
+  }
+
+  baik_reset_state(baik);
+  global_object = baik_mk_object(baik);
+  push_baik_val(&baik->scopes, global_object);
+  baik_ctx_reset(&baik->scratch, global_object, -1);
+  baik->vals.this_obj = BAIK_UNDEFINED;
+  baik->vals.dataview_proto = BAIK_UNDEFINED;
+
+  return BAIK_OK;
 }
 
-static void baik_apply_(struct baik *baik) {
-  baik_val_t res = BAIK_UNDEFINED, *args = NULL;
-  baik_val_t func = baik->vals.this_obj, v = baik_arg(baik, 1);
-  int i, nargs = 0;
-  if (baik_is_array(v)) {
-    nargs = baik_array_length(baik, v);
-    args = calloc(nargs, sizeof(args[0]));
-    for (i = 0; i < nargs; i++) args[i] = baik_array_get(baik, v, i);
+baik_err_t baik_set_errorf(struct baik *baik, baik_err_t err, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  free(baik->error_msg);
+  baik->error_msg = NULL;
+  baik->error = err;
+  if (fmt != NULL) {
+    baik_generic_avprintf(&baik->error_msg, 0, fmt, ap);
   }
-  baik_apply(baik, &res, func, baik_arg(baik, 0), nargs, args);
-  free(args);
-  baik_return(baik, res);
+  va_end(ap);
+  return err;
 }
 
-static int getprop_builtin(struct baik *baik, baik_val_t val, baik_val_t name,
-                           baik_val_t *res) {
-  size_t n;
-  char *s = NULL;
-  int need_free = 0;
-  int handled = 0;
+baik_err_t baik_prepend_errorf(struct baik *baik, baik_err_t err, const char *fmt,
+                             ...) {
+  char *old_error_msg = baik->error_msg;
+  char *new_error_msg = NULL;
+  va_list ap;
+  va_start(ap, fmt);
 
-  baik_err_t err = baik_to_string(baik, &name, &s, &n, &need_free);
+  assert(err != BAIK_OK);
 
-  if (err == BAIK_OK) {
-    if (baik_is_string(val)) {
-      handled = getprop_builtin_string(baik, val, s, n, res);
-    } else if (s != NULL && n == 5 && strncmp(s, "apply", n) == 0) {
-      *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_apply_);
-      handled = 1;
-    } else if (baik_is_array(val)) {
-      handled = getprop_builtin_array(baik, val, s, n, res);
-    } else if (baik_is_foreign(val)) {
-      handled = getprop_builtin_foreign(baik, val, s, n, res);
-    }
+  baik->error_msg = NULL;
+ 
+  if (baik->error == BAIK_OK) {
+    baik->error = err;
   }
+  baik_generic_avprintf(&new_error_msg, 0, fmt, ap);
+  va_end(ap);
 
-  if (need_free) {
-    free(s);
-    s = NULL;
+  if (old_error_msg != NULL) {
+    baik_generic_asprintf(&baik->error_msg, 0, "%s: %s", new_error_msg, old_error_msg);
+    free(new_error_msg);
+    free(old_error_msg);
+  } else {
+    baik->error_msg = new_error_msg;
   }
-
-  return handled;
+  return err;
+}
+
+void baik_print_error(struct baik *baik, FILE *fp, const char *msg,
+                     int print_stack_trace) {
+  if (print_stack_trace && baik->stack_trace != NULL) {
+    fprintf(fp, "%s", baik->stack_trace);
+  }
+
+  if (msg == NULL) {
+    msg = "BAIK galat";
+  }
+
+  fprintf(fp, "%s: %s\n", msg, baik_strerror(baik, baik->error));
+}
+
+BAIK_PRIVATE void baik_die(struct baik *baik) {
+  baik_val_t msg_v = BAIK_UNDEFINED;
+  const char *msg = NULL;
+  size_t msg_len = 0;
+
+  if (!baik_check_arg(baik, 0, "msg", BAIK_TYPE_STRING, &msg_v)) {
+    goto clean;
+  }
+
+  msg = baik_get_string(baik, &msg_v, &msg_len);
+
+  baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "%.*s", (int) msg_len, msg);
+
+clean:
+  baik_return(baik, BAIK_UNDEFINED);
+}
+
+const char *baik_strerror(struct baik *baik, enum baik_err err) {
+  const char *err_names[] = {
+      "NO_ERROR",        "SYNTAX_ERROR",    "REFERENCE_ERROR",
+      "TYPE_ERROR",      "OUT_OF_MEMORY",   "INTERNAL_ERROR",
+      "NOT_IMPLEMENTED", "FILE_OPEN_ERROR", "BAD_ARGUMENTS",
+      "SUSPENDED",       "INTERRUPTED"};
+  return baik->error_msg == NULL || baik->error_msg[0] == '\0' ? err_names[err]
+                                                             : baik->error_msg;
+}
+
+BAIK_PRIVATE size_t baik_get_func_addr(baik_val_t v) {
+  return v & ~BAIK_TAG_MASK;
+}
+
+BAIK_PRIVATE enum baik_type baik_get_type(baik_val_t v) {
+  int tag;
+  if (baik_is_number(v)) {
+    return BAIK_TYPE_NUMBER;
+  }
+  tag = (v & BAIK_TAG_MASK) >> 48;
+  switch (tag) {
+    case BAIK_TAG_FOREIGN >> 48:
+      return BAIK_TYPE_FOREIGN;
+    case BAIK_TAG_UNDEFINED >> 48:
+      return BAIK_TYPE_UNDEFINED;
+    case BAIK_TAG_OBJECT >> 48:
+      return BAIK_TYPE_OBJECT_GENERIC;
+    case BAIK_TAG_ARRAY >> 48:
+      return BAIK_TYPE_OBJECT_ARRAY;
+    case BAIK_TAG_FUNCTION >> 48:
+      return BAIK_TYPE_OBJECT_FUNCTION;
+    case BAIK_TAG_STRING_I >> 48:
+    case BAIK_TAG_STRING_O >> 48:
+    case BAIK_TAG_STRING_F >> 48:
+    case BAIK_TAG_STRING_D >> 48:
+    case BAIK_TAG_STRING_5 >> 48:
+      return BAIK_TYPE_STRING;
+    case BAIK_TAG_BOOLEAN >> 48:
+      return BAIK_TYPE_BOOLEAN;
+    case BAIK_TAG_NULL >> 48:
+      return BAIK_TYPE_NULL;
+    default:
+      abort();
+      return BAIK_TYPE_UNDEFINED;
+  }
+}
+
+baik_val_t baik_get_global(struct baik *baik) {
+  return *vptr(&baik->scopes, 0);
+}
+
+static void baik_append_stack_trace_line(struct baik *baik, size_t offset) {
+  if (offset != BAIK_BCODE_OFFSET_EXIT) {
+    const char *filename = baik_get_bcode_filename_by_offset(baik, offset);
+    int line_no = baik_get_lineno_by_offset(baik, offset);
+    char *new_line = NULL;
+    const char *fmt = "  at %s:%d\n";
+    if (filename == NULL) {
+      fprintf(stderr,
+              "ERROR during stack trace generation: wrong bcode offset %d\n",
+              (int) offset);
+      filename = "<unknown-filename>";
+    }
+    baik_generic_asprintf(&new_line, 0, fmt, filename, line_no);
+
+    if (baik->stack_trace != NULL) {
+      char *old = baik->stack_trace;
+      baik_generic_asprintf(&baik->stack_trace, 0, "%s%s", baik->stack_trace, new_line);
+      free(old);
+      free(new_line);
+    } else {
+      baik->stack_trace = new_line;
+    }
+  }
+}
+
+BAIK_PRIVATE void baik_gen_stack_trace(struct baik *baik, size_t offset) {
+  baik_append_stack_trace_line(baik, offset);
+  while (baik->call_stack.len >=
+         sizeof(baik_val_t) * CALL_STACK_FRAME_ITEMS_CNT) {
+    int i;
+
+    offset = baik_get_int(
+        baik, *vptr(&baik->call_stack, -1 - CALL_STACK_FRAME_ITEM_RETURN_ADDR));
+
+    for (i = 0; i < CALL_STACK_FRAME_ITEMS_CNT; i++) {
+      baik_pop_val(&baik->call_stack);
+    }
+
+    baik_append_stack_trace_line(baik, offset);
+  }
+}
+
+void baik_own(struct baik *baik, baik_val_t *v) {
+  mbuf_append(&baik->owned_values, &v, sizeof(v));
+}
+
+int baik_disown(struct baik *baik, baik_val_t *v) {
+  baik_val_t **vp = (baik_val_t **) (baik->owned_values.buf +
+                                   baik->owned_values.len - sizeof(v));
+
+  for (; (char *) vp >= baik->owned_values.buf; vp--) {
+    if (*vp == v) {
+      *vp = *(baik_val_t **) (baik->owned_values.buf + baik->owned_values.len -
+                             sizeof(v));
+      baik->owned_values.len -= sizeof(v);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+BAIK_PRIVATE int baik_getretvalpos(struct baik *baik) {
+  int pos;
+  baik_val_t *ppos = vptr(&baik->call_stack, -1);
+  
+  assert(ppos != NULL && baik_is_number(*ppos));
+  pos = baik_get_int(baik, *ppos) - 1;
+  assert(pos < (int) baik_stack_size(&baik->stack));
+  return pos;
+}
+
+int baik_nargs(struct baik *baik) {
+  int top = baik_stack_size(&baik->stack);
+  int pos = baik_getretvalpos(baik) + 1;
+  
+  return pos > 0 && pos < top ? top - pos : 0;
+}
+
+baik_val_t baik_arg(struct baik *baik, int arg_index) {
+  baik_val_t res = BAIK_UNDEFINED;
+  int top = baik_stack_size(&baik->stack);
+  int pos = baik_getretvalpos(baik) + 1;
+  
+  if (pos > 0 && pos + arg_index < top) {
+    res = *vptr(&baik->stack, pos + arg_index);
+  }
+
+  return res;
+}
+
+void baik_return(struct baik *baik, baik_val_t v) {
+  int pos = baik_getretvalpos(baik);
+  
+  baik->stack.len = sizeof(baik_val_t) * pos;
+  baik_push(baik, v);
+}
+
+BAIK_PRIVATE baik_val_t vtop(struct mbuf *m) {
+  size_t size = baik_stack_size(m);
+  return size > 0 ? *vptr(m, size - 1) : BAIK_UNDEFINED;
+}
+
+BAIK_PRIVATE size_t baik_stack_size(const struct mbuf *m) {
+  return m->len / sizeof(baik_val_t);
+}
+
+BAIK_PRIVATE baik_val_t *vptr(struct mbuf *m, int idx) {
+  int size = baik_stack_size(m);
+  if (idx < 0) idx = size + idx;
+  return idx >= 0 && idx < size ? &((baik_val_t *) m->buf)[idx] : NULL;
+}
+
+BAIK_PRIVATE baik_val_t baik_pop(struct baik *baik) {
+  if (baik->stack.len == 0) {
+    baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "stack underflow");
+    return BAIK_UNDEFINED;
+  } else {
+    return baik_pop_val(&baik->stack);
+  }
+}
+
+BAIK_PRIVATE void push_baik_val(struct mbuf *m, baik_val_t v) {
+  mbuf_append(m, &v, sizeof(v));
+}
+
+BAIK_PRIVATE baik_val_t baik_pop_val(struct mbuf *m) {
+  baik_val_t v = BAIK_UNDEFINED;
+  assert(m->len >= sizeof(v));
+  if (m->len >= sizeof(v)) {
+    memcpy(&v, m->buf + m->len - sizeof(v), sizeof(v));
+    m->len -= sizeof(v);
+  }
+  return v;
+}
+
+BAIK_PRIVATE void baik_push(struct baik *baik, baik_val_t v) {
+  push_baik_val(&baik->stack, v);
+}
+
+void baik_set_generate_jsc(struct baik *baik, int generate_jsc) {
+  baik->generate_jsc = generate_jsc;
+}
+
+void *baik_mem_to_ptr(unsigned val) {
+  return (void *) (uintptr_t) val;
+}
+
+void *baik_mem_get_ptr(void *base, int offset) {
+  return (char *) base + offset;
+}
+
+void baik_mem_set_ptr(void *ptr, void *val) {
+  *(void **) ptr = val;
+}
+
+double baik_mem_get_dbl(void *ptr) {
+  double v;
+  memcpy(&v, ptr, sizeof(v));
+  return v;
+}
+
+void baik_mem_set_dbl(void *ptr, double val) {
+  memcpy(ptr, &val, sizeof(val));
+}
+
+double baik_mem_get_uint(void *ptr, int size, int bigendian) {
+  uint8_t *p = (uint8_t *) ptr;
+  int i, inc = bigendian ? 1 : -1;
+  unsigned int res = 0;
+  p += bigendian ? 0 : size - 1;
+  for (i = 0; i < size; i++, p += inc) {
+    res <<= 8;
+    res |= *p;
+  }
+  return res;
+}
+
+double baik_mem_get_int(void *ptr, int size, int bigendian) {
+  uint8_t *p = (uint8_t *) ptr;
+  int i, inc = bigendian ? 1 : -1;
+  int res = 0;
+  p += bigendian ? 0 : size - 1;
+
+  for (i = 0; i < size; i++, p += inc) {
+    res <<= 8;
+    res |= *p;
+  }
+
+  {
+    int extra = sizeof(res) - size;
+    for (i = 0; i < extra; i++) res <<= 8;
+    for (i = 0; i < extra; i++) res >>= 8;
+  }
+
+  return res;
+}
+
+void baik_mem_set_uint(void *ptr, unsigned int val, int size, int bigendian) {
+  uint8_t *p = (uint8_t *) ptr + (bigendian ? size - 1 : 0);
+  int i, inc = bigendian ? -1 : 1;
+  for (i = 0; i < size; i++, p += inc) {
+    *p = val & 0xff;
+    val >>= 8;
+  }
+}
+
+void baik_mem_set_int(void *ptr, int val, int size, int bigendian) {
+  baik_mem_set_uint(ptr, val, size, bigendian);
+}
+
+#if BAIK_GENERATE_INAC && defined(BAIK_EM_MMAP)
+#include <sys/mman.h>
+#endif
+
+static void call_stack_push_frame(struct baik *baik, size_t offset, int part,
+                                  baik_val_t retval_stack_idx) {
+ 
+  baik_val_t this_obj = baik_pop_val(&baik->arg_stack);
+  push_baik_val(&baik->call_stack, baik->vals.this_obj);
+  baik->vals.this_obj = this_obj;
+  push_baik_val(&baik->call_stack, baik_mk_number(baik, (double) part));
+  push_baik_val(&baik->call_stack, baik_mk_number(baik, (double) offset));
+  push_baik_val(&baik->call_stack,
+               baik_mk_number(baik, (double) baik_stack_size(&baik->scopes)));
+  push_baik_val(
+      &baik->call_stack,
+      baik_mk_number(baik, (double) baik_stack_size(&baik->loop_addresses)));
+  push_baik_val(&baik->call_stack, retval_stack_idx);
+}
+
+
+static size_t call_stack_restore_frame(struct baik *baik, int *part) {
+  size_t retval_stack_idx, return_address, scope_index, loop_addr_index;
+  int return_part;
+  assert(baik_stack_size(&baik->call_stack) >= CALL_STACK_FRAME_ITEMS_CNT);
+
+  retval_stack_idx = baik_get_int(baik, baik_pop_val(&baik->call_stack));
+  loop_addr_index = baik_get_int(baik, baik_pop_val(&baik->call_stack));
+  scope_index = baik_get_int(baik, baik_pop_val(&baik->call_stack));
+  return_address = baik_get_int(baik, baik_pop_val(&baik->call_stack));
+  return_part = baik_get_int(baik, baik_pop_val(&baik->call_stack));
+  if (part != NULL) *part = return_part;
+  baik->vals.this_obj = baik_pop_val(&baik->call_stack);
+
+  while (baik_stack_size(&baik->scopes) > scope_index) {
+    baik_pop_val(&baik->scopes);
+  }
+
+  while (baik_stack_size(&baik->loop_addresses) > loop_addr_index) {
+    baik_pop_val(&baik->loop_addresses);
+  }
+
+  baik->stack.len = retval_stack_idx * sizeof(baik_val_t);
+
+  return return_address;
+}
+
+static baik_val_t baik_find_scope(struct baik *baik, baik_val_t key) {
+  size_t num_scopes = baik_stack_size(&baik->scopes);
+  while (num_scopes > 0) {
+    baik_val_t scope = *vptr(&baik->scopes, num_scopes - 1);
+    num_scopes--;
+    baik->scope_prop = baik_get_own_property_v(baik, scope, key);
+    if (baik->scope_prop != NULL) return scope;
+  }
+  baik_set_errorf(baik, BAIK_REFERENCE_ERROR, "[%s] tidak terdefinisikan",
+                 baik_get_cstring(baik, &key));
+  return BAIK_UNDEFINED;
+}
+
+baik_val_t baik_get_this(struct baik *baik) {
+  return baik->vals.this_obj;
+}
+
+static double do_arith_op(double da, double db, int op, bool *resnan) {
+  *resnan = false;
+
+  if (isnan(da) || isnan(db)) {
+    *resnan = true;
+    return 0;
+  }
+ 
+  switch (op) {
+    case TOK_MINUS:   return da - db;
+    case TOK_PLUS:    return da + db;
+    case TOK_MUL:     return da * db;
+    case TOK_DIV:
+      if (db != 0) {
+        return da / db;
+      } else {
+       
+        *resnan = true;
+        return 0;
+      }
+    case TOK_REM:
+     
+      db = (int) db;
+      if (db != 0) {
+        bool neg = false;
+        if (da < 0) {
+          neg = true;
+          da = -da;
+        }
+        if (db < 0) {
+          db = -db;
+        }
+        da = (double) ((int64_t) da % (int64_t) db);
+        if (neg) {
+          da = -da;
+        }
+        return da;
+      } else {
+        *resnan = true;
+        return 0;
+      }
+    case TOK_AND:     return (double) ((int64_t) da & (int64_t) db);
+    case TOK_OR:      return (double) ((int64_t) da | (int64_t) db);
+    case TOK_XOR:     return (double) ((int64_t) da ^ (int64_t) db);
+    case TOK_LSHIFT:  return (double) ((int64_t) da << (int64_t) db);
+    case TOK_RSHIFT:  return (double) ((int64_t) da >> (int64_t) db);
+    case TOK_URSHIFT: return (double) ((uint32_t) da >> (uint32_t) db);
+  }
+ 
+  *resnan = true;
+  return 0;
+}
+
+static void set_no_autoconversion_error(struct baik *baik) {
+  baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
+                     "galat : konversi tipe implisit dilarang");
+}
+
+static baik_val_t do_op(struct baik *baik, baik_val_t a, baik_val_t b, int op) {
+  baik_val_t ret = BAIK_UNDEFINED;
+  bool resnan = false;
+  if ((baik_is_foreign(a) || baik_is_number(a)) &&
+      (baik_is_foreign(b) || baik_is_number(b))) {
+    int is_result_ptr = 0;
+    double da, db, result;
+
+    if (baik_is_foreign(a) && baik_is_foreign(b)) {
+      if (op != TOK_MINUS) {
+        baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : operan tidak valid");
+      }
+    } else if (baik_is_foreign(a) || baik_is_foreign(b)) {
+      if (op != TOK_MINUS && op != TOK_PLUS) {
+        baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : operan tidak valid");
+      }
+      is_result_ptr = 1;
+    }
+    da = baik_is_number(a) ? baik_get_double(baik, a)
+                          : (double) (uintptr_t) baik_get_ptr(baik, a);
+    db = baik_is_number(b) ? baik_get_double(baik, b)
+                          : (double) (uintptr_t) baik_get_ptr(baik, b);
+    result = do_arith_op(da, db, op, &resnan);
+    if (resnan) {
+      ret = BAIK_TAG_NAN;
+    } else {
+     
+      ret = is_result_ptr ? baik_mk_foreign(baik, (void *) (uintptr_t) result)
+                          : baik_mk_number(baik, result);
+    }
+  } else if (baik_is_string(a) && baik_is_string(b) && (op == TOK_PLUS)) {
+    ret = s_concat(baik, a, b);
+  } else {
+    set_no_autoconversion_error(baik);
+  }
+  return ret;
+}
+
+static void op_assign(struct baik *baik, int op) {
+  baik_val_t val = baik_pop(baik);
+  baik_val_t obj = baik_pop(baik);
+  baik_val_t key = baik_pop(baik);
+  if (baik_is_object(obj) && baik_is_string(key)) {
+    baik_val_t v = baik_get_v(baik, obj, key);
+    baik_set_v(baik, obj, key, do_op(baik, v, val, op));
+    baik_push(baik, v);
+  } else {
+    baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand");
+  }
+}
+
+static int check_equal(struct baik *baik, baik_val_t a, baik_val_t b) {
+  int ret = 0;
+  if (a == BAIK_TAG_NAN && b == BAIK_TAG_NAN) {
+    ret = 0;
+  } else if (a == b) {
+    ret = 1;
+  } else if (baik_is_number(a) && baik_is_number(b)) {
+    ret = 0;
+  } else if (baik_is_string(a) && baik_is_string(b)) {
+    ret = s_cmp(baik, a, b) == 0;
+  } else if (baik_is_foreign(a) && b == BAIK_NULL) {
+    ret = baik_get_ptr(baik, a) == NULL;
+  } else if (a == BAIK_NULL && baik_is_foreign(b)) {
+    ret = baik_get_ptr(baik, b) == NULL;
+  } else {
+    ret = 0;
+  }
+  return ret;
+}
+
+/*
+ * The comparison of a fused compare-and-branch, `a` being the left operand.
+ * Gives what the comparison opcode would push, without making the boolean.
+ */
+static int cmp_jump_holds(struct baik *baik, uint8_t op, baik_val_t a,
+                          baik_val_t b) {
+  double da, db;
+  switch (op) {
+    case OP_JMP_FALSE_EQ:
+      return check_equal(baik, b, a);
+    case OP_JMP_FALSE_NE:
+      return !check_equal(baik, b, a);
+    default:
+      break;
+  }
+  /* Anything but a number reads as NaN, which compares false */
+  da = baik_get_double(baik, a);
+  db = baik_get_double(baik, b);
+  switch (op) {
+    case OP_JMP_FALSE_LT:
+      return da < db;
+    case OP_JMP_FALSE_GT:
+      return da > db;
+    case OP_JMP_FALSE_LE:
+      return da <= db;
+    default:
+      return da >= db;
+  }
+}
+
+#ifndef BAIK_ENABLE_QUICKEN
+#define BAIK_ENABLE_QUICKEN 1
+#endif
+
+#if BAIK_QUICKEN_STATS
+#define QUICKEN_COUNT(baik, what) ((baik)->quicken.what++)
+#else
+#define QUICKEN_COUNT(baik, what) ((void) 0)
+#endif
+
+/*
+ * Rewrites the opcode at `i` of the running part in place. Only bytecode
+ * this instance owns is rewritten; shared code objects and code in flash
+ * keep running the generic opcodes. Every quickened opcode has the length
+ * of the one it replaces, so no offset moves; an operator run through
+ * OP_EXPR is one byte longer and is left alone.
+ */
+static void quicken(const struct baik_bcode_part *bp, size_t i, uint8_t op) {
+#if BAIK_ENABLE_QUICKEN
+  uint8_t *code = (uint8_t *) bp->data.p;
+  if (bp->code == NULL && !bp->in_rom && code[i] != OP_EXPR) code[i] = op;
+#else
+  (void) bp;
+  (void) i;
+  (void) op;
+#endif
+}
+
+/* What do_op() is given for OP_ADD and the operators after it */
+static const uint8_t s_arith_toks[] = {
+    TOK_PLUS, TOK_MINUS, TOK_MUL,    TOK_DIV,    TOK_REM,    TOK_XOR,
+    TOK_AND,  TOK_OR,    TOK_LSHIFT, TOK_RSHIFT, TOK_URSHIFT};
+static const uint8_t s_arith_assign_toks[] = {
+    TOK_PLUS_ASSIGN,   TOK_MINUS_ASSIGN,  TOK_MUL_ASSIGN,
+    TOK_DIV_ASSIGN,    TOK_REM_ASSIGN,    TOK_XOR_ASSIGN,
+    TOK_AND_ASSIGN,    TOK_OR_ASSIGN,     TOK_LSHIFT_ASSIGN,
+    TOK_RSHIFT_ASSIGN, TOK_URSHIFT_ASSIGN};
+
+/* The opcode of operator `tok`, OP_NOP for the ones that do nothing */
+static uint8_t expr_opcode(int tok) {
+  size_t i;
+  for (i = 0; i < ARRAY_SIZE(s_arith_toks); i++) {
+    if (s_arith_toks[i] == tok) return (uint8_t) (OP_ADD + i);
+    if (s_arith_assign_toks[i] == tok) return (uint8_t) (OP_ADD_ASSIGN + i);
+  }
+  switch (tok) {
+    case TOK_LT:            return OP_LT;
+    case TOK_GT:            return OP_GT;
+    case TOK_LE:            return OP_LE;
+    case TOK_GE:            return OP_GE;
+    case TOK_EQ_EQ:         return OP_EQ_EQ;
+    case TOK_NE_NE:         return OP_NE_NE;
+    case TOK_EQ:            return OP_EQ;
+    case TOK_NE:            return OP_NE;
+    case TOK_UNARY_MINUS:   return OP_NEG;
+    case TOK_NOT:           return OP_NOT;
+    case TOK_TILDA:         return OP_BIT_NOT;
+    case TOK_KEYWORD_TIPE:  return OP_TYPEOF;
+    case TOK_ASSIGN:        return OP_ASSIGN;
+    case TOK_PLUS_PLUS:     return OP_INC;
+    case TOK_MINUS_MINUS:   return OP_DEC;
+    case TOK_POSTFIX_PLUS:  return OP_POST_INC;
+    case TOK_POSTFIX_MINUS: return OP_POST_DEC;
+    default:                return OP_NOP;
+  }
+}
+
+/* What do_op() gives for a quickened operator on numbers `a` and `b` */
+static baik_val_t quick_arith(struct baik *baik, uint8_t op, baik_val_t a,
+                              baik_val_t b) {
+  double da = baik_get_double(baik, a), db = baik_get_double(baik, b);
+  if (isnan(da) || isnan(db)) return BAIK_TAG_NAN;
+  switch (op) {
+    case OP_ADD_NUM:
+      return baik_mk_number(baik, da + db);
+    case OP_SUB_NUM:
+      return baik_mk_number(baik, da - db);
+    default:
+      return baik_mk_number(baik, da * db);
+  }
+}
+
+/* The opcode an OP_GET that just ran on `obj` and `key` should become */
+static uint8_t quick_get_op(uint8_t prev_op, baik_val_t obj, baik_val_t key) {
+  if (prev_op == OP_FIND_SCOPE) return OP_GET_OWN_CACHED;
+  if (baik_is_array(obj) && baik_is_number(key)) return OP_GET_ARRAY_INDEX;
+  return OP_GET;
+}
+
+/*
+ * Runs a quickened OP_GET. Gives 1 with `*val` set, 0 if this access has to
+ * take the generic path, or -1 if the guard failed and the site should go
+ * back to OP_GET.
+ */
+static int quick_get(struct baik *baik, uint8_t op, uint8_t prev_op,
+                     baik_val_t obj, baik_val_t key, baik_val_t *val) {
+  if (op == OP_GET_OWN_CACHED) {
+    size_t n;
+    const char *s;
+    if (prev_op != OP_FIND_SCOPE) return -1;
+    /* getprop_builtin() answers "apply" before any own property */
+    s = baik_get_string(baik, &key, &n);
+    if (baik->scope_prop == NULL || (n == 5 && memcmp(s, "apply", 5) == 0)) {
+      return 0;
+    }
+    *val = baik->scope_prop->value;
+    return 1;
+  } else {
+    int has;
+    double d;
+    if (!baik_is_array(obj) || !baik_is_number(key)) return -1;
+    /* Only indexes baik_to_string() prints the way baik_array_get2() does */
+    d = baik_get_double(baik, key);
+    if (!(d >= 0 && d < 4294967295.0) || d != (double) (unsigned long) d) {
+      return 0;
+    }
+    *val = baik_array_get2(baik, obj, (unsigned long) d, &has);
+    return has;
+  }
+}
+
+/* Pops key, object and value; stores the value and pushes it back */
+static void exec_assign(struct baik *baik) {
+  baik_val_t val = baik_pop(baik);
+  baik_val_t obj = baik_pop(baik);
+  baik_val_t key = baik_pop(baik);
+  if (baik_is_object(obj)) {
+    baik_set_v(baik, obj, key, val);
+  } else if (baik_is_foreign(obj)) {
+   
+
+    int ikey = baik_get_int(baik, key);
+    int ival = baik_get_int(baik, val);
+
+    if (!baik_is_number(key)) {
+      baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : index harus angka");
+      val = BAIK_UNDEFINED;
+    } else if (!baik_is_number(val) || ival < 0 || ival > 0xff) {
+      baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
+                         "GALAT : hanya angka 0 .. 255 yang bisa digunakan");
+      val = BAIK_UNDEFINED;
+    } else {
+      uint8_t *ptr = (uint8_t *) baik_get_ptr(baik, obj);
+      *(ptr + ikey) = (uint8_t) ival;
+    }
+  } else {
+    baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tipe objek tidak didukung");
+  }
+  baik_push(baik, val);
+}
+
+static const struct baik_builtin baik_string_builtins[] = {
+    BAIK_BUILTIN_FN("at", baik_string_char_code_at),
+    BAIK_BUILTIN_FN("charCodeAt", baik_string_char_code_at),
+    BAIK_BUILTIN_FN("indexOf", baik_string_index_of),
+    BAIK_BUILTIN_FN("slice", baik_string_slice),
+    BAIK_BUILTIN_END,
+};
+
+static const struct baik_builtin baik_array_builtins[] = {
+    BAIK_BUILTIN_FN("splice", baik_array_splice),
+    BAIK_BUILTIN_FN("push", baik_array_push_internal),
+    BAIK_BUILTIN_END,
+};
+
+static int getprop_builtin_string(struct baik *baik, baik_val_t val,
+                                  const char *name, size_t name_len,
+                                  baik_val_t *res) {
+  int isnum = 0;
+  int idx = cstr_to_ulong(name, name_len, &isnum);
+  const struct baik_builtin *b;
+
+  if (name_len == 7 && memcmp(name, "panjang", 7) == 0) {
+    size_t val_len;
+    baik_get_string(baik, &val, &val_len);
+    *res = baik_mk_number(baik, (double) val_len);
+    return 1;
+  } else if (name_len > 0 &&
+             (b = baik_builtin_find(baik_string_builtins, name, name_len)) != NULL) {
+    *res = baik_mk_foreign_func(baik, b->fn);
+    return 1;
+  } else if (isnum) {
+   
+    size_t val_len;
+    const char *str = baik_get_string(baik, &val, &val_len);
+    if (idx >= 0 && idx < (int) val_len) {
+      *res = baik_mk_string(baik, str + idx, 1, 1);
+    } else {
+      *res = BAIK_UNDEFINED;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+static int getprop_builtin_array(struct baik *baik, baik_val_t val,
+                                 const char *name, size_t name_len,
+                                 baik_val_t *res) {
+  const struct baik_builtin *b;
+
+  if (name_len == 7 && memcmp(name, "panjang", 7) == 0) {
+    *res = baik_mk_number(baik, baik_array_length(baik, val));
+    return 1;
+  } else if (name_len > 0 &&
+             (b = baik_builtin_find(baik_array_builtins, name, name_len)) != NULL) {
+    *res = baik_mk_foreign_func(baik, b->fn);
+    return 1;
+  }
+  return 0;
+}
+
+static int getprop_builtin_foreign(struct baik *baik, baik_val_t val,
+                                   const char *name, size_t name_len,
+                                   baik_val_t *res) {
+  int isnum = 0;
+  int idx = cstr_to_ulong(name, name_len, &isnum);
+
+  if (!isnum) {
+    baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : index harus angka");
+  } else {
+    uint8_t *ptr = (uint8_t *) baik_get_ptr(baik, val);
+    *res = baik_mk_number(baik, *(ptr + idx));
+  }
+  return 1;
+}
+
+static void baik_apply_(struct baik *baik) {
+  baik_val_t res = BAIK_UNDEFINED, *args = NULL;
+  baik_val_t func = baik->vals.this_obj, v = baik_arg(baik, 1);
+  int i, nargs = 0;
+  if (baik_is_array(v)) {
+    nargs = baik_array_length(baik, v);
+    args = calloc(nargs, sizeof(args[0]));
+    for (i = 0; i < nargs; i++) args[i] = baik_array_get(baik, v, i);
+  }
+  baik_apply(baik, &res, func, baik_arg(baik, 0), nargs, args);
+  free(args);
+  baik_return(baik, res);
+}
+
+static int getprop_builtin(struct baik *baik, baik_val_t val, baik_val_t name,
+                           baik_val_t *res) {
+  size_t n;
+  char *s = NULL;
+  int need_free = 0;
+  int handled = 0;
+
+  baik_err_t err = baik_to_string(baik, &name, &s, &n, &need_free);
+
+  if (err == BAIK_OK) {
+    if (baik_is_string(val)) {
+      handled = getprop_builtin_string(baik, val, s, n, res);
+    } else if (s != NULL && n == 5 && strncmp(s, "apply", n) == 0) {
+      *res = baik_mk_foreign_func(baik, (baik_func_ptr_t) baik_apply_);
+      handled = 1;
+    } else if (baik_is_array(val)) {
+      handled = getprop_builtin_array(baik, val, s, n, res);
+    } else if (baik_is_foreign(val)) {
+      handled = getprop_builtin_foreign(baik, val, s, n, res);
+    }
+  }
+
+  if (need_free) {
+    free(s);
+    s = NULL;
+  }
+
+  return handled;
+}
+
+#ifndef BAIK_BUDGET_CLOCK_TICKS
+#define BAIK_BUDGET_CLOCK_TICKS 64
+#endif
+
+void baik_set_budget(struct baik *baik, unsigned long ticks, unsigned long ms) {
+  baik->budget_ticks = ticks;
+  baik->budget_ms = ms;
+}
+
+void baik_interrupt(struct baik *baik) {
+  baik->interrupted = 1;
+}
+
+static void baik_budget_arm(struct baik *baik) {
+  baik->ticks_used = 0;
+  baik->budget_out = 0;
+  if (baik->budget_ms != 0) {
+    baik->budget_start = baik_uptime_ms();
+  }
+}
+
+// Values are only known to be rooted between opcodes, so a collection
+// requested by an allocation runs at the next safepoint: a backward jump,
+// a call or a return. Straight-line code never polls. A tick of the
+// budget is one safepoint; nonzero means leave the dispatch loop, either
+// with an error or, if the run can be resumed, suspended.
+static int baik_safepoint(struct baik *baik, int can_suspend) {
+#if BAIK_AGGRESSIVE_GC
+  baik->need_gc = 1;
+#endif
+  if (baik->need_gc && maybe_gc(baik)) {
+    baik->need_gc = 0;
+  }
+  if (baik->interrupted) {
+    baik->interrupted = 0;
+    baik_set_errorf(baik, BAIK_INTERRUPTED, "eksekusi dihentikan");
+    return 1;
+  }
+  if (baik->budget_ticks == 0 && baik->budget_ms == 0) {
+    return 0;
+  }
+  baik->ticks_used++;
+  if (baik->budget_ticks != 0 && baik->ticks_used > baik->budget_ticks) {
+    baik->budget_out = 1;
+  } else if (baik->budget_ms != 0 &&
+             baik->ticks_used % BAIK_BUDGET_CLOCK_TICKS == 0 &&
+             baik_uptime_ms() - baik->budget_start >= baik->budget_ms) {
+    baik->budget_out = 1;
+  }
+  return baik->budget_out && can_suspend;
 }
 
 BAIK_PRIVATE baik_err_t baik_execute(struct baik *baik, size_t off, baik_val_t *res) {
@@ -7397,2054 +9389,3836 @@ BAIK_PRIVATE baik_err_t baik_execute(struct baik *baik, size_t off, baik_val_t *
   uint8_t opcode = OP_MAX;
 
  
-  int stack_len = baik->stack.len;
-  int call_stack_len = baik->call_stack.len;
-  int arg_stack_len = baik->arg_stack.len;
-  int scopes_len = baik->scopes.len;
-  int loop_addresses_len = baik->loop_addresses.len;
-  size_t start_off = off;
-  const uint8_t *code;
+  int stack_len = baik->stack.len;
+  int call_stack_len = baik->call_stack.len;
+  int arg_stack_len = baik->arg_stack.len;
+  int scopes_len = baik->scopes.len;
+  int loop_addresses_len = baik->loop_addresses.len;
+  size_t start_off = off;
+  const uint8_t *code;
+
+  int can_suspend, part;
+  int expr_tok = 0; /* the opcode came from OP_EXPR and its token byte */
+  struct baik_bcode_part bp;
+
+  if (off == BAIK_BCODE_OFFSET_RESUME) {
+    off = baik->susp.off;
+    start_off = baik->susp.start_off;
+    stack_len = baik->susp.stack_len;
+    call_stack_len = baik->susp.call_stack_len;
+    arg_stack_len = baik->susp.arg_stack_len;
+    scopes_len = baik->susp.scopes_len;
+    loop_addresses_len = baik->susp.loop_addresses_len;
+    opcode = baik->susp.prev_opcode;
+    baik->suspended = 0;
+  }
+
+  // Only a run entered from the host or the task scheduler can be
+  // suspended; a nested one returns into C code that has no way to resume
+  // it. A task's run starts above its entry frame.
+  can_suspend = (call_stack_len == baik->call_stack_base);
+  if (can_suspend) {
+    baik_budget_arm(baik);
+  }
+  if (baik->exec_depth++ == 0) {
+    baik->resumable = can_suspend;
+  }
+
+  part = baik_bcode_part_idx_by_offset(baik, off);
+  bp = *baik_bcode_part_get(baik, part);
+
+  baik_set_errorf(baik, BAIK_OK, NULL);
+  free(baik->stack_trace);
+  baik->stack_trace = NULL;
+
+  off -= bp.start_idx;
+
+  for (i = off; i < bp.data.len; i++) {
+    code = (const uint8_t *) bp.data.p;
+    baik_disasm_single(code, i);
+    prev_opcode = opcode;
+    opcode = code[i];
+  dispatch:
+    switch (opcode) {
+      case OP_BCODE_HEADER: {
+        baik_header_item_t bcode_offset;
+        memcpy(&bcode_offset,
+               code + i + 1 +
+                   sizeof(baik_header_item_t) * BAIK_HDR_ITEM_BCODE_OFFSET,
+               sizeof(bcode_offset));
+        i += bcode_offset;
+      } break;
+      case OP_PUSH_NULL:
+        baik_push(baik, baik_mk_null());
+        break;
+      case OP_PUSH_UNDEF:
+        baik_push(baik, baik_mk_undefined());
+        break;
+      case OP_PUSH_FALSE:
+        baik_push(baik, baik_mk_boolean(baik, 0));
+        break;
+      case OP_PUSH_TRUE:
+        baik_push(baik, baik_mk_boolean(baik, 1));
+        break;
+      case OP_PUSH_OBJ:
+        baik_push(baik, baik_mk_object(baik));
+        break;
+      case OP_PUSH_ARRAY:
+        baik_push(baik, baik_mk_array(baik));
+        break;
+      case OP_PUSH_FUNC: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        baik_push(baik, baik_mk_function(baik, bp.start_idx + i - n));
+        i += llen;
+        break;
+      }
+      case OP_PUSH_THIS:
+        baik_push(baik, baik->vals.this_obj);
+        break;
+      case OP_JMP: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        i += n + llen;
+        break;
+      }
+      case OP_JMP_FALSE: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        baik_val_t v = baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        i += llen;
+        if (!baik_is_truthy(baik, v)) {
+          baik_push(baik, BAIK_UNDEFINED);
+          i += n;
+        }
+        break;
+      }
+     
+      case OP_JMP_FALSE_LT:
+      case OP_JMP_FALSE_GT:
+      case OP_JMP_FALSE_LE:
+      case OP_JMP_FALSE_GE:
+      case OP_JMP_FALSE_EQ:
+      case OP_JMP_FALSE_NE: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        baik_val_t b = baik_pop(baik);
+        baik_val_t a = baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        i += llen;
+        if (!cmp_jump_holds(baik, opcode, a, b)) {
+          baik_push(baik, BAIK_UNDEFINED);
+          i += n;
+        }
+        break;
+      }
+      case OP_JMP_NEUTRAL_TRUE: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        i += llen;
+        if (baik_is_truthy(baik, vtop(&baik->stack))) {
+          i += n;
+        }
+        break;
+      }
+      case OP_JMP_NEUTRAL_FALSE: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        i += llen;
+        if (!baik_is_truthy(baik, vtop(&baik->stack))) {
+          i += n;
+        }
+        break;
+      }
+      case OP_FIND_SCOPE: {
+        baik_val_t key = vtop(&baik->stack);
+        baik_push(baik, baik_find_scope(baik, key));
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      }
+      case OP_CREATE: {
+        baik_val_t obj = baik_pop(baik);
+        baik_val_t key = baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        if (baik_get_own_property_v(baik, obj, key) == NULL) {
+          baik_set_v(baik, obj, key, BAIK_UNDEFINED);
+          if (baik->error != BAIK_OK) goto error;
+        }
+        break;
+      }
+      case OP_APPEND: {
+        baik_val_t val = baik_pop(baik);
+        baik_val_t arr = baik_pop(baik);
+        baik_err_t err;
+        if (baik->error != BAIK_OK) goto error;
+        err = baik_array_push(baik, arr, val);
+        if (err != BAIK_OK) {
+          baik_set_errorf(baik, BAIK_TYPE_ERROR, "append to non-array");
+          goto error;
+        }
+        break;
+      }
+      case OP_GET_ARRAY_INDEX:
+      case OP_GET_OWN_CACHED: {
+        baik_val_t val = BAIK_UNDEFINED;
+        int hit = -1;
+        if (baik->stack.len >= 2 * sizeof(val)) {
+          hit = quick_get(baik, opcode, prev_opcode, *vptr(&baik->stack, -1),
+                          *vptr(&baik->stack, -2), &val);
+        }
+        if (hit > 0) {
+          baik->vals.last_getprop_obj = prev_opcode != OP_FIND_SCOPE
+                                            ? *vptr(&baik->stack, -1)
+                                            : BAIK_UNDEFINED;
+          baik->stack.len -= sizeof(val);
+          *vptr(&baik->stack, -1) = val;
+          QUICKEN_COUNT(baik, specialized);
+          break;
+        } else if (hit < 0) {
+          quicken(&bp, i, OP_GET);
+          QUICKEN_COUNT(baik, deopts);
+        }
+      }
+      /* fallthrough */
+      case OP_GET: {
+        baik_val_t obj = baik_pop(baik);
+        baik_val_t key = baik_pop(baik);
+        baik_val_t val = BAIK_UNDEFINED;
+
+        QUICKEN_COUNT(baik, generic);
+
+        if (!getprop_builtin(baik, obj, key, &val)) {
+          if (baik_is_object(obj)) {
+            val = baik_get_v_proto(baik, obj, key);
+          } else {
+            baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tipe galat");
+          }
+        }
+        if (baik->error != BAIK_OK) goto error;
+
+        baik_push(baik, val);
+        if (prev_opcode != OP_FIND_SCOPE) {
+         
+          baik->vals.last_getprop_obj = obj;
+        } else {
+         
+          baik->vals.last_getprop_obj = BAIK_UNDEFINED;
+        }
+        quicken(&bp, i, quick_get_op(prev_opcode, obj, key));
+        break;
+      }
+      case OP_DEL_SCOPE:
+        if (baik->scopes.len <= 1) {
+          baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "scopes underflow");
+          goto error;
+        } else {
+          baik_pop_val(&baik->scopes);
+        }
+        break;
+      case OP_NEW_SCOPE:
+        push_baik_val(&baik->scopes, baik_mk_object(baik));
+        break;
+      case OP_PUSH_SCOPE:
+        assert(baik_stack_size(&baik->scopes) > 0);
+        baik_push(baik, vtop(&baik->scopes));
+        break;
+      case OP_PUSH_STR: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        baik_push(baik, baik_mk_string(baik, (char *) code + i + 1 + llen, n, 1));
+        i += llen + n;
+        break;
+      }
+      case OP_PUSH_INT: {
+        int llen;
+        int64_t n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        baik_push(baik, baik_mk_number(baik, (double) n));
+        i += llen;
+        break;
+      }
+      case OP_PUSH_DBL: {
+        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
+        baik_push(baik, baik_mk_number(
+                          baik, strtod((char *) code + i + 1 + llen, NULL)));
+        i += llen + n;
+        break;
+      }
+      case OP_PUSH_F64: {
+        double d;
+        memcpy(&d, &code[i + 1], sizeof(d));
+        baik_push(baik, baik_mk_number(baik, d));
+        i += sizeof(d);
+        break;
+      }
+      case OP_FOR_IN_NEXT: {
+       
+        baik_val_t *iterator = vptr(&baik->stack, -1);
+        baik_val_t obj = *vptr(&baik->stack, -2);
+        if (baik_is_object(obj)) {
+          baik_val_t var_name = *vptr(&baik->stack, -3);
+          baik_val_t key = baik_next(baik, obj, iterator);
+          if (key != BAIK_UNDEFINED) {
+            baik_val_t scope = baik_find_scope(baik, var_name);
+            baik_set_v(baik, scope, var_name, key);
+            if (baik->error != BAIK_OK) goto error;
+          }
+        } else {
+          baik_set_errorf(baik, BAIK_TYPE_ERROR,
+                         "can't iterate over non-object value");
+          goto error;
+        }
+        break;
+      }
+      case OP_RETURN: {
+       
+        int part_ret;
+        size_t off_ret;
+        if (baik_safepoint(baik, can_suspend)) goto preempt;
+        off_ret = call_stack_restore_frame(baik, &part_ret);
+        if (off_ret != BAIK_BCODE_OFFSET_EXIT) {
+          if (part_ret != part) {
+            part = part_ret;
+            bp = *baik_bcode_part_get(baik, part);
+          }
+          code = (const uint8_t *) bp.data.p;
+          i = off_ret - bp.start_idx;
+          LOG(LL_VERBOSE_DEBUG, ("RETURNING TO %d", (int) off_ret + 1));
+        } else {
+          goto clean;
+        }
+        
+        break;
+      }
+      case OP_ARGS: {
+       
+        if (prev_opcode != OP_GET && prev_opcode != OP_GET_ARRAY_INDEX &&
+            prev_opcode != OP_GET_OWN_CACHED) {
+          baik->vals.last_getprop_obj = BAIK_UNDEFINED;
+        }
+
+       
+        push_baik_val(&baik->arg_stack, baik->vals.last_getprop_obj);
+       
+        push_baik_val(&baik->arg_stack,
+                     baik_mk_number(baik, (double) baik_stack_size(&baik->stack)));
+        break;
+      }
+      case OP_CALL: {
+        
+        
+        int func_pos;
+        baik_val_t *func;
+        baik_val_t retval_stack_idx;
+        if (baik_safepoint(baik, can_suspend)) goto preempt;
+        baik->cur_bcode_offset = i;
+        retval_stack_idx = vtop(&baik->arg_stack);
+        func_pos = baik_get_int(baik, retval_stack_idx) - 1;
+        func = vptr(&baik->stack, func_pos);
+
+       
+        baik_pop_val(&baik->arg_stack);
+
+        if (baik_is_function(*func)) {
+          size_t off_call;
+          call_stack_push_frame(baik, bp.start_idx + i, part, retval_stack_idx);
+
+         
+          off_call = baik_get_func_addr(*func) - 1;
+          if (off_call < bp.start_idx || off_call >= bp.start_idx + bp.data.len) {
+            part = baik_bcode_part_idx_by_offset(baik, off_call);
+            bp = *baik_bcode_part_get(baik, part);
+          }
+          code = (const uint8_t *) bp.data.p;
+          i = off_call - bp.start_idx;
+
+          *func = BAIK_UNDEFINED;  
+          
+        } else if (baik_is_string(*func) ){//|| baik_is_ffi_sig(*func)) {
+         
+
+          call_stack_push_frame(baik, bp.start_idx + i, part, retval_stack_idx);
+
+         
+          //baik_ffi_call2(baik);
+
+          call_stack_restore_frame(baik, NULL);
+        } else if (baik_is_foreign(*func)) {
+         
+
+          call_stack_push_frame(baik, bp.start_idx + i, part, retval_stack_idx);
+
+         
+          ((void (*) (struct baik *)) baik_get_ptr(baik, *func))(baik);
+
+          call_stack_restore_frame(baik, NULL);
+          if (baik->error != BAIK_OK) goto error;
+          if (baik->yield_req) {
+            // tunggu() asked to yield: suspend past this call.
+            baik->yield_req = 0;
+            prev_opcode = opcode;
+            i++;
+            goto preempt;
+          }
+        } else {
+          baik_set_errorf(baik, BAIK_TYPE_ERROR, "calling non-callable");
+          goto error;
+        }
+        break;
+      }
+      case OP_SET_ARG: {
+        int llen1, llen2, n,
+            arg_no = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen1);
+        baik_val_t obj, key, v;
+        n = BAIK_EM_varint_decode_unsafe(&code[i + llen1 + 1], &llen2);
+        key = baik_mk_string(baik, (char *) code + i + 1 + llen1 + llen2, n, 1);
+        obj = vtop(&baik->scopes);
+        v = baik_arg(baik, arg_no);
+        baik_set_v(baik, obj, key, v);
+        i += llen1 + llen2 + n;
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      }
+      case OP_SETRETVAL: {
+        if (baik_stack_size(&baik->call_stack) < CALL_STACK_FRAME_ITEMS_CNT) {
+          baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "cannot return");
+          goto error;
+        } else {
+          size_t retval_pos = baik_get_int(
+              baik, *vptr(&baik->call_stack,
+                         -1 - CALL_STACK_FRAME_ITEM_RETVAL_STACK_IDX));
+          *vptr(&baik->stack, retval_pos - 1) = baik_pop(baik);
+          if (baik->error != BAIK_OK) goto error;
+        }
+        break;
+      }
+      case OP_ADD_NUM:
+      case OP_SUB_NUM:
+      case OP_MUL_NUM: {
+        baik_val_t *a = vptr(&baik->stack, -2), *b = vptr(&baik->stack, -1);
+        if (a != NULL && baik_is_number(*a) && baik_is_number(*b)) {
+          *a = quick_arith(baik, opcode, *a, *b);
+          baik->stack.len -= sizeof(*b);
+          QUICKEN_COUNT(baik, specialized);
+          break;
+        }
+        opcode = (uint8_t) (opcode - OP_ADD_NUM + OP_ADD);
+        quicken(&bp, i, opcode);
+        QUICKEN_COUNT(baik, deopts);
+      }
+      /* fallthrough */
+      case OP_ADD:
+      case OP_SUB:
+      case OP_MUL:
+      case OP_DIV:
+      case OP_REM:
+      case OP_XOR:
+      case OP_AND:
+      case OP_OR:
+      case OP_LSHIFT:
+      case OP_RSHIFT:
+      case OP_URSHIFT: {
+        baik_val_t b = baik_pop(baik);
+        baik_val_t a = baik_pop(baik);
+        if (opcode <= OP_MUL) {
+          if (baik_is_number(a) && baik_is_number(b)) {
+            quicken(&bp, i, (uint8_t) (opcode - OP_ADD + OP_ADD_NUM));
+          }
+          QUICKEN_COUNT(baik, generic);
+        }
+        baik_push(baik, do_op(baik, a, b, s_arith_toks[opcode - OP_ADD]));
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      }
+      case OP_ADD_ASSIGN:
+      case OP_SUB_ASSIGN:
+      case OP_MUL_ASSIGN:
+      case OP_DIV_ASSIGN:
+      case OP_REM_ASSIGN:
+      case OP_XOR_ASSIGN:
+      case OP_AND_ASSIGN:
+      case OP_OR_ASSIGN:
+      case OP_LSHIFT_ASSIGN:
+      case OP_RSHIFT_ASSIGN:
+      case OP_URSHIFT_ASSIGN:
+        op_assign(baik, s_arith_toks[opcode - OP_ADD_ASSIGN]);
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      case OP_LT:
+      case OP_GT:
+      case OP_LE:
+      case OP_GE: {
+        double b = baik_get_double(baik, baik_pop(baik));
+        double a = baik_get_double(baik, baik_pop(baik));
+        int res = opcode == OP_LT   ? a < b
+                  : opcode == OP_GT ? a > b
+                  : opcode == OP_LE ? a <= b
+                                    : a >= b;
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, baik_mk_boolean(baik, res));
+        break;
+      }
+      case OP_EQ_EQ:
+      case OP_NE_NE: {
+        baik_val_t a = baik_pop(baik);
+        baik_val_t b = baik_pop(baik);
+        int eq = check_equal(baik, a, b);
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, baik_mk_boolean(baik, opcode == OP_EQ_EQ ? eq : !eq));
+        break;
+      }
+      case OP_EQ:
+        baik_set_errorf(baik, BAIK_NOT_IMPLEMENTED_ERROR, "Use ===, not ==");
+        goto error;
+      case OP_NE:
+        baik_set_errorf(baik, BAIK_NOT_IMPLEMENTED_ERROR, "Use !==, not !=");
+        goto error;
+      case OP_NEG: {
+        double a = baik_get_double(baik, baik_pop(baik));
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, baik_mk_number(baik, -a));
+        break;
+      }
+      case OP_NOT: {
+        baik_val_t val = baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, baik_mk_boolean(baik, !baik_is_truthy(baik, val)));
+        break;
+      }
+      case OP_BIT_NOT: {
+        double a = baik_get_double(baik, baik_pop(baik));
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, baik_mk_number(baik, (double) (~(int64_t) a)));
+        break;
+      }
+      case OP_TYPEOF: {
+        baik_val_t val = baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, baik_mk_string(baik, baik_typeof(val), ~0, 1));
+        break;
+      }
+      case OP_ASSIGN:
+        exec_assign(baik);
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      case OP_INC:
+      case OP_DEC:
+      case OP_POST_INC:
+      case OP_POST_DEC: {
+        baik_val_t obj = baik_pop(baik);
+        baik_val_t key = baik_pop(baik);
+        int inc = opcode == OP_INC || opcode == OP_POST_INC;
+        if (baik_is_object(obj) && baik_is_string(key)) {
+          baik_val_t v = baik_get_v(baik, obj, key);
+          baik_val_t v1 =
+              do_op(baik, v, baik_mk_number(baik, 1), inc ? TOK_PLUS : TOK_MINUS);
+          baik_set_v(baik, obj, key, v1);
+          baik_push(baik, opcode == OP_INC || opcode == OP_DEC ? v1 : v);
+        } else {
+          baik_set_errorf(baik, BAIK_TYPE_ERROR, "invalid operand for %s",
+                          inc ? "++" : "--");
+        }
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      }
+      case OP_EXPR:
+        /*
+         * Bytecode from before operators had opcodes of their own, i.e. old
+         * .inac images, gives the operator as a token in the next byte. `i`
+         * stays here while the operator runs and skips the token after it.
+         */
+        opcode = expr_opcode(code[i + 1]);
+        expr_tok = 1;
+        goto dispatch;
+      case OP_DROP: {
+        baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        break;
+      }
+      case OP_DUP: {
+        baik_push(baik, vtop(&baik->stack));
+        break;
+      }
+      case OP_SWAP: {
+        baik_val_t a = baik_pop(baik);
+        baik_val_t b = baik_pop(baik);
+        if (baik->error != BAIK_OK) goto error;
+        baik_push(baik, a);
+        baik_push(baik, b);
+        break;
+      }
+      case OP_LOOP: {
+        int l1, l2, off = BAIK_EM_varint_decode_unsafe(&code[i + 1], &l1);
+       
+        push_baik_val(&baik->loop_addresses,
+                     baik_mk_number(baik, (double) baik_stack_size(&baik->scopes)));
+
+       
+        push_baik_val(
+            &baik->loop_addresses,
+            baik_mk_number(baik, (double) (i + 1 + l1 + off)));
+        off = BAIK_EM_varint_decode_unsafe(&code[i + 1 + l1], &l2);
+
+       
+        push_baik_val(
+            &baik->loop_addresses,
+            baik_mk_number(baik, (double) (i + 1 + l1 + l2 + off)));
+        i += l1 + l2;
+        break;
+      }
+      case OP_CONTINUE: {
+        if (baik_safepoint(baik, can_suspend)) goto preempt;
+        if (baik_stack_size(&baik->loop_addresses) >= 3) {
+          size_t scopes_len = baik_get_int(baik, *vptr(&baik->loop_addresses, -3));
+          assert(baik_stack_size(&baik->scopes) >= scopes_len);
+          baik->scopes.len = scopes_len * sizeof(baik_val_t);
+
+         
+          i = baik_get_int(baik, vtop(&baik->loop_addresses)) - 1;
+        } else {
+          baik_set_errorf(baik, BAIK_SYNTAX_ERROR, "misplaced 'continue'");
+          goto error;
+        }
+      } break;
+      case OP_BREAK: {
+        if (baik_stack_size(&baik->loop_addresses) >= 3) {
+          size_t scopes_len;
+         
+          baik_pop_val(&baik->loop_addresses);
+
+         
+          i = baik_get_int(baik, baik_pop_val(&baik->loop_addresses)) - 1;
+
+         
+          scopes_len = baik_get_int(baik, baik_pop_val(&baik->loop_addresses));
+          assert(baik_stack_size(&baik->scopes) >= scopes_len);
+          baik->scopes.len = scopes_len * sizeof(baik_val_t);
+
+          LOG(LL_VERBOSE_DEBUG, ("BREAKING TO %d", (int) i + 1));
+        } else {
+          baik_set_errorf(baik, BAIK_SYNTAX_ERROR, "misplaced 'break'");
+          goto error;
+        }
+      } break;
+      case OP_NOP:
+        break;
+      case OP_EXIT:
+        i = bp.data.len;
+        break;
+      default:
+#if BAIK_ENABLE_DEBUG
+        baik_dump(baik, 1);
+#endif
+        baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "Unknown opcode: %d, off %d+%d",
+                       (int) opcode, (int) bp.start_idx, (int) i);
+        goto error;
+    }
+    i += expr_tok;
+    expr_tok = 0;
+  }
+
+  if (baik->error == BAIK_OK) goto clean;
+  goto error;
+
+preempt:
+  if (baik->error == BAIK_OK) {
+    // The safepoint opcode has not run yet; resuming dispatches it again.
+    // After a yielding call, i already points past it.
+    baik->susp.off = bp.start_idx + i;
+    baik->susp.start_off = start_off;
+    baik->susp.stack_len = stack_len;
+    baik->susp.call_stack_len = call_stack_len;
+    baik->susp.arg_stack_len = arg_stack_len;
+    baik->susp.scopes_len = scopes_len;
+    baik->susp.loop_addresses_len = loop_addresses_len;
+    baik->susp.prev_opcode = prev_opcode;
+    baik->susp.wake_us = baik->wake_us;
+    baik->wake_us = 0;
+    baik->suspended = 1;
+    baik->error = BAIK_SUSPENDED;
+    baik->exec_depth--;
+    *res = BAIK_UNDEFINED;
+    return baik->error;
+  }
+
+error:
+  baik->cur_bcode_offset = i;
+  baik_gen_stack_trace(baik, bp.start_idx + i - 1);
+
+  baik->stack.len = stack_len;
+  baik->call_stack.len = call_stack_len;
+  baik->arg_stack.len = arg_stack_len;
+  baik->scopes.len = scopes_len;
+  baik->loop_addresses.len = loop_addresses_len;
+
+  baik_push(baik, BAIK_UNDEFINED);
+
+clean:
+ 
+  baik_bcode_part_get_by_offset(baik, start_off)->exec_res = baik->error;
+
+  baik->exec_depth--;
+  *res = baik_pop(baik);
+  return baik->error;
+}
+
+BAIK_PRIVATE baik_err_t baik_exec_internal(struct baik *baik, const char *path,
+                                        const char *src, int generate_jsc,
+                                        baik_val_t *res) {
+  size_t off = baik->bcode_len;
+  baik_val_t r = BAIK_UNDEFINED;
+  if (baik->suspended) {
+    if (res != NULL) *res = BAIK_UNDEFINED;
+    return baik_set_errorf(baik, BAIK_INTERNAL_ERROR,
+                           "eksekusi sebelumnya masih ditangguhkan");
+  }
+  baik->error = baik_parse(path, src, baik);
+  if (BAIK_EM_log_level >= LL_VERBOSE_DEBUG) baik_dump(baik, 1);
+  if (generate_jsc == -1) generate_jsc = baik->generate_jsc;
+  if (baik->error == BAIK_OK) {
+#if BAIK_GENERATE_INAC && defined(BAIK_EM_MMAP)
+    if (generate_jsc && path != NULL) {
+      const char *jsext = ".ina";
+      int basename_len = (int) strlen(path) - strlen(jsext);
+      if (basename_len > 0 && strcmp(path + basename_len, jsext) == 0) {
+       
+        int rewrite = 1;
+        int read_mmapped = 1;
+
+       
+        const char *jscext = ".inac";
+        char filename_jsc[basename_len + strlen(jscext) + 1];
+        memcpy(filename_jsc, path, basename_len);
+        strcpy(filename_jsc + basename_len, jscext);
+
+       
+        struct baik_bcode_part *bp =
+            baik_bcode_part_get(baik, baik_bcode_parts_cnt(baik) - 1);
+
+       
+        {
+          size_t size;
+          char *data = BAIK_EM_mmap_file(filename_jsc, &size);
+          if (data != NULL) {
+            if (size == bp->data.len) {
+              if (memcmp(data, bp->data.p, size) == 0) {
+               
+                rewrite = 0;
+              }
+            }
+            munmap(data, size);
+          }
+        }
+
+       
+        if (rewrite) {
+          FILE *fp = fopen(filename_jsc, "wb");
+          if (fp != NULL) {
+           
+            fwrite(bp->data.p, bp->data.len, 1, fp);
+            fclose(fp);
+          } else {
+            LOG(LL_WARN, ("Failed to open %s for writing", filename_jsc));
+            read_mmapped = 0;
+          }
+        }
+
+        if (read_mmapped) {
+          free((void *) bp->data.p);
+          bp->data.p = BAIK_EM_mmap_file(filename_jsc, &bp->data.len);
+          bp->in_rom = 1;
+        }
+      }
+    }
+#else
+    (void) generate_jsc;
+#endif
+
+    if (path != NULL && strcmp(path, "<stdin>") == 0) {
+      baik->bcode_unreclaimed += baik->bcode_len - off;
+    }
+    baik_execute(baik, off, &r);
+    baik_bcode_reclaim(baik, &r);
+  }
+  if (res != NULL) *res = r;
+  return baik->error;
+}
+
+baik_err_t baik_exec(struct baik *baik, const char *src, baik_val_t *res) {
+  return baik_exec_internal(baik, "<stdin>", src, 0, res);
+}
+
+baik_err_t baik_resume(struct baik *baik, baik_val_t *res) {
+  baik_val_t r = BAIK_UNDEFINED;
+  if (!baik->suspended) {
+    baik_set_errorf(baik, BAIK_BAD_ARGS_ERROR,
+                    "tidak ada eksekusi yang ditangguhkan");
+  } else if (baik->susp.wake_us > baik_uptime_us() && !baik->interrupted) {
+    // Still inside tunggu().
+    baik_set_errorf(baik, BAIK_SUSPENDED, NULL);
+  } else {
+    baik_execute(baik, BAIK_BCODE_OFFSET_RESUME, &r);
+    baik_bcode_reclaim(baik, &r);
+  }
+  if (res != NULL) *res = r;
+  return baik->error;
+}
+
+// Parses src into a code object without running it; the instance is only
+// borrowed for the parser. Drop the reference with baik_code_unref.
+baik_err_t baik_compile(struct baik *baik, const char *path, const char *src,
+                        struct baik_code **code) {
+  struct baik_bcode_part *bp;
+  struct baik_code *c;
+  *code = NULL;
+  if (baik_parse(path, src, baik) != BAIK_OK) return baik->error;
+
+  // Nothing can point into the part yet, so its offsets are given back.
+  bp = baik_bcode_part_get(baik, baik_bcode_parts_cnt(baik) - 1);
+  c = (struct baik_code *) calloc(1, sizeof(*c));
+  if (c == NULL) {
+    free((void *) bp->data.p);
+  } else {
+    c->refs = 1;
+    c->p = bp->data.p;
+    c->len = bp->data.len;
+  }
+  baik->bcode_len = bp->start_idx;
+  baik->bcode_parts.len -= sizeof(*bp);
+  if (c == NULL) {
+    return baik_set_errorf(baik, BAIK_OUT_OF_MEMORY, "kehabisan memori");
+  }
+  *code = c;
+  return BAIK_OK;
+}
+
+// Wraps bytecode that outlives every instance using it, such as a .inac
+// image in flash. Returns NULL if it does not look like bytecode.
+struct baik_code *baik_code_from_rom(const void *bcode, size_t len) {
+  struct baik_code *c;
+  if (len == 0 || *(const uint8_t *) bcode != OP_BCODE_HEADER) return NULL;
+  c = (struct baik_code *) calloc(1, sizeof(*c));
+  if (c != NULL) {
+    c->refs = 1;
+    c->p = (const char *) bcode;
+    c->len = len;
+    c->in_rom = 1;
+  }
+  return c;
+}
+
+// Runs a code object in this instance. The instance maps it at its own
+// offsets and takes a reference instead of copying it.
+baik_err_t baik_exec_code(struct baik *baik, struct baik_code *code,
+                          baik_val_t *res) {
+  struct baik_bcode_part bp;
+  baik_val_t r = BAIK_UNDEFINED;
+  if (baik->suspended) {
+    if (res != NULL) *res = BAIK_UNDEFINED;
+    return baik_set_errorf(baik, BAIK_INTERNAL_ERROR,
+                           "eksekusi sebelumnya masih ditangguhkan");
+  }
+  memset(&bp, 0, sizeof(bp));
+  bp.data.p = code->p;
+  bp.data.len = code->len;
+  bp.start_idx = baik->bcode_len;
+  bp.exec_res = BAIK_ERRS_CNT;
+  bp.code = code;
+  __atomic_add_fetch(&code->refs, 1, __ATOMIC_RELAXED);
+  baik_bcode_part_add(baik, &bp);
+  baik->bcode_len += bp.data.len;
+
+  if (strcmp(baik_get_bcode_filename(baik, &bp), "<stdin>") == 0) {
+    baik->bcode_unreclaimed += bp.data.len;
+  }
+  baik_execute(baik, bp.start_idx, &r);
+  baik_bcode_reclaim(baik, &r);
+  if (res != NULL) *res = r;
+  return baik->error;
+}
+
+baik_err_t baik_exec_file(struct baik *baik, const char *path, baik_val_t *res) {
+  baik_err_t error = BAIK_FILE_READ_ERROR;
+  baik_val_t r = BAIK_UNDEFINED;
+  size_t size;
+  char *source_code = BAIK_EM_read_file(path, &size);
+
+  if (source_code == NULL) {
+    error = BAIK_FILE_READ_ERROR;
+    baik_prepend_errorf(baik, error, "GALAT : gagal membaca file \"%s\"", path);
+    goto clean;
+  }
+
+  r = BAIK_UNDEFINED;
+  error = baik_exec_internal(baik, path, source_code, -1, &r);
+  free(source_code);
+
+clean:
+  if (res != NULL) *res = r;
+  return error;
+}
+
+baik_err_t baik_call(struct baik *baik, baik_val_t *res, baik_val_t func,
+                   baik_val_t this_val, int nargs, ...) {
+  va_list ap;
+  int i;
+  baik_err_t ret;
+  baik_val_t *args = calloc(nargs, sizeof(baik_val_t));
+  va_start(ap, nargs);
+  for (i = 0; i < nargs; i++) {
+    args[i] = va_arg(ap, baik_val_t);
+  }
+  va_end(ap);
+
+  ret = baik_apply(baik, res, func, this_val, nargs, args);
+
+  free(args);
+  return ret;
+}
+
+baik_err_t baik_apply(struct baik *baik, baik_val_t *res, baik_val_t func,
+                    baik_val_t this_val, int nargs, baik_val_t *args) {
+  baik_val_t r, prev_this_val, retval_stack_idx, *resp;
+  int i;
+
+  //if (!baik_is_function(func) && !baik_is_foreign(func) &&
+  //     !baik_is_ffi_sig(func)) {
+  //   return baik_set_errorf(baik, BAIK_TYPE_ERROR, "calling non-callable");
+  // }
+
+  //LOG(LL_VERBOSE_DEBUG, ("applying func %d", (int) baik_get_func_addr(func)));
+
+  prev_this_val = baik->vals.this_obj;
+
+  baik_push(baik, func);
+  resp = vptr(&baik->stack, -1);
+  retval_stack_idx = baik_mk_number(baik, (double) baik_stack_size(&baik->stack));
+
+  for (i = 0; i < nargs; i++) {
+    baik_push(baik, args[i]);
+  }
+
+  push_baik_val(&baik->arg_stack, this_val);
+  call_stack_push_frame(baik, BAIK_BCODE_OFFSET_EXIT, -1, retval_stack_idx);
+
+  // if (baik_is_foreign(func)) {
+  //   ((void (*) (struct baik *)) baik_get_ptr(baik, func))(baik);
+  //   if (res != NULL) *res = *resp;
+  // } else if (baik_is_ffi_sig(func)) {
+  //   baik_ffi_call2(baik);
+  //   if (res != NULL) *res = *resp;
+  // } else {
+    size_t addr = baik_get_func_addr(func);
+    baik_execute(baik, addr, &r);
+    if (res != NULL) *res = r;
+  //}
+
+  if (baik->error != BAIK_OK) {
+    call_stack_restore_frame(baik, NULL);
+
+    
+    baik_pop(baik);
+  }
+  baik->vals.this_obj = prev_this_val;
+
+  return baik->error;
+}
+
+#ifndef RTLD_DEFAULT
+#define RTLD_DEFAULT NULL
+#endif
+
+// static ffi_fn_t *get_cb_impl_by_signature(const baik_ffi_sig_t *sig);
+
+
+struct cbdata {
+  baik_val_t func;
+  baik_val_t userdata;
+  int8_t func_idx;
+  int8_t userdata_idx;
+};
+
+// void baik_set_ffi_resolver(struct baik *baik, baik_ffi_resolver_t *dlsym) {
+//   baik->dlsym = dlsym;
+// }
+
+// static baik_ffi_ctype_t parse_cval_type(struct baik *baik, const char *s,
+//                                        const char *e) {
+//   struct baik_generic_str ms = GENERIC_NULL_STR;
+ 
+//   while (s < e && isspace((int) *s)) s++;
+//   while (e > s && isspace((int) e[-1])) e--;
+//   ms.p = s;
+//   ms.len = e - s;
+//   if (baik_generic_vcmp(&ms, "void") == 0) {
+//     return BAIK_FFI_CTYPE_NONE;
+//   } else if (baik_generic_vcmp(&ms, "userdata") == 0) {
+//     return BAIK_FFI_CTYPE_USERDATA;
+//   } else if (baik_generic_vcmp(&ms, "int") == 0) {
+//     return BAIK_FFI_CTYPE_INT;
+//   } else if (baik_generic_vcmp(&ms, "bool") == 0) {
+//     return BAIK_FFI_CTYPE_BOOL;
+//   } else if (baik_generic_vcmp(&ms, "double") == 0) {
+//     return BAIK_FFI_CTYPE_DOUBLE;
+//   } else if (baik_generic_vcmp(&ms, "float") == 0) {
+//     return BAIK_FFI_CTYPE_FLOAT;
+//   } else if (baik_generic_vcmp(&ms, "char*") == 0 || baik_generic_vcmp(&ms, "char *") == 0) {
+//     return BAIK_FFI_CTYPE_CHAR_PTR;
+//   } else if (baik_generic_vcmp(&ms, "void*") == 0 || baik_generic_vcmp(&ms, "void *") == 0) {
+//     return BAIK_FFI_CTYPE_VOID_PTR;
+//   } else if (baik_generic_vcmp(&ms, "struct baik_generic_str") == 0) {
+//     return BAIK_FFI_CTYPE_STRUCT_GENERIC_STR;
+//   } else if (baik_generic_vcmp(&ms, "struct baik_generic_str *") == 0 ||
+//              baik_generic_vcmp(&ms, "struct baik_generic_str*") == 0) {
+//     return BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR;
+//   } else {
+//     baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : gagal menguraikan isi tipe \"%.*s\"",
+//                        (int) ms.len, ms.p);
+//     return BAIK_FFI_CTYPE_INVALID;
+//   }
+// }
+
+static const char *find_paren(const char *s, const char *e) {
+  for (; s < e; s++) {
+    if (*s == '(') return s;
+  }
+  return NULL;
+}
+
+static const char *find_closing_paren(const char *s, const char *e) {
+  int nesting = 1;
+  while (s < e) {
+    if (*s == '(') {
+      nesting++;
+    } else if (*s == ')') {
+      if (--nesting == 0) break;
+    }
+    s++;
+  }
+  return (s < e ? s : NULL);
+}
+
+// BAIK_PRIVATE baik_err_t baik_parse_ffi_signature(struct baik *baik, const char *s,
+//                                               int sig_len, baik_ffi_sig_t *sig,
+//                                               enum ffi_sig_type sig_type) {
+//   baik_err_t ret = BAIK_OK;
+//   int vtidx = 0;
+//   const char *cur, *e, *tmp_e, *tmp;
+//   struct baik_generic_str rt = GENERIC_NULL_STR, fn = GENERIC_NULL_STR, args = GENERIC_NULL_STR;
+//   baik_ffi_ctype_t val_type = BAIK_FFI_CTYPE_INVALID;
+//   if (sig_len == ~0) {
+//     sig_len = strlen(s);
+//   }
+//   e = s + sig_len;
+
+//   baik_ffi_sig_init(sig);
+//   for (cur = s; cur < e && isspace((int) *cur); cur++);
+
+//   tmp_e = find_paren(cur, e);
+//   if (tmp_e == NULL || tmp_e - s < 2) {
+//     ret = BAIK_TYPE_ERROR;
+//     baik_prepend_errorf(baik, ret, "1");
+//     goto clean;
+//   }
+//   tmp = find_closing_paren(tmp_e + 1, e);
+//   if (tmp == NULL) {
+//     ret = BAIK_TYPE_ERROR;
+//     baik_prepend_errorf(baik, ret, "2");
+//     goto clean;
+//   }
+
+//   args.p = find_paren(tmp + 1, e);
+//   if (args.p == NULL) {
+   
+//     fn.p = tmp_e - 1;
+//     while (fn.p > cur && isspace((int) *fn.p)) fn.p--;
+//     while (fn.p > cur && (isalnum((int) *fn.p) || *fn.p == '_')) {
+//       fn.p--;
+//       fn.len++;
+//     }
+//     fn.p++;
+//     rt.p = cur;
+//     rt.len = fn.p - rt.p;
+   
+//     args.p = tmp_e + 1;
+//     args.len = tmp - args.p;
+//   } else {
+   
+//     fn.p = tmp + 1;
+//     fn.len = args.p - tmp;
+//     rt.p = cur;
+//     rt.len = tmp_e - rt.p;
+//     args.p++;
+//     tmp = find_closing_paren(args.p, e);
+//     if (tmp == NULL) {
+//       ret = BAIK_TYPE_ERROR;
+//       baik_prepend_errorf(baik, ret, "3");
+//       goto clean;
+//     }
+//     args.len = tmp - args.p;
+   
+//     sig->is_callback = 1;
+//   }
+
+//   val_type = parse_cval_type(baik, rt.p, rt.p + rt.len);
+//   if (val_type == BAIK_FFI_CTYPE_INVALID) {
+//     ret = baik->error;
+//     goto clean;
+//   }
+//   baik_ffi_sig_set_val_type(sig, vtidx++, val_type);
+
+//   if (!sig->is_callback) {
+//     char buf[100];
+//     if (baik->dlsym == NULL) {
+//       ret = BAIK_TYPE_ERROR;
+//       baik_prepend_errorf(baik, ret,
+//                          "GALAT : resolver belum diaktifkan, panggil baik_set_ffi_resolver");
+//       goto clean;
+//     }
+
+//     snprintf(buf, sizeof(buf), "%.*s", (int) fn.len, fn.p);
+//     sig->fn = (ffi_fn_t *) baik->dlsym(RTLD_DEFAULT, buf);
+//     if (sig->fn == NULL) {
+//       ret = BAIK_TYPE_ERROR;
+//       baik_prepend_errorf(baik, ret, "GALAT : dlsym('%s') gagal", buf);
+//       goto clean;
+//     }
+//   } else {
+//     tmp_e = strchr(tmp_e, ')');
+//     if (tmp_e == NULL) {
+//       ret = BAIK_TYPE_ERROR;
+//       goto clean;
+//     }
+//   }
+
+//   cur = tmp_e = args.p;
+
+//   while (tmp_e - args.p < (ptrdiff_t) args.len) {
+//     int level = 0;
+//     int is_fp = 0;
+//     tmp_e = cur;
+
+//     while (*tmp_e && (level > 0 || (*tmp_e != ',' && *tmp_e != ')'))) {
+//       switch (*tmp_e) {
+//         case '(':
+//           level++;
+         
+//           is_fp = 1;
+//           break;
+//         case ')':
+//           level--;
+//           break;
+//       }
+//       tmp_e++;
+//     }
+
+//     if (tmp_e == cur) break;
+
+//     if (is_fp) {
+     
+//       if (sig->cb_sig != NULL) {
+       
+//         ret = BAIK_TYPE_ERROR;
+//         baik_prepend_errorf(baik, ret, "GALAT : hanya satu callback yang diijinkan");
+//         goto clean;
+//       }
+
+//       sig->cb_sig = calloc(sizeof(*sig->cb_sig), 1);
+//       ret = baik_parse_ffi_signature(baik, cur, tmp_e - cur, sig->cb_sig,
+//                                     FFI_SIG_CALLBACK);
+//       if (ret != BAIK_OK) {
+//         baik_ffi_sig_free(sig->cb_sig);
+//         free(sig->cb_sig);
+//         sig->cb_sig = NULL;
+//         goto clean;
+//       }
+//       val_type = BAIK_FFI_CTYPE_CALLBACK;
+//     } else {
+     
+//       val_type = parse_cval_type(baik, cur, tmp_e);
+//       if (val_type == BAIK_FFI_CTYPE_INVALID) {
+       
+//         ret = BAIK_TYPE_ERROR;
+//         goto clean;
+//       }
+//     }
+
+//     if (!baik_ffi_sig_set_val_type(sig, vtidx++, val_type)) {
+//       ret = BAIK_TYPE_ERROR;
+//       baik_prepend_errorf(baik, ret, "GALAT : begitu banyak argumen callback");
+//       goto clean;
+//     }
+
+//     if (*tmp_e == ',') {
+//       cur = tmp_e + 1;
+//       while (*cur == ' ') cur++;
+//     } else {
+     
+//       break;
+//     }
+//   }
+ 
+
+ 
+//   baik_ffi_sig_validate(baik, sig, sig_type);
+//   if (!sig->is_valid) {
+//     ret = BAIK_TYPE_ERROR;
+//     goto clean;
+//   }
+
+//   if (sig->is_callback) {
+//     sig->fn = get_cb_impl_by_signature(sig);
+//     if (sig->fn == NULL) {
+//       ret = BAIK_TYPE_ERROR;
+//       baik_prepend_errorf(baik, ret,
+//                          "GALAT : callback signature valid, "
+//                          "tetapi tidak ada callback yang terdefinisi");
+//       goto clean;
+//     }
+//   }
+
+// clean:
+//   if (ret != BAIK_OK) {
+//     baik_prepend_errorf(baik, ret, "GALAT : ffi signature bermasalah: \"%.*s\"", sig_len, s);
+//     sig->is_valid = 0;
+//   }
+//   return ret;
+// }
+
+union ffi_cb_data_val {
+  void *p;
+  uintptr_t w;
+  double d;
+  float f;
+};
+
+// struct ffi_cb_data {
+//   union ffi_cb_data_val args[BAIK_CB_ARGS_MAX_CNT];
+// };
+
+// static union ffi_cb_data_val ffi_cb_impl_generic(void *param,
+//                                                  struct ffi_cb_data *data) {
+//   struct baik_ffi_cb_args *cbargs = (struct baik_ffi_cb_args *) param;
+//   baik_val_t *args, res = BAIK_UNDEFINED;
+//   union ffi_cb_data_val ret;
+//   int i;
+//   struct baik *baik = cbargs->baik;
+//   baik_ffi_ctype_t return_ctype = BAIK_FFI_CTYPE_NONE;
+//   baik_err_t err;
+
+//   memset(&ret, 0, sizeof(ret));
+//   baik_own(baik, &res);
+
+//   assert(cbargs->sig.args_cnt > 0);
+
+//   args = calloc(1, sizeof(baik_val_t) * cbargs->sig.args_cnt);
+//   for (i = 0; i < cbargs->sig.args_cnt; i++) {
+//     baik_ffi_ctype_t val_type =
+//         cbargs->sig.val_types[i + 1];
+//     switch (val_type) {
+//       case BAIK_FFI_CTYPE_USERDATA:
+//         args[i] = cbargs->userdata;
+//         break;
+//       case BAIK_FFI_CTYPE_INT:
+//         args[i] = baik_mk_number(baik, (double) data->args[i].w);
+//         break;
+//       case BAIK_FFI_CTYPE_BOOL:
+//         args[i] = baik_mk_boolean(baik, !!data->args[i].w);
+//         break;
+//       case BAIK_FFI_CTYPE_CHAR_PTR: {
+//         const char *s = (char *) data->args[i].w;
+//         if (s == NULL) s = "";
+//         args[i] = baik_mk_string(baik, s, ~0, 1);
+//         break;
+//       }
+//       case BAIK_FFI_CTYPE_VOID_PTR:
+//         args[i] = baik_mk_foreign(baik, (void *) data->args[i].w);
+//         break;
+//       case BAIK_FFI_CTYPE_DOUBLE:
+//         args[i] = baik_mk_number(baik, data->args[i].d);
+//         break;
+//       case BAIK_FFI_CTYPE_FLOAT:
+//         args[i] = baik_mk_number(baik, data->args[i].f);
+//         break;
+//       case BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR: {
+//         struct baik_generic_str *s = (struct baik_generic_str *) (void *) data->args[i].w;
+//         args[i] = baik_mk_string(baik, s->p, s->len, 1);
+//         break;
+//       }
+//       default:
+       
+//         LOG(LL_ERROR, ("unexpected val type for arg #%d: %d\n", i, val_type));
+//         abort();
+//     }
+//   }
+
+ 
+//   return_ctype = cbargs->sig.val_types[0];
+
+//   LOG(LL_VERBOSE_DEBUG, ("calling BAIK callback void-void %d from C",
+//                          baik_get_int(baik, cbargs->func)));
+//   err = baik_apply(baik, &res, cbargs->func, BAIK_UNDEFINED, cbargs->sig.args_cnt,
+//                   args);
+//   cbargs = NULL;
+//   if (err != BAIK_OK) {
+//     baik_print_error(baik, stderr, "BAIK callback error",
+//                     1);
+//     goto clean;
+//   }
+
+ 
+//   switch (return_ctype) {
+//     case BAIK_FFI_CTYPE_NONE:
+//       break;
+//     case BAIK_FFI_CTYPE_INT:
+//       ret.w = baik_get_int(baik, res);
+//       break;
+//     case BAIK_FFI_CTYPE_BOOL:
+//       ret.w = baik_get_bool(baik, res);
+//       break;
+//     case BAIK_FFI_CTYPE_VOID_PTR:
+//       ret.p = baik_get_ptr(baik, res);
+//       break;
+//     case BAIK_FFI_CTYPE_DOUBLE:
+//       ret.d = baik_get_double(baik, res);
+//       break;
+//     case BAIK_FFI_CTYPE_FLOAT:
+//       ret.f = (float) baik_get_double(baik, res);
+//       break;
+//     default:
+//       LOG(LL_ERROR, ("unexpected return val type %d\n", return_ctype));
+//       abort();
+//   }
+
+// clean:
+//   free(args);
+//   baik_disown(baik, &res);
+//   return ret;
+// }
+
+// static void ffi_init_cb_data_wwww(struct ffi_cb_data *data, uintptr_t w0,
+//                                   uintptr_t w1, uintptr_t w2, uintptr_t w3,
+//                                   uintptr_t w4, uintptr_t w5) {
+//   memset(data, 0, sizeof(*data));
+//   data->args[0].w = w0;
+//   data->args[1].w = w1;
+//   data->args[2].w = w2;
+//   data->args[3].w = w3;
+//   data->args[4].w = w4;
+//   data->args[5].w = w5;
+// }
+
+// static uintptr_t ffi_cb_impl_wpwwwww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
+//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
+//   struct ffi_cb_data data;
+//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
+//   return ffi_cb_impl_generic((void *) w0, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wwpwwww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
+//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
+//   struct ffi_cb_data data;
+//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
+//   return ffi_cb_impl_generic((void *) w1, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wwwpwww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
+//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
+//   struct ffi_cb_data data;
+//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
+//   return ffi_cb_impl_generic((void *) w2, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wwwwpww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
+//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
+//   struct ffi_cb_data data;
+//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
+//   return ffi_cb_impl_generic((void *) w3, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wwwwwpw(uintptr_t w0, uintptr_t w1, uintptr_t w2,
+//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
+//   struct ffi_cb_data data;
+//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
+//   return ffi_cb_impl_generic((void *) w4, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wwwwwwp(uintptr_t w0, uintptr_t w1, uintptr_t w2,
+//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
+//   struct ffi_cb_data data;
+//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
+//   return ffi_cb_impl_generic((void *) w5, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wpd(uintptr_t w0, double d1) {
+//   struct ffi_cb_data data;
+
+//   memset(&data, 0, sizeof(data));
+//   data.args[0].w = w0;
+//   data.args[1].d = d1;
+
+//   return ffi_cb_impl_generic((void *) w0, &data).w;
+// }
+
+// static uintptr_t ffi_cb_impl_wdp(double d0, uintptr_t w1) {
+//   struct ffi_cb_data data;
+
+//   memset(&data, 0, sizeof(data));
+//   data.args[0].d = d0;
+//   data.args[1].w = w1;
+
+//   return ffi_cb_impl_generic((void *) w1, &data).w;
+// }
+
+
+// static struct baik_ffi_cb_args **ffi_get_matching(struct baik_ffi_cb_args **plist,
+//                                                  baik_val_t func,
+//                                                  baik_val_t userdata) {
+//   for (; *plist != NULL; plist = &((*plist)->next)) {
+//     if ((*plist)->func == func && (*plist)->userdata == userdata) {
+//       break;
+//     }
+//   }
+//   return plist;
+// }
+
+// static ffi_fn_t *get_cb_impl_by_signature(const baik_ffi_sig_t *sig) {
+//   if (sig->is_valid) {
+//     int i;
+//     int double_cnt = 0;
+//     int float_cnt = 0;
+//     int userdata_idx = 0;
+
+//     for (i = 1; i < BAIK_CB_SIGNATURE_MAX_SIZE;
+//          i++) {
+//       baik_ffi_ctype_t type = sig->val_types[i];
+//       switch (type) {
+//         case BAIK_FFI_CTYPE_DOUBLE:
+//           double_cnt++;
+//           break;
+//         case BAIK_FFI_CTYPE_FLOAT:
+//           float_cnt++;
+//           break;
+//         case BAIK_FFI_CTYPE_USERDATA:
+//           assert(userdata_idx == 0);
+//           userdata_idx = i;
+//           break;
+//         default:
+//           break;
+//       }
+//     }
+
+//     if (float_cnt > 0) {
+//       return NULL;
+//     }
+
+//     assert(userdata_idx > 0);
+
+//     if (sig->args_cnt <= BAIK_CB_ARGS_MAX_CNT) {
+//       if (baik_ffi_is_regular_word_or_void(sig->val_types[0])) {
+       
+//         switch (double_cnt) {
+//           case 0:
+//             switch (userdata_idx) {
+//               case 1:
+//                 return (ffi_fn_t *) ffi_cb_impl_wpwwwww;
+//               case 2:
+//                 return (ffi_fn_t *) ffi_cb_impl_wwpwwww;
+//               case 3:
+//                 return (ffi_fn_t *) ffi_cb_impl_wwwpwww;
+//               case 4:
+//                 return (ffi_fn_t *) ffi_cb_impl_wwwwpww;
+//               case 5:
+//                 return (ffi_fn_t *) ffi_cb_impl_wwwwwpw;
+//               case 6:
+//                 return (ffi_fn_t *) ffi_cb_impl_wwwwwwp;
+//               default:
+//                 abort();
+//             }
+//             break;
+//           case 1:
+           
+//             switch (userdata_idx) {
+//               case 1:
+//                 return (ffi_fn_t *) ffi_cb_impl_wpd;
+//               case 2:
+//                 return (ffi_fn_t *) ffi_cb_impl_wdp;
+//             }
+//             break;
+//         }
+//       }
+//     } else {}
+//   }
+
+//   return NULL;
+// }
+
+// BAIK_PRIVATE baik_val_t baik_ffi_sig_to_value(struct baik_ffi_sig *psig) {
+//   if (psig == NULL) {
+//     return BAIK_NULL;
+//   } else {
+//     return baik_legit_pointer_to_value(psig) | BAIK_TAG_FUNCTION_FFI;
+//   }
+// }
+
+// BAIK_PRIVATE int baik_is_ffi_sig(baik_val_t v) {
+//   return (v & BAIK_TAG_MASK) == BAIK_TAG_FUNCTION_FFI;
+// }
+
+// BAIK_PRIVATE struct baik_ffi_sig *baik_get_ffi_sig_struct(baik_val_t v) {
+//   struct baik_ffi_sig *ret = NULL;
+//   assert(baik_is_ffi_sig(v));
+//   ret = (struct baik_ffi_sig *) get_ptr(v);
+//   return ret;
+// }
+
+// BAIK_PRIVATE baik_val_t baik_mk_ffi_sig(struct baik *baik) {
+//   struct baik_ffi_sig *psig = new_ffi_sig(baik);
+//   baik_ffi_sig_init(psig);
+//   return baik_ffi_sig_to_value(psig);
+// }
+
+// BAIK_PRIVATE void baik_ffi_sig_destructor(struct baik *baik, void *psig) {
+//   baik_ffi_sig_free((baik_ffi_sig_t *) psig);
+//   (void) baik;
+// }
+
+// BAIK_PRIVATE void *baik_dlsym(void *handle, const char *name) {
+//     void *client_hndl;
+//     typedef int main_t(int, char**);
+//     main_t *client_main;
+//     client_hndl = dlopen(baik_dlsym_file,  RTLD_LAZY);
+//     if (!client_hndl){
+//         fprintf(stderr, "%s\n", dlerror());
+//         exit(1);
+//     }
+//     client_main = (main_t*)dlsym(client_hndl, name);
+//     if (!client_main){
+//         fprintf(stderr, "%s\n", dlerror());
+//         exit(2);
+//     }
+//     else{
+//         return (main_t*)dlsym(client_hndl, name);
+//     }
+//     return NULL;
+// }
+
+// BAIK_PRIVATE baik_err_t baik_ffi_call(struct baik *baik) {
+//   baik_err_t e = BAIK_OK;
+//   const char *sig_str = NULL;
+//   baik_val_t sig_str_v = baik_arg(baik, 0);
+//   baik_val_t ret_v = BAIK_UNDEFINED;
+//   struct baik_ffi_sig *psig = baik_get_ffi_sig_struct(baik_mk_ffi_sig(baik));
+//   size_t sig_str_len;
+  
+//   sig_str = baik_get_string(baik, &sig_str_v, &sig_str_len);
+
+//   size_t sig_str_len_dlsym_file;
+//   baik_val_t sig_str_v_dlsym_file = baik_arg(baik, 1);
+//   baik_dlsym_file = baik_get_string(baik, &sig_str_v_dlsym_file, &sig_str_len_dlsym_file);
+//   if(baik_dlsym_file != NULL){
+//     //printf("%s",baik_dlsym_file);
+//     baik_set_ffi_resolver(baik, baik_dlsym);
+//   }
+
+//   e = baik_parse_ffi_signature(baik, sig_str, sig_str_len, psig, FFI_SIG_FUNC);
+//   if (e != BAIK_OK) goto clean;
+//   ret_v = baik_ffi_sig_to_value(psig);
+
+// clean:
+//   baik_return(baik, ret_v);
+//   return e;
+// }
+
+// BAIK_PRIVATE baik_err_t baik_ffi_call2(struct baik *baik) {
+//   baik_err_t ret = BAIK_OK;
+//   baik_ffi_sig_t *psig = NULL;
+//   baik_ffi_ctype_t rtype;
+//   baik_val_t sig_v = *vptr(&baik->stack, baik_getretvalpos(baik));
+
+//   int i, nargs;
+//   struct ffi_arg res;
+//   struct ffi_arg args[FFI_MAX_ARGS_CNT];
+//   struct cbdata cbdata;
+
+ 
+//   baik_val_t resv = baik_mk_undefined();
 
-  struct baik_bcode_part bp = *baik_bcode_part_get_by_offset(baik, off);
+ 
+//   baik_val_t argvs[FFI_MAX_ARGS_CNT];
+//   struct baik_generic_str argvmgstr[FFI_MAX_ARGS_CNT];
 
-  baik_set_errorf(baik, BAIK_OK, NULL);
-  free(baik->stack_trace);
-  baik->stack_trace = NULL;
+//   if (baik_is_ffi_sig(sig_v)) {
+//     psig = baik_get_ffi_sig_struct(sig_v);
+//   } else {
+//     ret = BAIK_TYPE_ERROR;
+//     baik_prepend_errorf(baik, ret, "GALAT :  isi non-ffi-callable");
+//     goto clean;
+//   }
 
-  off -= bp.start_idx;
+//   memset(&cbdata, 0, sizeof(cbdata));
+//   cbdata.func_idx = -1;
+//   cbdata.userdata_idx = -1;
 
-  for (i = off; i < bp.data.len; i++) {
-    baik->cur_bcode_offset = i;
+//   rtype = psig->val_types[0];
 
-    if (baik->need_gc) {
-      if (maybe_gc(baik)) {
-        baik->need_gc = 0;
-      }
-    }
-#if BAIK_AGGRESSIVE_GC
-    maybe_gc(baik);
-#endif
+//   switch (rtype) {
+//     case BAIK_FFI_CTYPE_DOUBLE:
+//       res.ctype = FFI_CTYPE_DOUBLE;
+//       break;
+//     case BAIK_FFI_CTYPE_FLOAT:
+//       res.ctype = FFI_CTYPE_FLOAT;
+//       break;
+//     case BAIK_FFI_CTYPE_BOOL:
+//       res.ctype = FFI_CTYPE_BOOL;
+//       break;
+//     case BAIK_FFI_CTYPE_USERDATA:
+//     case BAIK_FFI_CTYPE_INT:
+//     case BAIK_FFI_CTYPE_CHAR_PTR:
+//     case BAIK_FFI_CTYPE_VOID_PTR:
+//     case BAIK_FFI_CTYPE_NONE:
+//       res.ctype = FFI_CTYPE_WORD;
+//       break;
+//     case BAIK_FFI_CTYPE_INVALID:
+//       ret = BAIK_TYPE_ERROR;
+//       baik_prepend_errorf(baik, ret, "GALAT : kesalahan balikan tipe pada fungsi ffi");
+//       goto clean;
+//   }
+//   res.v.i = 0;
 
-    code = (const uint8_t *) bp.data.p;
-    baik_disasm_single(code, i);
-    prev_opcode = opcode;
-    opcode = code[i];
-    switch (opcode) {
-      case OP_BCODE_HEADER: {
-        baik_header_item_t bcode_offset;
-        memcpy(&bcode_offset,
-               code + i + 1 +
-                   sizeof(baik_header_item_t) * BAIK_HDR_ITEM_BCODE_OFFSET,
-               sizeof(bcode_offset));
-        i += bcode_offset;
-      } break;
-      case OP_PUSH_NULL:
-        baik_push(baik, baik_mk_null());
-        break;
-      case OP_PUSH_UNDEF:
-        baik_push(baik, baik_mk_undefined());
-        break;
-      case OP_PUSH_FALSE:
-        baik_push(baik, baik_mk_boolean(baik, 0));
-        break;
-      case OP_PUSH_TRUE:
-        baik_push(baik, baik_mk_boolean(baik, 1));
-        break;
-      case OP_PUSH_OBJ:
-        baik_push(baik, baik_mk_object(baik));
-        break;
-      case OP_PUSH_ARRAY:
-        baik_push(baik, baik_mk_array(baik));
-        break;
-      case OP_PUSH_FUNC: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        baik_push(baik, baik_mk_function(baik, bp.start_idx + i - n));
-        i += llen;
-        break;
-      }
-      case OP_PUSH_THIS:
-        baik_push(baik, baik->vals.this_obj);
-        break;
-      case OP_JMP: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        i += n + llen;
-        break;
-      }
-      case OP_JMP_FALSE: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        i += llen;
-        if (!baik_is_truthy(baik, baik_pop(baik))) {
-          baik_push(baik, BAIK_UNDEFINED);
-          i += n;
-        }
-        break;
-      }
-     
-      case OP_JMP_NEUTRAL_TRUE: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        i += llen;
-        if (baik_is_truthy(baik, vtop(&baik->stack))) {
-          i += n;
-        }
-        break;
-      }
-      case OP_JMP_NEUTRAL_FALSE: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        i += llen;
-        if (!baik_is_truthy(baik, vtop(&baik->stack))) {
-          i += n;
-        }
-        break;
-      }
-      case OP_FIND_SCOPE: {
-        baik_val_t key = vtop(&baik->stack);
-        baik_push(baik, baik_find_scope(baik, key));
-        break;
-      }
-      case OP_CREATE: {
-        baik_val_t obj = baik_pop(baik);
-        baik_val_t key = baik_pop(baik);
-        if (baik_get_own_property_v(baik, obj, key) == NULL) {
-          baik_set_v(baik, obj, key, BAIK_UNDEFINED);
-        }
-        break;
-      }
-      case OP_APPEND: {
-        baik_val_t val = baik_pop(baik);
-        baik_val_t arr = baik_pop(baik);
-        baik_err_t err = baik_array_push(baik, arr, val);
-        if (err != BAIK_OK) {
-          baik_set_errorf(baik, BAIK_TYPE_ERROR, "append to non-array");
-        }
-        break;
-      }
-      case OP_GET: {
-        baik_val_t obj = baik_pop(baik);
-        baik_val_t key = baik_pop(baik);
-        baik_val_t val = BAIK_UNDEFINED;
+//   nargs =
+//       baik_stack_size(&baik->stack) - baik_get_int(baik, vtop(&baik->call_stack));
 
-        if (!getprop_builtin(baik, obj, key, &val)) {
-          if (baik_is_object(obj)) {
-            val = baik_get_v_proto(baik, obj, key);
-          } else {
-            baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tipe galat");
-          }
-        }
+//   if (nargs != psig->args_cnt) {
+//     ret = BAIK_TYPE_ERROR;
+//     baik_prepend_errorf(baik, ret, "GALAT : got %d actuals, but function takes %d args",
+//                        nargs, psig->args_cnt);
+//     goto clean;
+//   }
 
-        baik_push(baik, val);
-        if (prev_opcode != OP_FIND_SCOPE) {
+//   for (i = 0; i < nargs; i++) {
+//     baik_val_t arg = baik_arg(baik, i);
+
+//     switch (psig->val_types[1 + i]) {
+//       case BAIK_FFI_CTYPE_NONE:
+       
+//         ret = BAIK_TYPE_ERROR;
+//         if (i == 0) {
          
-          baik->vals.last_getprop_obj = obj;
-        } else {
+//           baik_prepend_errorf(baik, ret, "GALAT : fungsi ffi-ed tidak memiliki argumen");
+//         } else {
          
-          baik->vals.last_getprop_obj = BAIK_UNDEFINED;
-        }
-        break;
-      }
-      case OP_DEL_SCOPE:
-        if (baik->scopes.len <= 1) {
-          baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "scopes underflow");
-        } else {
-          baik_pop_val(&baik->scopes);
-        }
-        break;
-      case OP_NEW_SCOPE:
-        push_baik_val(&baik->scopes, baik_mk_object(baik));
-        break;
-      case OP_PUSH_SCOPE:
-        assert(baik_stack_size(&baik->scopes) > 0);
-        baik_push(baik, vtop(&baik->scopes));
-        break;
-      case OP_PUSH_STR: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        baik_push(baik, baik_mk_string(baik, (char *) code + i + 1 + llen, n, 1));
-        i += llen + n;
-        break;
-      }
-      case OP_PUSH_INT: {
-        int llen;
-        int64_t n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        baik_push(baik, baik_mk_number(baik, (double) n));
-        i += llen;
-        break;
-      }
-      case OP_PUSH_DBL: {
-        int llen, n = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen);
-        baik_push(baik, baik_mk_number(
-                          baik, strtod((char *) code + i + 1 + llen, NULL)));
-        i += llen + n;
-        break;
-      }
-      case OP_FOR_IN_NEXT: {
-       
-        baik_val_t *iterator = vptr(&baik->stack, -1);
-        baik_val_t obj = *vptr(&baik->stack, -2);
-        if (baik_is_object(obj)) {
-          baik_val_t var_name = *vptr(&baik->stack, -3);
-          baik_val_t key = baik_next(baik, obj, iterator);
-          if (key != BAIK_UNDEFINED) {
-            baik_val_t scope = baik_find_scope(baik, var_name);
-            baik_set_v(baik, scope, var_name, key);
-          }
-        } else {
-          baik_set_errorf(baik, BAIK_TYPE_ERROR,
-                         "can't iterate over non-object value");
-        }
-        break;
-      }
-      case OP_RETURN: {
-       
-        size_t off_ret = call_stack_restore_frame(baik);
-        if (off_ret != BAIK_BCODE_OFFSET_EXIT) {
-          bp = *baik_bcode_part_get_by_offset(baik, off_ret);
-          code = (const uint8_t *) bp.data.p;
-          i = off_ret - bp.start_idx;
-          LOG(LL_VERBOSE_DEBUG, ("RETURNING TO %d", (int) off_ret + 1));
-        } else {
-          goto clean;
-        }
-        
-        break;
-      }
-      case OP_ARGS: {
-       
-        if (prev_opcode != OP_GET) {
-          baik->vals.last_getprop_obj = BAIK_UNDEFINED;
-        }
+//           baik_prepend_errorf(baik, ret, "GALAT : arg ffi bermasalah #%d tipe: \"void\"", i);
+//         }
 
+//         goto clean;
+//       case BAIK_FFI_CTYPE_USERDATA:
        
-        push_baik_val(&baik->arg_stack, baik->vals.last_getprop_obj);
-       
-        push_baik_val(&baik->arg_stack,
-                     baik_mk_number(baik, (double) baik_stack_size(&baik->stack)));
-        break;
-      }
-      case OP_CALL: {
-        
-        
-        int func_pos;
-        baik_val_t *func;
-        baik_val_t retval_stack_idx = vtop(&baik->arg_stack);
-        func_pos = baik_get_int(baik, retval_stack_idx) - 1;
-        func = vptr(&baik->stack, func_pos);
+//         if (cbdata.userdata_idx != -1) {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(baik, ret, "GALAT dua atau lebih argumen userdata : #%d and %d",
+//                              cbdata.userdata_idx, i);
 
+//           goto clean;
+//         }
+//         cbdata.userdata = arg;
+//         cbdata.userdata_idx = i;
+//         break;
+//       case BAIK_FFI_CTYPE_INT: {
+//         int intval = 0;
+//         if (baik_is_number(arg)) {
+//           intval = baik_get_int(baik, arg);
+//         } else if (baik_is_boolean(arg)) {
+//           intval = baik_get_bool(baik, arg);
+//         } else {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(
+//               baik, ret, "GALAT : arg #%d bukan int (tipe idx adalah: %s)", i,
+//               baik_typeof(arg));
+//         }
+//         ffi_set_word(&args[i], intval);
+//       } break;
+//       case BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR: {
+//         if (!baik_is_string(arg)) {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(
+//               baik, ret, "GALAT : arg #%d bukan string (tipe idx adalah: %s)",
+//               i, baik_typeof(arg));
+//           goto clean;
+//         }
+//         argvs[i] = arg;
+//         argvmgstr[i].p = baik_get_string(baik, &argvs[i], &argvmgstr[i].len);
        
-        baik_pop_val(&baik->arg_stack);
+//         ffi_set_ptr(&args[i], (void *) &argvmgstr[i]);
+//         break;
+//       }
+//       case BAIK_FFI_CTYPE_BOOL: {
+//         int intval = 0;
+//         if (baik_is_number(arg)) {
+//           intval = !!baik_get_int(baik, arg);
+//         } else if (baik_is_boolean(arg)) {
+//           intval = baik_get_bool(baik, arg);
+//         } else {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(
+//               baik, ret, "GALAT : arg #%d bukan bool (tipe idx adalah: %s)", i,
+//               baik_typeof(arg));
+//         }
+//         ffi_set_word(&args[i], intval);
+//       } break;
+//       case BAIK_FFI_CTYPE_DOUBLE:
+//         ffi_set_double(&args[i], baik_get_double(baik, arg));
+//         break;
+//       case BAIK_FFI_CTYPE_FLOAT:
+//         ffi_set_float(&args[i], (float) baik_get_double(baik, arg));
+//         break;
+//       case BAIK_FFI_CTYPE_CHAR_PTR: {
+//         size_t s;
+//         if (baik_is_string(arg)) {
+         
+//           argvs[i] = arg;
+//           ffi_set_ptr(&args[i], (void *) baik_get_string(baik, &argvs[i], &s));
+//         } else if (baik_is_null(arg)) {
+//           ffi_set_ptr(&args[i], NULL);
+//         } else {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(
+//               baik, ret, "GALAT : arg #%d bukan string (tipe idx adalah: %s)",
+//               i, baik_typeof(arg));
+//           goto clean;
+//         }
+//       } break;
+//       case BAIK_FFI_CTYPE_VOID_PTR:
+//         if (baik_is_string(arg)) {
+//           size_t n;
+         
+//           argvs[i] = arg;
+//           ffi_set_ptr(&args[i], (void *) baik_get_string(baik, &argvs[i], &n));
+//         } else if (baik_is_foreign(arg)) {
+//           ffi_set_ptr(&args[i], (void *) baik_get_ptr(baik, arg));
+//         } else if (baik_is_null(arg)) {
+//           ffi_set_ptr(&args[i], NULL);
+//         } else {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(baik, ret, "GALAT : arg #%d bukan ptr", i);
+//           goto clean;
+//         }
+//         break;
+//       case BAIK_FFI_CTYPE_CALLBACK:
+//         if (baik_is_function(arg) || baik_is_foreign(arg) ||
+//             baik_is_ffi_sig(arg)) {
+         
+//           cbdata.func = arg;
+//           cbdata.func_idx = i;
+//         } else {
+//           ret = BAIK_TYPE_ERROR;
+//           baik_prepend_errorf(baik, ret,
+//                              "GALAT : arg #%d bukan fungsi, tetapi %s", i,
+//                              baik_stringify_type((enum baik_type) arg));
+//           goto clean;
+//         }
+//         break;
+//       case BAIK_FFI_CTYPE_INVALID:
+       
+//         ret = BAIK_TYPE_ERROR;
+//         baik_prepend_errorf(baik, ret, "GALAT : kesalahan tipe arg");
+//         goto clean;
+//       default:
+//         abort();
+//         break;
+//     }
+//   }
 
-        if (baik_is_function(*func)) {
-          size_t off_call;
-          call_stack_push_frame(baik, bp.start_idx + i, retval_stack_idx);
+//   if (cbdata.userdata_idx >= 0 && cbdata.func_idx >= 0) {
+//     struct baik_ffi_cb_args *cbargs = NULL;
+//     struct baik_ffi_cb_args **pitem = NULL;
 
-         
-          off_call = baik_get_func_addr(*func) - 1;
-          bp = *baik_bcode_part_get_by_offset(baik, off_call);
-          code = (const uint8_t *) bp.data.p;
-          i = off_call - bp.start_idx;
+//     pitem = ffi_get_matching(&baik->ffi_cb_args, cbdata.func, cbdata.userdata);
+//     if (*pitem == NULL) {
+     
+//       cbargs = calloc(1, sizeof(*cbargs));
+//       cbargs->baik = baik;
+//       cbargs->func = cbdata.func;
+//       cbargs->userdata = cbdata.userdata;
+//       baik_ffi_sig_copy(&cbargs->sig, psig->cb_sig);
 
-          *func = BAIK_UNDEFINED;  
-          
-        } else if (baik_is_string(*func) ){//|| baik_is_ffi_sig(*func)) {
-         
+//       *pitem = cbargs;
+//     } else {
+     
+//       cbargs = *pitem;
+//     }
 
-          call_stack_push_frame(baik, bp.start_idx + i, retval_stack_idx);
+//     {
+//       union {
+//         ffi_fn_t *fn;
+//         void *p;
+//       } u;
+//       u.fn = psig->cb_sig->fn;
+//       ffi_set_ptr(&args[cbdata.func_idx], u.p);
+//       ffi_set_ptr(&args[cbdata.userdata_idx], cbargs);
+//     }
+//   } else if (!(cbdata.userdata_idx == -1 && cbdata.func_idx == -1)) {
+   
+//     abort();
+//   }
 
-         
-          //baik_ffi_call2(baik);
+//   ffi_call(psig->fn, nargs, &res, args);
 
-          call_stack_restore_frame(baik);
-        } else if (baik_is_foreign(*func)) {
-         
+//   switch (rtype) {
+//     case BAIK_FFI_CTYPE_CHAR_PTR: {
+//       const char *s = (const char *) (uintptr_t) res.v.i;
+//       if (s != NULL) {
+//         resv = baik_mk_string(baik, s, ~0, 1);
+//       } else {
+//         resv = BAIK_NULL;
+//       }
+//       break;
+//     }
+//     case BAIK_FFI_CTYPE_VOID_PTR:
+//       resv = baik_mk_foreign(baik, (void *) (uintptr_t) res.v.i);
+//       break;
+//     case BAIK_FFI_CTYPE_INT:
+//       resv = baik_mk_number(baik, (int) res.v.i);
+//       break;
+//     case BAIK_FFI_CTYPE_BOOL:
+//       resv = baik_mk_boolean(baik, !!res.v.i);
+//       break;
+//     case BAIK_FFI_CTYPE_DOUBLE:
+//       resv = baik_mk_number(baik, res.v.d);
+//       break;
+//     case BAIK_FFI_CTYPE_FLOAT:
+//       resv = baik_mk_number(baik, res.v.f);
+//       break;
+//     default:
+//       resv = baik_mk_undefined();
+//       break;
+//   }
 
-          call_stack_push_frame(baik, bp.start_idx + i, retval_stack_idx);
+// clean:
+ 
+//   if (ret != BAIK_OK) {
+//     baik_prepend_errorf(baik, ret, "GALAT : gagal memanggil fungsi FFIed");
+   
+//   }
+//   baik_return(baik, resv);
 
-         
-          ((void (*) (struct baik *)) baik_get_ptr(baik, *func))(baik);
+//   return ret;
+// }
 
-          call_stack_restore_frame(baik);
-        } else {
-          baik_set_errorf(baik, BAIK_TYPE_ERROR, "calling non-callable");
-        }
-        break;
-      }
-      case OP_SET_ARG: {
-        int llen1, llen2, n,
-            arg_no = BAIK_EM_varint_decode_unsafe(&code[i + 1], &llen1);
-        baik_val_t obj, key, v;
-        n = BAIK_EM_varint_decode_unsafe(&code[i + llen1 + 1], &llen2);
-        key = baik_mk_string(baik, (char *) code + i + 1 + llen1 + llen2, n, 1);
-        obj = vtop(&baik->scopes);
-        v = baik_arg(baik, arg_no);
-        baik_set_v(baik, obj, key, v);
-        i += llen1 + llen2 + n;
-        break;
-      }
-      case OP_SETRETVAL: {
-        if (baik_stack_size(&baik->call_stack) < CALL_STACK_FRAME_ITEMS_CNT) {
-          baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "cannot return");
-        } else {
-          size_t retval_pos = baik_get_int(
-              baik, *vptr(&baik->call_stack,
-                         -1 - CALL_STACK_FRAME_ITEM_RETVAL_STACK_IDX));
-          *vptr(&baik->stack, retval_pos - 1) = baik_pop(baik);
-        }
-        
-        
-        break;
-      }
-      case OP_EXPR: {
-        int op = code[i + 1];
-        exec_expr(baik, op);
-        i++;
-        break;
-      }
-      case OP_DROP: {
-        baik_pop(baik);
-        break;
-      }
-      case OP_DUP: {
-        baik_push(baik, vtop(&baik->stack));
-        break;
-      }
-      case OP_SWAP: {
-        baik_val_t a = baik_pop(baik);
-        baik_val_t b = baik_pop(baik);
-        baik_push(baik, a);
-        baik_push(baik, b);
-        break;
-      }
-      case OP_LOOP: {
-        int l1, l2, off = BAIK_EM_varint_decode_unsafe(&code[i + 1], &l1);
-       
-        push_baik_val(&baik->loop_addresses,
-                     baik_mk_number(baik, (double) baik_stack_size(&baik->scopes)));
+// BAIK_PRIVATE void baik_ffi_cb_free(struct baik *baik) {
+//   baik_val_t ret = baik_mk_number(baik, 0);
+//   baik_val_t func = baik_arg(baik, 0);
+//   baik_val_t userdata = baik_arg(baik, 1);
 
-       
-        push_baik_val(
-            &baik->loop_addresses,
-            baik_mk_number(baik, (double) (i + 1 + l1 + off)));
-        off = BAIK_EM_varint_decode_unsafe(&code[i + 1 + l1], &l2);
+//   if (baik_is_function(func)) {
+//     struct baik_ffi_cb_args **pitem =
+//         ffi_get_matching(&baik->ffi_cb_args, func, userdata);
+//     if (*pitem != NULL) {
+     
+//       struct baik_ffi_cb_args *cbargs = *pitem;
+//       *pitem = cbargs->next;
+//       baik_ffi_sig_free(&cbargs->sig);
+//       free(cbargs);
+//       ret = baik_mk_number(baik, 1);
+//     }
+//   } else {
+//     baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : kesalahan argumen 'func'");
+//   }
 
-       
-        push_baik_val(
-            &baik->loop_addresses,
-            baik_mk_number(baik, (double) (i + 1 + l1 + l2 + off)));
-        i += l1 + l2;
-        break;
-      }
-      case OP_CONTINUE: {
-        if (baik_stack_size(&baik->loop_addresses) >= 3) {
-          size_t scopes_len = baik_get_int(baik, *vptr(&baik->loop_addresses, -3));
-          assert(baik_stack_size(&baik->scopes) >= scopes_len);
-          baik->scopes.len = scopes_len * sizeof(baik_val_t);
+//   baik_return(baik, ret);
+// }
 
-         
-          i = baik_get_int(baik, vtop(&baik->loop_addresses)) - 1;
-        } else {
-          baik_set_errorf(baik, BAIK_SYNTAX_ERROR, "misplaced 'continue'");
-        }
-      } break;
-      case OP_BREAK: {
-        if (baik_stack_size(&baik->loop_addresses) >= 3) {
-          size_t scopes_len;
-         
-          baik_pop_val(&baik->loop_addresses);
+// void baik_ffi_args_free_list(struct baik *baik) {
+//   ffi_cb_args_t *next = baik->ffi_cb_args;
 
-         
-          i = baik_get_int(baik, baik_pop_val(&baik->loop_addresses)) - 1;
+//   while (next != NULL) {
+//     ffi_cb_args_t *cur = next;
+//     next = next->next;
+//     free(cur);
+//   }
+// }
 
-         
-          scopes_len = baik_get_int(baik, baik_pop_val(&baik->loop_addresses));
-          assert(baik_stack_size(&baik->scopes) >= scopes_len);
-          baik->scopes.len = scopes_len * sizeof(baik_val_t);
+// BAIK_PRIVATE void baik_ffi_sig_init(baik_ffi_sig_t *sig) {
+//   memset(sig, 0, sizeof(*sig));
+// }
 
-          LOG(LL_VERBOSE_DEBUG, ("BREAKING TO %d", (int) i + 1));
-        } else {
-          baik_set_errorf(baik, BAIK_SYNTAX_ERROR, "misplaced 'break'");
-        }
-      } break;
-      case OP_NOP:
-        break;
-      case OP_EXIT:
-        i = bp.data.len;
-        break;
-      default:
-#if BAIK_ENABLE_DEBUG
-        baik_dump(baik, 1);
-#endif
-        baik_set_errorf(baik, BAIK_INTERNAL_ERROR, "Unknown opcode: %d, off %d+%d",
-                       (int) opcode, (int) bp.start_idx, (int) i);
-        i = bp.data.len;
-        break;
-    }
-    if (baik->error != BAIK_OK) {
-      baik_gen_stack_trace(baik, bp.start_idx + i - 1);
+// BAIK_PRIVATE void baik_ffi_sig_copy(baik_ffi_sig_t *to,
+//                                   const baik_ffi_sig_t *from) {
+//   memcpy(to, from, sizeof(*to));
+//   if (from->cb_sig != NULL) {
+//     to->cb_sig = calloc(sizeof(*to->cb_sig), 1);
+//     baik_ffi_sig_copy(to->cb_sig, from->cb_sig);
+//   }
+// }
 
-      baik->stack.len = stack_len;
-      baik->call_stack.len = call_stack_len;
-      baik->arg_stack.len = arg_stack_len;
-      baik->scopes.len = scopes_len;
-      baik->loop_addresses.len = loop_addresses_len;
+// BAIK_PRIVATE void baik_ffi_sig_free(baik_ffi_sig_t *sig) {
+//   if (sig->cb_sig != NULL) {
+//     free(sig->cb_sig);
+//     sig->cb_sig = NULL;
+//   }
+// }
 
-      baik_push(baik, BAIK_UNDEFINED);
-      break;
-    }
-  }
+// BAIK_PRIVATE int baik_ffi_sig_set_val_type(baik_ffi_sig_t *sig, int idx,
+//                                          baik_ffi_ctype_t type) {
+//   if (idx < BAIK_CB_SIGNATURE_MAX_SIZE) {
+//     sig->val_types[idx] = type;
+//     return 1;
+//   } else {
+   
+//     return 0;
+//   }
+// }
 
-clean:
- 
-  baik_bcode_part_get_by_offset(baik, start_off)->exec_res = baik->error;
+// BAIK_PRIVATE int baik_ffi_sig_validate(struct baik *baik, baik_ffi_sig_t *sig,
+//                                      enum ffi_sig_type sig_type) {
+//   int ret = 0;
+//   int i;
+//   int callback_idx = 0;
+//   int userdata_idx = 0;
 
-  *res = baik_pop(baik);
-  return baik->error;
-}
+//   sig->is_valid = 0;
 
-BAIK_PRIVATE baik_err_t baik_exec_internal(struct baik *baik, const char *path,
-                                        const char *src, int generate_jsc,
-                                        baik_val_t *res) {
-  size_t off = baik->bcode_len;
-  baik_val_t r = BAIK_UNDEFINED;
-  baik->error = baik_parse(path, src, baik);
-  if (BAIK_EM_log_level >= LL_VERBOSE_DEBUG) baik_dump(baik, 1);
-  if (generate_jsc == -1) generate_jsc = baik->generate_jsc;
-  if (baik->error == BAIK_OK) {
-#if BAIK_GENERATE_INAC && defined(BAIK_EM_MMAP)
-    if (generate_jsc && path != NULL) {
-      const char *jsext = ".ina";
-      int basename_len = (int) strlen(path) - strlen(jsext);
-      if (basename_len > 0 && strcmp(path + basename_len, jsext) == 0) {
-       
-        int rewrite = 1;
-        int read_mmapped = 1;
+//   switch (sig_type) {
+//     case FFI_SIG_FUNC:
+     
+//       if (sig->val_types[0] != BAIK_FFI_CTYPE_NONE &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_INT &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_BOOL &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_DOUBLE &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_FLOAT &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_VOID_PTR &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_CHAR_PTR) {
+//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : nilai tipe balikan salah");
+//         goto clean;
+//       }
+//       break;
+//     case FFI_SIG_CALLBACK:
+     
+//       if (sig->val_types[0] != BAIK_FFI_CTYPE_NONE &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_INT &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_BOOL &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_DOUBLE &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_FLOAT &&
+//           sig->val_types[0] != BAIK_FFI_CTYPE_VOID_PTR) {
+//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tipe nilai balikan salah");
+//         goto clean;
+//       }
+//   }
 
+ 
+//   for (i = 1; i < BAIK_CB_SIGNATURE_MAX_SIZE; i++) {
+//     baik_ffi_ctype_t type = sig->val_types[i];
+//     switch (type) {
+//       case BAIK_FFI_CTYPE_USERDATA:
+//         if (userdata_idx != 0) {
+         
+//           baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
+//                              "GALAT : lebih dari satu userdata arg: #%d dan #%d",
+//                              (userdata_idx - 1), (i - 1));
+//           goto clean;
+//         }
+//         userdata_idx = i;
+//         break;
+//       case BAIK_FFI_CTYPE_CALLBACK:
+//         switch (sig_type) {
+//           case FFI_SIG_FUNC:
+//             break;
+//           case FFI_SIG_CALLBACK:
+//             baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
+//                                "GALAT : callback tidak mendapatkan callback lainnya");
+//             goto clean;
+//         }
+//         callback_idx = i;
+//         break;
+//       case BAIK_FFI_CTYPE_INT:
+//       case BAIK_FFI_CTYPE_BOOL:
+//       case BAIK_FFI_CTYPE_VOID_PTR:
+//       case BAIK_FFI_CTYPE_CHAR_PTR:
+//       case BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR:
+//       case BAIK_FFI_CTYPE_DOUBLE:
+//       case BAIK_FFI_CTYPE_FLOAT:
        
-        const char *jscext = ".inac";
-        char filename_jsc[basename_len + strlen(jscext) + 1];
-        memcpy(filename_jsc, path, basename_len);
-        strcpy(filename_jsc + basename_len, jscext);
-
+//         break;
+//       case BAIK_FFI_CTYPE_NONE:
        
-        struct baik_bcode_part *bp =
-            baik_bcode_part_get(baik, baik_bcode_parts_cnt(baik) - 1);
+//         goto args_over;
+//       default:
+//         baik_prepend_errorf(baik, BAIK_INTERNAL_ERROR, "GALAT : kesalahan ffi_ctype: %d",
+//                            type);
+//         goto clean;
+//     }
 
-       
-        {
-          size_t size;
-          char *data = BAIK_EM_mmap_file(filename_jsc, &size);
-          if (data != NULL) {
-            if (size == bp->data.len) {
-              if (memcmp(data, bp->data.p, size) == 0) {
-               
-                rewrite = 0;
-              }
-            }
-            munmap(data, size);
-          }
-        }
+//     sig->args_cnt++;
+//   }
+// args_over:
 
+//   switch (sig_type) {
+//     case FFI_SIG_FUNC:
+//       if (!((callback_idx > 0 && userdata_idx > 0) ||
+//             (callback_idx == 0 && userdata_idx == 0))) {
+//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
+//                            "GALAT : callback and userdata should be either both "
+//                            "present or both absent");
+//         goto clean;
+//       }
+//       break;
+//     case FFI_SIG_CALLBACK:
+//       if (userdata_idx == 0) {
        
-        if (rewrite) {
-          FILE *fp = fopen(filename_jsc, "wb");
-          if (fp != NULL) {
-           
-            fwrite(bp->data.p, bp->data.len, 1, fp);
-            fclose(fp);
-          } else {
-            LOG(LL_WARN, ("Failed to open %s for writing", filename_jsc));
-            read_mmapped = 0;
-          }
-        }
+//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tanpa userdata arg");
+//         goto clean;
+//       }
+//       break;
+//   }
 
-        if (read_mmapped) {
-          free((void *) bp->data.p);
-          bp->data.p = BAIK_EM_mmap_file(filename_jsc, &bp->data.len);
-          bp->in_rom = 1;
-        }
-      }
-    }
-#else
-    (void) generate_jsc;
-#endif
+//   ret = 1;
 
-    baik_execute(baik, off, &r);
-  }
-  if (res != NULL) *res = r;
-  return baik->error;
-}
+// clean:
+//   if (ret) {
+//     sig->is_valid = 1;
+//   }
+//   return ret;
+// }
 
-baik_err_t baik_exec(struct baik *baik, const char *src, baik_val_t *res) {
-  return baik_exec_internal(baik, "<stdin>", src, 0, res);
-}
+// BAIK_PRIVATE int baik_ffi_is_regular_word(baik_ffi_ctype_t type) {
+//   switch (type) {
+//     case BAIK_FFI_CTYPE_INT:
+//     case BAIK_FFI_CTYPE_BOOL:
+//       return 1;
+//     default:
+//       return 0;
+//   }
+// }
 
-baik_err_t baik_exec_file(struct baik *baik, const char *path, baik_val_t *res) {
-  baik_err_t error = BAIK_FILE_READ_ERROR;
-  baik_val_t r = BAIK_UNDEFINED;
-  size_t size;
-  char *source_code = BAIK_EM_read_file(path, &size);
+// BAIK_PRIVATE int baik_ffi_is_regular_word_or_void(baik_ffi_ctype_t type) {
+//   return (type == BAIK_FFI_CTYPE_NONE || baik_ffi_is_regular_word(type));
+// }
 
-  if (source_code == NULL) {
-    error = BAIK_FILE_READ_ERROR;
-    baik_prepend_errorf(baik, error, "GALAT : gagal membaca file \"%s\"", path);
-    goto clean;
+#ifdef _WIN32
+void *dlsym(void *handle, const char *name) {
+  static HANDLE msvcrt_dll;
+  void *sym = NULL;
+  if (msvcrt_dll == NULL) msvcrt_dll = GetModuleHandle("msvcrt.dll");
+  if ((sym = GetProcAddress(GetModuleHandle(NULL), name)) == NULL) {
+    sym = GetProcAddress(msvcrt_dll, name);
   }
+  return sym;
+}
+#elif !defined(__unix__) && !defined(__APPLE__)
+void *dlsym(void *handle, const char *name) {
+  (void) handle;
+  (void) name;
+  return NULL;
+}
+#endif
 
-  r = BAIK_UNDEFINED;
-  error = baik_exec_internal(baik, path, source_code, -1, &r);
-  free(source_code);
+#include <stdio.h>
 
-clean:
-  if (res != NULL) *res = r;
-  return error;
-}
+#define GC_BLOCK_MARKS_SIZE(n) (((n) + 7) / 8)
+#define GC_BLOCK_CELL_IDX(a, b, p) \
+  ((size_t) ((const char *) (p) - (const char *) (b)->base) / (a)->cell_size)
+#define MARK(b, i) ((b)->marks[(i) >> 3] |= (uint8_t)(1 << ((i) &7)))
+#define MARKED(b, i) ((b)->marks[(i) >> 3] & (1 << ((i) &7)))
+#define FREE_LINK(next) ((uintptr_t) (next) | 1)
+#define MARKED_FREE(p) (((struct gc_cell *) (p))->head.word & 1)
+#define NEXT_FREE(p) \
+  ((struct gc_cell *) (((struct gc_cell *) (p))->head.word & ~(uintptr_t) 1))
+#define GC_ARENA_CELLS_RESERVE 2
 
-baik_err_t baik_call(struct baik *baik, baik_val_t *res, baik_val_t func,
-                   baik_val_t this_val, int nargs, ...) {
-  va_list ap;
-  int i;
-  baik_err_t ret;
-  baik_val_t *args = calloc(nargs, sizeof(baik_val_t));
-  va_start(ap, nargs);
-  for (i = 0; i < nargs; i++) {
-    args[i] = va_arg(ap, baik_val_t);
-  }
-  va_end(ap);
+static struct gc_block *gc_new_block(struct gc_arena *a, size_t size);
+static void gc_free_block(struct gc_block *b);
+static struct gc_block *gc_find_block(const struct gc_arena *a, const void *p);
+static void gc_mark_mbuf_pt(struct baik *baik, const struct mbuf *mbuf);
+#if BAIK_GC_THREADS
+static void gc_bg_take(struct baik *baik, struct gc_arena *a);
 
-  ret = baik_apply(baik, res, func, this_val, nargs, args);
+static int gc_bg_active(struct gc_arena *a) {
+  return __atomic_load_n(&a->bg, __ATOMIC_ACQUIRE);
+}
+#endif
 
-  free(args);
-  return ret;
+BAIK_PRIVATE struct baik_object *new_object(struct baik *baik) {
+  return (struct baik_object *) gc_alloc_cell(baik, &baik->object_arena);
 }
 
-baik_err_t baik_apply(struct baik *baik, baik_val_t *res, baik_val_t func,
-                    baik_val_t this_val, int nargs, baik_val_t *args) {
-  baik_val_t r, prev_this_val, retval_stack_idx, *resp;
-  int i;
+BAIK_PRIVATE struct baik_property *new_property(struct baik *baik) {
+  return (struct baik_property *) gc_alloc_cell(baik, &baik->property_arena);
+}
 
-  //if (!baik_is_function(func) && !baik_is_foreign(func) &&
-  //     !baik_is_ffi_sig(func)) {
-  //   return baik_set_errorf(baik, BAIK_TYPE_ERROR, "calling non-callable");
-  // }
+BAIK_PRIVATE struct baik_ffi_sig *new_ffi_sig(struct baik *baik) {
+  return (struct baik_ffi_sig *) gc_alloc_cell(baik, &baik->ffi_sig_arena);
+}
 
-  //LOG(LL_VERBOSE_DEBUG, ("applying func %d", (int) baik_get_func_addr(func)));
+BAIK_PRIVATE void gc_arena_init(struct gc_arena *a, size_t cell_size,
+                               size_t initial_size, size_t size_increment) {
+  assert(cell_size >= sizeof(uintptr_t));
 
-  prev_this_val = baik->vals.this_obj;
+  memset(a, 0, sizeof(*a));
+  a->cell_size = cell_size;
+  a->size_increment = size_increment;
+  a->blocks = gc_new_block(a, initial_size);
+}
 
-  baik_push(baik, func);
-  resp = vptr(&baik->stack, -1);
-  retval_stack_idx = baik_mk_number(baik, (double) baik_stack_size(&baik->stack));
+BAIK_PRIVATE void gc_arena_destroy(struct baik *baik, struct gc_arena *a) {
+  struct gc_block *b;
 
-  for (i = 0; i < nargs; i++) {
-    baik_push(baik, args[i]);
+  for (b = a->blocks; b != NULL;) {
+    struct gc_block *tmp;
+    if (a->destructor != NULL) {
+      struct gc_cell *cur;
+      for (cur = b->base; cur < GC_CELL_OP(a, b->base, +, b->size);
+           cur = GC_CELL_OP(a, cur, +, 1)) {
+        if (!MARKED_FREE(cur)) {
+          a->destructor(baik, cur);
+        }
+      }
+    }
+    tmp = b;
+    b = b->next;
+    gc_free_block(tmp);
   }
+  a->blocks = NULL;
+  a->sweep = NULL;
+  a->free = NULL;
+}
 
-  push_baik_val(&baik->arg_stack, this_val);
-  call_stack_push_frame(baik, BAIK_BCODE_OFFSET_EXIT, retval_stack_idx);
-
-  // if (baik_is_foreign(func)) {
-  //   ((void (*) (struct baik *)) baik_get_ptr(baik, func))(baik);
-  //   if (res != NULL) *res = *resp;
-  // } else if (baik_is_ffi_sig(func)) {
-  //   baik_ffi_call2(baik);
-  //   if (res != NULL) *res = *resp;
-  // } else {
-    size_t addr = baik_get_func_addr(func);
-    baik_execute(baik, addr, &r);
-    if (res != NULL) *res = r;
-  //}
-
-  if (baik->error != BAIK_OK) {
-    call_stack_restore_frame(baik);
+// Frees every cell but keeps the blocks, handing the cells out again in the
+// same order a fresh block would.
+BAIK_PRIVATE void gc_arena_reset(struct baik *baik, struct gc_arena *a) {
+  struct gc_block *b;
+  struct gc_cell *cur;
 
-    
-    baik_pop(baik);
+  a->free = NULL;
+  for (b = a->blocks; b != NULL; b = b->next) {
+    for (cur = b->base; cur < GC_CELL_OP(a, b->base, +, b->size);
+         cur = GC_CELL_OP(a, cur, +, 1)) {
+      if (a->destructor != NULL && !MARKED_FREE(cur)) {
+        a->destructor(baik, cur);
+      }
+      cur->head.word = FREE_LINK(a->free);
+      a->free = cur;
+    }
+    memset(b->marks, 0, GC_BLOCK_MARKS_SIZE(b->size));
   }
-  baik->vals.this_obj = prev_this_val;
-
-  return baik->error;
+  a->sweep = NULL;
+#if BAIK_GC_THREADS
+  a->swept = a->swept_tail = NULL;
+  a->bg = 0;
+#endif
 }
 
-#ifndef RTLD_DEFAULT
-#define RTLD_DEFAULT NULL
-#endif
+BAIK_PRIVATE size_t gc_arena_cells(const struct gc_arena *a) {
+  const struct gc_block *b;
+  size_t n = 0;
+  for (b = a->blocks; b != NULL; b = b->next) {
+    n += b->size;
+  }
+  return n;
+}
 
-// static ffi_fn_t *get_cb_impl_by_signature(const baik_ffi_sig_t *sig);
+// Makes room for at least `cells` cells in total.
+BAIK_PRIVATE void gc_arena_grow(struct gc_arena *a, size_t cells) {
+  size_t have = gc_arena_cells(a);
+  if (have < cells) {
+    struct gc_block *b = gc_new_block(a, cells - have);
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+}
 
+static void gc_free_block(struct gc_block *b) {
+  free(b->base);
+  free(b);
+}
 
-struct cbdata {
-  baik_val_t func;
-  baik_val_t userdata;
-  int8_t func_idx;
-  int8_t userdata_idx;
-};
+static struct gc_block *gc_new_block(struct gc_arena *a, size_t size) {
+  struct gc_cell *cur;
+  struct gc_block *b;
 
-// void baik_set_ffi_resolver(struct baik *baik, baik_ffi_resolver_t *dlsym) {
-//   baik->dlsym = dlsym;
-// }
+  b = (struct gc_block *) calloc(1, sizeof(*b) + GC_BLOCK_MARKS_SIZE(size));
+  if (b == NULL) abort();
 
-// static baik_ffi_ctype_t parse_cval_type(struct baik *baik, const char *s,
-//                                        const char *e) {
-//   struct baik_generic_str ms = GENERIC_NULL_STR;
- 
-//   while (s < e && isspace((int) *s)) s++;
-//   while (e > s && isspace((int) e[-1])) e--;
-//   ms.p = s;
-//   ms.len = e - s;
-//   if (baik_generic_vcmp(&ms, "void") == 0) {
-//     return BAIK_FFI_CTYPE_NONE;
-//   } else if (baik_generic_vcmp(&ms, "userdata") == 0) {
-//     return BAIK_FFI_CTYPE_USERDATA;
-//   } else if (baik_generic_vcmp(&ms, "int") == 0) {
-//     return BAIK_FFI_CTYPE_INT;
-//   } else if (baik_generic_vcmp(&ms, "bool") == 0) {
-//     return BAIK_FFI_CTYPE_BOOL;
-//   } else if (baik_generic_vcmp(&ms, "double") == 0) {
-//     return BAIK_FFI_CTYPE_DOUBLE;
-//   } else if (baik_generic_vcmp(&ms, "float") == 0) {
-//     return BAIK_FFI_CTYPE_FLOAT;
-//   } else if (baik_generic_vcmp(&ms, "char*") == 0 || baik_generic_vcmp(&ms, "char *") == 0) {
-//     return BAIK_FFI_CTYPE_CHAR_PTR;
-//   } else if (baik_generic_vcmp(&ms, "void*") == 0 || baik_generic_vcmp(&ms, "void *") == 0) {
-//     return BAIK_FFI_CTYPE_VOID_PTR;
-//   } else if (baik_generic_vcmp(&ms, "struct baik_generic_str") == 0) {
-//     return BAIK_FFI_CTYPE_STRUCT_GENERIC_STR;
-//   } else if (baik_generic_vcmp(&ms, "struct baik_generic_str *") == 0 ||
-//              baik_generic_vcmp(&ms, "struct baik_generic_str*") == 0) {
-//     return BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR;
-//   } else {
-//     baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : gagal menguraikan isi tipe \"%.*s\"",
-//                        (int) ms.len, ms.p);
-//     return BAIK_FFI_CTYPE_INVALID;
-//   }
-// }
+  b->size = size;
+  b->marks = (uint8_t *) (b + 1);
+  b->base = (struct gc_cell *) calloc(a->cell_size, b->size);
+  if (b->base == NULL) abort();
 
-static const char *find_paren(const char *s, const char *e) {
-  for (; s < e; s++) {
-    if (*s == '(') return s;
+  for (cur = GC_CELL_OP(a, b->base, +, 0);
+       cur < GC_CELL_OP(a, b->base, +, b->size);
+       cur = GC_CELL_OP(a, cur, +, 1)) {
+    cur->head.word = FREE_LINK(a->free);
+    a->free = cur;
   }
-  return NULL;
+
+  return b;
 }
 
-static const char *find_closing_paren(const char *s, const char *e) {
-  int nesting = 1;
-  while (s < e) {
-    if (*s == '(') {
-      nesting++;
-    } else if (*s == ')') {
-      if (--nesting == 0) break;
+static struct gc_block *gc_find_block(const struct gc_arena *a,
+                                      const void *ptr) {
+  const struct gc_cell *p = (const struct gc_cell *) ptr;
+  struct gc_block *b;
+  for (b = a->blocks; b != NULL; b = b->next) {
+    if (p >= b->base && p < GC_CELL_OP(a, b->base, +, b->size)) {
+      return b;
     }
-    s++;
   }
-  return (s < e ? s : NULL);
+  return NULL;
 }
 
-// BAIK_PRIVATE baik_err_t baik_parse_ffi_signature(struct baik *baik, const char *s,
-//                                               int sig_len, baik_ffi_sig_t *sig,
-//                                               enum ffi_sig_type sig_type) {
-//   baik_err_t ret = BAIK_OK;
-//   int vtidx = 0;
-//   const char *cur, *e, *tmp_e, *tmp;
-//   struct baik_generic_str rt = GENERIC_NULL_STR, fn = GENERIC_NULL_STR, args = GENERIC_NULL_STR;
-//   baik_ffi_ctype_t val_type = BAIK_FFI_CTYPE_INVALID;
-//   if (sig_len == ~0) {
-//     sig_len = strlen(s);
-//   }
-//   e = s + sig_len;
 
-//   baik_ffi_sig_init(sig);
-//   for (cur = s; cur < e && isspace((int) *cur); cur++);
+static int gc_arena_is_gc_needed(struct gc_arena *a) {
+  struct gc_cell *r = a->free;
+  int i;
 
-//   tmp_e = find_paren(cur, e);
-//   if (tmp_e == NULL || tmp_e - s < 2) {
-//     ret = BAIK_TYPE_ERROR;
-//     baik_prepend_errorf(baik, ret, "1");
-//     goto clean;
-//   }
-//   tmp = find_closing_paren(tmp_e + 1, e);
-//   if (tmp == NULL) {
-//     ret = BAIK_TYPE_ERROR;
-//     baik_prepend_errorf(baik, ret, "2");
-//     goto clean;
-//   }
+#if BAIK_GC_THREADS
+  if (gc_bg_active(a)) return 0;
+#endif
+  if (a->sweep != NULL) return 0;
 
-//   args.p = find_paren(tmp + 1, e);
-//   if (args.p == NULL) {
-   
-//     fn.p = tmp_e - 1;
-//     while (fn.p > cur && isspace((int) *fn.p)) fn.p--;
-//     while (fn.p > cur && (isalnum((int) *fn.p) || *fn.p == '_')) {
-//       fn.p--;
-//       fn.len++;
-//     }
-//     fn.p++;
-//     rt.p = cur;
-//     rt.len = fn.p - rt.p;
-   
-//     args.p = tmp_e + 1;
-//     args.len = tmp - args.p;
-//   } else {
-   
-//     fn.p = tmp + 1;
-//     fn.len = args.p - tmp;
-//     rt.p = cur;
-//     rt.len = tmp_e - rt.p;
-//     args.p++;
-//     tmp = find_closing_paren(args.p, e);
-//     if (tmp == NULL) {
-//       ret = BAIK_TYPE_ERROR;
-//       baik_prepend_errorf(baik, ret, "3");
-//       goto clean;
-//     }
-//     args.len = tmp - args.p;
-   
-//     sig->is_callback = 1;
-//   }
+  for (i = 0; i <= GC_ARENA_CELLS_RESERVE; i++, r = NEXT_FREE(r)) {
+    if (r == NULL) {
+      return 1;
+    }
+  }
 
-//   val_type = parse_cval_type(baik, rt.p, rt.p + rt.len);
-//   if (val_type == BAIK_FFI_CTYPE_INVALID) {
-//     ret = baik->error;
-//     goto clean;
-//   }
-//   baik_ffi_sig_set_val_type(sig, vtidx++, val_type);
+  return 0;
+}
 
-//   if (!sig->is_callback) {
-//     char buf[100];
-//     if (baik->dlsym == NULL) {
-//       ret = BAIK_TYPE_ERROR;
-//       baik_prepend_errorf(baik, ret,
-//                          "GALAT : resolver belum diaktifkan, panggil baik_set_ffi_resolver");
-//       goto clean;
-//     }
+BAIK_PRIVATE int gc_strings_is_gc_needed(struct baik *baik) {
+  struct mbuf *m = &baik->owned_strings;
+  return (double) m->len / (double) m->size > 0.9;
+}
 
-//     snprintf(buf, sizeof(buf), "%.*s", (int) fn.len, fn.p);
-//     sig->fn = (ffi_fn_t *) baik->dlsym(RTLD_DEFAULT, buf);
-//     if (sig->fn == NULL) {
-//       ret = BAIK_TYPE_ERROR;
-//       baik_prepend_errorf(baik, ret, "GALAT : dlsym('%s') gagal", buf);
-//       goto clean;
-//     }
-//   } else {
-//     tmp_e = strchr(tmp_e, ')');
-//     if (tmp_e == NULL) {
-//       ret = BAIK_TYPE_ERROR;
-//       goto clean;
-//     }
-//   }
 
-//   cur = tmp_e = args.p;
+static struct gc_cell *gc_sweep_block(struct baik *baik, struct gc_arena *a,
+                                      struct gc_cell *free_list) {
+  struct gc_block *b = *a->sweep;
+  struct gc_cell *prev_free = free_list;
+  struct gc_cell *cur;
+  size_t i, freed_in_block = 0;
 
-//   while (tmp_e - args.p < (ptrdiff_t) args.len) {
-//     int level = 0;
-//     int is_fp = 0;
-//     tmp_e = cur;
+  for (i = 0, cur = b->base; i < b->size;
+       i++, cur = GC_CELL_OP(a, cur, +, 1)) {
+    if (MARKED(b, i)) {
+#if BAIK_MEMORY_STATS
+      a->alive++;
+#endif
+      continue;
+    }
+    if (!MARKED_FREE(cur)) {
+      if (a->destructor != NULL) {
+        a->destructor(baik, cur);
+      }
+#if BAIK_MEMORY_STATS
+      a->garbage++;
+#endif
+    }
+    cur->head.word = FREE_LINK(free_list);
+    free_list = cur;
+    freed_in_block++;
+  }
+  memset(b->marks, 0, GC_BLOCK_MARKS_SIZE(b->size));
 
-//     while (*tmp_e && (level > 0 || (*tmp_e != ',' && *tmp_e != ')'))) {
-//       switch (*tmp_e) {
-//         case '(':
-//           level++;
-         
-//           is_fp = 1;
-//           break;
-//         case ')':
-//           level--;
-//           break;
-//       }
-//       tmp_e++;
-//     }
+#if BAIK_GC_THREADS
+  // keep empty blocks while the helper sweeps, otherwise the next cycle
+  // starts with no headroom
+  if (freed_in_block == b->size && b->next != NULL && !gc_bg_active(a)) {
+#else
+  if (freed_in_block == b->size && b->next != NULL) {
+#endif
+    *a->sweep = b->next;
+    gc_free_block(b);
+    free_list = prev_free;
+  } else {
+    a->sweep = &b->next;
+  }
+  if (*a->sweep == NULL) {
+    a->sweep = NULL;
+  }
+  return free_list;
+}
 
-//     if (tmp_e == cur) break;
+BAIK_PRIVATE void *gc_alloc_cell(struct baik *baik, struct gc_arena *a) {
+  struct gc_cell *r;
 
-//     if (is_fp) {
-     
-//       if (sig->cb_sig != NULL) {
-       
-//         ret = BAIK_TYPE_ERROR;
-//         baik_prepend_errorf(baik, ret, "GALAT : hanya satu callback yang diijinkan");
-//         goto clean;
-//       }
+#if BAIK_GC_THREADS
+  if (a->free == NULL && gc_bg_active(a)) {
+    gc_bg_take(baik, a);
+  }
+#endif
 
-//       sig->cb_sig = calloc(sizeof(*sig->cb_sig), 1);
-//       ret = baik_parse_ffi_signature(baik, cur, tmp_e - cur, sig->cb_sig,
-//                                     FFI_SIG_CALLBACK);
-//       if (ret != BAIK_OK) {
-//         baik_ffi_sig_free(sig->cb_sig);
-//         free(sig->cb_sig);
-//         sig->cb_sig = NULL;
-//         goto clean;
-//       }
-//       val_type = BAIK_FFI_CTYPE_CALLBACK;
-//     } else {
-     
-//       val_type = parse_cval_type(baik, cur, tmp_e);
-//       if (val_type == BAIK_FFI_CTYPE_INVALID) {
-       
-//         ret = BAIK_TYPE_ERROR;
-//         goto clean;
-//       }
-//     }
+  while (a->free == NULL && a->sweep != NULL) {
+    a->free = gc_sweep_block(baik, a, a->free);
+  }
+
+  if (a->free == NULL) {
+    struct gc_block *b = gc_new_block(a, a->size_increment);
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+  r = a->free;
 
-//     if (!baik_ffi_sig_set_val_type(sig, vtidx++, val_type)) {
-//       ret = BAIK_TYPE_ERROR;
-//       baik_prepend_errorf(baik, ret, "GALAT : begitu banyak argumen callback");
-//       goto clean;
-//     }
+  a->free = NEXT_FREE(r);
 
-//     if (*tmp_e == ',') {
-//       cur = tmp_e + 1;
-//       while (*cur == ' ') cur++;
-//     } else {
-     
-//       break;
-//     }
-//   }
- 
+#if BAIK_MEMORY_STATS
+  a->allocations++;
+  a->alive++;
+#endif
 
- 
-//   baik_ffi_sig_validate(baik, sig, sig_type);
-//   if (!sig->is_valid) {
-//     ret = BAIK_TYPE_ERROR;
-//     goto clean;
-//   }
+  if (gc_arena_is_gc_needed(a)) {
+    baik->need_gc = 1;
+  }
 
-//   if (sig->is_callback) {
-//     sig->fn = get_cb_impl_by_signature(sig);
-//     if (sig->fn == NULL) {
-//       ret = BAIK_TYPE_ERROR;
-//       baik_prepend_errorf(baik, ret,
-//                          "GALAT : callback signature valid, "
-//                          "tetapi tidak ada callback yang terdefinisi");
-//       goto clean;
-//     }
-//   }
+  memset(r, 0, a->cell_size);
+  return (void *) r;
+}
 
-// clean:
-//   if (ret != BAIK_OK) {
-//     baik_prepend_errorf(baik, ret, "GALAT : ffi signature bermasalah: \"%.*s\"", sig_len, s);
-//     sig->is_valid = 0;
-//   }
-//   return ret;
-// }
 
-union ffi_cb_data_val {
-  void *p;
-  uintptr_t w;
-  double d;
-  float f;
-};
+void gc_sweep(struct baik *baik, struct gc_arena *a) {
+  while (a->sweep != NULL) {
+    a->free = gc_sweep_block(baik, a, a->free);
+  }
+}
 
-// struct ffi_cb_data {
-//   union ffi_cb_data_val args[BAIK_CB_ARGS_MAX_CNT];
-// };
 
-// static union ffi_cb_data_val ffi_cb_impl_generic(void *param,
-//                                                  struct ffi_cb_data *data) {
-//   struct baik_ffi_cb_args *cbargs = (struct baik_ffi_cb_args *) param;
-//   baik_val_t *args, res = BAIK_UNDEFINED;
-//   union ffi_cb_data_val ret;
-//   int i;
-//   struct baik *baik = cbargs->baik;
-//   baik_ffi_ctype_t return_ctype = BAIK_FFI_CTYPE_NONE;
-//   baik_err_t err;
+static void gc_sweep_start(struct gc_arena *a) {
+  if (a->blocks == NULL) return;
+  a->free = NULL;
+  a->sweep = &a->blocks;
+#if BAIK_GC_THREADS
+  a->swept = NULL;
+#endif
+#if BAIK_MEMORY_STATS
+  a->alive = 0;
+#endif
+}
 
-//   memset(&ret, 0, sizeof(ret));
-//   baik_own(baik, &res);
 
-//   assert(cbargs->sig.args_cnt > 0);
+// static void gc_mark_ffi_sig(struct baik *baik, baik_val_t *v) {
+//   struct baik_ffi_sig *psig;
 
-//   args = calloc(1, sizeof(baik_val_t) * cbargs->sig.args_cnt);
-//   for (i = 0; i < cbargs->sig.args_cnt; i++) {
-//     baik_ffi_ctype_t val_type =
-//         cbargs->sig.val_types[i + 1];
-//     switch (val_type) {
-//       case BAIK_FFI_CTYPE_USERDATA:
-//         args[i] = cbargs->userdata;
-//         break;
-//       case BAIK_FFI_CTYPE_INT:
-//         args[i] = baik_mk_number(baik, (double) data->args[i].w);
-//         break;
-//       case BAIK_FFI_CTYPE_BOOL:
-//         args[i] = baik_mk_boolean(baik, !!data->args[i].w);
-//         break;
-//       case BAIK_FFI_CTYPE_CHAR_PTR: {
-//         const char *s = (char *) data->args[i].w;
-//         if (s == NULL) s = "";
-//         args[i] = baik_mk_string(baik, s, ~0, 1);
-//         break;
-//       }
-//       case BAIK_FFI_CTYPE_VOID_PTR:
-//         args[i] = baik_mk_foreign(baik, (void *) data->args[i].w);
-//         break;
-//       case BAIK_FFI_CTYPE_DOUBLE:
-//         args[i] = baik_mk_number(baik, data->args[i].d);
-//         break;
-//       case BAIK_FFI_CTYPE_FLOAT:
-//         args[i] = baik_mk_number(baik, data->args[i].f);
-//         break;
-//       case BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR: {
-//         struct baik_generic_str *s = (struct baik_generic_str *) (void *) data->args[i].w;
-//         args[i] = baik_mk_string(baik, s->p, s->len, 1);
-//         break;
-//       }
-//       default:
-       
-//         LOG(LL_ERROR, ("unexpected val type for arg #%d: %d\n", i, val_type));
-//         abort();
-//     }
-//   }
+//   assert(baik_is_ffi_sig(*v));
 
- 
-//   return_ctype = cbargs->sig.val_types[0];
+//   psig = baik_get_ffi_sig_struct(*v);
 
-//   LOG(LL_VERBOSE_DEBUG, ("calling BAIK callback void-void %d from C",
-//                          baik_get_int(baik, cbargs->func)));
-//   err = baik_apply(baik, &res, cbargs->func, BAIK_UNDEFINED, cbargs->sig.args_cnt,
-//                   args);
-//   cbargs = NULL;
-//   if (err != BAIK_OK) {
-//     baik_print_error(baik, stderr, "BAIK callback error",
-//                     1);
-//     goto clean;
+//   if (!gc_check_val(baik, *v)) {
+//     abort();
 //   }
 
- 
-//   switch (return_ctype) {
-//     case BAIK_FFI_CTYPE_NONE:
-//       break;
-//     case BAIK_FFI_CTYPE_INT:
-//       ret.w = baik_get_int(baik, res);
-//       break;
-//     case BAIK_FFI_CTYPE_BOOL:
-//       ret.w = baik_get_bool(baik, res);
-//       break;
-//     case BAIK_FFI_CTYPE_VOID_PTR:
-//       ret.p = baik_get_ptr(baik, res);
-//       break;
-//     case BAIK_FFI_CTYPE_DOUBLE:
-//       ret.d = baik_get_double(baik, res);
-//       break;
-//     case BAIK_FFI_CTYPE_FLOAT:
-//       ret.f = (float) baik_get_double(baik, res);
-//       break;
-//     default:
-//       LOG(LL_ERROR, ("unexpected return val type %d\n", return_ctype));
-//       abort();
-//   }
+//   if (MARKED(psig)) return;
 
-// clean:
-//   free(args);
-//   baik_disown(baik, &res);
-//   return ret;
+//   MARK(psig);
 // }
 
-// static void ffi_init_cb_data_wwww(struct ffi_cb_data *data, uintptr_t w0,
-//                                   uintptr_t w1, uintptr_t w2, uintptr_t w3,
-//                                   uintptr_t w4, uintptr_t w5) {
-//   memset(data, 0, sizeof(*data));
-//   data->args[0].w = w0;
-//   data->args[1].w = w1;
-//   data->args[2].w = w2;
-//   data->args[3].w = w3;
-//   data->args[4].w = w4;
-//   data->args[5].w = w5;
-// }
 
-// static uintptr_t ffi_cb_impl_wpwwwww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
-//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
-//   struct ffi_cb_data data;
-//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
-//   return ffi_cb_impl_generic((void *) w0, &data).w;
-// }
+static void gc_mark_object(struct baik *baik, baik_val_t *v) {
+  struct baik_object *obj_base;
+  struct baik_property *prop;
+  struct baik_property *next;
+  struct gc_arena *a = &baik->object_arena;
+  struct gc_block *b;
+  size_t idx;
 
-// static uintptr_t ffi_cb_impl_wwpwwww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
-//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
-//   struct ffi_cb_data data;
-//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
-//   return ffi_cb_impl_generic((void *) w1, &data).w;
-// }
+  assert(baik_is_object(*v));
 
-// static uintptr_t ffi_cb_impl_wwwpwww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
-//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
-//   struct ffi_cb_data data;
-//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
-//   return ffi_cb_impl_generic((void *) w2, &data).w;
-// }
+  obj_base = get_object_struct(*v);
 
-// static uintptr_t ffi_cb_impl_wwwwpww(uintptr_t w0, uintptr_t w1, uintptr_t w2,
-//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
-//   struct ffi_cb_data data;
-//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
-//   return ffi_cb_impl_generic((void *) w3, &data).w;
-// }
+  if ((b = gc_find_block(a, obj_base)) == NULL) {
+    abort();
+  }
 
-// static uintptr_t ffi_cb_impl_wwwwwpw(uintptr_t w0, uintptr_t w1, uintptr_t w2,
-//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
-//   struct ffi_cb_data data;
-//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
-//   return ffi_cb_impl_generic((void *) w4, &data).w;
-// }
+  idx = GC_BLOCK_CELL_IDX(a, b, obj_base);
+  if (MARKED(b, idx)) return;
 
-// static uintptr_t ffi_cb_impl_wwwwwwp(uintptr_t w0, uintptr_t w1, uintptr_t w2,
-//                                      uintptr_t w3, uintptr_t w4, uintptr_t w5) {
-//   struct ffi_cb_data data;
-//   ffi_init_cb_data_wwww(&data, w0, w1, w2, w3, w4, w5);
-//   return ffi_cb_impl_generic((void *) w5, &data).w;
-// }
+  a = &baik->property_arena;
+  for ((prop = obj_base->properties), MARK(b, idx); prop != NULL;
+       prop = next) {
+    if ((b = gc_find_block(a, prop)) == NULL) {
+      abort();
+    }
 
-// static uintptr_t ffi_cb_impl_wpd(uintptr_t w0, double d1) {
-//   struct ffi_cb_data data;
+    gc_mark(baik, &prop->name);
+    gc_mark(baik, &prop->value);
 
-//   memset(&data, 0, sizeof(data));
-//   data.args[0].w = w0;
-//   data.args[1].d = d1;
+    next = prop->next;
+    idx = GC_BLOCK_CELL_IDX(a, b, prop);
+    MARK(b, idx);
+  }
 
-//   return ffi_cb_impl_generic((void *) w0, &data).w;
-// }
+}
+
+
+static void gc_mark_string(struct baik *baik, baik_val_t *v) {
+  baik_val_t h, tmp = 0;
+  char *s;
+  assert((*v & BAIK_TAG_MASK) == BAIK_TAG_STRING_O);
+
+  s = baik->owned_strings.buf + gc_string_baik_val_to_offset(*v);
+  assert(s < baik->owned_strings.buf + baik->owned_strings.len);
+  if (s[-1] == '\0') {
+    memcpy(&tmp, s, sizeof(tmp) - 2);
+    tmp |= BAIK_TAG_STRING_C;
+  } else {
+    memcpy(&tmp, s, sizeof(tmp) - 2);
+    tmp |= BAIK_TAG_FOREIGN;
+  }
+
+  h = (baik_val_t)(uintptr_t) v;
+  s[-1] = 1;
+  memcpy(s, &h, sizeof(h) - 2);
+  memcpy(v, &tmp, sizeof(tmp));
+}
 
-// static uintptr_t ffi_cb_impl_wdp(double d0, uintptr_t w1) {
-//   struct ffi_cb_data data;
+BAIK_PRIVATE void gc_mark_bcode(struct baik *baik, baik_val_t v) {
+  struct baik_bcode_part *bp;
+  if (baik->bcode_reclaim && baik_is_function(v)) {
+    bp = baik_bcode_part_get_by_offset(baik, baik_get_func_addr(v) - 1);
+    if (bp != NULL) bp->referenced = 1;
+  }
+}
 
-//   memset(&data, 0, sizeof(data));
-//   data.args[0].d = d0;
-//   data.args[1].w = w1;
+BAIK_PRIVATE void gc_mark(struct baik *baik, baik_val_t *v) {
+  gc_mark_bcode(baik, *v);
+  if (baik_is_object(*v)) {
+    gc_mark_object(baik, v);
+  }
+  // if (baik_is_ffi_sig(*v)) {
+  //   gc_mark_ffi_sig(baik, v);
+  // }
+  if ((*v & BAIK_TAG_MASK) == BAIK_TAG_STRING_O) {
+    gc_mark_string(baik, v);
+  }
+}
 
-//   return ffi_cb_impl_generic((void *) w1, &data).w;
-// }
+BAIK_PRIVATE uint64_t gc_string_baik_val_to_offset(baik_val_t v) {
+  return (((uint64_t)(uintptr_t) get_ptr(v)) & ~BAIK_TAG_MASK);
+}
 
+BAIK_PRIVATE baik_val_t gc_string_val_from_offset(uint64_t s) {
+  return s | BAIK_TAG_STRING_O;
+}
 
-// static struct baik_ffi_cb_args **ffi_get_matching(struct baik_ffi_cb_args **plist,
-//                                                  baik_val_t func,
-//                                                  baik_val_t userdata) {
-//   for (; *plist != NULL; plist = &((*plist)->next)) {
-//     if ((*plist)->func == func && (*plist)->userdata == userdata) {
-//       break;
-//     }
-//   }
-//   return plist;
-// }
+void gc_compact_strings(struct baik *baik) {
+  char *p = baik->owned_strings.buf + 1;
+  uint64_t h, next, head = 1;
+  int len, llen;
 
-// static ffi_fn_t *get_cb_impl_by_signature(const baik_ffi_sig_t *sig) {
-//   if (sig->is_valid) {
-//     int i;
-//     int double_cnt = 0;
-//     int float_cnt = 0;
-//     int userdata_idx = 0;
+  while (p < baik->owned_strings.buf + baik->owned_strings.len) {
+    if (p[-1] == '\1') {
+     
+      h = 0;
+      memcpy(&h, p, sizeof(h) - 2);
 
-//     for (i = 1; i < BAIK_CB_SIGNATURE_MAX_SIZE;
-//          i++) {
-//       baik_ffi_ctype_t type = sig->val_types[i];
-//       switch (type) {
-//         case BAIK_FFI_CTYPE_DOUBLE:
-//           double_cnt++;
-//           break;
-//         case BAIK_FFI_CTYPE_FLOAT:
-//           float_cnt++;
-//           break;
-//         case BAIK_FFI_CTYPE_USERDATA:
-//           assert(userdata_idx == 0);
-//           userdata_idx = i;
-//           break;
-//         default:
-//           break;
-//       }
-//     }
+      for (; (h & BAIK_TAG_MASK) != BAIK_TAG_STRING_C; h = next) {
+        h &= ~BAIK_TAG_MASK;
+        memcpy(&next, (char *) (uintptr_t) h, sizeof(h));
 
-//     if (float_cnt > 0) {
-//       return NULL;
-//     }
+        *(baik_val_t *) (uintptr_t) h = gc_string_val_from_offset(head);
+      }
+      h &= ~BAIK_TAG_MASK;
 
-//     assert(userdata_idx > 0);
+      len = BAIK_EM_varint_decode_unsafe((unsigned char *) &h, &llen);
+      len += llen + 1;
 
-//     if (sig->args_cnt <= BAIK_CB_ARGS_MAX_CNT) {
-//       if (baik_ffi_is_regular_word_or_void(sig->val_types[0])) {
-       
-//         switch (double_cnt) {
-//           case 0:
-//             switch (userdata_idx) {
-//               case 1:
-//                 return (ffi_fn_t *) ffi_cb_impl_wpwwwww;
-//               case 2:
-//                 return (ffi_fn_t *) ffi_cb_impl_wwpwwww;
-//               case 3:
-//                 return (ffi_fn_t *) ffi_cb_impl_wwwpwww;
-//               case 4:
-//                 return (ffi_fn_t *) ffi_cb_impl_wwwwpww;
-//               case 5:
-//                 return (ffi_fn_t *) ffi_cb_impl_wwwwwpw;
-//               case 6:
-//                 return (ffi_fn_t *) ffi_cb_impl_wwwwwwp;
-//               default:
-//                 abort();
-//             }
-//             break;
-//           case 1:
-           
-//             switch (userdata_idx) {
-//               case 1:
-//                 return (ffi_fn_t *) ffi_cb_impl_wpd;
-//               case 2:
-//                 return (ffi_fn_t *) ffi_cb_impl_wdp;
-//             }
-//             break;
-//         }
-//       }
-//     } else {}
-//   }
+      memcpy(p, &h, sizeof(h) - 2);
 
-//   return NULL;
-// }
+      memmove(baik->owned_strings.buf + head, p, len);
+      baik->owned_strings.buf[head - 1] = 0x0;
+      p += len;
+      head += len;
+    } else {
+      len = BAIK_EM_varint_decode_unsafe((unsigned char *) p, &llen);
+      len += llen + 1;
 
-// BAIK_PRIVATE baik_val_t baik_ffi_sig_to_value(struct baik_ffi_sig *psig) {
-//   if (psig == NULL) {
-//     return BAIK_NULL;
-//   } else {
-//     return baik_legit_pointer_to_value(psig) | BAIK_TAG_FUNCTION_FFI;
-//   }
-// }
+      p += len;
+    }
+  }
 
-// BAIK_PRIVATE int baik_is_ffi_sig(baik_val_t v) {
-//   return (v & BAIK_TAG_MASK) == BAIK_TAG_FUNCTION_FFI;
-// }
+  baik->owned_strings.len = head;
+}
 
-// BAIK_PRIVATE struct baik_ffi_sig *baik_get_ffi_sig_struct(baik_val_t v) {
-//   struct baik_ffi_sig *ret = NULL;
-//   assert(baik_is_ffi_sig(v));
-//   ret = (struct baik_ffi_sig *) get_ptr(v);
-//   return ret;
-// }
+BAIK_PRIVATE int maybe_gc(struct baik *baik) {
+  if (!baik->inhibit_gc) {
+    baik_gc(baik, 0);
+    return 1;
+  }
+  return 0;
+}
 
-// BAIK_PRIVATE baik_val_t baik_mk_ffi_sig(struct baik *baik) {
-//   struct baik_ffi_sig *psig = new_ffi_sig(baik);
-//   baik_ffi_sig_init(psig);
-//   return baik_ffi_sig_to_value(psig);
-// }
 
-// BAIK_PRIVATE void baik_ffi_sig_destructor(struct baik *baik, void *psig) {
-//   baik_ffi_sig_free((baik_ffi_sig_t *) psig);
-//   (void) baik;
-// }
+static void gc_mark_val_array(struct baik *baik, baik_val_t *vals, size_t len) {
+  baik_val_t *vp;
+  for (vp = vals; vp < vals + len; vp++) {
+    gc_mark(baik, vp);
+  }
+}
 
-// BAIK_PRIVATE void *baik_dlsym(void *handle, const char *name) {
-//     void *client_hndl;
-//     typedef int main_t(int, char**);
-//     main_t *client_main;
-//     client_hndl = dlopen(baik_dlsym_file,  RTLD_LAZY);
-//     if (!client_hndl){
-//         fprintf(stderr, "%s\n", dlerror());
-//         exit(1);
-//     }
-//     client_main = (main_t*)dlsym(client_hndl, name);
-//     if (!client_main){
-//         fprintf(stderr, "%s\n", dlerror());
-//         exit(2);
-//     }
-//     else{
-//         return (main_t*)dlsym(client_hndl, name);
-//     }
-//     return NULL;
-// }
 
-// BAIK_PRIVATE baik_err_t baik_ffi_call(struct baik *baik) {
-//   baik_err_t e = BAIK_OK;
-//   const char *sig_str = NULL;
-//   baik_val_t sig_str_v = baik_arg(baik, 0);
-//   baik_val_t ret_v = BAIK_UNDEFINED;
-//   struct baik_ffi_sig *psig = baik_get_ffi_sig_struct(baik_mk_ffi_sig(baik));
-//   size_t sig_str_len;
-  
-//   sig_str = baik_get_string(baik, &sig_str_v, &sig_str_len);
+static void gc_mark_mbuf_pt(struct baik *baik, const struct mbuf *mbuf) {
+  baik_val_t **vp;
+  for (vp = (baik_val_t **) mbuf->buf; (char *) vp < mbuf->buf + mbuf->len;
+       vp++) {
+    gc_mark(baik, *vp);
+  }
+}
 
-//   size_t sig_str_len_dlsym_file;
-//   baik_val_t sig_str_v_dlsym_file = baik_arg(baik, 1);
-//   baik_dlsym_file = baik_get_string(baik, &sig_str_v_dlsym_file, &sig_str_len_dlsym_file);
-//   if(baik_dlsym_file != NULL){
-//     //printf("%s",baik_dlsym_file);
-//     baik_set_ffi_resolver(baik, baik_dlsym);
-//   }
 
-//   e = baik_parse_ffi_signature(baik, sig_str, sig_str_len, psig, FFI_SIG_FUNC);
-//   if (e != BAIK_OK) goto clean;
-//   ret_v = baik_ffi_sig_to_value(psig);
+static void gc_mark_mbuf_val(struct baik *baik, const struct mbuf *mbuf) {
+  gc_mark_val_array(baik, (baik_val_t *) mbuf->buf,
+                    mbuf->len / sizeof(baik_val_t));
+}
 
-// clean:
-//   baik_return(baik, ret_v);
-//   return e;
+// static void gc_mark_ffi_cbargs_list(struct baik *baik, ffi_cb_args_t *cbargs) {
+//   for (; cbargs != NULL; cbargs = cbargs->next) {
+//     gc_mark(baik, &cbargs->func);
+//     gc_mark(baik, &cbargs->userdata);
+//   }
 // }
 
-// BAIK_PRIVATE baik_err_t baik_ffi_call2(struct baik *baik) {
-//   baik_err_t ret = BAIK_OK;
-//   baik_ffi_sig_t *psig = NULL;
-//   baik_ffi_ctype_t rtype;
-//   baik_val_t sig_v = *vptr(&baik->stack, baik_getretvalpos(baik));
-
-//   int i, nargs;
-//   struct ffi_arg res;
-//   struct ffi_arg args[FFI_MAX_ARGS_CNT];
-//   struct cbdata cbdata;
-
- 
-//   baik_val_t resv = baik_mk_undefined();
 
- 
-//   baik_val_t argvs[FFI_MAX_ARGS_CNT];
-//   struct baik_generic_str argvmgstr[FFI_MAX_ARGS_CNT];
+#if BAIK_GC_THREADS
 
-//   if (baik_is_ffi_sig(sig_v)) {
-//     psig = baik_get_ffi_sig_struct(sig_v);
-//   } else {
-//     ret = BAIK_TYPE_ERROR;
-//     baik_prepend_errorf(baik, ret, "GALAT :  isi non-ffi-callable");
-//     goto clean;
-//   }
+#ifndef BAIK_GC_TASK_CORE
+#define BAIK_GC_TASK_CORE 0
+#endif
+#ifndef BAIK_GC_TASK_STACK
+#define BAIK_GC_TASK_STACK 4096
+#endif
+#ifndef BAIK_GC_TASK_PRIO
+#define BAIK_GC_TASK_PRIO 1
+#endif
+#ifndef BAIK_GC_SPLIT_DEPTH
+#define BAIK_GC_SPLIT_DEPTH 1
+#endif
+#ifndef BAIK_GC_MARK_STACK
+#define BAIK_GC_MARK_STACK 128
+#endif
 
-//   memset(&cbdata, 0, sizeof(cbdata));
-//   cbdata.func_idx = -1;
-//   cbdata.userdata_idx = -1;
+#define MARK_ATOMIC(b, i)                                                   \
+  (__atomic_fetch_or(&(b)->marks[(i) >> 3], (uint8_t)(1 << ((i) &7)),       \
+                     __ATOMIC_RELAXED) &                                    \
+   (1 << ((i) &7)))
+#define MARKED_ATOMIC(b, i) \
+  (__atomic_load_n(&(b)->marks[(i) >> 3], __ATOMIC_RELAXED) & (1 << ((i) &7)))
 
-//   rtype = psig->val_types[0];
+// Objects marked but not scanned yet. The helper task has a small stack, so
+// marking never recurses; when this fills up, the marker rescans the heap
+// for marked objects instead.
+struct gc_mark_stack {
+  struct baik_object *objs[BAIK_GC_MARK_STACK];
+  int len;
+  int overflow;
+};
 
-//   switch (rtype) {
-//     case BAIK_FFI_CTYPE_DOUBLE:
-//       res.ctype = FFI_CTYPE_DOUBLE;
-//       break;
-//     case BAIK_FFI_CTYPE_FLOAT:
-//       res.ctype = FFI_CTYPE_FLOAT;
-//       break;
-//     case BAIK_FFI_CTYPE_BOOL:
-//       res.ctype = FFI_CTYPE_BOOL;
-//       break;
-//     case BAIK_FFI_CTYPE_USERDATA:
-//     case BAIK_FFI_CTYPE_INT:
-//     case BAIK_FFI_CTYPE_CHAR_PTR:
-//     case BAIK_FFI_CTYPE_VOID_PTR:
-//     case BAIK_FFI_CTYPE_NONE:
-//       res.ctype = FFI_CTYPE_WORD;
-//       break;
-//     case BAIK_FFI_CTYPE_INVALID:
-//       ret = BAIK_TYPE_ERROR;
-//       baik_prepend_errorf(baik, ret, "GALAT : kesalahan balikan tipe pada fungsi ffi");
-//       goto clean;
-//   }
-//   res.v.i = 0;
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
-//   nargs =
-//       baik_stack_size(&baik->stack) - baik_get_int(baik, vtop(&baik->call_stack));
+typedef SemaphoreHandle_t gc_lock_t;
+typedef SemaphoreHandle_t gc_event_t;
+#else
+typedef pthread_mutex_t gc_lock_t;
+typedef struct {
+  pthread_mutex_t m;
+  pthread_cond_t c;
+  int set;
+} gc_event_t;
+#endif
+
+enum gc_job {
+  GC_JOB_NONE,
+  GC_JOB_MARK,
+  GC_JOB_SWEEP,
+  GC_JOB_QUIT,
+};
 
-//   if (nargs != psig->args_cnt) {
-//     ret = BAIK_TYPE_ERROR;
-//     baik_prepend_errorf(baik, ret, "GALAT : got %d actuals, but function takes %d args",
-//                        nargs, psig->args_cnt);
-//     goto clean;
-//   }
+struct gc_helper {
+  struct baik *baik;
+  gc_lock_t lock;
+  gc_event_t work;
+  gc_event_t done;
+  enum gc_job job;
+  unsigned busy : 1;
+  struct gc_mark_stack mark[2]; /* one per half of the roots */
+#if BAIK_EM_PLATFORM != BAIK_EM_P_ESP32
+  pthread_t thread;
+#endif
+};
 
-//   for (i = 0; i < nargs; i++) {
-//     baik_val_t arg = baik_arg(baik, i);
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+static int gc_lock_init(gc_lock_t *l) {
+  return (*l = xSemaphoreCreateMutex()) != NULL;
+}
 
-//     switch (psig->val_types[1 + i]) {
-//       case BAIK_FFI_CTYPE_NONE:
-       
-//         ret = BAIK_TYPE_ERROR;
-//         if (i == 0) {
-         
-//           baik_prepend_errorf(baik, ret, "GALAT : fungsi ffi-ed tidak memiliki argumen");
-//         } else {
-         
-//           baik_prepend_errorf(baik, ret, "GALAT : arg ffi bermasalah #%d tipe: \"void\"", i);
-//         }
+static void gc_lock_free(gc_lock_t *l) {
+  vSemaphoreDelete(*l);
+}
 
-//         goto clean;
-//       case BAIK_FFI_CTYPE_USERDATA:
-       
-//         if (cbdata.userdata_idx != -1) {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(baik, ret, "GALAT dua atau lebih argumen userdata : #%d and %d",
-//                              cbdata.userdata_idx, i);
+static void gc_lock(gc_lock_t *l) {
+  xSemaphoreTake(*l, portMAX_DELAY);
+}
 
-//           goto clean;
-//         }
-//         cbdata.userdata = arg;
-//         cbdata.userdata_idx = i;
-//         break;
-//       case BAIK_FFI_CTYPE_INT: {
-//         int intval = 0;
-//         if (baik_is_number(arg)) {
-//           intval = baik_get_int(baik, arg);
-//         } else if (baik_is_boolean(arg)) {
-//           intval = baik_get_bool(baik, arg);
-//         } else {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(
-//               baik, ret, "GALAT : arg #%d bukan int (tipe idx adalah: %s)", i,
-//               baik_typeof(arg));
-//         }
-//         ffi_set_word(&args[i], intval);
-//       } break;
-//       case BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR: {
-//         if (!baik_is_string(arg)) {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(
-//               baik, ret, "GALAT : arg #%d bukan string (tipe idx adalah: %s)",
-//               i, baik_typeof(arg));
-//           goto clean;
-//         }
-//         argvs[i] = arg;
-//         argvmgstr[i].p = baik_get_string(baik, &argvs[i], &argvmgstr[i].len);
-       
-//         ffi_set_ptr(&args[i], (void *) &argvmgstr[i]);
-//         break;
-//       }
-//       case BAIK_FFI_CTYPE_BOOL: {
-//         int intval = 0;
-//         if (baik_is_number(arg)) {
-//           intval = !!baik_get_int(baik, arg);
-//         } else if (baik_is_boolean(arg)) {
-//           intval = baik_get_bool(baik, arg);
-//         } else {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(
-//               baik, ret, "GALAT : arg #%d bukan bool (tipe idx adalah: %s)", i,
-//               baik_typeof(arg));
-//         }
-//         ffi_set_word(&args[i], intval);
-//       } break;
-//       case BAIK_FFI_CTYPE_DOUBLE:
-//         ffi_set_double(&args[i], baik_get_double(baik, arg));
-//         break;
-//       case BAIK_FFI_CTYPE_FLOAT:
-//         ffi_set_float(&args[i], (float) baik_get_double(baik, arg));
-//         break;
-//       case BAIK_FFI_CTYPE_CHAR_PTR: {
-//         size_t s;
-//         if (baik_is_string(arg)) {
-         
-//           argvs[i] = arg;
-//           ffi_set_ptr(&args[i], (void *) baik_get_string(baik, &argvs[i], &s));
-//         } else if (baik_is_null(arg)) {
-//           ffi_set_ptr(&args[i], NULL);
-//         } else {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(
-//               baik, ret, "GALAT : arg #%d bukan string (tipe idx adalah: %s)",
-//               i, baik_typeof(arg));
-//           goto clean;
-//         }
-//       } break;
-//       case BAIK_FFI_CTYPE_VOID_PTR:
-//         if (baik_is_string(arg)) {
-//           size_t n;
-         
-//           argvs[i] = arg;
-//           ffi_set_ptr(&args[i], (void *) baik_get_string(baik, &argvs[i], &n));
-//         } else if (baik_is_foreign(arg)) {
-//           ffi_set_ptr(&args[i], (void *) baik_get_ptr(baik, arg));
-//         } else if (baik_is_null(arg)) {
-//           ffi_set_ptr(&args[i], NULL);
-//         } else {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(baik, ret, "GALAT : arg #%d bukan ptr", i);
-//           goto clean;
-//         }
-//         break;
-//       case BAIK_FFI_CTYPE_CALLBACK:
-//         if (baik_is_function(arg) || baik_is_foreign(arg) ||
-//             baik_is_ffi_sig(arg)) {
-         
-//           cbdata.func = arg;
-//           cbdata.func_idx = i;
-//         } else {
-//           ret = BAIK_TYPE_ERROR;
-//           baik_prepend_errorf(baik, ret,
-//                              "GALAT : arg #%d bukan fungsi, tetapi %s", i,
-//                              baik_stringify_type((enum baik_type) arg));
-//           goto clean;
-//         }
-//         break;
-//       case BAIK_FFI_CTYPE_INVALID:
-       
-//         ret = BAIK_TYPE_ERROR;
-//         baik_prepend_errorf(baik, ret, "GALAT : kesalahan tipe arg");
-//         goto clean;
-//       default:
-//         abort();
-//         break;
-//     }
-//   }
+static void gc_unlock(gc_lock_t *l) {
+  xSemaphoreGive(*l);
+}
 
-//   if (cbdata.userdata_idx >= 0 && cbdata.func_idx >= 0) {
-//     struct baik_ffi_cb_args *cbargs = NULL;
-//     struct baik_ffi_cb_args **pitem = NULL;
+static int gc_event_init(gc_event_t *e) {
+  return (*e = xSemaphoreCreateBinary()) != NULL;
+}
 
-//     pitem = ffi_get_matching(&baik->ffi_cb_args, cbdata.func, cbdata.userdata);
-//     if (*pitem == NULL) {
-     
-//       cbargs = calloc(1, sizeof(*cbargs));
-//       cbargs->baik = baik;
-//       cbargs->func = cbdata.func;
-//       cbargs->userdata = cbdata.userdata;
-//       baik_ffi_sig_copy(&cbargs->sig, psig->cb_sig);
+static void gc_event_free(gc_event_t *e) {
+  vSemaphoreDelete(*e);
+}
 
-//       *pitem = cbargs;
-//     } else {
-     
-//       cbargs = *pitem;
-//     }
+static void gc_event_signal(gc_event_t *e) {
+  xSemaphoreGive(*e);
+}
 
-//     {
-//       union {
-//         ffi_fn_t *fn;
-//         void *p;
-//       } u;
-//       u.fn = psig->cb_sig->fn;
-//       ffi_set_ptr(&args[cbdata.func_idx], u.p);
-//       ffi_set_ptr(&args[cbdata.userdata_idx], cbargs);
-//     }
-//   } else if (!(cbdata.userdata_idx == -1 && cbdata.func_idx == -1)) {
-   
-//     abort();
-//   }
+static void gc_event_wait(gc_event_t *e) {
+  xSemaphoreTake(*e, portMAX_DELAY);
+}
+#else
+static int gc_lock_init(gc_lock_t *l) {
+  return pthread_mutex_init(l, NULL) == 0;
+}
 
-//   ffi_call(psig->fn, nargs, &res, args);
+static void gc_lock_free(gc_lock_t *l) {
+  pthread_mutex_destroy(l);
+}
 
-//   switch (rtype) {
-//     case BAIK_FFI_CTYPE_CHAR_PTR: {
-//       const char *s = (const char *) (uintptr_t) res.v.i;
-//       if (s != NULL) {
-//         resv = baik_mk_string(baik, s, ~0, 1);
-//       } else {
-//         resv = BAIK_NULL;
-//       }
-//       break;
-//     }
-//     case BAIK_FFI_CTYPE_VOID_PTR:
-//       resv = baik_mk_foreign(baik, (void *) (uintptr_t) res.v.i);
-//       break;
-//     case BAIK_FFI_CTYPE_INT:
-//       resv = baik_mk_number(baik, (int) res.v.i);
-//       break;
-//     case BAIK_FFI_CTYPE_BOOL:
-//       resv = baik_mk_boolean(baik, !!res.v.i);
-//       break;
-//     case BAIK_FFI_CTYPE_DOUBLE:
-//       resv = baik_mk_number(baik, res.v.d);
-//       break;
-//     case BAIK_FFI_CTYPE_FLOAT:
-//       resv = baik_mk_number(baik, res.v.f);
-//       break;
-//     default:
-//       resv = baik_mk_undefined();
-//       break;
-//   }
+static void gc_lock(gc_lock_t *l) {
+  pthread_mutex_lock(l);
+}
 
-// clean:
- 
-//   if (ret != BAIK_OK) {
-//     baik_prepend_errorf(baik, ret, "GALAT : gagal memanggil fungsi FFIed");
-   
-//   }
-//   baik_return(baik, resv);
+static void gc_unlock(gc_lock_t *l) {
+  pthread_mutex_unlock(l);
+}
+
+static int gc_event_init(gc_event_t *e) {
+  e->set = 0;
+  if (pthread_mutex_init(&e->m, NULL) != 0) return 0;
+  if (pthread_cond_init(&e->c, NULL) != 0) {
+    pthread_mutex_destroy(&e->m);
+    return 0;
+  }
+  return 1;
+}
 
-//   return ret;
-// }
+static void gc_event_free(gc_event_t *e) {
+  pthread_cond_destroy(&e->c);
+  pthread_mutex_destroy(&e->m);
+}
 
-// BAIK_PRIVATE void baik_ffi_cb_free(struct baik *baik) {
-//   baik_val_t ret = baik_mk_number(baik, 0);
-//   baik_val_t func = baik_arg(baik, 0);
-//   baik_val_t userdata = baik_arg(baik, 1);
+static void gc_event_signal(gc_event_t *e) {
+  pthread_mutex_lock(&e->m);
+  e->set = 1;
+  pthread_cond_signal(&e->c);
+  pthread_mutex_unlock(&e->m);
+}
 
-//   if (baik_is_function(func)) {
-//     struct baik_ffi_cb_args **pitem =
-//         ffi_get_matching(&baik->ffi_cb_args, func, userdata);
-//     if (*pitem != NULL) {
-     
-//       struct baik_ffi_cb_args *cbargs = *pitem;
-//       *pitem = cbargs->next;
-//       baik_ffi_sig_free(&cbargs->sig);
-//       free(cbargs);
-//       ret = baik_mk_number(baik, 1);
-//     }
-//   } else {
-//     baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : kesalahan argumen 'func'");
-//   }
+static void gc_event_wait(gc_event_t *e) {
+  pthread_mutex_lock(&e->m);
+  while (!e->set) pthread_cond_wait(&e->c, &e->m);
+  e->set = 0;
+  pthread_mutex_unlock(&e->m);
+}
+#endif
 
-//   baik_return(baik, ret);
-// }
+/* Marks object `v` and queues it for scanning unless it was marked */
+static void gc_par_push(struct baik *baik, struct gc_mark_stack *ms,
+                        baik_val_t v) {
+  struct baik_object *obj_base = get_object_struct(v);
+  struct gc_arena *a = &baik->object_arena;
+  struct gc_block *b;
 
-// void baik_ffi_args_free_list(struct baik *baik) {
-//   ffi_cb_args_t *next = baik->ffi_cb_args;
+  if ((b = gc_find_block(a, obj_base)) == NULL) {
+    abort();
+  }
+  if (MARK_ATOMIC(b, GC_BLOCK_CELL_IDX(a, b, obj_base))) return;
+  if (ms->len < BAIK_GC_MARK_STACK) {
+    ms->objs[ms->len++] = obj_base;
+  } else {
+    ms->overflow = 1;
+  }
+}
 
-//   while (next != NULL) {
-//     ffi_cb_args_t *cur = next;
-//     next = next->next;
-//     free(cur);
-//   }
-// }
+/* Whether marking `v`, not an object, touches strings or bcode parts */
+static int gc_par_shared(struct baik *baik, baik_val_t v) {
+  return (v & BAIK_TAG_MASK) == BAIK_TAG_STRING_O ||
+         (baik->bcode_reclaim && baik_is_function(v));
+}
 
-// BAIK_PRIVATE void baik_ffi_sig_init(baik_ffi_sig_t *sig) {
-//   memset(sig, 0, sizeof(*sig));
-// }
+static void gc_par_mark_split(struct baik *baik, struct gc_mark_stack *ms,
+                              baik_val_t v, int depth);
 
-// BAIK_PRIVATE void baik_ffi_sig_copy(baik_ffi_sig_t *to,
-//                                   const baik_ffi_sig_t *from) {
-//   memcpy(to, from, sizeof(*to));
-//   if (from->cb_sig != NULL) {
-//     to->cb_sig = calloc(sizeof(*to->cb_sig), 1);
-//     baik_ffi_sig_copy(to->cb_sig, from->cb_sig);
-//   }
-// }
+/*
+ * Marks the properties of a marked object and what they refer to. Both
+ * markers may walk the same object: a property belongs to the one that
+ * marks it first, and only that one looks at its name and value. Strings
+ * and bcode parts are shared by the markers, so those are marked under the
+ * helper's lock. Values `depth` levels or less below a root are marked
+ * right away instead of queued.
+ */
+static void gc_par_scan(struct baik *baik, struct gc_mark_stack *ms,
+                        struct baik_object *obj_base, int depth) {
+  struct gc_arena *a = &baik->property_arena;
+  gc_lock_t *lock = &baik->gc_helper->lock;
+  struct baik_property *prop;
+  struct gc_block *b;
+  int locked = 0;
 
-// BAIK_PRIVATE void baik_ffi_sig_free(baik_ffi_sig_t *sig) {
-//   if (sig->cb_sig != NULL) {
-//     free(sig->cb_sig);
-//     sig->cb_sig = NULL;
-//   }
-// }
+  for (prop = obj_base->properties; prop != NULL; prop = prop->next) {
+    if ((b = gc_find_block(a, prop)) == NULL) {
+      abort();
+    }
+    if (MARK_ATOMIC(b, GC_BLOCK_CELL_IDX(a, b, prop))) continue;
+    if (gc_par_shared(baik, prop->name) || gc_par_shared(baik, prop->value)) {
+      if (!locked) gc_lock(lock);
+      locked = 1;
+      if (!baik_is_object(prop->name)) gc_mark(baik, &prop->name);
+      if (!baik_is_object(prop->value)) gc_mark(baik, &prop->value);
+    }
+    if (baik_is_object(prop->name)) gc_par_push(baik, ms, prop->name);
+    if (!baik_is_object(prop->value)) continue;
+    if (depth > 0) {
+      if (locked) gc_unlock(lock);
+      locked = 0;
+      gc_par_mark_split(baik, ms, prop->value, depth - 1);
+    } else {
+      gc_par_push(baik, ms, prop->value);
+    }
+  }
+  if (locked) gc_unlock(lock);
+}
 
-// BAIK_PRIVATE int baik_ffi_sig_set_val_type(baik_ffi_sig_t *sig, int idx,
-//                                          baik_ffi_ctype_t type) {
-//   if (idx < BAIK_CB_SIGNATURE_MAX_SIZE) {
-//     sig->val_types[idx] = type;
-//     return 1;
-//   } else {
-   
-//     return 0;
-//   }
-// }
+static void gc_par_drain(struct baik *baik, struct gc_mark_stack *ms) {
+  struct gc_arena *a = &baik->object_arena;
+  struct gc_block *b;
+  size_t i;
 
-// BAIK_PRIVATE int baik_ffi_sig_validate(struct baik *baik, baik_ffi_sig_t *sig,
-//                                      enum ffi_sig_type sig_type) {
-//   int ret = 0;
-//   int i;
-//   int callback_idx = 0;
-//   int userdata_idx = 0;
+  for (;;) {
+    while (ms->len > 0) {
+      gc_par_scan(baik, ms, ms->objs[--ms->len], 0);
+    }
+    if (!ms->overflow) return;
+    /* Some marked objects were dropped unscanned: scan every marked one */
+    ms->overflow = 0;
+    for (b = a->blocks; b != NULL; b = b->next) {
+      for (i = 0; i < b->size; i++) {
+        if (!MARKED_ATOMIC(b, i)) continue;
+        gc_par_scan(baik, ms,
+                    (struct baik_object *) GC_CELL_OP(a, b->base, +, i), 0);
+        while (ms->len > 0) {
+          gc_par_scan(baik, ms, ms->objs[--ms->len], 0);
+        }
+      }
+    }
+  }
+}
 
-//   sig->is_valid = 0;
+/*
+ * Marks object `v` and everything it refers to. Both markers walk the same
+ * roots and the objects down to `depth` levels below them, each taking the
+ * properties the other has not reached yet, so the work under one large
+ * object such as the global one is split between them.
+ */
+static void gc_par_mark_split(struct baik *baik, struct gc_mark_stack *ms,
+                              baik_val_t v, int depth) {
+  struct baik_object *obj_base = get_object_struct(v);
+  struct gc_arena *a = &baik->object_arena;
+  struct gc_block *b;
 
-//   switch (sig_type) {
-//     case FFI_SIG_FUNC:
-     
-//       if (sig->val_types[0] != BAIK_FFI_CTYPE_NONE &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_INT &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_BOOL &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_DOUBLE &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_FLOAT &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_VOID_PTR &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_CHAR_PTR) {
-//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : nilai tipe balikan salah");
-//         goto clean;
-//       }
-//       break;
-//     case FFI_SIG_CALLBACK:
-     
-//       if (sig->val_types[0] != BAIK_FFI_CTYPE_NONE &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_INT &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_BOOL &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_DOUBLE &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_FLOAT &&
-//           sig->val_types[0] != BAIK_FFI_CTYPE_VOID_PTR) {
-//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tipe nilai balikan salah");
-//         goto clean;
-//       }
-//   }
+  if ((b = gc_find_block(a, obj_base)) == NULL) {
+    abort();
+  }
+  (void) MARK_ATOMIC(b, GC_BLOCK_CELL_IDX(a, b, obj_base));
+  gc_par_scan(baik, ms, obj_base, depth);
+  gc_par_drain(baik, ms);
+}
 
- 
-//   for (i = 1; i < BAIK_CB_SIGNATURE_MAX_SIZE; i++) {
-//     baik_ffi_ctype_t type = sig->val_types[i];
-//     switch (type) {
-//       case BAIK_FFI_CTYPE_USERDATA:
-//         if (userdata_idx != 0) {
-         
-//           baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
-//                              "GALAT : lebih dari satu userdata arg: #%d dan #%d",
-//                              (userdata_idx - 1), (i - 1));
-//           goto clean;
-//         }
-//         userdata_idx = i;
-//         break;
-//       case BAIK_FFI_CTYPE_CALLBACK:
-//         switch (sig_type) {
-//           case FFI_SIG_FUNC:
-//             break;
-//           case FFI_SIG_CALLBACK:
-//             baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
-//                                "GALAT : callback tidak mendapatkan callback lainnya");
-//             goto clean;
-//         }
-//         callback_idx = i;
-//         break;
-//       case BAIK_FFI_CTYPE_INT:
-//       case BAIK_FFI_CTYPE_BOOL:
-//       case BAIK_FFI_CTYPE_VOID_PTR:
-//       case BAIK_FFI_CTYPE_CHAR_PTR:
-//       case BAIK_FFI_CTYPE_STRUCT_GENERIC_STR_PTR:
-//       case BAIK_FFI_CTYPE_DOUBLE:
-//       case BAIK_FFI_CTYPE_FLOAT:
-       
-//         break;
-//       case BAIK_FFI_CTYPE_NONE:
-       
-//         goto args_over;
-//       default:
-//         baik_prepend_errorf(baik, BAIK_INTERNAL_ERROR, "GALAT : kesalahan ffi_ctype: %d",
-//                            type);
-//         goto clean;
-//     }
+static void gc_par_mark_vals(struct baik *baik, struct gc_mark_stack *ms,
+                             const baik_val_t *vals, size_t len) {
+  size_t i;
+  for (i = 0; i < len; i++) {
+    if (baik_is_object(vals[i])) {
+      gc_par_mark_split(baik, ms, vals[i], BAIK_GC_SPLIT_DEPTH);
+    }
+  }
+}
 
-//     sig->args_cnt++;
-//   }
-// args_over:
+static void gc_par_mark_roots(struct baik *baik, int half) {
+  struct gc_mark_stack *ms = &baik->gc_helper->mark[half];
+  baik_val_t **pp = (baik_val_t **) baik->owned_values.buf;
+  size_t i, n = baik->owned_values.len / sizeof(*pp);
 
-//   switch (sig_type) {
-//     case FFI_SIG_FUNC:
-//       if (!((callback_idx > 0 && userdata_idx > 0) ||
-//             (callback_idx == 0 && userdata_idx == 0))) {
-//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR,
-//                            "GALAT : callback and userdata should be either both "
-//                            "present or both absent");
-//         goto clean;
-//       }
-//       break;
-//     case FFI_SIG_CALLBACK:
-//       if (userdata_idx == 0) {
-       
-//         baik_prepend_errorf(baik, BAIK_TYPE_ERROR, "GALAT : tanpa userdata arg");
-//         goto clean;
-//       }
-//       break;
-//   }
+  ms->len = 0;
+  ms->overflow = 0;
+  gc_par_mark_vals(baik, ms, (const baik_val_t *) &baik->vals,
+                   sizeof(baik->vals) / sizeof(baik_val_t));
+  for (i = 0; i < n; i++) {
+    gc_par_mark_vals(baik, ms, pp[i], 1);
+  }
+  gc_par_mark_vals(baik, ms, (const baik_val_t *) baik->scopes.buf,
+                   baik->scopes.len / sizeof(baik_val_t));
+  gc_par_mark_vals(baik, ms, (const baik_val_t *) baik->stack.buf,
+                   baik->stack.len / sizeof(baik_val_t));
+  gc_par_mark_vals(baik, ms, (const baik_val_t *) baik->call_stack.buf,
+                   baik->call_stack.len / sizeof(baik_val_t));
+  gc_par_mark_vals(baik, ms, (const baik_val_t *) baik->arg_stack.buf,
+                   baik->arg_stack.len / sizeof(baik_val_t));
+}
 
-//   ret = 1;
+/* Marks the roots gc_par_mark_roots() went through that are not objects */
+static void gc_par_mark_root_vals(struct baik *baik, baik_val_t *vals,
+                                  size_t len) {
+  size_t i;
+  for (i = 0; i < len; i++) {
+    if (!baik_is_object(vals[i])) gc_mark(baik, &vals[i]);
+  }
+}
 
-// clean:
-//   if (ret) {
-//     sig->is_valid = 1;
-//   }
-//   return ret;
-// }
+static void gc_par_mark_other_roots(struct baik *baik) {
+  baik_val_t **pp = (baik_val_t **) baik->owned_values.buf;
+  size_t i, n = baik->owned_values.len / sizeof(*pp);
 
-// BAIK_PRIVATE int baik_ffi_is_regular_word(baik_ffi_ctype_t type) {
-//   switch (type) {
-//     case BAIK_FFI_CTYPE_INT:
-//     case BAIK_FFI_CTYPE_BOOL:
-//       return 1;
-//     default:
-//       return 0;
-//   }
-// }
+  gc_par_mark_root_vals(baik, (baik_val_t *) &baik->vals,
+                        sizeof(baik->vals) / sizeof(baik_val_t));
+  for (i = 0; i < n; i++) {
+    gc_par_mark_root_vals(baik, pp[i], 1);
+  }
+  gc_par_mark_root_vals(baik, (baik_val_t *) baik->scopes.buf,
+                        baik->scopes.len / sizeof(baik_val_t));
+  gc_par_mark_root_vals(baik, (baik_val_t *) baik->stack.buf,
+                        baik->stack.len / sizeof(baik_val_t));
+  gc_par_mark_root_vals(baik, (baik_val_t *) baik->call_stack.buf,
+                        baik->call_stack.len / sizeof(baik_val_t));
+  gc_par_mark_root_vals(baik, (baik_val_t *) baik->arg_stack.buf,
+                        baik->arg_stack.len / sizeof(baik_val_t));
+}
+
+static void gc_bg_sweep(struct gc_helper *h, struct gc_arena *a) {
+  int more = gc_bg_active(a);
+  while (more) {
+    gc_lock(&h->lock);
+    if (a->sweep != NULL) {
+      struct gc_cell *cells = gc_sweep_block(h->baik, a, NULL), *last;
+      if (cells != NULL) {
+        for (last = cells; NEXT_FREE(last) != NULL; last = NEXT_FREE(last)) {
+        }
+        if (a->swept == NULL) {
+          a->swept = cells;
+        } else {
+          a->swept_tail->head.word = FREE_LINK(cells);
+        }
+        a->swept_tail = last;
+      }
+    }
+    more = a->sweep != NULL;
+    gc_unlock(&h->lock);
+  }
+}
 
-// BAIK_PRIVATE int baik_ffi_is_regular_word_or_void(baik_ffi_ctype_t type) {
-//   return (type == BAIK_FFI_CTYPE_NONE || baik_ffi_is_regular_word(type));
-// }
+static void gc_bg_take(struct baik *baik, struct gc_arena *a) {
+  struct gc_helper *h = baik->gc_helper;
+  gc_lock(&h->lock);
+  while (a->swept == NULL && a->sweep != NULL) {
+    a->swept = gc_sweep_block(baik, a, NULL);
+  }
+  a->free = a->swept;
+  a->swept = NULL;
+  if (a->sweep == NULL) __atomic_store_n(&a->bg, 0, __ATOMIC_RELEASE);
+  gc_unlock(&h->lock);
+}
 
-#ifdef _WIN32
-void *dlsym(void *handle, const char *name) {
-  static HANDLE msvcrt_dll;
-  void *sym = NULL;
-  if (msvcrt_dll == NULL) msvcrt_dll = GetModuleHandle("msvcrt.dll");
-  if ((sym = GetProcAddress(GetModuleHandle(NULL), name)) == NULL) {
-    sym = GetProcAddress(msvcrt_dll, name);
+// Called with the helper idle: hands over whatever it swept and was not
+// taken yet.
+static void gc_bg_finish(struct gc_arena *a) {
+  if (!gc_bg_active(a)) return;
+  if (a->swept != NULL) {
+    a->swept_tail->head.word = FREE_LINK(a->free);
+    a->free = a->swept;
   }
-  return sym;
+  a->swept = a->swept_tail = NULL;
+  __atomic_store_n(&a->bg, 0, __ATOMIC_RELAXED);
 }
-#elif !defined(__unix__) && !defined(__APPLE__)
-void *dlsym(void *handle, const char *name) {
-  (void) handle;
-  (void) name;
+
+static void gc_bg_start(struct gc_arena *a) {
+  if (a->sweep != NULL && a->destructor == NULL) {
+    __atomic_store_n(&a->bg, 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void gc_helper_run(struct gc_helper *h) {
+  for (;;) {
+    gc_event_wait(&h->work);
+    switch (h->job) {
+      case GC_JOB_MARK:
+        gc_par_mark_roots(h->baik, 1);
+        break;
+      case GC_JOB_SWEEP:
+        gc_bg_sweep(h, &h->baik->object_arena);
+        gc_bg_sweep(h, &h->baik->property_arena);
+        gc_bg_sweep(h, &h->baik->ffi_sig_arena);
+        break;
+      case GC_JOB_QUIT:
+        gc_event_signal(&h->done);
+        return;
+      default:
+        break;
+    }
+    gc_event_signal(&h->done);
+  }
+}
+
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+static void gc_helper_task(void *arg) {
+  gc_helper_run((struct gc_helper *) arg);
+  vTaskDelete(NULL);
+}
+#else
+static void *gc_helper_thread(void *arg) {
+  gc_helper_run((struct gc_helper *) arg);
   return NULL;
 }
 #endif
 
-#include <stdio.h>
+static void gc_helper_post(struct gc_helper *h, enum gc_job job) {
+  h->job = job;
+  h->busy = 1;
+  gc_event_signal(&h->work);
+}
 
-#define MARK(p) (((struct gc_cell *) (p))->head.word |= 1)
-#define UNMARK(p) (((struct gc_cell *) (p))->head.word &= ~1)
-#define MARKED(p) (((struct gc_cell *) (p))->head.word & 1)
-#define MARK_FREE(p) (((struct gc_cell *) (p))->head.word |= 2)
-#define UNMARK_FREE(p) (((struct gc_cell *) (p))->head.word &= ~2)
-#define MARKED_FREE(p) (((struct gc_cell *) (p))->head.word & 2)
-#define GC_ARENA_CELLS_RESERVE 2
+static void gc_helper_wait(struct gc_helper *h) {
+  if (h->busy) {
+    gc_event_wait(&h->done);
+    h->busy = 0;
+  }
+}
 
-static struct gc_block *gc_new_block(struct gc_arena *a, size_t size);
-static void gc_free_block(struct gc_block *b);
-static void gc_mark_mbuf_pt(struct baik *baik, const struct mbuf *mbuf);
+BAIK_PRIVATE struct gc_helper *gc_helper_create(struct baik *baik) {
+  struct gc_helper *h = (struct gc_helper *) calloc(1, sizeof(*h));
+  int ok;
 
-BAIK_PRIVATE struct baik_object *new_object(struct baik *baik) {
-  return (struct baik_object *) gc_alloc_cell(baik, &baik->object_arena);
-}
+  if (h == NULL) return NULL;
+  h->baik = baik;
+  if (!gc_lock_init(&h->lock)) goto clean_h;
+  if (!gc_event_init(&h->work)) goto clean_lock;
+  if (!gc_event_init(&h->done)) goto clean_work;
 
-BAIK_PRIVATE struct baik_property *new_property(struct baik *baik) {
-  return (struct baik_property *) gc_alloc_cell(baik, &baik->property_arena);
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+  ok = xTaskCreatePinnedToCore(gc_helper_task, "baik_gc", BAIK_GC_TASK_STACK,
+                               h, BAIK_GC_TASK_PRIO, NULL,
+                               BAIK_GC_TASK_CORE) == pdPASS;
+#else
+  ok = pthread_create(&h->thread, NULL, gc_helper_thread, h) == 0;
+#endif
+  if (ok) return h;
+
+  gc_event_free(&h->done);
+clean_work:
+  gc_event_free(&h->work);
+clean_lock:
+  gc_lock_free(&h->lock);
+clean_h:
+  free(h);
+  return NULL;
 }
 
-BAIK_PRIVATE struct baik_ffi_sig *new_ffi_sig(struct baik *baik) {
-  return (struct baik_ffi_sig *) gc_alloc_cell(baik, &baik->ffi_sig_arena);
+BAIK_PRIVATE void gc_helper_destroy(struct gc_helper *h) {
+  if (h == NULL) return;
+  gc_helper_wait(h);
+  gc_helper_post(h, GC_JOB_QUIT);
+  gc_helper_wait(h);
+#if BAIK_EM_PLATFORM != BAIK_EM_P_ESP32
+  pthread_join(h->thread, NULL);
+#endif
+  gc_event_free(&h->done);
+  gc_event_free(&h->work);
+  gc_lock_free(&h->lock);
+  free(h);
 }
 
-BAIK_PRIVATE void gc_arena_init(struct gc_arena *a, size_t cell_size,
-                               size_t initial_size, size_t size_increment) {
-  assert(cell_size >= sizeof(uintptr_t));
+#endif
 
-  memset(a, 0, sizeof(*a));
-  a->cell_size = cell_size;
-  a->size_increment = size_increment;
-  a->blocks = gc_new_block(a, initial_size);
-}
+#if BAIK_GC_COMPACT
 
-BAIK_PRIVATE void gc_arena_destroy(struct baik *baik, struct gc_arena *a) {
-  struct gc_block *b;
+#define UNMARK(b, i) ((b)->marks[(i) >> 3] &= (uint8_t) ~(1 << ((i) &7)))
+
+struct gc_compact_dst {
+  struct gc_arena *a;
+  struct gc_block *blocks;
+  struct gc_block *cur;
+  size_t used;
+  size_t count;
+};
 
-  if (a->blocks != NULL) {
-    gc_sweep(baik, a, 0);
-    for (b = a->blocks; b != NULL;) {
-      struct gc_block *tmp;
-      tmp = b;
-      b = b->next;
-      gc_free_block(tmp);
+struct gc_compact {
+  struct baik *baik;
+  struct gc_compact_dst objs;
+  struct gc_compact_dst props;
+};
+
+static size_t gc_count_marked(const struct gc_arena *a) {
+  struct gc_block *b;
+  size_t i, n = 0;
+  for (b = a->blocks; b != NULL; b = b->next) {
+    for (i = 0; i < b->size; i++) {
+      if (MARKED(b, i)) n++;
     }
   }
+  return n;
 }
 
-static void gc_free_block(struct gc_block *b) {
-  free(b->base);
-  free(b);
+static void gc_free_blocks(struct gc_block *b) {
+  while (b != NULL) {
+    struct gc_block *next = b->next;
+    gc_free_block(b);
+    b = next;
+  }
 }
 
-static struct gc_block *gc_new_block(struct gc_arena *a, size_t size) {
-  struct gc_cell *cur;
-  struct gc_block *b;
+static int gc_compact_reserve(struct gc_compact_dst *d, struct gc_arena *a,
+                              size_t cells) {
+  struct gc_block **pb = &d->blocks;
+  size_t size = a->size_increment;
 
-  b = (struct gc_block *) calloc(1, sizeof(*b));
-  if (b == NULL) abort();
+  d->a = a;
+  for (; cells > 0; cells -= cells < size ? cells : size) {
+    struct gc_block *b =
+        (struct gc_block *) calloc(1, sizeof(*b) + GC_BLOCK_MARKS_SIZE(size));
+    if (b == NULL) return 0;
+    b->size = size;
+    b->marks = (uint8_t *) (b + 1);
+    if ((b->base = (struct gc_cell *) calloc(a->cell_size, size)) == NULL) {
+      free(b);
+      return 0;
+    }
+    *pb = b;
+    pb = &b->next;
+  }
+  d->cur = d->blocks;
+  return 1;
+}
 
-  b->size = size;
-  b->base = (struct gc_cell *) calloc(a->cell_size, b->size);
-  if (b->base == NULL) abort();
+static void *gc_compact_alloc(struct gc_compact_dst *d) {
+  if (d->used == d->cur->size) {
+    d->cur = d->cur->next;
+    d->used = 0;
+  }
+  d->count++;
+  return GC_CELL_OP(d->a, d->cur->base, +, d->used++);
+}
 
-  for (cur = GC_CELL_OP(a, b->base, +, 0);
-       cur < GC_CELL_OP(a, b->base, +, b->size);
-       cur = GC_CELL_OP(a, cur, +, 1)) {
-    cur->head.link = a->free;
+static void gc_compact_finish(struct gc_compact_dst *d) {
+  struct gc_arena *a = d->a;
+  struct gc_cell *cur;
+
+  gc_free_blocks(a->blocks);
+  a->blocks = d->blocks;
+  a->free = NULL;
+  a->sweep = NULL;
+#if BAIK_MEMORY_STATS
+  a->alive = d->count;
+#endif
+  if (d->cur == NULL) return;
+  for (cur = GC_CELL_OP(a, d->cur->base, +, d->cur->size - 1);
+       d->used < d->cur->size; d->used++, cur = GC_CELL_OP(a, cur, -, 1)) {
+    cur->head.word = FREE_LINK(a->free);
     a->free = cur;
   }
+}
 
-  return b;
+static void gc_compact_val(struct gc_compact *c, baik_val_t *v) {
+  struct gc_arena *a = &c->baik->object_arena;
+  struct baik_object *o, *no;
+  struct baik_property *p, **pp;
+  struct gc_block *b;
+  size_t idx;
+
+  if (!baik_is_object(*v)) return;
+  o = get_object_struct(*v);
+  if ((b = gc_find_block(a, o)) == NULL) return;
+
+  idx = GC_BLOCK_CELL_IDX(a, b, o);
+  if (MARKED(b, idx)) {
+    UNMARK(b, idx);
+    no = (struct baik_object *) gc_compact_alloc(&c->objs);
+    for (pp = &no->properties, p = o->properties; p != NULL; p = p->next) {
+      *pp = (struct baik_property *) gc_compact_alloc(&c->props);
+      (*pp)->name = p->name;
+      (*pp)->value = p->value;
+      /* The old cell forwards to the new one, see gc_compact_iters() */
+      p->name = baik_mk_foreign(c->baik, *pp);
+      pp = &(*pp)->next;
+    }
+    o->properties = (struct baik_property *) no;
+  }
+  no = (struct baik_object *) o->properties;
+  *v = baik_legit_pointer_to_value(no) | (*v & BAIK_TAG_MASK);
 }
 
+static void gc_compact_vals(struct gc_compact *c, baik_val_t *vals,
+                            size_t len) {
+  size_t i;
+  for (i = 0; i < len; i++) {
+    gc_compact_val(c, &vals[i]);
+  }
+}
 
-static int gc_arena_is_gc_needed(struct gc_arena *a) {
-  struct gc_cell *r = a->free;
-  int i;
+static void gc_compact_mbuf_val(struct gc_compact *c, struct mbuf *m) {
+  gc_compact_vals(c, (baik_val_t *) m->buf, m->len / sizeof(baik_val_t));
+}
 
-  for (i = 0; i <= GC_ARENA_CELLS_RESERVE; i++, r = r->head.link) {
-    if (r == NULL) {
-      return 1;
+/*
+ * A for-in iterator is a foreign pointer to the property it is at. The
+ * object is on the same stack, so by now that property has been moved and
+ * its old cell holds where to.
+ */
+static void gc_compact_iters(struct gc_compact *c, struct mbuf *m) {
+  baik_val_t *v = (baik_val_t *) m->buf;
+  baik_val_t *end = v + m->len / sizeof(baik_val_t);
+  for (; v < end; v++) {
+    struct baik_property *p;
+    if (!baik_is_foreign(*v)) continue;
+    p = (struct baik_property *) get_ptr(*v);
+    if (gc_find_block(&c->baik->property_arena, p) != NULL &&
+        baik_is_foreign(p->name)) {
+      *v = p->name;
     }
   }
-
-  return 0;
 }
 
-BAIK_PRIVATE int gc_strings_is_gc_needed(struct baik *baik) {
-  struct mbuf *m = &baik->owned_strings;
-  return (double) m->len / (double) m->size > 0.9;
+static void gc_compact_ctx(struct gc_compact *c, struct baik_ctx *ctx) {
+  if (!ctx->saved) return;
+  gc_compact_mbuf_val(c, &ctx->scopes);
+  gc_compact_mbuf_val(c, &ctx->stack);
+  gc_compact_mbuf_val(c, &ctx->call_stack);
+  gc_compact_mbuf_val(c, &ctx->arg_stack);
+  gc_compact_val(c, &ctx->this_obj);
+  gc_compact_val(c, &ctx->last_getprop_obj);
 }
 
-BAIK_PRIVATE void *gc_alloc_cell(struct baik *baik, struct gc_arena *a) {
-  struct gc_cell *r;
+static int gc_compact_heap(struct baik *baik) {
+  struct gc_compact c;
+  struct gc_block *b;
+  struct baik_task *t;
+  baik_val_t **pp;
+  size_t i;
 
-  if (a->free == NULL) {
-    struct gc_block *b = gc_new_block(a, a->size_increment);
-    b->next = a->blocks;
-    a->blocks = b;
+  memset(&c, 0, sizeof(c));
+  c.baik = baik;
+  if (!gc_compact_reserve(&c.objs, &baik->object_arena,
+                          gc_count_marked(&baik->object_arena)) ||
+      !gc_compact_reserve(&c.props, &baik->property_arena,
+                          gc_count_marked(&baik->property_arena))) {
+    gc_free_blocks(c.objs.blocks);
+    gc_free_blocks(c.props.blocks);
+    return 0;
   }
-  r = a->free;
-
-  UNMARK(r);
 
-  a->free = r->head.link;
-
-#if BAIK_MEMORY_STATS
-  a->allocations++;
-  a->alive++;
-#endif
+  gc_compact_vals(&c, (baik_val_t *) &baik->vals,
+                  sizeof(baik->vals) / sizeof(baik_val_t));
+  for (pp = (baik_val_t **) baik->owned_values.buf;
+       (char *) pp < baik->owned_values.buf + baik->owned_values.len; pp++) {
+    gc_compact_val(&c, *pp);
+  }
+  gc_compact_mbuf_val(&c, &baik->scopes);
+  gc_compact_mbuf_val(&c, &baik->stack);
+  gc_compact_mbuf_val(&c, &baik->call_stack);
+  gc_compact_mbuf_val(&c, &baik->arg_stack);
+  for (t = baik->tasks; t != NULL; t = t->next) {
+    gc_compact_ctx(&c, &t->ctx);
+    gc_compact_val(&c, &t->func);
+  }
+  gc_compact_ctx(&c, &baik->parked);
+  gc_compact_ctx(&c, &baik->scratch);
+
+  for (b = c.objs.blocks; b != NULL; b = b->next) {
+    for (i = 0; i < b->size && (b != c.objs.cur || i < c.objs.used); i++) {
+      struct baik_object *o =
+          (struct baik_object *) GC_CELL_OP(c.objs.a, b->base, +, i);
+      struct baik_property *p;
+      for (p = o->properties; p != NULL; p = p->next) {
+        gc_compact_val(&c, &p->name);
+        gc_compact_val(&c, &p->value);
+      }
+    }
+    if (b == c.objs.cur) break;
+  }
 
-  if (gc_arena_is_gc_needed(a)) {
-    baik->need_gc = 1;
+  gc_compact_iters(&c, &baik->stack);
+  for (t = baik->tasks; t != NULL; t = t->next) {
+    if (t->ctx.saved) gc_compact_iters(&c, &t->ctx.stack);
   }
+  if (baik->parked.saved) gc_compact_iters(&c, &baik->parked.stack);
+  if (baik->scratch.saved) gc_compact_iters(&c, &baik->scratch.stack);
+  baik->scope_prop = NULL;
 
-  memset(r, 0, a->cell_size);
-  return (void *) r;
+  gc_compact_finish(&c.objs);
+  gc_compact_finish(&c.props);
+  return 1;
 }
 
-
-void gc_sweep(struct baik *baik, struct gc_arena *a, size_t start) {
-  struct gc_block *b;
-  struct gc_cell *cur;
-  struct gc_block **prevp = &a->blocks;
-#if BAIK_MEMORY_STATS
-  a->alive = 0;
 #endif
 
-  {
-    struct gc_cell *next;
-    for (cur = a->free; cur != NULL; cur = next) {
-      next = cur->head.link;
-      MARK_FREE(cur);
-    }
-  }
-
-  a->free = NULL;
+static void gc_mark_roots(struct baik *baik) {
+  gc_mark_val_array(baik, (baik_val_t *) &baik->vals,
+                    sizeof(baik->vals) / sizeof(baik_val_t));
 
-  for (b = a->blocks; b != NULL;) {
-    size_t freed_in_block = 0;
-   
-    struct gc_cell *prev_free = a->free;
+  gc_mark_mbuf_pt(baik, &baik->owned_values);
+  gc_mark_mbuf_val(baik, &baik->scopes);
+  gc_mark_mbuf_val(baik, &baik->stack);
+  gc_mark_mbuf_val(baik, &baik->call_stack);
+  // `this` of a pending call lives only here between OP_ARGS and OP_CALL.
+  gc_mark_mbuf_val(baik, &baik->arg_stack);
+}
 
-    for (cur = GC_CELL_OP(a, b->base, +, start);
-         cur < GC_CELL_OP(a, b->base, +, b->size);
-         cur = GC_CELL_OP(a, cur, +, 1)) {
-      if (MARKED(cur)) {
-        UNMARK(cur);
-#if BAIK_MEMORY_STATS
-        a->alive++;
+BAIK_PRIVATE void gc_reset(struct baik *baik) {
+#if BAIK_GC_THREADS
+  if (baik->gc_helper != NULL) {
+    gc_helper_wait(baik->gc_helper);
+  }
 #endif
-      } else {
-        if (MARKED_FREE(cur)) {
-         
-          UNMARK_FREE(cur);
-        } else {
-         
-          if (a->destructor != NULL) {
-            a->destructor(baik, cur);
-          }
-          memset(cur, 0, a->cell_size);
-        }
-        cur->head.link = a->free;
-        a->free = cur;
-        freed_in_block++;
-#if BAIK_MEMORY_STATS
-        a->garbage++;
+  gc_arena_reset(baik, &baik->object_arena);
+  gc_arena_reset(baik, &baik->property_arena);
+  gc_arena_reset(baik, &baik->ffi_sig_arena);
+}
+
+void baik_gc(struct baik *baik, int full) {
+#if BAIK_GC_THREADS
+  struct gc_helper *h = baik->gc_helper;
+  if (h != NULL) {
+    gc_helper_wait(h);
+    gc_bg_finish(&baik->object_arena);
+    gc_bg_finish(&baik->property_arena);
+    gc_bg_finish(&baik->ffi_sig_arena);
+  }
+#endif
+  gc_sweep(baik, &baik->object_arena);
+  gc_sweep(baik, &baik->property_arena);
+  gc_sweep(baik, &baik->ffi_sig_arena);
+
+#if BAIK_GC_THREADS
+  if (h != NULL) {
+    gc_helper_post(h, GC_JOB_MARK);
+    gc_par_mark_roots(baik, 0);
+    gc_helper_wait(h);
+    gc_par_mark_other_roots(baik);
+  } else {
+    gc_mark_roots(baik);
+  }
+#else
+  gc_mark_roots(baik);
 #endif
-      }
-    }
+  baik_events_mark(baik);
+  baik_tasks_mark(baik);
+  //gc_mark_ffi_cbargs_list(baik, baik->ffi_cb_args);
+  gc_compact_strings(baik);
+  gc_sweep_start(&baik->object_arena);
+  gc_sweep_start(&baik->property_arena);
+  gc_sweep_start(&baik->ffi_sig_arena);
 
-    if (b->next != NULL && freed_in_block == b->size) {
-      *prevp = b->next;
-      gc_free_block(b);
-      b = *prevp;
-      a->free = prev_free;
-    } else {
-      prevp = &b->next;
-      b = b->next;
+  if (full) {
+    size_t trimmed_size = baik->owned_strings.len + _BAIK_STRING_BUF_RESERVE;
+#if BAIK_GC_COMPACT
+    gc_compact_heap(baik);
+#endif
+    gc_sweep(baik, &baik->object_arena);
+    gc_sweep(baik, &baik->property_arena);
+    gc_sweep(baik, &baik->ffi_sig_arena);
+    if (trimmed_size < baik->owned_strings.size) {
+      mbuf_resize(&baik->owned_strings, trimmed_size);
     }
   }
+#if BAIK_GC_THREADS
+  if (!full && h != NULL) {
+    gc_bg_start(&baik->object_arena);
+    gc_bg_start(&baik->property_arena);
+    gc_bg_start(&baik->ffi_sig_arena);
+    gc_helper_post(h, GC_JOB_SWEEP);
+  }
+#endif
 }
 
+#define BAIK_SNAPSHOT_MAGIC 0x4e534b42 /* "BKSN" */
+#define BAIK_SNAPSHOT_VERSION 3
 
-// static void gc_mark_ffi_sig(struct baik *baik, baik_val_t *v) {
-//   struct baik_ffi_sig *psig;
+// What tells one build of the program from another. On the device it is
+// the SHA-256 of the application ELF, which changes with every firmware
+// upload; the host falls back to the time baik.c was compiled.
+#ifndef BAIK_BUILD_ID
+#define BAIK_BUILD_ID __DATE__ " " __TIME__
+#endif
 
-//   assert(baik_is_ffi_sig(*v));
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+#include "esp_idf_version.h"
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include "esp_app_desc.h"
+#define snap_app_desc esp_app_get_description
+#else
+#include "esp_ota_ops.h"
+#define snap_app_desc esp_ota_get_app_description
+#endif
+#endif
+
+// A snapshot is a copy of a quiet instance: the bytecode parts, both string
+// heaps, every live object and property cell at its index in its arena, the
+// global scope and the pending timers. Cells refer to each other by index,
+// so an image loads into arenas anywhere in memory. Pointers into the
+// program (builtins, foreign strings) are moved by however far the program
+// itself moved, which only holds for the very same build; images from any
+// other build, told apart by build_id, are refused. Foreign values pointing into the C heap cannot
+// survive a reboot and must not be part of a snapshot.
+struct baik_snap_hdr {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t ptr_size;
+  uint64_t anchor;
+  uint8_t build_id[32];
+  uint64_t bcode_len;
+  uint64_t strings_len;
+  uint64_t fstrings_len;
+  uint32_t nparts;
+  uint32_t obj_cells;
+  uint32_t prop_cells;
+  uint32_t ntimers;
+  int32_t timer_seq;
+  uint32_t reserved;
+  baik_val_t global;
+  baik_val_t vals[sizeof(struct baik_vals) / sizeof(baik_val_t)];
+};
 
-//   psig = baik_get_ffi_sig_struct(*v);
+struct baik_snap_part {
+  uint64_t start_idx;
+  uint64_t len;
+  uint32_t exec_res;
+  uint32_t reserved;
+};
 
-//   if (!gc_check_val(baik, *v)) {
-//     abort();
-//   }
+struct baik_snap_timer {
+  uint32_t id;
+  uint32_t period_ms;
+  uint64_t left_us;
+  baik_val_t func;
+};
 
-//   if (MARKED(psig)) return;
+struct snap_block {
+  const char *base;
+  const char *end;
+  size_t first;
+};
 
-//   MARK(psig);
-// }
+// Cell pointer to arena index, for saving.
+struct snap_map {
+  size_t cell_size;
+  struct snap_block *blocks;
+  int n;
+};
 
+struct snap_reader {
+  const char *p;
+  const char *end;
+};
 
-static void gc_mark_object(struct baik *baik, baik_val_t *v) {
-  struct baik_object *obj_base;
-  struct baik_property *prop;
-  struct baik_property *next;
+static uint64_t snap_fn_addr(baik_func_ptr_t fn) {
+  union {
+    baik_func_ptr_t fn;
+    void *p;
+  } u;
+  u.fn = fn;
+  return (uint64_t)(uintptr_t) u.p;
+}
 
-  assert(baik_is_object(*v));
+static void snap_build_id(uint8_t id[32]) {
+#if BAIK_EM_PLATFORM == BAIK_EM_P_ESP32
+  memcpy(id, snap_app_desc()->app_elf_sha256, 32);
+#else
+  static const char build[] = BAIK_BUILD_ID;
+  memset(id, 0, 32);
+  memcpy(id, build, sizeof(build) < 32 ? sizeof(build) : 32);
+#endif
+}
 
-  obj_base = get_object_struct(*v);
+// Every record is padded to 8 bytes, so that an image mapped from flash
+// can be read in place.
+static int snap_pad(struct mbuf *m) {
+  static const char zeros[8];
+  size_t n = (8 - m->len % 8) % 8;
+  return mbuf_append(m, zeros, n) == n;
+}
 
-  if (!gc_check_val(baik, *v)) {
-    abort();
-  }
+static int snap_put(struct mbuf *m, const void *p, size_t len) {
+  return mbuf_append(m, p, len) == len && snap_pad(m);
+}
 
-  if (MARKED(obj_base)) return;
+static const char *snap_take(struct snap_reader *r, size_t len) {
+  const char *p = r->p;
+  size_t padded = len + (8 - len % 8) % 8;
+  if (padded < len || (size_t)(r->end - r->p) < padded) return NULL;
+  r->p += padded;
+  return p;
+}
 
-  for ((prop = obj_base->properties), MARK(obj_base); prop != NULL;
-       prop = next) {
-    if (!gc_check_ptr(&baik->property_arena, prop)) {
-      abort();
-    }
+static int snap_block_cmp(const void *a, const void *b) {
+  const struct snap_block *x = (const struct snap_block *) a;
+  const struct snap_block *y = (const struct snap_block *) b;
+  return x->base < y->base ? -1 : x->base > y->base;
+}
 
-    gc_mark(baik, &prop->name);
-    gc_mark(baik, &prop->value);
+static int snap_map_init(struct snap_map *mp, const struct gc_arena *a) {
+  const struct gc_block *b;
+  size_t first = 0;
+  int n = 0;
 
-    next = prop->next;
-    MARK(prop);
+  for (b = a->blocks; b != NULL; b = b->next) n++;
+  mp->cell_size = a->cell_size;
+  mp->n = n;
+  mp->blocks = (struct snap_block *) calloc(n + 1, sizeof(*mp->blocks));
+  if (mp->blocks == NULL) return 0;
+  for (n = 0, b = a->blocks; b != NULL; b = b->next, n++) {
+    mp->blocks[n].base = (const char *) b->base;
+    mp->blocks[n].end = (const char *) b->base + b->size * a->cell_size;
+    mp->blocks[n].first = first;
+    first += b->size;
   }
-
+  qsort(mp->blocks, mp->n, sizeof(*mp->blocks), snap_block_cmp);
+  return 1;
 }
 
-
-static void gc_mark_string(struct baik *baik, baik_val_t *v) {
-  baik_val_t h, tmp = 0;
-  char *s;
-  assert((*v & BAIK_TAG_MASK) == BAIK_TAG_STRING_O);
-
-  s = baik->owned_strings.buf + gc_string_baik_val_to_offset(*v);
-  assert(s < baik->owned_strings.buf + baik->owned_strings.len);
-  if (s[-1] == '\0') {
-    memcpy(&tmp, s, sizeof(tmp) - 2);
-    tmp |= BAIK_TAG_STRING_C;
-  } else {
-    memcpy(&tmp, s, sizeof(tmp) - 2);
-    tmp |= BAIK_TAG_FOREIGN;
+static size_t snap_map_idx(const struct snap_map *mp, const void *ptr) {
+  const char *p = (const char *) ptr;
+  int lo = 0, hi = mp->n, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (p < mp->blocks[mid].base) {
+      hi = mid;
+    } else if (p >= mp->blocks[mid].end) {
+      lo = mid + 1;
+    } else {
+      return mp->blocks[mid].first +
+             (p - mp->blocks[mid].base) / mp->cell_size;
+    }
   }
-
-  h = (baik_val_t)(uintptr_t) v;
-  s[-1] = 1;
-  memcpy(s, &h, sizeof(h) - 2);
-  memcpy(v, &tmp, sizeof(tmp));
+  return (size_t) -1;
 }
 
-BAIK_PRIVATE void gc_mark(struct baik *baik, baik_val_t *v) {
-  if (baik_is_object(*v)) {
-    gc_mark_object(baik, v);
-  }
-  // if (baik_is_ffi_sig(*v)) {
-  //   gc_mark_ffi_sig(baik, v);
-  // }
-  if ((*v & BAIK_TAG_MASK) == BAIK_TAG_STRING_O) {
-    gc_mark_string(baik, v);
+static int snap_val_out(const struct snap_map *objs, baik_val_t v,
+                        baik_val_t *out) {
+  uint64_t tag = v & BAIK_TAG_MASK;
+  *out = v;
+  if (tag == BAIK_TAG_OBJECT || tag == BAIK_TAG_ARRAY) {
+    size_t idx = snap_map_idx(objs, get_ptr(v));
+    if (idx == (size_t) -1) return 0;
+    *out = (baik_val_t) idx | tag;
+  } else if (tag == BAIK_TAG_FUNCTION_FFI) {
+    return 0;
   }
+  return 1;
 }
 
-BAIK_PRIVATE uint64_t gc_string_baik_val_to_offset(baik_val_t v) {
-  return (((uint64_t)(uintptr_t) get_ptr(v)) & ~BAIK_TAG_MASK);
+static int snap_val_in(void **objs, size_t nobjs, uint64_t slide,
+                       baik_val_t v, baik_val_t *out) {
+  uint64_t tag = v & BAIK_TAG_MASK;
+  *out = v;
+  if (tag == BAIK_TAG_OBJECT || tag == BAIK_TAG_ARRAY) {
+    size_t idx = (size_t)(v & ~BAIK_TAG_MASK);
+    if (idx >= nobjs || objs[idx] == NULL) return 0;
+    *out = baik_legit_pointer_to_value(objs[idx]) | tag;
+  } else if (tag == BAIK_TAG_FOREIGN) {
+    if (get_ptr(v) != NULL) {
+      *out = ((v + slide) & ~BAIK_TAG_MASK) | tag;
+    }
+  } else if (tag == BAIK_TAG_STRING_F && sizeof(void *) <= 4 &&
+             ((v >> 32) & 0xFFFF) != 0) {
+    // The pointer sits in the value itself, see baik_mk_string.
+    *out = (v & ~(uint64_t) 0xFFFFFFFF) | (uint32_t)(v + slide);
+  } else if (tag == BAIK_TAG_FUNCTION_FFI) {
+    return 0;
+  }
+  return 1;
 }
 
-BAIK_PRIVATE baik_val_t gc_string_val_from_offset(uint64_t s) {
-  return s | BAIK_TAG_STRING_O;
+static int snap_relocate_fstrings(struct mbuf *m, uint64_t slide) {
+  size_t pos = 0, llen;
+  uint64_t len;
+  char *p;
+  while (pos < m->len) {
+    if (!BAIK_EM_varint_decode((uint8_t *) m->buf + pos, m->len - pos, &len,
+                               &llen) ||
+        m->len - pos - llen < sizeof(p)) {
+      return 0;
+    }
+    memcpy(&p, m->buf + pos + llen, sizeof(p));
+    if (p != NULL) {
+      p = (char *) (uintptr_t)((uint64_t)(uintptr_t) p + slide);
+      memcpy(m->buf + pos + llen, &p, sizeof(p));
+    }
+    pos += llen + sizeof(p);
+  }
+  return 1;
 }
 
-void gc_compact_strings(struct baik *baik) {
-  char *p = baik->owned_strings.buf + 1;
-  uint64_t h, next, head = 1;
-  int len, llen;
-
-  while (p < baik->owned_strings.buf + baik->owned_strings.len) {
-    if (p[-1] == '\1') {
-     
-      h = 0;
-      memcpy(&h, p, sizeof(h) - 2);
-
-      for (; (h & BAIK_TAG_MASK) != BAIK_TAG_STRING_C; h = next) {
-        h &= ~BAIK_TAG_MASK;
-        memcpy(&next, (char *) (uintptr_t) h, sizeof(h));
+// Appends one bit per arena cell, set for the cells in use.
+static int snap_put_live(struct mbuf *m, const struct gc_arena *a,
+                         size_t cells) {
+  const struct gc_block *b;
+  struct gc_cell *cur;
+  size_t i = 0, start = m->len, n = (cells + 7) / 8;
 
-        *(baik_val_t *) (uintptr_t) h = gc_string_val_from_offset(head);
+  if (mbuf_append(m, NULL, n) != n) return 0;
+  memset(m->buf + start, 0, n);
+  for (b = a->blocks; b != NULL; b = b->next) {
+    for (cur = b->base; cur < GC_CELL_OP(a, b->base, +, b->size);
+         cur = GC_CELL_OP(a, cur, +, 1), i++) {
+      if (!MARKED_FREE(cur)) {
+        m->buf[start + i / 8] |= 1 << (i % 8);
       }
-      h &= ~BAIK_TAG_MASK;
-
-      len = BAIK_EM_varint_decode_unsafe((unsigned char *) &h, &llen);
-      len += llen + 1;
+    }
+  }
+  return snap_pad(m);
+}
 
-      memcpy(p, &h, sizeof(h) - 2);
+static int snap_is_live(const uint8_t *live, size_t i) {
+  return (live[i / 8] >> (i % 8)) & 1;
+}
 
-      memmove(baik->owned_strings.buf + head, p, len);
-      baik->owned_strings.buf[head - 1] = 0x0;
-      p += len;
-      head += len;
-    } else {
-      len = BAIK_EM_varint_decode_unsafe((unsigned char *) p, &llen);
-      len += llen + 1;
+// Lays the cells of an image out over the arena: live ones are cleared for
+// filling in, all others go on the free list in the order gc_arena_reset
+// uses. Returns the cell of every index, NULL for free ones.
+static void **snap_cells(struct gc_arena *a, size_t cells,
+                         const uint8_t *live) {
+  void **res;
+  struct gc_block *b;
+  struct gc_cell *cur;
+  size_t i = 0;
 
-      p += len;
+  gc_arena_grow(a, cells);
+  res = (void **) calloc(cells + 1, sizeof(*res));
+  if (res == NULL) return NULL;
+  a->free = NULL;
+  for (b = a->blocks; b != NULL; b = b->next) {
+    for (cur = b->base; cur < GC_CELL_OP(a, b->base, +, b->size);
+         cur = GC_CELL_OP(a, cur, +, 1), i++) {
+      if (i < cells && snap_is_live(live, i)) {
+        memset(cur, 0, a->cell_size);
+        res[i] = cur;
+      } else {
+        cur->head.word = FREE_LINK(a->free);
+        a->free = cur;
+      }
     }
   }
-
-  baik->owned_strings.len = head;
+  return res;
 }
 
-BAIK_PRIVATE int maybe_gc(struct baik *baik) {
-  if (!baik->inhibit_gc) {
-    baik_gc(baik, 0);
-    return 1;
+static size_t snap_count_live(const uint8_t *live, size_t cells) {
+  size_t i, n = 0;
+  for (i = 0; i < cells; i++) {
+    n += snap_is_live(live, i);
   }
-  return 0;
+  return n;
 }
 
-
-static void gc_mark_val_array(struct baik *baik, baik_val_t *vals, size_t len) {
-  baik_val_t *vp;
-  for (vp = vals; vp < vals + len; vp++) {
-    gc_mark(baik, vp);
+baik_err_t baik_snapshot_save_buf(struct baik *baik, char **buf, size_t *len) {
+  struct baik_snap_hdr hdr;
+  struct snap_map objs, props;
+  struct mbuf m;
+  struct gc_arena *a;
+  struct gc_block *b;
+  struct gc_cell *cur;
+  uint64_t now = baik_uptime_us();
+  int i, ok = 1;
+
+  *buf = NULL;
+  *len = 0;
+  if (baik->exec_depth != 0 || baik->suspended || baik->tasks != NULL ||
+      !baik_ev_empty(baik)) {
+    return baik_set_errorf(baik, BAIK_INTERNAL_ERROR,
+                           "snapshot butuh instance yang diam");
+  }
+
+  // Only reachable cells stay, and they are all swept.
+  baik_gc(baik, 1);
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = BAIK_SNAPSHOT_MAGIC;
+  hdr.version = BAIK_SNAPSHOT_VERSION;
+  hdr.ptr_size = sizeof(void *);
+  hdr.anchor = snap_fn_addr((baik_func_ptr_t) baik_snapshot_load_buf);
+  snap_build_id(hdr.build_id);
+  hdr.bcode_len = baik->bcode_len;
+  hdr.strings_len = baik->owned_strings.len;
+  hdr.fstrings_len = baik->foreign_strings.len;
+  hdr.nparts = baik_bcode_parts_cnt(baik);
+  hdr.obj_cells = gc_arena_cells(&baik->object_arena);
+  hdr.prop_cells = gc_arena_cells(&baik->property_arena);
+  hdr.ntimers = baik->timers_cnt;
+  hdr.timer_seq = baik->timer_seq;
+
+  objs.blocks = props.blocks = NULL;
+  mbuf_init(&m, 0);
+  if (!snap_map_init(&objs, &baik->object_arena) ||
+      !snap_map_init(&props, &baik->property_arena)) {
+    ok = 0;
+    goto clean;
   }
-}
 
+  ok &= snap_val_out(&objs, baik_get_global(baik), &hdr.global);
+  for (i = 0; i < (int) (sizeof(hdr.vals) / sizeof(hdr.vals[0])); i++) {
+    ok &= snap_val_out(&objs, ((baik_val_t *) &baik->vals)[i], &hdr.vals[i]);
+  }
+  ok &= snap_put(&m, &hdr, sizeof(hdr));
 
-static void gc_mark_mbuf_pt(struct baik *baik, const struct mbuf *mbuf) {
-  baik_val_t **vp;
-  for (vp = (baik_val_t **) mbuf->buf; (char *) vp < mbuf->buf + mbuf->len;
-       vp++) {
-    gc_mark(baik, *vp);
+  for (i = 0; i < (int) hdr.nparts; i++) {
+    struct baik_bcode_part *bp = baik_bcode_part_get(baik, i);
+    struct baik_snap_part sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.start_idx = bp->start_idx;
+    sp.len = bp->data.len;
+    sp.exec_res = bp->exec_res;
+    ok &= snap_put(&m, &sp, sizeof(sp));
+    ok &= snap_put(&m, bp->data.p, bp->data.len);
   }
-}
 
+  ok &= snap_put(&m, baik->owned_strings.buf, baik->owned_strings.len);
+  ok &= snap_put(&m, baik->foreign_strings.buf, baik->foreign_strings.len);
 
-static void gc_mark_mbuf_val(struct baik *baik, const struct mbuf *mbuf) {
-  gc_mark_val_array(baik, (baik_val_t *) mbuf->buf,
-                    mbuf->len / sizeof(baik_val_t));
-}
+  a = &baik->object_arena;
+  ok &= snap_put_live(&m, a, hdr.obj_cells);
+  for (b = a->blocks; b != NULL; b = b->next) {
+    for (cur = b->base; cur < GC_CELL_OP(a, b->base, +, b->size);
+         cur = GC_CELL_OP(a, cur, +, 1)) {
+      struct baik_object *o = (struct baik_object *) cur;
+      uint64_t first = 0;
+      if (MARKED_FREE(cur)) continue;
+      if (o->properties != NULL) {
+        first = snap_map_idx(&props, o->properties) + 1;
+      }
+      ok &= snap_put(&m, &first, sizeof(first));
+    }
+  }
 
-// static void gc_mark_ffi_cbargs_list(struct baik *baik, ffi_cb_args_t *cbargs) {
-//   for (; cbargs != NULL; cbargs = cbargs->next) {
-//     gc_mark(baik, &cbargs->func);
-//     gc_mark(baik, &cbargs->userdata);
-//   }
-// }
+  a = &baik->property_arena;
+  ok &= snap_put_live(&m, a, hdr.prop_cells);
+  for (b = a->blocks; b != NULL; b = b->next) {
+    for (cur = b->base; cur < GC_CELL_OP(a, b->base, +, b->size);
+         cur = GC_CELL_OP(a, cur, +, 1)) {
+      struct baik_property *p = (struct baik_property *) cur;
+      uint64_t rec[3] = {0, 0, 0};
+      if (MARKED_FREE(cur)) continue;
+      if (p->next != NULL) {
+        rec[0] = snap_map_idx(&props, p->next) + 1;
+      }
+      ok &= snap_val_out(&objs, p->name, &rec[1]);
+      ok &= snap_val_out(&objs, p->value, &rec[2]);
+      ok &= snap_put(&m, rec, sizeof(rec));
+    }
+  }
 
+  for (i = 0; i < BAIK_TIMER_SLOTS; i++) {
+    struct baik_timer *t;
+    for (t = baik->timers[i]; t != NULL; t = t->next) {
+      struct baik_snap_timer st;
+      memset(&st, 0, sizeof(st));
+      st.id = t->id;
+      st.period_ms = t->period_ms;
+      st.left_us = t->due_us > now ? t->due_us - now : 0;
+      ok &= snap_val_out(&objs, t->func, &st.func);
+      ok &= snap_put(&m, &st, sizeof(st));
+    }
+  }
 
-void baik_gc(struct baik *baik, int full) {
-  gc_mark_val_array(baik, (baik_val_t *) &baik->vals,
-                    sizeof(baik->vals) / sizeof(baik_val_t));
+clean:
+  free(objs.blocks);
+  free(props.blocks);
+  if (!ok) {
+    mbuf_free(&m);
+    return baik_set_errorf(baik, BAIK_INTERNAL_ERROR,
+                           "snapshot gagal dibuat");
+  }
+  *buf = m.buf;
+  *len = m.len;
+  return BAIK_OK;
+}
 
-  gc_mark_mbuf_pt(baik, &baik->owned_values);
-  gc_mark_mbuf_val(baik, &baik->scopes);
-  gc_mark_mbuf_val(baik, &baik->stack);
-  gc_mark_mbuf_val(baik, &baik->call_stack);
-  //gc_mark_ffi_cbargs_list(baik, baik->ffi_cb_args);
-  gc_compact_strings(baik);
-  gc_sweep(baik, &baik->object_arena, 0);
-  gc_sweep(baik, &baik->property_arena, 0);
-  gc_sweep(baik, &baik->ffi_sig_arena, 0);
+baik_err_t baik_snapshot_load_buf(struct baik *baik, const void *buf,
+                                  size_t len) {
+  struct snap_reader r;
+  struct baik_snap_hdr hdr;
+  uint8_t build_id[32];
+  const char *p;
+  const uint8_t *obj_live, *prop_live;
+  const char *obj_recs, *prop_recs, *timer_recs;
+  void **objs = NULL, **props = NULL;
+  baik_val_t v;
+  uint64_t slide, now = baik_uptime_us();
+  size_t i, k, n;
+
+  if (baik->exec_depth != 0) {
+    return baik_set_errorf(baik, BAIK_INTERNAL_ERROR,
+                           "tidak bisa memuat snapshot saat skrip berjalan");
+  }
+
+  r.p = (const char *) buf;
+  r.end = r.p + len;
+  if ((p = snap_take(&r, sizeof(hdr))) == NULL) goto bad_image;
+  memcpy(&hdr, p, sizeof(hdr));
+  snap_build_id(build_id);
+  if (hdr.magic != BAIK_SNAPSHOT_MAGIC ||
+      hdr.version != BAIK_SNAPSHOT_VERSION ||
+      hdr.ptr_size != sizeof(void *) ||
+      memcmp(hdr.build_id, build_id, sizeof(build_id)) != 0) {
+    return baik_set_errorf(baik, BAIK_FILE_READ_ERROR,
+                           "snapshot bukan untuk program ini");
+  }
+  slide = snap_fn_addr((baik_func_ptr_t) baik_snapshot_load_buf) - hdr.anchor;
+
+  baik_reset_state(baik);
+
+  for (i = 0; i < hdr.nparts; i++) {
+    struct baik_snap_part sp;
+    struct baik_bcode_part bp;
+    char *data;
+    if ((p = snap_take(&r, sizeof(sp))) == NULL) goto bad;
+    memcpy(&sp, p, sizeof(sp));
+    if (sp.start_idx + sp.len > hdr.bcode_len ||
+        (p = snap_take(&r, sp.len)) == NULL) {
+      goto bad;
+    }
+    if ((data = (char *) malloc(sp.len + 1)) == NULL) goto bad;
+    memcpy(data, p, sp.len);
+    memset(&bp, 0, sizeof(bp));
+    bp.start_idx = sp.start_idx;
+    bp.data.p = data;
+    bp.data.len = sp.len;
+    bp.exec_res = (baik_err_t) sp.exec_res;
+    baik_bcode_part_add(baik, &bp);
+  }
+  baik->bcode_len = hdr.bcode_len;
+
+  baik->owned_strings.len = 0;
+  if (hdr.strings_len == 0 || (p = snap_take(&r, hdr.strings_len)) == NULL ||
+      mbuf_append(&baik->owned_strings, p, hdr.strings_len) != hdr.strings_len) {
+    goto bad;
+  }
+  n = hdr.fstrings_len;
+  if ((p = snap_take(&r, n)) == NULL) goto bad;
+  if (n > 0 && (mbuf_append(&baik->foreign_strings, p, n) != n ||
+                !snap_relocate_fstrings(&baik->foreign_strings, slide))) {
+    goto bad;
+  }
+
+  obj_live = (const uint8_t *) snap_take(&r, (hdr.obj_cells + 7) / 8);
+  if (obj_live == NULL) goto bad;
+  n = snap_count_live(obj_live, hdr.obj_cells);
+  obj_recs = snap_take(&r, n * sizeof(uint64_t));
+  prop_live = (const uint8_t *) snap_take(&r, (hdr.prop_cells + 7) / 8);
+  if (obj_recs == NULL || prop_live == NULL) goto bad;
+  n = snap_count_live(prop_live, hdr.prop_cells);
+  prop_recs = snap_take(&r, n * 3 * sizeof(uint64_t));
+  timer_recs = snap_take(&r, hdr.ntimers * sizeof(struct baik_snap_timer));
+  if (prop_recs == NULL || timer_recs == NULL) goto bad;
+
+  objs = snap_cells(&baik->object_arena, hdr.obj_cells, obj_live);
+  props = snap_cells(&baik->property_arena, hdr.prop_cells, prop_live);
+  if (objs == NULL || props == NULL) goto bad;
+
+  for (i = k = 0; i < hdr.obj_cells; i++) {
+    struct baik_object *o = (struct baik_object *) objs[i];
+    uint64_t first;
+    if (o == NULL) continue;
+    memcpy(&first, obj_recs + k++ * sizeof(first), sizeof(first));
+    if (first != 0) {
+      if (first > hdr.prop_cells || props[first - 1] == NULL) goto bad;
+      o->properties = (struct baik_property *) props[first - 1];
+    }
+  }
+  for (i = k = 0; i < hdr.prop_cells; i++) {
+    struct baik_property *prop = (struct baik_property *) props[i];
+    uint64_t rec[3];
+    if (prop == NULL) continue;
+    memcpy(rec, prop_recs + k++ * sizeof(rec), sizeof(rec));
+    if (rec[0] != 0) {
+      if (rec[0] > hdr.prop_cells || props[rec[0] - 1] == NULL) goto bad;
+      prop->next = (struct baik_property *) props[rec[0] - 1];
+    }
+    if (!snap_val_in(objs, hdr.obj_cells, slide, rec[1], &prop->name) ||
+        !snap_val_in(objs, hdr.obj_cells, slide, rec[2], &prop->value)) {
+      goto bad;
+    }
+  }
 
-  if (full) {
-    size_t trimmed_size = baik->owned_strings.len + _BAIK_STRING_BUF_RESERVE;
-    if (trimmed_size < baik->owned_strings.size) {
-      mbuf_resize(&baik->owned_strings, trimmed_size);
+  for (i = 0; i < hdr.ntimers; i++) {
+    struct baik_snap_timer st;
+    struct baik_timer *t;
+    memcpy(&st, timer_recs + i * sizeof(st), sizeof(st));
+    if (!snap_val_in(objs, hdr.obj_cells, slide, st.func, &v) ||
+        (t = (struct baik_timer *) calloc(1, sizeof(*t))) == NULL) {
+      goto bad;
+    }
+    t->id = st.id;
+    t->due_us = now + st.left_us;
+    t->period_ms = st.period_ms;
+    t->func = v;
+    baik_timer_link(baik, t);
+    baik->timers_cnt++;
+  }
+  baik->timer_tick = now / 1000 / BAIK_TIMER_TICK_MS;
+  baik->timer_seq = hdr.timer_seq;
+
+  if (!snap_val_in(objs, hdr.obj_cells, slide, hdr.global, &v) ||
+      !baik_is_object(v)) {
+    goto bad;
+  }
+  push_baik_val(&baik->scopes, v);
+  baik_ctx_reset(&baik->scratch, v, -1);
+  for (i = 0; i < sizeof(hdr.vals) / sizeof(hdr.vals[0]); i++) {
+    if (!snap_val_in(objs, hdr.obj_cells, slide, hdr.vals[i],
+                     &((baik_val_t *) &baik->vals)[i])) {
+      goto bad;
     }
   }
+
+  free(objs);
+  free(props);
+  return BAIK_OK;
+
+bad:
+  free(objs);
+  free(props);
+  baik_reset(baik);
+bad_image:
+  return baik_set_errorf(baik, BAIK_FILE_READ_ERROR, "snapshot rusak");
 }
 
-BAIK_PRIVATE int gc_check_val(struct baik *baik, baik_val_t v) {
-  if (baik_is_object(v)) {
-    return gc_check_ptr(&baik->object_arena, get_object_struct(v));
+baik_err_t baik_snapshot_save(struct baik *baik, const char *path) {
+  char *buf;
+  size_t len;
+  FILE *fp;
+  baik_err_t err = baik_snapshot_save_buf(baik, &buf, &len);
+
+  if (err != BAIK_OK) return err;
+  if ((fp = fopen(path, "wb")) == NULL) {
+    err = BAIK_INTERNAL_ERROR;
+  } else {
+    if (fwrite(buf, 1, len, fp) != len) err = BAIK_INTERNAL_ERROR;
+    if (fclose(fp) != 0) err = BAIK_INTERNAL_ERROR;
+    // A torn image must not be found on the next boot.
+    if (err != BAIK_OK) remove(path);
   }
-  // if (baik_is_ffi_sig(v)) {
-  //   return gc_check_ptr(&baik->ffi_sig_arena, baik_get_ffi_sig_struct(v));
-  // }
-  return 1;
+  free(buf);
+  if (err != BAIK_OK) {
+    baik_set_errorf(baik, err, "GALAT : gagal menulis file \"%s\"", path);
+  }
+  return err;
 }
 
-BAIK_PRIVATE int gc_check_ptr(const struct gc_arena *a, const void *ptr) {
-  const struct gc_cell *p = (const struct gc_cell *) ptr;
-  struct gc_block *b;
-  for (b = a->blocks; b != NULL; b = b->next) {
-    if (p >= b->base && p < GC_CELL_OP(a, b->base, +, b->size)) {
-      return 1;
-    }
+baik_err_t baik_snapshot_load(struct baik *baik, const char *path) {
+  size_t size;
+  baik_err_t err;
+  char *buf = BAIK_EM_read_file(path, &size);
+
+  if (buf == NULL) {
+    return baik_set_errorf(baik, BAIK_FILE_READ_ERROR,
+                           "GALAT : gagal membaca file \"%s\"", path);
   }
-  return 0;
+  err = baik_snapshot_load_buf(baik, buf, size);
+  free(buf);
+  return err;
 }
 
 #define BUF_LEFT(size, used) (((size_t)(used) < (size)) ? ((size) - (used)) : 0)
@@ -9961,22 +13735,92 @@ int repl()
     return 0;
 }
   
+#ifndef BAIK_KANAL_CAPACITY
+#define BAIK_KANAL_CAPACITY 64
+#endif
+
+// Resumes a suspended run until it completes, keeping timers and tasks
+// going meanwhile. With `all`, then also waits until none are left.
+static baik_err_t baik_run_events(struct baik *baik, baik_err_t err,
+                                  baik_val_t *res, int all)
+{
+    for (;;) {
+        unsigned long wait;
+        if (err == BAIK_SUSPENDED) {
+            err = baik_resume(baik, res);
+        }
+        if (err != BAIK_SUSPENDED &&
+            (!all || err != BAIK_OK || !baik_events_pending(baik))) {
+            return err;
+        }
+        baik_poll(baik, &wait);
+        if (err == BAIK_SUSPENDED && wait > 1) {
+            wait = 1;
+        }
+        if (wait > 0 && wait != (unsigned long) -1) {
+            usleep(wait * 1000);
+        }
+    }
+}
+
+// The second instance of -p: runs on its own thread, talking to the main
+// one over a pair of channels.
+struct baik_worker {
+    pthread_t thread;
+    const char *path;
+    struct baik_chan *tx;
+    struct baik_chan *rx;
+};
+
+static void *baik_worker_main(void *arg)
+{
+    struct baik_worker *w = (struct baik_worker *) arg;
+    struct baik *baik = baik_create();
+    baik_err_t err;
+
+    baik_set_kanal(baik, w->tx, w->rx);
+    err = baik_exec_file(baik, w->path, NULL);
+    err = baik_run_events(baik, err, NULL, 1);
+    if (err != BAIK_OK) {
+        baik_print_error(baik, stdout, NULL, 1);
+    }
+    baik_destroy(baik);
+    return NULL;
+}
+
 int main(int argc,char* argv[]) 
 { 
     struct baik *baik = baik_create();
     baik_err_t err = BAIK_OK;
     baik_val_t res = 0;
+    struct baik_worker worker;
+    const char *snapshot_out = NULL;
     int i;
 
+    memset(&worker, 0, sizeof(worker));
+
     for (i = 1; i < argc && argv[i][0] == '-' && err == BAIK_OK; i++) {
         if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
             err = baik_exec(baik, argv[++i], &res);
+            err = baik_run_events(baik, err, &res, 0);
         } else if  (strcmp(argv[i], "-c") == 0){
             baik_set_generate_jsc(baik, 1);
         } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
             //BAIK_EM_log_set_level(atoi(argv[++i]));
         } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
             err = baik_exec_file(baik, argv[++i], &res);
+            err = baik_run_events(baik, err, &res, 0);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc &&
+                   worker.path == NULL) {
+            worker.path = argv[++i];
+            worker.tx = baik_chan_create(BAIK_KANAL_CAPACITY);
+            worker.rx = baik_chan_create(BAIK_KANAL_CAPACITY);
+            baik_set_kanal(baik, worker.rx, worker.tx);
+            pthread_create(&worker.thread, NULL, baik_worker_main, &worker);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            err = baik_snapshot_load(baik, argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            snapshot_out = argv[++i];
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             printf("Baik X, " __DATE__ "\n");
             printf("Pakai:\n");
@@ -9985,6 +13829,9 @@ int main(int argc,char* argv[])
             printf("  -e <baik script>  - Eksekusi ekspresi Baik\n");
             printf("  -c                - Aktifkan precompiling (berkas .inac)\n");
             printf("  -f <baik file>    - Eksekusi kode dari file (.ina)\n");
+            printf("  -p <baik file>    - Jalankan file di instance kedua, terhubung lewat kanal\n");
+            printf("  -m <snapshot>     - Muat snapshot sebelum menjalankan kode berikutnya\n");
+            printf("  -s <snapshot>     - Simpan snapshot setelah semua kode selesai\n");
             return EXIT_SUCCESS;
         } else {
             fprintf(stderr, "Unknown flag: [%s]\n", argv[i]);
@@ -9993,16 +13840,31 @@ int main(int argc,char* argv[])
     }
     for (; i < argc && err == BAIK_OK; i++) {
         err = baik_exec_file(baik, argv[i], &res);
+        err = baik_run_events(baik, err, &res, 0);
+    }
+
+    if (err == BAIK_OK && snapshot_out != NULL) {
+        // Timers set up by the scripts go into the snapshot instead of
+        // running here.
+        err = baik_snapshot_save(baik, snapshot_out);
+    } else if (err == BAIK_OK) {
+        err = baik_run_events(baik, err, &res, 1);
+    }
+
+    if (worker.path != NULL) {
+        pthread_join(worker.thread, NULL);
     }
 
     if (err == BAIK_OK) {
-        if(res == 0)
+        if(res == 0 && worker.path == NULL)
             repl();
     } else {
         baik_print_error(baik, stdout, NULL, 1);
     }
 
     baik_destroy(baik);
+    baik_chan_destroy(worker.tx);
+    baik_chan_destroy(worker.rx);
     return EXIT_SUCCESS;
 } 
 
@@ -10064,9 +13926,11 @@ BAIK_PRIVATE struct baik_property *baik_get_own_property(struct baik *baik,
     for (p = o->properties; p != NULL; p = p->next) {
       if (baik_strcmp(baik, &p->name, name, len) == 0) return p;
     }
-    return p;
   }
 
+  if (baik->scopes.len > 0 && obj == baik_get_global(baik)) {
+    return baik_builtin_materialize(baik, obj, name, len);
+  }
   return NULL;
 }
 
@@ -10402,78 +14266,290 @@ baik_val_t baik_struct_to_obj(struct baik *baik, const void *base,
 static baik_err_t parse_statement(struct pstate *p);
 static baik_err_t parse_expr(struct pstate *p);
 
-static int ptest(struct pstate *p) {
-  struct pstate saved = *p;
-  int tok = pnext(p);
-  *p = saved;
-  return tok;
-}
-
 static int s_unary_ops[] = {TOK_NOT, TOK_TILDA, TOK_PLUS_PLUS, TOK_MINUS_MINUS,
                             TOK_KEYWORD_TIPE, TOK_MINUS, TOK_PLUS, TOK_EOF};
-static int s_comparison_ops[] = {TOK_LT, TOK_LE, TOK_GT, TOK_GE, TOK_EOF};
 static int s_postfix_ops[] = {TOK_PLUS_PLUS, TOK_MINUS_MINUS, TOK_EOF};
-static int s_equality_ops[] = {TOK_EQ, TOK_NE, TOK_EQ_EQ, TOK_NE_NE, TOK_EOF};
 static int s_assign_ops[] = {
     TOK_ASSIGN,         TOK_PLUS_ASSIGN, TOK_MINUS_ASSIGN,  TOK_MUL_ASSIGN,
     TOK_DIV_ASSIGN,     TOK_REM_ASSIGN,  TOK_LSHIFT_ASSIGN, TOK_RSHIFT_ASSIGN,
     TOK_URSHIFT_ASSIGN, TOK_AND_ASSIGN,  TOK_XOR_ASSIGN,    TOK_OR_ASSIGN,
     TOK_EOF};
 
-static int findtok(int *toks, int tok) {
-  int i = 0;
-  while (tok != toks[i] && toks[i] != TOK_EOF) i++;
-  return toks[i];
+static int findtok(int *toks, int tok) {
+  int i = 0;
+  while (tok != toks[i] && toks[i] != TOK_EOF) i++;
+  return toks[i];
+}
+
+static void emit_number(struct pstate *p, double d) {
+  double iv;
+  if (modf(d, &iv) == 0 && d >= 0 && !signbit(d) &&
+      d < 9223372036854775808.0) {
+    emit_byte(p, OP_PUSH_INT);
+    emit_int(p, (int64_t) d);
+  } else {
+    emit_byte(p, OP_PUSH_F64);
+    emit_dbl(p, d);
+  }
+}
+
+/* Notes that the code emitted since `start` pushes a constant */
+static void mark_const(struct pstate *p, int start) {
+  if (p->nconsts > 0 && p->consts[p->nconsts - 1].end != start) {
+    p->nconsts = 0;
+  }
+  if (p->nconsts == BAIK_FOLD_DEPTH) {
+    memmove(p->consts, p->consts + 1, sizeof(p->consts[0]) * --p->nconsts);
+  }
+  p->consts[p->nconsts].start = start;
+  p->consts[p->nconsts].end = p->cur_idx;
+  p->nconsts++;
+}
+
+/* A constant read back from its push instruction */
+struct fold_val {
+  baik_val_t v;    /* BAIK_UNDEFINED for strings */
+  const char *str; /* into bcode_gen, NULL unless a string */
+  size_t len;
+};
+
+static void fold_read(struct pstate *p, int off, struct fold_val *fv) {
+  const uint8_t *code = (const uint8_t *) p->baik->bcode_gen.buf + off;
+  int llen;
+  double d;
+  fv->v = BAIK_UNDEFINED;
+  fv->str = NULL;
+  fv->len = 0;
+  switch (code[0]) {
+    case OP_PUSH_INT:
+      d = (double) (int64_t) BAIK_EM_varint_decode_unsafe(code + 1, &llen);
+      fv->v = baik_mk_number(p->baik, d);
+      break;
+    case OP_PUSH_F64:
+      memcpy(&d, code + 1, sizeof(d));
+      fv->v = baik_mk_number(p->baik, d);
+      break;
+    case OP_PUSH_STR:
+      fv->len = (size_t) BAIK_EM_varint_decode_unsafe(code + 1, &llen);
+      fv->str = (const char *) code + 1 + llen;
+      break;
+    case OP_PUSH_TRUE:
+      fv->v = baik_mk_boolean(p->baik, 1);
+      break;
+    case OP_PUSH_FALSE:
+      fv->v = baik_mk_boolean(p->baik, 0);
+      break;
+    case OP_PUSH_NULL:
+      fv->v = BAIK_NULL;
+      break;
+    default:
+      assert(code[0] == OP_PUSH_UNDEF);
+      break;
+  }
+}
+
+/* Integer conversions in do_arith_op() are only defined for these */
+static int fold_int_ok(double d) {
+  return d > -9223372036854775808.0 && d < 9223372036854775808.0;
+}
+
+/*
+ * Evaluates `op` at compile time when its operands are constants pushed
+ * right before it, replacing them with the result. Follows the operator
+ * opcodes and do_op() exactly, and leaves alone anything that would raise an
+ * error or depend on undefined conversions at run time, such as string +
+ * number or shifting by 64. Returns 1 if the operator was folded away.
+ */
+static int fold_op(struct pstate *p, int op) {
+  struct fold_val a, b;
+  struct baik_lineno_item *l;
+  struct mbuf str;
+  int n = p->nconsts, arity, start;
+  int is_num = 0, is_bool = 0, is_str = 0;
+  double da = 0, db = 0, num = 0;
+  bool resnan = false;
+  int boolean = 0;
+  size_t nl;
+
+  switch (op) {
+    case TOK_UNARY_PLUS:
+    case TOK_UNARY_MINUS:
+    case TOK_NOT:
+    case TOK_TILDA:
+    case TOK_KEYWORD_TIPE:
+      arity = 1;
+      break;
+    case TOK_MINUS:
+    case TOK_PLUS:
+    case TOK_MUL:
+    case TOK_DIV:
+    case TOK_REM:
+    case TOK_XOR:
+    case TOK_AND:
+    case TOK_OR:
+    case TOK_LSHIFT:
+    case TOK_RSHIFT:
+    case TOK_URSHIFT:
+    case TOK_LT:
+    case TOK_GT:
+    case TOK_LE:
+    case TOK_GE:
+    case TOK_EQ_EQ:
+    case TOK_NE_NE:
+      arity = 2;
+      break;
+    default:
+      return 0;
+  }
+  if (n < arity || p->consts[n - 1].end != p->cur_idx) return 0;
+  start = p->consts[n - arity].start;
+  /* A jump into the operands brings in values from elsewhere */
+  if (p->last_label > start) return 0;
+
+  fold_read(p, p->consts[n - arity].start, &a);
+  if (arity == 2) {
+    fold_read(p, p->consts[n - 1].start, &b);
+  } else {
+    memset(&b, 0, sizeof(b));
+  }
+  if (baik_is_number(a.v)) da = baik_get_double(p->baik, a.v);
+  if (arity == 2 && baik_is_number(b.v)) db = baik_get_double(p->baik, b.v);
+  mbuf_init(&str, 0);
+
+  switch (op) {
+    case TOK_UNARY_PLUS:
+      return 1;
+    case TOK_UNARY_MINUS:
+      if (!baik_is_number(a.v)) return 0;
+      num = -da;
+      is_num = 1;
+      break;
+    case TOK_TILDA:
+      if (!baik_is_number(a.v) || isnan(da) || !fold_int_ok(da)) return 0;
+      num = (double) (~(int64_t) da);
+      is_num = 1;
+      break;
+    case TOK_NOT:
+      boolean = a.str != NULL ? a.len == 0 : !baik_is_truthy(p->baik, a.v);
+      is_bool = 1;
+      break;
+    case TOK_KEYWORD_TIPE: {
+      const char *t = a.str != NULL ? baik_stringify_type(BAIK_TYPE_STRING)
+                                    : baik_typeof(a.v);
+      mbuf_append(&str, t, strlen(t));
+      is_str = 1;
+      break;
+    }
+    case TOK_EQ_EQ:
+    case TOK_NE_NE:
+      if (a.str != NULL || b.str != NULL) {
+        boolean = a.str != NULL && b.str != NULL && a.len == b.len &&
+                  memcmp(a.str, b.str, a.len) == 0;
+      } else {
+        boolean = check_equal(p->baik, a.v, b.v);
+      }
+      if (op == TOK_NE_NE) boolean = !boolean;
+      is_bool = 1;
+      break;
+    case TOK_PLUS:
+      if (a.str != NULL && b.str != NULL) {
+        /* Never a NULL buffer, even when both strings are empty */
+        mbuf_resize(&str, a.len + b.len + 1);
+        mbuf_append(&str, a.str, a.len);
+        mbuf_append(&str, b.str, b.len);
+        is_str = 1;
+        break;
+      }
+      /* fallthrough */
+    default:
+      if (!baik_is_number(a.v) || !baik_is_number(b.v)) return 0;
+      if (isnan(da) || isnan(db)) {
+        /* Comparisons below are false and arithmetic gives NaN */
+      } else if (op == TOK_REM) {
+        if (!fold_int_ok(da) || db <= -2147483648.0 || db >= 2147483648.0) {
+          return 0;
+        }
+      } else if (op == TOK_AND || op == TOK_OR || op == TOK_XOR) {
+        if (!fold_int_ok(da) || !fold_int_ok(db)) return 0;
+      } else if (op == TOK_LSHIFT || op == TOK_RSHIFT) {
+        if (da < 0 || da >= 2147483648.0 || db < 0 || db >= 32) return 0;
+      } else if (op == TOK_URSHIFT) {
+        if (da < 0 || da >= 4294967296.0 || db < 0 || db >= 32) return 0;
+      }
+      switch (op) {
+        case TOK_LT: boolean = da < db; break;
+        case TOK_GT: boolean = da > db; break;
+        case TOK_LE: boolean = da <= db; break;
+        case TOK_GE: boolean = da >= db; break;
+        default:
+          num = do_arith_op(da, db, op, &resnan);
+          if (resnan) num = NAN;
+          is_num = 1;
+          break;
+      }
+      is_bool = !is_num;
+      break;
+  }
+
+  /* Drop the operands, their line map entries included */
+  p->baik->bcode_gen.len = start;
+  p->cur_idx = start;
+  p->nconsts -= arity;
+  l = (struct baik_lineno_item *) p->offset_lineno_map.buf;
+  nl = p->offset_lineno_map.len / sizeof(*l);
+  while (nl > 0 && l[nl - 1].offset >= start) nl--;
+  p->offset_lineno_map.len = nl * sizeof(*l);
+  p->last_emitted_line_no = nl > 0 ? l[nl - 1].line_no : 1;
+
+  if (is_num) {
+    emit_number(p, num);
+  } else if (is_bool) {
+    emit_byte(p, (uint8_t)(boolean ? OP_PUSH_TRUE : OP_PUSH_FALSE));
+  } else if (is_str) {
+    emit_byte(p, OP_PUSH_STR);
+    emit_str(p, str.buf, str.len);
+  }
+  mbuf_free(&str);
+  mark_const(p, start);
+  return 1;
 }
 
+/* The fused jump taken when comparison `op` is false, or OP_NOP */
+static uint8_t cmp_jump_op(uint8_t op) {
+  switch (op) {
+    case OP_LT:
+      return OP_JMP_FALSE_LT;
+    case OP_GT:
+      return OP_JMP_FALSE_GT;
+    case OP_LE:
+      return OP_JMP_FALSE_LE;
+    case OP_GE:
+      return OP_JMP_FALSE_GE;
+    case OP_EQ_EQ:
+      return OP_JMP_FALSE_EQ;
+    case OP_NE_NE:
+      return OP_JMP_FALSE_NE;
+    default:
+      return OP_NOP;
+  }
+}
+
+#ifndef BAIK_ENABLE_FOLD
+#define BAIK_ENABLE_FOLD 1
+#endif
+
 static void emit_op(struct pstate *pstate, int tok) {
-  assert(tok >= 0 && tok <= 255);
-  emit_byte(pstate, OP_EXPR);
-  emit_byte(pstate, (uint8_t) tok);
+  uint8_t op;
+  if (BAIK_ENABLE_FOLD && fold_op(pstate, tok)) return;
+  op = expr_opcode(tok);
+  if (op == OP_NOP) return;
+  if (cmp_jump_op(op) != OP_NOP) pstate->last_cmp = pstate->cur_idx;
+  emit_byte(pstate, op);
 }
 
 #define BINOP_STACK_FRAME_SIZE 16
 #define STACK_LIMIT 8192
 
-#define PARSE_LTR_BINOP(p, f1, f2, ops, prev_op)                               \
-  do {                                                                         \
-    baik_err_t res = BAIK_OK;                                                    \
-    p->depth++;                                                                \
-    if (p->depth > (STACK_LIMIT / BINOP_STACK_FRAME_SIZE)) {                   \
-      baik_set_errorf(p->baik, BAIK_SYNTAX_ERROR, "parser stack overflow");       \
-      res = BAIK_SYNTAX_ERROR;                                                  \
-      goto binop_clean;                                                        \
-    }                                                                          \
-    if ((res = f1(p, TOK_EOF)) != BAIK_OK) goto binop_clean;                    \
-    if (prev_op != TOK_EOF) emit_op(p, prev_op);                               \
-    if (findtok(ops, p->tok.tok) != TOK_EOF) {                                 \
-      int op = p->tok.tok;                                                     \
-      size_t off_if = 0;                                                       \
-                          \
-      if (ops[0] == TOK_LOGICAL_AND || ops[0] == TOK_LOGICAL_OR) {             \
-        emit_byte(p,                                                           \
-                  (uint8_t)(ops[0] == TOK_LOGICAL_AND ? OP_JMP_NEUTRAL_FALSE   \
-                                                      : OP_JMP_NEUTRAL_TRUE)); \
-        off_if = p->cur_idx;                                                   \
-        emit_init_offset(p);                                                   \
-                     \
-                 \
-        emit_byte(p, (uint8_t) OP_DROP);                                       \
-        op = TOK_EOF;                                                          \
-      }                                                                        \
-      pnext1(p);                                                               \
-      if ((res = f2(p, op)) != BAIK_OK) goto binop_clean;                       \
-                                                                               \
-      if (off_if != 0) {                                                       \
-        baik_bcode_insert_offset(p, p->baik, off_if,                             \
-                                p->cur_idx - off_if - BAIK_INIT_OFFSET_SIZE);   \
-      }                                                                        \
-    }                                                                          \
-  binop_clean:                                                                 \
-    p->depth--;                                                                \
-    return res;                                                                \
-  } while (0)
-
 #define PARSE_RTL_BINOP(p, f1, f2, ops, prev_op)        \
   do {                                                  \
     baik_err_t res = BAIK_OK;                             \
@@ -10488,19 +14564,52 @@ static void emit_op(struct pstate *pstate, int tok) {
     return res;                                         \
   } while (0)
 
-#if BAIK_INIT_OFFSET_SIZE > 0
-static void emit_init_offset(struct pstate *p) {
-  size_t i;
-  for (i = 0; i < BAIK_INIT_OFFSET_SIZE; i++) {
-    emit_byte(p, 0);
-  }
+/* Emits a jump offset placeholder and returns its relocation */
+static size_t emit_init_offset(struct pstate *p) {
+  struct baik_reloc r;
+  memset(&r, 0, sizeof(r));
+  r.slot = p->cur_idx;
+  r.from = r.to = -1;
+  mbuf_append(&p->relocs, &r, sizeof(r));
+  emit_byte(p, 0);
+  return p->relocs.len / sizeof(r) - 1;
 }
-#else
-static void emit_init_offset(struct pstate *p) {
-  (void) p;
+
+/* Points the jump offset of relocation `off` to `target` */
+static void patch_offset(struct pstate *p, size_t off, size_t target) {
+  struct baik_reloc *r = (struct baik_reloc *) p->relocs.buf;
+  baik_bcode_set_offset(p, off, r[off].slot + 1, target);
 }
+
+#ifndef BAIK_ENABLE_CMP_JUMP
+#define BAIK_ENABLE_CMP_JUMP 1
 #endif
 
+/*
+ * Whether the code up to cur_idx ends in a comparison that the jump of a
+ * condition can take over, no jump landing past its start.
+ */
+static int cond_ends_in_cmp(struct pstate *p) {
+  return BAIK_ENABLE_CMP_JUMP && p->last_cmp == p->cur_idx - 1 &&
+         p->last_label <= p->last_cmp;
+}
+
+/*
+ * Emits the jump taken when a condition is false and returns its
+ * relocation. With `fuse` set, the comparison ending the condition becomes
+ * part of the jump, so no boolean is made.
+ */
+static size_t emit_cond_jump(struct pstate *p, int fuse) {
+  if (fuse) {
+    /* In place, so the jump keeps the line of the comparison */
+    char *code = p->baik->bcode_gen.buf;
+    code[p->cur_idx - 1] = (char) cmp_jump_op((uint8_t) code[p->cur_idx - 1]);
+  } else {
+    emit_byte(p, OP_JMP_FALSE);
+  }
+  return emit_init_offset(p);
+}
+
 static baik_err_t parse_statement_list(struct pstate *p, int et) {
   baik_err_t res = BAIK_OK;
   int drop = 0;
@@ -10518,8 +14627,18 @@ static baik_err_t parse_statement_list(struct pstate *p, int et) {
   return res;
 }
 
+// A block scope is only observable through what gets created in it: `isi`,
+// a named `fungsi` (declared even from inside an expression) and `muat`,
+// whose top level runs in the caller's scope.
+static void emit_create(struct pstate *p) {
+  emit_byte(p, OP_CREATE);
+  p->declared = 1;
+}
+
 static baik_err_t parse_block(struct pstate *p, int mkscope) {
   baik_err_t res = BAIK_OK;
+  size_t scope_idx = p->cur_idx;
+  int outer = p->declared;
   p->depth++;
   if (p->depth > (STACK_LIMIT / BINOP_STACK_FRAME_SIZE)) {
     baik_set_errorf(p->baik, BAIK_SYNTAX_ERROR, "parser stack overflow");
@@ -10527,10 +14646,22 @@ static baik_err_t parse_block(struct pstate *p, int mkscope) {
     return res;
   }
   LOG(LL_VERBOSE_DEBUG, ("[%.*s]", 10, p->tok.ptr));
-  if (mkscope) emit_byte(p, OP_NEW_SCOPE);
+  if (mkscope) {
+    emit_byte(p, OP_NEW_SCOPE);
+    p->declared = 0;
+  }
   res = parse_statement_list(p, TOK_CLOSE_CURLY);
   EXPECT(p, TOK_CLOSE_CURLY);
-  if (mkscope) emit_byte(p, OP_DEL_SCOPE);
+  if (mkscope) {
+    if (p->declared) {
+      emit_byte(p, OP_DEL_SCOPE);
+    } else {
+      /* Nothing went into the scope; the peephole pass drops the NOP */
+      p->baik->bcode_gen.buf[scope_idx] = OP_NOP;
+    }
+    p->declared = outer;
+  }
+  p->depth--;
   return res;
 }
 
@@ -10538,6 +14669,7 @@ static baik_err_t parse_function(struct pstate *p) {
   size_t prologue, off;
   int arg_no = 0;
   int name_provided = 0;
+  int outer;
   baik_err_t res = BAIK_OK;
 
   EXPECT(p, TOK_KEYWORD_FUNGSI);
@@ -10548,7 +14680,7 @@ static baik_err_t parse_function(struct pstate *p) {
     emit_byte(p, OP_PUSH_STR);
     emit_str(p, tmp.ptr, tmp.len);
     emit_byte(p, OP_PUSH_SCOPE);
-    emit_byte(p, OP_CREATE);
+    emit_create(p);
     emit_byte(p, OP_PUSH_STR);
     emit_str(p, tmp.ptr, tmp.len);
     emit_byte(p, OP_FIND_SCOPE);
@@ -10556,8 +14688,7 @@ static baik_err_t parse_function(struct pstate *p) {
   }
 
   emit_byte(p, OP_JMP);
-  off = p->cur_idx;
-  emit_init_offset(p);
+  off = emit_init_offset(p);
   prologue = p->cur_idx;
   EXPECT(p, TOK_OPEN_PAREN);
   emit_byte(p, OP_NEW_SCOPE);
@@ -10568,16 +14699,18 @@ static baik_err_t parse_function(struct pstate *p) {
     emit_int(p, arg_no);
     arg_no++;
     emit_str(p, p->tok.ptr, p->tok.len);
-    if (ptest(p) == TOK_COMMA) pnext1(p);
+    if (ppeek(p, 1) == TOK_COMMA) pnext1(p);
     pnext1(p);
   }
   EXPECT(p, TOK_CLOSE_PAREN);
+  outer = p->declared;
   if ((res = parse_block(p, 0)) != BAIK_OK) return res;
+  p->declared = outer;
   emit_byte(p, OP_RETURN);
-  prologue += baik_bcode_insert_offset(p, p->baik, off,
-                                      p->cur_idx - off - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off, p->cur_idx);
+  off = p->cur_idx;
   emit_byte(p, OP_PUSH_FUNC);
-  emit_int(p, p->cur_idx - 1 - prologue);
+  baik_bcode_set_offset(p, emit_init_offset(p), prologue, off);
   if (name_provided) {
     emit_op(p, TOK_ASSIGN);
   }
@@ -10625,27 +14758,32 @@ static baik_err_t parse_array_literal(struct pstate *p) {
 static enum baik_err parse_literal(struct pstate *p, const struct tok *t) {
   struct mbuf *bcode_gen = &p->baik->bcode_gen;
   enum baik_err res = BAIK_OK;
-  int tok = t->tok;
+  int tok = t->tok, start = p->cur_idx;
   LOG(LL_VERBOSE_DEBUG, ("[%.*s] %p", p->tok.len, p->tok.ptr, (void *) &t));
   switch (t->tok) {
     case TOK_KEYWORD_FALSE:
       emit_byte(p, OP_PUSH_FALSE);
+      mark_const(p, start);
       break;
     case TOK_KEYWORD_TRUE:
       emit_byte(p, OP_PUSH_TRUE);
+      mark_const(p, start);
       break;
     case TOK_KEYWORD_TAKTERDEFINISI:
       emit_byte(p, OP_PUSH_UNDEF);
+      mark_const(p, start);
       break;
     case TOK_KEYWORD_KOSONG:
       emit_byte(p, OP_PUSH_NULL);
+      mark_const(p, start);
       break;
     case TOK_IDENT: {
       int prev_tok = p->prev_tok;
-      int next_tok = ptest(p);
+      int next_tok = ppeek(p, 1);
       emit_byte(p, OP_PUSH_STR);
       emit_str(p, t->ptr, t->len);
       emit_byte(p, (uint8_t)(prev_tok == TOK_DOT ? OP_SWAP : OP_FIND_SCOPE));
+      if (t->len == 4 && strncmp(t->ptr, "muat", 4) == 0) p->declared = 1;
       if (!findtok(s_assign_ops, next_tok) &&
           !findtok(s_postfix_ops, next_tok) &&
          
@@ -10654,25 +14792,17 @@ static enum baik_err parse_literal(struct pstate *p, const struct tok *t) {
       }
       break;
     }
-    case TOK_NUM: {
-      double iv, d = strtod(t->ptr, NULL);
-      unsigned long uv = strtoul(t->ptr + 2, NULL, 16);
-      if (t->ptr[0] == '0' && t->ptr[1] == 'x') d = uv;
-      if (modf(d, &iv) == 0) {
-        emit_byte(p, OP_PUSH_INT);
-        emit_int(p, (int64_t) d);
-      } else {
-        emit_byte(p, OP_PUSH_DBL);
-        emit_str(p, t->ptr, t->len);
-      }
+    case TOK_NUM:
+      emit_number(p, t->num);
+      mark_const(p, start);
       break;
-    }
     case TOK_STR: {
       size_t oldlen;
       emit_byte(p, OP_PUSH_STR);
       oldlen = bcode_gen->len;
       embed_string(bcode_gen, p->cur_idx, t->ptr, t->len, EMBSTR_UNESCAPE);
       p->cur_idx += bcode_gen->len - oldlen;
+      mark_const(p, start);
     } break;
     case TOK_OPEN_BRACKET:
       res = parse_array_literal(p);
@@ -10765,6 +14895,135 @@ static baik_err_t parse_unary(struct pstate *p, int prev_op) {
   return res;
 }
 
+/* Binding power of a binary operator, 0 if `tok` is not one */
+static int binop_prec(int tok) {
+  switch (tok) {
+    case TOK_MUL:
+    case TOK_DIV:
+    case TOK_REM:
+      return 10;
+    case TOK_PLUS:
+    case TOK_MINUS:
+      return 9;
+    case TOK_LSHIFT:
+    case TOK_RSHIFT:
+    case TOK_URSHIFT:
+      return 8;
+    case TOK_LT:
+    case TOK_LE:
+    case TOK_GT:
+    case TOK_GE:
+      return 7;
+    case TOK_EQ:
+    case TOK_NE:
+    case TOK_EQ_EQ:
+    case TOK_NE_NE:
+      return 6;
+    case TOK_AND:
+      return 5;
+    case TOK_XOR:
+      return 4;
+    case TOK_OR:
+      return 3;
+    case TOK_LOGICAL_AND:
+      return 2;
+    case TOK_LOGICAL_OR:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Parses a chain of binary operators binding at least as tight as
+ * `min_prec`, one loop per precedence climb instead of one C call per level.
+ * Arithmetic operators are left-associative. `&&` and `||` take the rest of
+ * their chain as the right operand, so every short-circuit jump of a chain
+ * lands on its end.
+ */
+static baik_err_t parse_binary(struct pstate *p, int min_prec) {
+  baik_err_t res = BAIK_OK;
+  int prec;
+
+  p->depth++;
+  if (p->depth > (STACK_LIMIT / BINOP_STACK_FRAME_SIZE)) {
+    baik_set_errorf(p->baik, BAIK_SYNTAX_ERROR, "parser stack overflow");
+    res = BAIK_SYNTAX_ERROR;
+    goto clean;
+  }
+  if ((res = parse_unary(p, TOK_EOF)) != BAIK_OK) goto clean;
+
+  while ((prec = binop_prec(p->tok.tok)) >= min_prec) {
+    int op = p->tok.tok;
+    if (op == TOK_LOGICAL_AND || op == TOK_LOGICAL_OR) {
+      size_t off_if;
+      emit_byte(p, (uint8_t)(op == TOK_LOGICAL_AND ? OP_JMP_NEUTRAL_FALSE
+                                                   : OP_JMP_NEUTRAL_TRUE));
+      off_if = emit_init_offset(p);
+      emit_byte(p, (uint8_t) OP_DROP);
+      pnext1(p);
+      if ((res = parse_binary(p, prec)) != BAIK_OK) goto clean;
+      patch_offset(p, off_if, p->cur_idx);
+    } else {
+      pnext1(p);
+      if ((res = parse_binary(p, prec + 1)) != BAIK_OK) goto clean;
+      emit_op(p, op);
+    }
+  }
+
+clean:
+  p->depth--;
+  return res;
+}
+
+#ifndef BAIK_PARSER_CHAIN
+#define BAIK_PARSER_CHAIN 0
+#endif
+
+#if BAIK_PARSER_CHAIN
+/*
+ * The parser parse_binary() replaced, one C function per precedence level.
+ * Only the host parser test builds it, to check that both give the same
+ * bytecode; s_parser_chain picks it instead of parse_binary().
+ */
+static int s_parser_chain;
+
+static int s_comparison_ops[] = {TOK_LT, TOK_LE, TOK_GT, TOK_GE, TOK_EOF};
+static int s_equality_ops[] = {TOK_EQ, TOK_NE, TOK_EQ_EQ, TOK_NE_NE, TOK_EOF};
+
+#define PARSE_LTR_BINOP(p, f1, f2, ops, prev_op)                               \
+  do {                                                                         \
+    baik_err_t res = BAIK_OK;                                                  \
+    p->depth++;                                                                \
+    if (p->depth > (STACK_LIMIT / BINOP_STACK_FRAME_SIZE)) {                   \
+      baik_set_errorf(p->baik, BAIK_SYNTAX_ERROR, "parser stack overflow");    \
+      res = BAIK_SYNTAX_ERROR;                                                 \
+      goto binop_clean;                                                        \
+    }                                                                          \
+    if ((res = f1(p, TOK_EOF)) != BAIK_OK) goto binop_clean;                   \
+    if (prev_op != TOK_EOF) emit_op(p, prev_op);                               \
+    if (findtok(ops, p->tok.tok) != TOK_EOF) {                                 \
+      int op = p->tok.tok;                                                     \
+      int off_if = -1;                                                         \
+      if (ops[0] == TOK_LOGICAL_AND || ops[0] == TOK_LOGICAL_OR) {             \
+        emit_byte(p,                                                           \
+                  (uint8_t)(ops[0] == TOK_LOGICAL_AND ? OP_JMP_NEUTRAL_FALSE   \
+                                                      : OP_JMP_NEUTRAL_TRUE)); \
+        off_if = (int) emit_init_offset(p);                                    \
+        emit_byte(p, (uint8_t) OP_DROP);                                       \
+        op = TOK_EOF;                                                          \
+      }                                                                        \
+      pnext1(p);                                                               \
+      if ((res = f2(p, op)) != BAIK_OK) goto binop_clean;                      \
+      if (off_if >= 0) {                                                       \
+        patch_offset(p, off_if, p->cur_idx);                                   \
+      }                                                                        \
+    }                                                                          \
+  binop_clean:                                                                 \
+    p->depth--;                                                                \
+    return res;                                                                \
+  } while (0)
+
 static baik_err_t parse_mul_div_rem(struct pstate *p, int prev_op) {
   int ops[] = {TOK_MUL, TOK_DIV, TOK_REM, TOK_EOF};
   PARSE_LTR_BINOP(p, parse_unary, parse_mul_div_rem, ops, prev_op);
@@ -10812,25 +15071,28 @@ static baik_err_t parse_logical_or(struct pstate *p, int prev_op) {
   int ops[] = {TOK_LOGICAL_OR, TOK_EOF};
   PARSE_LTR_BINOP(p, parse_logical_and, parse_logical_or, ops, prev_op);
 }
+#endif
 
 static baik_err_t parse_ternary(struct pstate *p, int prev_op) {
   baik_err_t res = BAIK_OK;
-  if ((res = parse_logical_or(p, TOK_EOF)) != BAIK_OK) return res;
+#if BAIK_PARSER_CHAIN
+  res = s_parser_chain ? parse_logical_or(p, TOK_EOF) : parse_binary(p, 1);
+#else
+  res = parse_binary(p, 1);
+#endif
+  if (res != BAIK_OK) return res;
   if (prev_op != TOK_EOF) emit_op(p, prev_op);
 
   if (p->tok.tok == TOK_QUESTION) {
     size_t off_if, off_endif, off_else;
     EXPECT(p, TOK_QUESTION);
 
-    emit_byte(p, OP_JMP_FALSE);
-    off_if = p->cur_idx;
-    emit_init_offset(p);
+    off_if = emit_cond_jump(p, cond_ends_in_cmp(p));
 
     if ((res = parse_ternary(p, TOK_EOF)) != BAIK_OK) return res;
 
     emit_byte(p, OP_JMP);
-    off_else = p->cur_idx;
-    emit_init_offset(p);
+    off_else = emit_init_offset(p);
     off_endif = p->cur_idx;
 
     emit_byte(p, OP_DROP);
@@ -10839,11 +15101,8 @@ static baik_err_t parse_ternary(struct pstate *p, int prev_op) {
     if ((res = parse_ternary(p, TOK_EOF)) != BAIK_OK) return res;
 
    
-    off_endif += baik_bcode_insert_offset(
-        p, p->baik, off_else, p->cur_idx - off_else - BAIK_INIT_OFFSET_SIZE);
-
-    baik_bcode_insert_offset(p, p->baik, off_if,
-                            off_endif - off_if - BAIK_INIT_OFFSET_SIZE);
+    patch_offset(p, off_else, p->cur_idx);
+    patch_offset(p, off_if, off_endif);
   }
 
   return res;
@@ -10868,7 +15127,7 @@ static baik_err_t parse_let(struct pstate *p) {
     emit_byte(p, OP_PUSH_STR);
     emit_str(p, tmp.ptr, tmp.len);
     emit_byte(p, OP_PUSH_SCOPE);
-    emit_byte(p, OP_CREATE);
+    emit_create(p);
 
     if (p->tok.tok == TOK_ASSIGN) {
       pnext1(p);
@@ -10890,7 +15149,7 @@ static baik_err_t parse_let(struct pstate *p) {
 }
 
 static baik_err_t parse_block_or_stmt(struct pstate *p, int cs) {
-  if (ptest(p) == TOK_OPEN_CURLY) {
+  if (ppeek(p, 1) == TOK_OPEN_CURLY) {
     return parse_block(p, cs);
   } else {
     return parse_statement(p);
@@ -10900,6 +15159,7 @@ static baik_err_t parse_block_or_stmt(struct pstate *p, int cs) {
 static baik_err_t parse_for_in(struct pstate *p) {
   baik_err_t res = BAIK_OK;
   size_t off_b, off_check_end;
+  int outer = p->declared;
 
  
   emit_byte(p, OP_NEW_SCOPE);
@@ -10910,7 +15170,7 @@ static baik_err_t parse_for_in(struct pstate *p) {
     emit_byte(p, OP_PUSH_STR);
     emit_str(p, p->tok.ptr, p->tok.len);
     emit_byte(p, OP_PUSH_SCOPE);
-    emit_byte(p, OP_CREATE);
+    emit_create(p);
   }
   emit_byte(p, OP_PUSH_STR);
   emit_str(p, p->tok.ptr, p->tok.len);
@@ -10925,15 +15185,13 @@ static baik_err_t parse_for_in(struct pstate *p) {
 
  
   emit_byte(p, OP_LOOP);
-  off_b = p->cur_idx;
-  emit_init_offset(p);
+  off_b = emit_init_offset(p);
   emit_byte(p, 0);
 
   emit_byte(p, OP_FOR_IN_NEXT);
   emit_byte(p, OP_DUP);
   emit_byte(p, OP_JMP_FALSE);
-  off_check_end = p->cur_idx;
-  emit_init_offset(p);
+  off_check_end = emit_init_offset(p);
 
   
   if (p->tok.tok == TOK_OPEN_CURLY) {
@@ -10945,39 +15203,33 @@ static baik_err_t parse_for_in(struct pstate *p) {
   emit_byte(p, OP_DROP);
   emit_byte(p, OP_CONTINUE);
  
-  baik_bcode_insert_offset(p, p->baik, off_check_end,
-                          p->cur_idx - off_check_end - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_check_end, p->cur_idx);
 
   emit_byte(p, OP_BREAK);
 
-  baik_bcode_insert_offset(p, p->baik, off_b,
-                          p->cur_idx - off_b - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_b, p->cur_idx);
 
   emit_byte(p, OP_DROP);
   emit_byte(p, OP_DROP);
   emit_byte(p, OP_DROP);
   emit_byte(p, OP_DEL_SCOPE);
+  /* The loop has a scope of its own */
+  p->declared = outer;
 
   return res;
 }
 
 static int check_for_in(struct pstate *p) {
-  struct pstate saved = *p;
-  int forin = 0;
-  if (p->tok.tok == TOK_KEYWORD_ISI) pnext1(p);
-  if (p->tok.tok == TOK_IDENT) {
-    pnext1(p);
-    if (p->tok.tok == TOK_KEYWORD_IN) forin = 1;
-  }
-  *p = saved;
-  return forin;
+  int k = p->tok.tok == TOK_KEYWORD_ISI;
+  int tok = k ? ppeek(p, 1) : p->tok.tok;
+  return tok == TOK_IDENT && ppeek(p, k + 1) == TOK_KEYWORD_IN;
 }
 
 static baik_err_t parse_for(struct pstate *p) {
   baik_err_t res = BAIK_OK;
   size_t off_b, off_c, off_init_end;
   size_t off_incr_begin, off_cond_begin, off_cond_end;
-  int buf_cur_idx;
+  int buf_cur_idx, fuse, outer = p->declared;
 
   LOG(LL_VERBOSE_DEBUG, ("[%.*s]", 10, p->tok.ptr));
   EXPECT(p, TOK_KEYWORD_UNTUK);
@@ -10987,10 +15239,8 @@ static baik_err_t parse_for(struct pstate *p) {
 
   emit_byte(p, OP_NEW_SCOPE);
   emit_byte(p, OP_LOOP);
-  off_b = p->cur_idx;
-  emit_init_offset(p);
-  off_c = p->cur_idx;
-  emit_init_offset(p);
+  off_b = emit_init_offset(p);
+  off_c = emit_init_offset(p);
 
   if (p->tok.tok == TOK_KEYWORD_ISI) {
     if ((res = parse_let(p)) != BAIK_OK) return res;
@@ -11001,8 +15251,7 @@ static baik_err_t parse_for(struct pstate *p) {
   emit_byte(p, OP_DROP);
 
   emit_byte(p, OP_JMP);
-  off_init_end = p->cur_idx;
-  emit_init_offset(p);
+  off_init_end = emit_init_offset(p);
 
   off_incr_begin = p->cur_idx;
   off_cond_begin = p->cur_idx;
@@ -11011,21 +15260,20 @@ static baik_err_t parse_for(struct pstate *p) {
   EXPECT(p, TOK_SEMICOLON);
 
   buf_cur_idx = p->cur_idx;
-  p->cur_idx = off_incr_begin;
+  fuse = cond_ends_in_cmp(p);
 
   if ((res = parse_expr(p)) != BAIK_OK) return res;
   EXPECT(p, TOK_CLOSE_PAREN);
   emit_byte(p, OP_DROP);
 
   {
-    int incr_size = p->cur_idx - off_incr_begin;
+    /* The increment runs before the condition: move it in front */
+    int incr_size = p->cur_idx - buf_cur_idx;
+    baik_bcode_hoist(p, off_incr_begin, buf_cur_idx);
     off_cond_begin += incr_size;
-    p->cur_idx = buf_cur_idx + incr_size;
   }
 
-  emit_byte(p, OP_JMP_FALSE);
-  off_cond_end = p->cur_idx;
-  emit_init_offset(p);
+  off_cond_end = emit_cond_jump(p, fuse);
 
   if (p->tok.tok == TOK_OPEN_CURLY) {
     if ((res = parse_statement_list(p, TOK_CLOSE_CURLY)) != BAIK_OK) return res;
@@ -11035,25 +15283,22 @@ static baik_err_t parse_for(struct pstate *p) {
   }
   emit_byte(p, OP_DROP);
   emit_byte(p, OP_CONTINUE);
-  baik_bcode_insert_offset(p, p->baik, off_cond_end,
-                          p->cur_idx - off_cond_end - BAIK_INIT_OFFSET_SIZE);
-  off_incr_begin += baik_bcode_insert_offset(
-      p, p->baik, off_init_end,
-      off_cond_begin - off_init_end - BAIK_INIT_OFFSET_SIZE);
-  baik_bcode_insert_offset(p, p->baik, off_c,
-                          off_incr_begin - off_c - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_cond_end, p->cur_idx);
+  patch_offset(p, off_init_end, off_cond_begin);
+  patch_offset(p, off_c, off_incr_begin);
 
   emit_byte(p, OP_BREAK);
-  baik_bcode_insert_offset(p, p->baik, off_b,
-                          p->cur_idx - off_b - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_b, p->cur_idx);
 
   emit_byte(p, OP_DEL_SCOPE);
+  p->declared = outer;
 
   return res;
 }
 
 static baik_err_t parse_while(struct pstate *p) {
   size_t off_cond_end, off_b;
+  int outer = p->declared;
   baik_err_t res = BAIK_OK;
 
   EXPECT(p, TOK_KEYWORD_ULANG);
@@ -11061,16 +15306,13 @@ static baik_err_t parse_while(struct pstate *p) {
 
   emit_byte(p, OP_NEW_SCOPE);
   emit_byte(p, OP_LOOP);
-  off_b = p->cur_idx;
-  emit_init_offset(p);
+  off_b = emit_init_offset(p);
   emit_byte(p, 0);
 
   if ((res = parse_expr(p)) != BAIK_OK) return res;
   EXPECT(p, TOK_CLOSE_PAREN);
 
-  emit_byte(p, OP_JMP_FALSE);
-  off_cond_end = p->cur_idx;
-  emit_init_offset(p);
+  off_cond_end = emit_cond_jump(p, cond_ends_in_cmp(p));
 
   if (p->tok.tok == TOK_OPEN_CURLY) {
     if ((res = parse_statement_list(p, TOK_CLOSE_CURLY)) != BAIK_OK) return res;
@@ -11081,12 +15323,11 @@ static baik_err_t parse_while(struct pstate *p) {
   emit_byte(p, OP_DROP);
   emit_byte(p, OP_CONTINUE);
 
-  baik_bcode_insert_offset(p, p->baik, off_cond_end,
-                          p->cur_idx - off_cond_end - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_cond_end, p->cur_idx);
   emit_byte(p, OP_BREAK);
-  baik_bcode_insert_offset(p, p->baik, off_b,
-                          p->cur_idx - off_b - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_b, p->cur_idx);
   emit_byte(p, OP_DEL_SCOPE);
+  p->declared = outer;
   return res;
 }
 
@@ -11098,9 +15339,7 @@ static baik_err_t parse_if(struct pstate *p) {
   EXPECT(p, TOK_OPEN_PAREN);
   if ((res = parse_expr(p)) != BAIK_OK) return res;
 
-  emit_byte(p, OP_JMP_FALSE);
-  off_if = p->cur_idx;
-  emit_init_offset(p);
+  off_if = emit_cond_jump(p, cond_ends_in_cmp(p));
 
   EXPECT(p, TOK_CLOSE_PAREN);
   if ((res = parse_block_or_stmt(p, 1)) != BAIK_OK) return res;
@@ -11110,30 +15349,37 @@ static baik_err_t parse_if(struct pstate *p) {
     size_t off_else, off_endelse;
     pnext1(p);
     emit_byte(p, OP_JMP);
-    off_else = p->cur_idx;
-    emit_init_offset(p);
+    off_else = emit_init_offset(p);
     off_endif = p->cur_idx;
 
     emit_byte(p, OP_DROP);
     if ((res = parse_block_or_stmt(p, 1)) != BAIK_OK) return res;
     off_endelse = p->cur_idx;
-    off_endif += baik_bcode_insert_offset(
-        p, p->baik, off_else, off_endelse - off_else - BAIK_INIT_OFFSET_SIZE);
+    patch_offset(p, off_else, off_endelse);
   } else {
     off_endif = p->cur_idx;
   }
 
-  baik_bcode_insert_offset(p, p->baik, off_if,
-                          off_endif - off_if - BAIK_INIT_OFFSET_SIZE);
+  patch_offset(p, off_if, off_endif);
   return res;
 }
 
+/*
+ * The lookahead ring only caches what lexing from `pos` yields, so it is
+ * dropped rather than restored.
+ */
 static void pstate_revert(struct pstate *p, struct pstate *old,
                           int old_bcode_gen_len) {
   p->pos = old->pos;
   p->line_no = old->line_no;
+  p->ahead_len = 0;
   p->last_emitted_line_no = old->last_emitted_line_no;
   p->offset_lineno_map.len = old->offset_lineno_map.len;
+  p->relocs.len = old->relocs.len;
+  memcpy(p->consts, old->consts, sizeof(p->consts));
+  p->nconsts = old->nconsts;
+  p->last_label = old->last_label;
+  p->last_cmp = old->last_cmp;
   p->prev_tok = old->prev_tok;
   p->tok = old->tok;
   p->baik->bcode_gen.len = old_bcode_gen_len;
@@ -11212,11 +15458,18 @@ static baik_err_t parse_statement(struct pstate *p) {
   }
 }
 
+static void append_varint(struct mbuf *m, int64_t n) {
+  size_t llen = BAIK_EM_varint_llen(n);
+  mbuf_append(m, NULL, llen);
+  BAIK_EM_varint_encode(n, (uint8_t *) m->buf + m->len - llen, llen);
+}
+
 BAIK_PRIVATE baik_err_t
 baik_parse(const char *path, const char *buf, struct baik *baik) {
   baik_err_t res = BAIK_OK;
   struct pstate p;
-  size_t start_idx, llen;
+  struct baik_lineno_item *items;
+  size_t start_idx, i, n;
   int map_len;
   baik_header_item_t bcode_offset, map_offset, total_size;
 
@@ -11241,21 +15494,25 @@ baik_parse(const char *path, const char *buf, struct baik *baik) {
 
   res = parse_statement_list(&p, TOK_EOF);
   emit_byte(&p, OP_EXIT);
+  if (res == BAIK_OK) baik_bcode_optimize(&p);
+  if (res == BAIK_OK) res = baik_bcode_resolve(&p);
 
   map_offset = p.baik->bcode_gen.len - start_idx;
   memcpy(p.baik->bcode_gen.buf + start_idx +
              sizeof(baik_header_item_t) * BAIK_HDR_ITEM_MAP_OFFSET,
          &map_offset, sizeof(baik_header_item_t));
 
-  map_len = p.offset_lineno_map.len;
-  llen = BAIK_EM_varint_llen(map_len);
-  mbuf_resize(&p.baik->bcode_gen, p.baik->bcode_gen.size + llen);
-  BAIK_EM_varint_encode(
-      map_len, (uint8_t *) p.baik->bcode_gen.buf + p.baik->bcode_gen.len, llen);
-  p.baik->bcode_gen.len += llen;
-
-  mbuf_append(&p.baik->bcode_gen, p.offset_lineno_map.buf,
-              p.offset_lineno_map.len);
+  items = (struct baik_lineno_item *) p.offset_lineno_map.buf;
+  n = p.offset_lineno_map.len / sizeof(*items);
+  for (i = 0, map_len = 0; i < n; i++) {
+    map_len += BAIK_EM_varint_llen(items[i].offset);
+    map_len += BAIK_EM_varint_llen(items[i].line_no);
+  }
+  append_varint(&p.baik->bcode_gen, map_len);
+  for (i = 0; i < n; i++) {
+    append_varint(&p.baik->bcode_gen, items[i].offset);
+    append_varint(&p.baik->bcode_gen, items[i].line_no);
+  }
 
   total_size = p.baik->bcode_gen.len - start_idx;
   memcpy(p.baik->bcode_gen.buf + start_idx +
@@ -11263,6 +15520,7 @@ baik_parse(const char *path, const char *buf, struct baik *baik) {
          &total_size, sizeof(baik_header_item_t));
 
   mbuf_free(&p.offset_lineno_map);
+  mbuf_free(&p.relocs);
 
   if (res == BAIK_OK) {
     baik_bcode_commit(baik);
@@ -11951,85 +16209,208 @@ BAIK_PRIVATE void pinit(const char *file_name, const char *buf,
   p->file_name = file_name;
   p->buf = p->pos = buf;
   mbuf_init(&p->offset_lineno_map, 0);
-}
+  mbuf_init(&p->relocs, 0);
+}
+
+/*
+ * Character classes for the lexer, indexed by unsigned char. Bytes past
+ * 0x7f are all zero.
+ */
+#define CC_SPACE 1
+#define CC_DIGIT 2
+#define CC_IDENT 4 /* may start an identifier */
+
+static const uint8_t s_char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0, 0,
+    0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 4,
+    0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0,
+};
+
+#define CHAR_CLASS(c) s_char_class[(uint8_t)(c)]
 
 static int baik_is_space(int c) {
-  return c == ' ' || c == '\r' || c == '\n' || c == '\t' || c == '\f' ||
-         c == '\v';
+  return CHAR_CLASS(c) & CC_SPACE;
 }
 
 BAIK_PRIVATE int baik_is_digit(int c) {
-  return c >= '0' && c <= '9';
-}
-
-static int baik_is_alpha(int c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  return CHAR_CLASS(c) & CC_DIGIT;
 }
 
 BAIK_PRIVATE int baik_is_ident(int c) {
-  return c == '_' || c == '$' || baik_is_alpha(c);
-}
-
-static int longtok(struct pstate *p, const char *first_chars,
-                   const char *second_chars) {
-  if (strchr(first_chars, p->pos[0]) == NULL) return TOK_EOF;
-  if (p->pos[1] != '\0' && strchr(second_chars, p->pos[1]) != NULL) {
-    p->tok.len++;
-    p->pos++;
-    return p->pos[-1] << 8 | p->pos[0];
-  }
-  return p->pos[0];
+  return CHAR_CLASS(c) & CC_IDENT;
 }
 
-static int longtok3(struct pstate *p, char a, char b, char c) {
-  if (p->pos[0] == a && p->pos[1] == b && p->pos[2] == c) {
-    p->tok.len += 2;
-    p->pos += 2;
-    return p->pos[-2] << 16 | p->pos[-1] << 8 | p->pos[0];
-  }
-  return TOK_EOF;
-}
+/* Powers of ten that a double holds exactly */
+static const double s_exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
 
-static int longtok4(struct pstate *p, char a, char b, char c, char d) {
-  if (p->pos[0] == a && p->pos[1] == b && p->pos[2] == c && p->pos[3] == d) {
-    p->tok.len += 3;
-    p->pos += 3;
-    return p->pos[-3] << 24 | p->pos[-2] << 16 | p->pos[-1] << 8 | p->pos[0];
-  }
-  return TOK_EOF;
+static int hex_digit_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
 }
 
+/*
+ * Scans a number and computes its value into p->tok.num in the same pass.
+ * Digits are gathered into an integer mantissa; when it fits in 53 bits
+ * and the decimal exponent is within the exact powers of ten, one double
+ * multiplication or division gives the correctly rounded value. Longer
+ * literals are left to strtod().
+ */
 static int getnum(struct pstate *p) {
-  if (p->pos[0] == '0' && p->pos[1] == 'x') {
-    
-    strtoul(p->pos + 2, (char **) &p->pos, 16);
+  const char *s = p->pos;
+  uint64_t m = 0;
+  int digits = 0, exp = 0, d;
+
+  if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    for (s += 2; (d = hex_digit_value(*s)) >= 0; s++) {
+      if (m != 0 || d != 0) digits++;
+      m = m << 4 | (uint64_t) d;
+    }
+    p->tok.num = digits <= 16 ? (double) m : strtod(p->pos, NULL);
   } else {
-    strtod(p->pos, (char **) &p->pos);
+    for (; baik_is_digit(*s); s++) {
+      if (m != 0 || *s != '0') digits++;
+      if (digits <= 19) {
+        m = m * 10 + (uint64_t)(*s - '0');
+      } else {
+        exp++;
+      }
+    }
+    if (*s == '.') {
+      for (s++; baik_is_digit(*s); s++) {
+        if (m != 0 || *s != '0') digits++;
+        if (digits <= 19) {
+          m = m * 10 + (uint64_t)(*s - '0');
+          exp--;
+        }
+      }
+    }
+    if ((s[0] == 'e' || s[0] == 'E') &&
+        (baik_is_digit(s[1]) ||
+         ((s[1] == '+' || s[1] == '-') && baik_is_digit(s[2])))) {
+      int neg = s[1] == '-', e = 0;
+      for (s += baik_is_digit(s[1]) ? 1 : 2; baik_is_digit(*s); s++) {
+        if (e < 100000) e = e * 10 + (*s - '0');
+      }
+      exp += neg ? -e : e;
+    }
+    if (digits <= 19 && m <= ((uint64_t) 1 << 53) && exp >= -22 && exp <= 22) {
+      p->tok.num = exp < 0 ? (double) m / s_exact_pow10[-exp]
+                           : (double) m * s_exact_pow10[exp];
+    } else {
+      p->tok.num = strtod(p->pos, NULL);
+    }
   }
+  p->pos = s;
   p->tok.len = p->pos - p->tok.ptr;
   p->pos--;
   return TOK_NUM;
 }
 
+struct baik_keyword {
+  const char *name;
+  int len;
+  int tok;
+};
+
+/*
+ * Keywords placed by keyword_hash(), which has no collisions among them.
+ * The multipliers were found offline by a brute-force search; a new keyword
+ * needs a new search and a regenerated table.
+ */
+static const struct baik_keyword s_keywords[64] = {
+    {"void", 4, TOK_KEYWORD_VOID},
+    {"benar", 5, TOK_KEYWORD_TRUE},
+    {"takterdefinisi", 14, TOK_KEYWORD_TAKTERDEFINISI},
+    {"untuk", 5, TOK_KEYWORD_UNTUK},
+    {NULL, 0, 0},
+    {"pilih", 5, TOK_KEYWORD_PILIH},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"tipe", 4, TOK_KEYWORD_TIPE},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"lainnya", 7, TOK_KEYWORD_LAINNYA},
+    {NULL, 0, 0},
+    {"balik", 5, TOK_KEYWORD_BALIK},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"isi", 3, TOK_KEYWORD_ISI},
+    {NULL, 0, 0},
+    {"ulang", 5, TOK_KEYWORD_ULANG},
+    {"instanceof", 10, TOK_KEYWORD_INSTANCEOF},
+    {"standar", 7, TOK_KEYWORD_STANDAR},
+    {"kerjakan", 8, TOK_KEYWORD_KERJAKAN},
+    {NULL, 0, 0},
+    {"teruskan", 8, TOK_KEYWORD_TERUSKAN},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"salah", 5, TOK_KEYWORD_FALSE},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"kosong", 6, TOK_KEYWORD_KOSONG},
+    {"throw", 5, TOK_KEYWORD_THROW},
+    {"with", 4, TOK_KEYWORD_WITH},
+    {NULL, 0, 0},
+    {"jika", 4, TOK_KEYWORD_JIKA},
+    {NULL, 0, 0},
+    {"sama", 4, TOK_KEYWORD_SAMA},
+    {"var", 3, TOK_KEYWORD_VAR},
+    {"debugger", 8, TOK_KEYWORD_DEBUGGER},
+    {NULL, 0, 0},
+    {"delete", 6, TOK_KEYWORD_DELETE},
+    {NULL, 0, 0},
+    {"in", 2, TOK_KEYWORD_IN},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"this", 4, TOK_KEYWORD_THIS},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"new", 3, TOK_KEYWORD_NEW},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"try", 3, TOK_KEYWORD_TRY},
+    {"berhenti", 8, TOK_KEYWORD_BERHENTI},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"catch", 5, TOK_KEYWORD_CATCH},
+    {NULL, 0, 0},
+    {NULL, 0, 0},
+    {"fungsi", 6, TOK_KEYWORD_FUNGSI},
+    {"finally", 7, TOK_KEYWORD_FINALLY},
+};
+
+#define KEYWORD_MIN_LEN 2
+#define KEYWORD_MAX_LEN 14
+
+static int keyword_hash(const char *s, int len) {
+  return ((uint8_t) s[0] * 50 + (uint8_t) s[len - 1] * 44 + len) & 63;
+}
+
 static int is_reserved_word_token(const char *s, int len) {
-  const char *reserved[] = {
-      "berhenti",     "sama",   "catch",   "teruskan",   "debugger", "standar",
-      "delete",    "kerjakan",     "lainnya", "salah",      "finally",  "untuk",
-      "fungsi",  "jika",   "in",      "instanceof", "new",      "kosong",
-      "balik",    "pilih", "this",    "throw",      "benar",     "try",
-      "tipe",    "var",    "void",    "ulang",      "with",     "isi",
-      "takterdefinisi", NULL};
-  int i;
-  if (!baik_is_alpha(s[0])) return 0;
-  for (i = 0; reserved[i] != NULL; i++) {
-    if (len == (int) strlen(reserved[i]) && strncmp(s, reserved[i], len) == 0)
-      return i + 1;
-  }
-  return 0;
+  const struct baik_keyword *k;
+  if (len < KEYWORD_MIN_LEN || len > KEYWORD_MAX_LEN) return 0;
+  k = &s_keywords[keyword_hash(s, len)];
+  if (k->len != len || memcmp(s, k->name, len) != 0) return 0;
+  return k->tok - TOK_IDENT;
 }
 
 static int getident(struct pstate *p) {
-  while (baik_is_ident(p->pos[0]) || baik_is_digit(p->pos[0])) p->pos++;
+  while (CHAR_CLASS(p->pos[0]) & (CC_IDENT | CC_DIGIT)) p->pos++;
   p->tok.len = p->pos - p->tok.ptr;
   p->pos--;
   return TOK_IDENT;
@@ -12075,68 +16456,179 @@ static void skip_spaces_and_comments(struct pstate *p) {
   } while (pos < p->pos);
 }
 
-static int ptranslate(int tok) {
-#define DT(a, b) ((a) << 8 | (b))
-#define TT(a, b, c) ((a) << 16 | (b) << 8 | (c))
-#define QT(a, b, c, d) ((a) << 24 | (b) << 16 | (c) << 8 | (d))
- 
- 
-  switch (tok) {
-    case ':': return TOK_COLON;
-    case ';': return TOK_SEMICOLON;
-    case ',': return TOK_COMMA;
-    case '=': return TOK_ASSIGN;
-    case '{': return TOK_OPEN_CURLY;
-    case '}': return TOK_CLOSE_CURLY;
-    case '(': return TOK_OPEN_PAREN;
-    case ')': return TOK_CLOSE_PAREN;
-    case '[': return TOK_OPEN_BRACKET;
-    case ']': return TOK_CLOSE_BRACKET;
-    case '*': return TOK_MUL;
-    case '+': return TOK_PLUS;
-    case '-': return TOK_MINUS;
-    case '/': return TOK_DIV;
-    case '%': return TOK_REM;
-    case '&': return TOK_AND;
-    case '|': return TOK_OR;
-    case '^': return TOK_XOR;
-    case '.': return TOK_DOT;
-    case '?': return TOK_QUESTION;
-    case '!': return TOK_NOT;
-    case '~': return TOK_TILDA;
-    case '<': return TOK_LT;
-    case '>': return TOK_GT;
-    case DT('<','<'): return TOK_LSHIFT;
-    case DT('>','>'): return TOK_RSHIFT;
-    case DT('-','-'): return TOK_MINUS_MINUS;
-    case DT('+','+'): return TOK_PLUS_PLUS;
-    case DT('+','='): return TOK_PLUS_ASSIGN;
-    case DT('-','='): return TOK_MINUS_ASSIGN;
-    case DT('*','='): return TOK_MUL_ASSIGN;
-    case DT('/','='): return TOK_DIV_ASSIGN;
-    case DT('&','='): return TOK_AND_ASSIGN;
-    case DT('|','='): return TOK_OR_ASSIGN;
-    case DT('%','='): return TOK_REM_ASSIGN;
-    case DT('^','='): return TOK_XOR_ASSIGN;
-    case DT('=','='): return TOK_EQ;
-    case DT('!','='): return TOK_NE;
-    case DT('<','='): return TOK_LE;
-    case DT('>','='): return TOK_GE;
-    case DT('&','&'): return TOK_LOGICAL_AND;
-    case DT('|','|'): return TOK_LOGICAL_OR;
-    case TT('=','=','='): return TOK_EQ_EQ;
-    case TT('!','=','='): return TOK_NE_NE;
-    case TT('<','<','='): return TOK_LSHIFT_ASSIGN;
-    case TT('>','>','='): return TOK_RSHIFT_ASSIGN;
-    case TT('>','>','>'): return TOK_URSHIFT;
-    case QT('>','>','>','='): return TOK_URSHIFT_ASSIGN;
+/*
+ * Scans the punctuator at p->pos, longest match first. Leaves p->pos on its
+ * last character, like the other get* scanners.
+ */
+static int getop(struct pstate *p) {
+  const char *s = p->pos;
+  int len = 1, tok;
+
+  switch (s[0]) {
+    case ',': tok = TOK_COMMA; break;
+    case '.': tok = TOK_DOT; break;
+    case ':': tok = TOK_COLON; break;
+    case ';': tok = TOK_SEMICOLON; break;
+    case '{': tok = TOK_OPEN_CURLY; break;
+    case '}': tok = TOK_CLOSE_CURLY; break;
+    case '[': tok = TOK_OPEN_BRACKET; break;
+    case ']': tok = TOK_CLOSE_BRACKET; break;
+    case '(': tok = TOK_OPEN_PAREN; break;
+    case ')': tok = TOK_CLOSE_PAREN; break;
+    case '?': tok = TOK_QUESTION; break;
+    case '<':
+      if (s[1] == '<' && s[2] == '=') {
+        tok = TOK_LSHIFT_ASSIGN;
+        len = 3;
+      } else if (s[1] == '<') {
+        tok = TOK_LSHIFT;
+        len = 2;
+      } else if (s[1] == '=') {
+        tok = TOK_LE;
+        len = 2;
+      } else {
+        tok = TOK_LT;
+      }
+      break;
+    case '>':
+      if (s[1] == '>' && s[2] == '>' && s[3] == '=') {
+        tok = TOK_URSHIFT_ASSIGN;
+        len = 4;
+      } else if (s[1] == '>' && s[2] == '>') {
+        tok = TOK_URSHIFT;
+        len = 3;
+      } else if (s[1] == '>' && s[2] == '=') {
+        tok = TOK_RSHIFT_ASSIGN;
+        len = 3;
+      } else if (s[1] == '>') {
+        tok = TOK_RSHIFT;
+        len = 2;
+      } else if (s[1] == '=') {
+        tok = TOK_GE;
+        len = 2;
+      } else {
+        tok = TOK_GT;
+      }
+      break;
+    case '=':
+      if (s[1] == '=' && s[2] == '=') {
+        tok = TOK_EQ_EQ;
+        len = 3;
+      } else if (s[1] == '=') {
+        tok = TOK_EQ;
+        len = 2;
+      } else {
+        tok = TOK_ASSIGN;
+      }
+      break;
+    case '!':
+      if (s[1] == '=' && s[2] == '=') {
+        tok = TOK_NE_NE;
+        len = 3;
+      } else if (s[1] == '=') {
+        tok = TOK_NE;
+        len = 2;
+      } else {
+        tok = TOK_NOT;
+      }
+      break;
+    case '&':
+      if (s[1] == '&') {
+        tok = TOK_LOGICAL_AND;
+        len = 2;
+      } else if (s[1] == '=') {
+        tok = TOK_AND_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_AND;
+      }
+      break;
+    case '|':
+      if (s[1] == '|') {
+        tok = TOK_LOGICAL_OR;
+        len = 2;
+      } else if (s[1] == '=') {
+        tok = TOK_OR_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_OR;
+      }
+      break;
+    case '+':
+      if (s[1] == '+') {
+        tok = TOK_PLUS_PLUS;
+        len = 2;
+      } else if (s[1] == '=') {
+        tok = TOK_PLUS_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_PLUS;
+      }
+      break;
+    case '-':
+      if (s[1] == '-') {
+        tok = TOK_MINUS_MINUS;
+        len = 2;
+      } else if (s[1] == '=') {
+        tok = TOK_MINUS_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_MINUS;
+      }
+      break;
+    case '*':
+      if (s[1] == '=') {
+        tok = TOK_MUL_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_MUL;
+      }
+      break;
+    case '/':
+      if (s[1] == '=') {
+        tok = TOK_DIV_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_DIV;
+      }
+      break;
+    case '%':
+      if (s[1] == '=') {
+        tok = TOK_REM_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_REM;
+      }
+      break;
+    case '^':
+      if (s[1] == '=') {
+        tok = TOK_XOR_ASSIGN;
+        len = 2;
+      } else {
+        tok = TOK_XOR;
+      }
+      break;
+    case '~':
+      /* There is no "~=", but it still scans as one (invalid) token */
+      if (s[1] == '=') {
+        tok = TOK_INVALID;
+        len = 2;
+      } else {
+        tok = TOK_TILDA;
+      }
+      break;
+    default:
+      tok = TOK_INVALID;
+      break;
   }
- 
+  p->tok.len = len;
+  p->pos += len - 1;
   return tok;
 }
 
-BAIK_PRIVATE int pnext(struct pstate *p) {
-  int tmp, tok = TOK_INVALID;
+/* Lexes the token at p->pos into p->tok */
+static int plex(struct pstate *p) {
+  int tok;
 
   skip_spaces_and_comments(p);
   p->tok.ptr = p->pos;
@@ -12150,31 +16642,58 @@ BAIK_PRIVATE int pnext(struct pstate *p) {
     tok = getstr(p);
   } else if (baik_is_ident(p->pos[0])) {
     tok = getident(p);
-   
     tok += is_reserved_word_token(p->tok.ptr, p->tok.len);
-  } else if (strchr(",.:;{}[]()?", p->pos[0]) != NULL) {
-    tok = p->pos[0];
-  } else if ((tmp = longtok3(p, '<', '<', '=')) != TOK_EOF ||
-             (tmp = longtok3(p, '>', '>', '=')) != TOK_EOF ||
-             (tmp = longtok4(p, '>', '>', '>', '=')) != TOK_EOF ||
-             (tmp = longtok3(p, '>', '>', '>')) != TOK_EOF ||
-             (tmp = longtok3(p, '=', '=', '=')) != TOK_EOF ||
-             (tmp = longtok3(p, '!', '=', '=')) != TOK_EOF ||
-             (tmp = longtok(p, "&", "&=")) != TOK_EOF ||
-             (tmp = longtok(p, "|", "|=")) != TOK_EOF ||
-             (tmp = longtok(p, "<", "<=")) != TOK_EOF ||
-             (tmp = longtok(p, ">", ">=")) != TOK_EOF ||
-             (tmp = longtok(p, "-", "-=")) != TOK_EOF ||
-             (tmp = longtok(p, "+", "+=")) != TOK_EOF) {
-    tok = tmp;
-  } else if ((tmp = longtok(p, "^~+-%/*<>=!|&", "=")) != TOK_EOF) {
-    tok = tmp;
+  } else {
+    tok = getop(p);
   }
   if (p->pos[0] != '\0') p->pos++;
   LOG(LL_VERBOSE_DEBUG, ("  --> %d [%.*s]", tok, p->tok.len, p->tok.ptr));
+  p->tok.tok = tok;
+  return tok;
+}
+
+BAIK_PRIVATE int pnext(struct pstate *p) {
   p->prev_tok = p->tok.tok;
-  p->tok.tok = ptranslate(tok);
-  return p->tok.tok;
+  if (p->ahead_len > 0) {
+    struct baik_lexeme *l = &p->ahead[p->ahead_head];
+    p->tok = l->tok;
+    p->pos = l->pos;
+    p->line_no = l->line_no;
+    p->ahead_head = (p->ahead_head + 1) % BAIK_LOOKAHEAD;
+    p->ahead_len--;
+    return p->tok.tok;
+  }
+  return plex(p);
+}
+
+/*
+ * Returns the k-th token after the current one without consuming it. Each
+ * token is lexed once into the ring and handed out from there by pnext(),
+ * while p->pos and p->line_no keep describing the current token.
+ */
+BAIK_PRIVATE int ppeek(struct pstate *p, int k) {
+  assert(k >= 1 && k <= BAIK_LOOKAHEAD);
+  while (p->ahead_len < k) {
+    struct tok tok = p->tok;
+    const char *pos = p->pos;
+    int line_no = p->line_no;
+    struct baik_lexeme *l;
+    if (p->ahead_len > 0) {
+      l = &p->ahead[(p->ahead_head + p->ahead_len - 1) % BAIK_LOOKAHEAD];
+      p->pos = l->pos;
+      p->line_no = l->line_no;
+    }
+    plex(p);
+    l = &p->ahead[(p->ahead_head + p->ahead_len) % BAIK_LOOKAHEAD];
+    l->tok = p->tok;
+    l->pos = p->pos;
+    l->line_no = p->line_no;
+    p->ahead_len++;
+    p->tok = tok;
+    p->pos = pos;
+    p->line_no = line_no;
+  }
+  return p->ahead[(p->ahead_head + k - 1) % BAIK_LOOKAHEAD].tok.tok;
 }
 
 const char *baik_typeof(baik_val_t v) {
@@ -12265,7 +16784,15 @@ BAIK_PRIVATE const char *opcodetostr(uint8_t opcode) {
       "PUSH_UNDEF", "PUSH_OBJ", "PUSH_ARRAY", "PUSH_FUNC", "PUSH_THIS", "GET",
       "CREATE", "EXPR", "APPEND", "SET_ARG", "NEW_SCOPE", "DEL_SCOPE", "CALL",
       "RETURN", "LOOP", "BREAK", "CONTINUE", "SETRETVAL", "EXIT", "BCODE_HDR",
-      "ARGS", "FOR_IN_NEXT",
+      "ARGS", "FOR_IN_NEXT", "JMP_FALSE_LT", "JMP_FALSE_GT", "JMP_FALSE_LE",
+      "JMP_FALSE_GE", "JMP_FALSE_EQ", "JMP_FALSE_NE", "ADD_NUM", "SUB_NUM",
+      "MUL_NUM", "GET_ARRAY_INDEX", "GET_OWN_CACHED", "ADD", "SUB", "MUL",
+      "DIV", "REM", "XOR", "AND", "OR", "LSHIFT", "RSHIFT", "URSHIFT",
+      "ADD_ASSIGN", "SUB_ASSIGN", "MUL_ASSIGN", "DIV_ASSIGN", "REM_ASSIGN",
+      "XOR_ASSIGN", "AND_ASSIGN", "OR_ASSIGN", "LSHIFT_ASSIGN", "RSHIFT_ASSIGN",
+      "URSHIFT_ASSIGN", "LT", "GT", "LE", "GE", "EQ_EQ", "NE_NE", "EQ", "NE",
+      "NEG", "NOT", "BIT_NOT", "TYPEOF", "ASSIGN", "INC", "DEC", "POST_INC",
+      "POST_DEC", "PUSH_F64",
   };
   const char *name = "???";
   assert(ARRAY_SIZE(names) == OP_MAX);
@@ -12311,11 +16838,24 @@ BAIK_PRIVATE size_t baik_disasm_single(const uint8_t *code, size_t i) {
       i += llen + n;
       break;
     }
+    case OP_PUSH_F64: {
+      double d;
+      memcpy(&d, &code[i + 1], sizeof(d));
+      LOG(LL_VERBOSE_DEBUG, ("%s\t%.17g", buf, d));
+      i += sizeof(d);
+      break;
+    }
     case OP_JMP:
     case OP_JMP_TRUE:
     case OP_JMP_NEUTRAL_TRUE:
     case OP_JMP_FALSE:
-    case OP_JMP_NEUTRAL_FALSE: {
+    case OP_JMP_NEUTRAL_FALSE:
+    case OP_JMP_FALSE_LT:
+    case OP_JMP_FALSE_GT:
+    case OP_JMP_FALSE_LE:
+    case OP_JMP_FALSE_GE:
+    case OP_JMP_FALSE_EQ:
+    case OP_JMP_FALSE_NE: {
       BAIK_EM_varint_decode(&code[i + 1], ~0, &n, &llen);
       LOG(LL_VERBOSE_DEBUG,
           ("%s\t%u", buf,
@@ -12563,12 +17103,11 @@ int baik_get_lineno_by_offset(struct baik *baik, int offset) {
       BAIK_EM_varint_decode(p, ~0, &line_no, &llen);
       p += llen;
 
-      if (cur_offset >= (uint64_t) offset) {
-        ret = prev_line_no;
-        break;
-      }
+      if (cur_offset >= (uint64_t) offset) break;
       prev_line_no = line_no;
     }
+    /* Past the last entry is still the last line */
+    ret = prev_line_no;
   }
   return ret;
 }
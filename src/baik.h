@@ -9,6 +9,14 @@
 #define BAIK_MEMORY_STATS 0
 #endif
 
+#if !defined(BAIK_GC_THREADS)
+#define BAIK_GC_THREADS 0
+#endif
+
+#if !defined(BAIK_GC_COMPACT)
+#define BAIK_GC_COMPACT 0
+#endif
+
 #if !defined(BAIK_GENERATE_INAC)
 #if defined(BAIK_EM_MMAP)
 #define BAIK_GENERATE_INAC 1
@@ -58,6 +66,8 @@ typedef enum baik_err {
   BAIK_NOT_IMPLEMENTED_ERROR,
   BAIK_FILE_READ_ERROR,
   BAIK_BAD_ARGS_ERROR,
+  BAIK_SUSPENDED,
+  BAIK_INTERRUPTED,
   BAIK_ERRS_CNT
 } baik_err_t;
 struct baik;
@@ -70,6 +80,7 @@ struct baik_create_opts {
 };
 struct baik *baik_create_opt(struct baik_create_opts opts);
 void baik_destroy(struct baik *baik);
+baik_err_t baik_reset(struct baik *baik);
 baik_val_t baik_get_global(struct baik *baik);
 void baik_own(struct baik *baik, baik_val_t *v);
 int baik_disown(struct baik *baik, baik_val_t *v);
@@ -84,6 +95,15 @@ int baik_nargs(struct baik *baik);
 baik_val_t baik_arg(struct baik *baik, int n);
 void baik_return(struct baik *baik, baik_val_t v);
 
+/* Counted only when built with BAIK_QUICKEN_STATS */
+struct baik_quicken_stats {
+  unsigned long generic;     /* runs of quickenable opcodes left generic */
+  unsigned long specialized; /* runs of their specialized forms */
+  unsigned long deopts;      /* specialized forms whose guard failed */
+};
+
+void baik_get_quicken_stats(struct baik *baik, struct baik_quicken_stats *st);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -194,6 +214,7 @@ struct baik_create_opts {
 
 struct baik *baik_create_opt(struct baik_create_opts opts);
 void baik_destroy(struct baik *baik);
+baik_err_t baik_reset(struct baik *baik);
 baik_val_t baik_get_global(struct baik *baik);
 void baik_own(struct baik *baik, baik_val_t *v);
 int baik_disown(struct baik *baik, baik_val_t *v);
@@ -230,6 +251,76 @@ baik_err_t baik_apply(struct baik *baik, baik_val_t *res, baik_val_t func,
 baik_err_t baik_call(struct baik *baik, baik_val_t *res, baik_val_t func,
                    baik_val_t this_val, int nargs, ...);
 baik_val_t baik_get_this(struct baik *baik);
+baik_err_t baik_resume(struct baik *baik, baik_val_t *res);
+void baik_set_budget(struct baik *baik, unsigned long ticks, unsigned long ms);
+void baik_interrupt(struct baik *baik);
+
+struct baik_code;
+
+baik_err_t baik_compile(struct baik *baik, const char *path, const char *src,
+                        struct baik_code **code);
+struct baik_code *baik_code_from_rom(const void *bcode, size_t len);
+void baik_code_unref(struct baik_code *code);
+baik_err_t baik_exec_code(struct baik *baik, struct baik_code *code,
+                          baik_val_t *res);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
+
+#ifndef BAIK_EVENTS_PUBLIC_H_
+#define BAIK_EVENTS_PUBLIC_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef void (*baik_event_cb_t)(struct baik *baik, void *user_data);
+
+struct baik_event_stats {
+  unsigned long events;
+  unsigned long latency_max_us;
+  unsigned long long latency_sum_us;
+  unsigned long timers;
+  unsigned long jitter_max_us;
+  unsigned long long jitter_sum_us;
+};
+
+int baik_post(struct baik *baik, baik_val_t func, baik_val_t arg);
+int baik_post_cb(struct baik *baik, baik_event_cb_t cb, void *user_data);
+int baik_poll(struct baik *baik, unsigned long *wait_ms);
+int baik_events_pending(struct baik *baik);
+void baik_get_event_stats(struct baik *baik, struct baik_event_stats *st);
+
+struct baik_chan;
+
+struct baik_chan *baik_chan_create(size_t capacity);
+void baik_chan_destroy(struct baik_chan *ch);
+int baik_chan_send(struct baik *baik, struct baik_chan *ch, baik_val_t v);
+int baik_chan_recv(struct baik *baik, struct baik_chan *ch, baik_val_t *v);
+void baik_set_kanal(struct baik *baik, struct baik_chan *tx,
+                    struct baik_chan *rx);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
+
+#ifndef BAIK_SNAPSHOT_PUBLIC_H_
+#define BAIK_SNAPSHOT_PUBLIC_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+baik_err_t baik_snapshot_save(struct baik *baik, const char *path);
+baik_err_t baik_snapshot_load(struct baik *baik, const char *path);
+baik_err_t baik_snapshot_save_buf(struct baik *baik, char **buf, size_t *len);
+baik_err_t baik_snapshot_load_buf(struct baik *baik, const void *buf,
+                                  size_t len);
 
 #if defined(__cplusplus)
 }
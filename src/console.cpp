@@ -216,6 +216,271 @@ namespace ESP32Console
         return true;
     }
 
+    // Scripts run in slices of this many milliseconds; between slices the
+    // interpreter task yields. The event loop sleeps at most BAIK_POLL_MS.
+    static const unsigned long BAIK_SLICE_MS = 20;
+    static const unsigned long BAIK_POLL_MS = 10;
+
+    // The interpreter lives in the Arduino loop task (see Console::loop);
+    // the REPL task and everyone else hand it work through baik_post_cb.
+    static struct baik *volatile s_baik = nullptr;
+    static volatile TaskHandle_t s_baik_task = nullptr;
+    static SemaphoreHandle_t s_baik_done = nullptr;
+    // Set while a posted script is suspended; Console::loop resumes it
+    // between polls so that timers and tasks keep running meanwhile.
+    static bool s_baik_busy = false;
+    // How the last posted script or snapshot call ended.
+    static baik_err_t s_baik_err = BAIK_OK;
+
+    // Errors are printed here, in the interpreter task, since the instance
+    // must not be touched from any other.
+    static void finishBaik(struct baik *baik, baik_err_t err, bool report)
+    {
+        s_baik_err = err;
+        s_baik_busy = (err == BAIK_SUSPENDED);
+        if (s_baik_busy)
+        {
+            return;
+        }
+        if (err == BAIK_INTERRUPTED)
+        {
+            printf("^C\r\n");
+        }
+        else if (err != BAIK_OK && report)
+        {
+            baik_print_error(baik, stdout, NULL, 1);
+        }
+        xSemaphoreGive(s_baik_done);
+    }
+
+    static void runBaik(struct baik *baik, void *src)
+    {
+        baik_err_t err = baik_exec(baik, (const char *)src, NULL);
+        free(src);
+        finishBaik(baik, err, true);
+    }
+
+    // The state /baik.ina leaves behind is kept in /baik.snap, so that the
+    // next boot can load it instead of running the script again. Uploading
+    // any file removes it (see handleFileUpload); after a firmware upload the
+    // image is refused by its build id and removed on boot.
+    static const char *BAIK_SNAPSHOT_FILE = "/baik.snap";
+    static const char *BAIK_SNAPSHOT_PATH = "/spiffs/baik.snap";
+
+    static void loadSnapshot(struct baik *baik, void *)
+    {
+        finishBaik(baik, baik_snapshot_load(baik, BAIK_SNAPSHOT_PATH), true);
+    }
+
+    // Scripts that leave tasks or a suspended run behind cannot be saved;
+    // that is expected and not reported.
+    static void saveSnapshot(struct baik *baik, void *)
+    {
+        finishBaik(baik, baik_snapshot_save(baik, BAIK_SNAPSHOT_PATH), false);
+    }
+
+    // A second interpreter runs /pekerja.ina, if present, on core 0 while
+    // the main one stays in the Arduino loop task on core 1. The two talk
+    // through kanal.kirim/terima over these channels.
+    static const size_t BAIK_KANAL_CAPACITY = 64;
+    static struct baik_chan *s_to_worker = nullptr;
+    static struct baik_chan *s_from_worker = nullptr;
+
+    static void workerBaik(void *src)
+    {
+        struct baik *baik = baik_create();
+        baik_set_budget(baik, 0, BAIK_SLICE_MS);
+        baik_set_kanal(baik, s_from_worker, s_to_worker);
+        baik_err_t err = baik_exec(baik, (const char *)src, NULL);
+        free(src);
+        for (;;)
+        {
+            if (err == BAIK_SUSPENDED)
+            {
+                err = baik_resume(baik, NULL);
+            }
+            else if (err != BAIK_OK)
+            {
+                baik_print_error(baik, stdout, NULL, 1);
+                err = BAIK_OK;
+            }
+
+            unsigned long wait;
+            baik_poll(baik, &wait);
+            if (err == BAIK_SUSPENDED)
+            {
+                wait = 0;
+            }
+            else if (wait > BAIK_POLL_MS)
+            {
+                wait = BAIK_POLL_MS;
+            }
+            TickType_t ticks = pdMS_TO_TICKS(wait);
+            vTaskDelay(ticks > 0 ? ticks : 1);
+        }
+    }
+
+    static void startWorker(struct baik *baik)
+    {
+        String src;
+        if (!SPIFFS.exists("/pekerja.ina") || !readFileToCStr("/pekerja.ina", src))
+        {
+            return;
+        }
+        s_to_worker = baik_chan_create(BAIK_KANAL_CAPACITY);
+        s_from_worker = baik_chan_create(BAIK_KANAL_CAPACITY);
+        baik_set_kanal(baik, s_to_worker, s_from_worker);
+        if (xTaskCreatePinnedToCore(workerBaik, "baik_pekerja", 8192, strdup(src.c_str()), 1, NULL, 0) != pdTRUE)
+        {
+            log_e("Could not start the BAIK worker!");
+            baik_set_kanal(baik, nullptr, nullptr);
+            baik_chan_destroy(s_to_worker);
+            baik_chan_destroy(s_from_worker);
+            s_to_worker = s_from_worker = nullptr;
+        }
+    }
+
+    // What is typed while a script runs, kept for the REPL to read once it
+    // is done. Ctrl-C interrupts the script and drops it. Lines end in
+    // '\n'; a line not finished yet is left at the end.
+    static char s_typeahead[256];
+    static size_t s_typeahead_len = 0;
+    static int s_typeahead_esc = 0; // 1 after ESC, 2 inside ESC [ ...
+    static bool s_typeahead_cr = false;
+
+    static void typeahead(uint8_t c)
+    {
+        bool cr = s_typeahead_cr;
+        s_typeahead_cr = (c == '\r');
+        if (s_typeahead_esc != 0)
+        {
+            // Escape sequences are cursor keys and the like; skip them
+            if (s_typeahead_esc == 1 && (c == '[' || c == 'O'))
+            {
+                s_typeahead_esc = 2;
+            }
+            else if (s_typeahead_esc == 1 || (c >= 0x40 && c <= 0x7e))
+            {
+                s_typeahead_esc = 0;
+            }
+            return;
+        }
+        if (c == 0x1b)
+        {
+            s_typeahead_esc = 1;
+        }
+        else if (c == 0x08 || c == 0x7f)
+        {
+            if (s_typeahead_len > 0 && s_typeahead[s_typeahead_len - 1] != '\n')
+            {
+                s_typeahead_len--;
+            }
+        }
+        else if ((c == '\n' && cr) || (c < 0x20 && c != '\r' && c != '\n'))
+        {
+            return;
+        }
+        else if (s_typeahead_len < sizeof(s_typeahead) - 1)
+        {
+            s_typeahead[s_typeahead_len++] = (c == '\r') ? '\n' : (char)c;
+        }
+    }
+
+    // The first whole line typed ahead, to be freed with linenoiseFree,
+    // or NULL if there is none.
+    static char *typeaheadLine()
+    {
+        char *nl = (char *)memchr(s_typeahead, '\n', s_typeahead_len);
+        if (nl == NULL)
+        {
+            return NULL;
+        }
+        size_t n = nl - s_typeahead;
+        char *line = (char *)malloc(n + 1);
+        if (line != NULL)
+        {
+            memcpy(line, s_typeahead, n);
+            line[n] = '\0';
+        }
+        s_typeahead_len -= n + 1;
+        memmove(s_typeahead, nl + 1, s_typeahead_len);
+        return line;
+    }
+
+    // Runs cb in the interpreter task and waits for it, turning a Ctrl-C
+    // on the console UART into baik_interrupt. The outcome is left in
+    // s_baik_err.
+    static bool postBaikCb(baik_event_cb_t cb, void *arg, uart_port_t uart)
+    {
+        while (s_baik == nullptr)
+        {
+            vTaskDelay(pdMS_TO_TICKS(BAIK_POLL_MS));
+        }
+        if (!baik_post_cb(s_baik, cb, arg))
+        {
+            return false;
+        }
+        xTaskNotifyGive(s_baik_task);
+        while (xSemaphoreTake(s_baik_done, pdMS_TO_TICKS(BAIK_SLICE_MS)) != pdTRUE)
+        {
+            uint8_t c;
+            while (uart_read_bytes(uart, &c, 1, 0) == 1)
+            {
+                if (c == 0x03)
+                {
+                    baik_interrupt(s_baik);
+                    s_typeahead_len = 0;
+                    s_typeahead_esc = 0;
+                }
+                else
+                {
+                    typeahead(c);
+                }
+            }
+        }
+        return true;
+    }
+
+    static void postBaik(const char *src, uart_port_t uart)
+    {
+        char *copy = strdup(src);
+        if (!postBaikCb(runBaik, copy, uart))
+        {
+            free(copy);
+        }
+    }
+
+    void Console::loop()
+    {
+        if (s_baik == nullptr)
+        {
+            struct baik *baik = baik_create();
+            baik_set_budget(baik, 0, BAIK_SLICE_MS);
+            s_baik_done = xSemaphoreCreateBinary();
+            s_baik_task = xTaskGetCurrentTaskHandle();
+            startWorker(baik);
+            s_baik = baik;
+        }
+
+        if (s_baik_busy)
+        {
+            finishBaik(s_baik, baik_resume(s_baik, NULL), true);
+        }
+
+        unsigned long wait;
+        baik_poll(s_baik, &wait);
+        if (s_baik_busy)
+        {
+            wait = 0;
+        }
+        else if (wait > BAIK_POLL_MS)
+        {
+            wait = BAIK_POLL_MS;
+        }
+        TickType_t ticks = pdMS_TO_TICKS(wait);
+        ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+    }
+
     void Console::repl_task(void *args)
     {
         Console const &console = *(static_cast<Console *>(args));
@@ -236,31 +501,41 @@ namespace ESP32Console
 
         setvbuf(stdin, NULL, _IONBF, 0);
 
-        // BAIK Code Initialize 
-        struct baik *baik = baik_create();
-        baik_err_t err = BAIK_OK;
-        baik_val_t res = 0;
+        uart_port_t uart = (uart_port_t)console.uart_channel_;
+        unsigned long bootStart = millis();
+        bool isSnapshotLoaded = false;
+        if (SPIFFS.exists(BAIK_SNAPSHOT_FILE))
+        {
+            isSnapshotLoaded = postBaikCb(loadSnapshot, nullptr, uart) && s_baik_err == BAIK_OK;
+            if (!isSnapshotLoaded)
+            {
+                SPIFFS.remove(BAIK_SNAPSHOT_FILE);
+            }
+        }
 
         // Variable to hold the file content
         String fileContent;
+        if (isSnapshotLoaded)
+        {
+            printf("\r\n"
+                    "Snapshot BAIK dimuat dalam %lu ms.\r\n", millis() - bootStart);
+        }
         // Read the file and store the content in the variable
-        bool isBaikFileExists = readFileToCStr("/baik.ina", fileContent);
-        if (isBaikFileExists)
+        else if (readFileToCStr("/baik.ina", fileContent))
         {
             printf("\r\n"
                     "Kode BAIK ditemukan dan dijalankan.....\r\n"
                     "---------------------------------------\r\n");
-            if (err == BAIK_OK)
-            {
-                if (res == 0)
-                    baik_exec(baik, fileContent.c_str(), NULL);
-            }
-            else
+            postBaik(fileContent.c_str(), uart);
+            printf("\r\n"
+                    "---------------------------------------\r\n"
+                    "Kode BAIK siap dalam %lu ms.\r\n", millis() - bootStart);
+            // Scripts that leave tasks or a suspended run behind cannot be
+            // snapshotted; they simply run again on every boot.
+            if (s_baik_err == BAIK_OK)
             {
-                baik_print_error(baik, stdout, NULL, 1);
+                postBaikCb(saveSnapshot, nullptr, uart);
             }
-            printf("\r\n"
-                    "---------------------------------------\r\n");
         }
 
         /* This message shall be printed here and not earlier as the stdout
@@ -294,7 +569,31 @@ namespace ESP32Console
             // Insert current PWD into prompt if needed
             prompt.replace("%pwd%", console_getpwd());
 
-            char *line = linenoise(prompt.c_str());
+            // Lines typed while a script ran come first. A line begun then is
+            // shown after the prompt for linenoise to finish.
+            char *line = typeaheadLine();
+            if (line != NULL)
+            {
+                printf("%s%s\r\n", prompt.c_str(), line);
+            }
+            else if (s_typeahead_len > 0)
+            {
+                s_typeahead[s_typeahead_len] = '\0';
+                String begun = prompt + s_typeahead;
+                size_t len = s_typeahead_len;
+                char *rest = linenoise(begun.c_str());
+                if (rest != NULL && (line = (char *)malloc(len + strlen(rest) + 1)) != NULL)
+                {
+                    memcpy(line, s_typeahead, len);
+                    strcpy(line + len, rest);
+                }
+                linenoiseFree(rest);
+                s_typeahead_len = 0;
+            }
+            else
+            {
+                line = linenoise(prompt.c_str());
+            }
             if (line == NULL)
             {
                 ESP_LOGD(TAG, "empty line");
@@ -338,15 +637,7 @@ namespace ESP32Console
             }
             else
             {
-                if (err == BAIK_OK)
-                {
-                    if (res == 0)
-                        baik_exec(baik, interpolated_line.c_str(), NULL);
-                }
-                else
-                {
-                    baik_print_error(baik, stdout, NULL, 1);
-                }
+                postBaik(interpolated_line.c_str(), uart);
             }
 
             // Reset global state
@@ -368,13 +659,12 @@ namespace ESP32Console
                 }
                 else if (esp_err != ESP_OK)
                 {
-                    printf("Internal error: %s\n", esp_err_to_name(err));
+                    printf("Internal error: %s\n", esp_err_to_name(esp_err));
                 }
             }
 
             linenoiseFree(line);
         }
-        baik_destroy(baik);
         ESP_LOGD(TAG, "REPL task ended");
         vTaskDelete(NULL);
     }
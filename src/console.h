@@ -147,5 +147,10 @@ namespace ESP32Console
         void begin(int baud, int rxPin = -1, int txPin = -1, uint8_t channel = 0);
 
         void end();
+
+        /**
+         * @brief Runs one round of the BAIK event loop: due timers, posted callbacks, script tasks (tugas) and lines from the REPL. Call it from the task that should own the interpreter, e.g. Arduino's loop().
+         */
+        void loop();
     };
 };
\ No newline at end of file
@@ -22,6 +22,8 @@ void handleFileUpload(AsyncWebServerRequest *request, String filename, size_t in
     if (!index)
     {
         Serial.printf("UploadStart: %s\n", filename.c_str());
+        // The boot snapshot was taken from the old files.
+        SPIFFS.remove("/baik.snap");
         if (!SPIFFS.open("/" + filename, FILE_WRITE))
         {
             return request->send(500, "text/plain", "Failed to open file for writing");
@@ -127,5 +129,6 @@ void setup()
 
 void loop()
 {
-    // Nothing to do here
+    // The BAIK interpreter and its event loop run in this task
+    console.loop();
 }
\ No newline at end of file
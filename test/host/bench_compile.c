@@ -0,0 +1,97 @@
+/*
+ * Compile time of large generated scripts: ordinary mixed code, one
+ * function with thousands of statements, and deeply nested loops whose
+ * jumps span most of the script.
+ */
+#include "host.h"
+
+#define RUNS 8
+
+static void gen_mixed(struct mbuf *m, int copies) {
+  char s[512];
+  int i;
+  for (i = 0; i < copies; i++) {
+    snprintf(s, sizeof(s),
+             "fungsi f%d(a, b) {"
+             "  isi t = 0, o = {x: a, y: [b, a + b, 'teks %d']};"
+             "  untuk (isi i = 0; i < a; i++) {"
+             "    jika (i %% 3 === 0) { t += o.y[1] * i; } lainnya { t -= b; }"
+             "  }"
+             "  ulang (t > 100) { t = t / 2; jika (t < 7) berhenti; }"
+             "  balik t + o.x;"
+             "}\n"
+             "isi v%d = f%d(%d, %d) > 10 ? 'besar' : 'kecil';\n",
+             i, i, i, i, i % 50, i % 7);
+    mbuf_append(m, s, strlen(s));
+  }
+}
+
+static void gen_long_function(struct mbuf *m, int stmts) {
+  char s[128];
+  int i;
+  mbuf_append(m, "fungsi panjang(a) { isi x = a;\n", 31);
+  for (i = 0; i < stmts; i++) {
+    snprintf(s, sizeof(s), "  jika (x > %d) { x = x - %d; } lainnya x++;\n", i,
+             i % 13);
+    mbuf_append(m, s, strlen(s));
+  }
+  mbuf_append(m, "  balik x; }\n", 13);
+}
+
+static void gen_nested(struct mbuf *m, int depth, int copies) {
+  char s[128];
+  int c, i;
+  for (c = 0; c < copies; c++) {
+    for (i = 0; i < depth; i++) {
+      snprintf(s, sizeof(s), "untuk (isi i%d = 0; i%d < 1; i%d++) {\n", i, i,
+               i);
+      mbuf_append(m, s, strlen(s));
+    }
+    mbuf_append(m, "n++;\n", 5);
+    for (i = 0; i < depth; i++) mbuf_append(m, "}\n", 2);
+  }
+}
+
+/* Best of RUNS compiles, in milliseconds */
+static double compile_ms(struct mbuf *m) {
+  struct baik *baik = baik_create();
+  double best = 1e9;
+  int i;
+
+  mbuf_append(m, "", 1);
+  for (i = 0; i < RUNS; i++) {
+    struct baik_code *code;
+    double t0 = host_now_ms(), t;
+    CHECK(baik_compile(baik, "bench", m->buf, &code) == BAIK_OK);
+    t = host_now_ms() - t0;
+    if (t < best) best = t;
+    baik_code_unref(code);
+  }
+  baik_destroy(baik);
+  return best;
+}
+
+static void report(const char *what, struct mbuf *m) {
+  double ms = compile_ms(m);
+  printf("%-26s %7.0f KB %8.1f ms %6.1f MB/s\n", what, m->len / 1024.0, ms,
+         m->len / 1e3 / ms);
+  mbuf_free(m);
+}
+
+int main(void) {
+  struct mbuf m;
+
+  mbuf_init(&m, 0);
+  gen_mixed(&m, 1000);
+  report("mixed code", &m);
+  mbuf_init(&m, 0);
+  gen_mixed(&m, 10000);
+  report("mixed code", &m);
+  mbuf_init(&m, 0);
+  gen_long_function(&m, 3000);
+  report("one 3000-statement fungsi", &m);
+  mbuf_init(&m, 0);
+  gen_nested(&m, 400, 20);
+  report("400-deep loops", &m);
+  return s_failed != 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Event loop: how fast the queue drains with several producer threads
+ * posting at once, then queue latency and the jitter of a periodic timer
+ * while one thread posts at a steady rate.
+ */
+#include "host.h"
+
+#include <pthread.h>
+
+#define PRODUCERS 4
+#define PER_PRODUCER 50000
+#define PACED_EVENTS 2000 /* one per millisecond */
+
+static struct baik *s_baik;
+static baik_val_t s_func;
+static int s_producing;
+static int s_cb_runs;
+
+static void count_cb(struct baik *baik, void *user_data) {
+  (void) baik;
+  (void) user_data;
+  s_cb_runs++;
+}
+
+static void *flood(void *arg) {
+  int i;
+  for (i = 0; i < PER_PRODUCER; i++) {
+    baik_post_cb(s_baik, count_cb, NULL);
+  }
+  __atomic_fetch_sub(&s_producing, 1, __ATOMIC_RELEASE);
+  return arg;
+}
+
+static void *paced(void *arg) {
+  int i;
+  for (i = 0; i < PACED_EVENTS; i++) {
+    baik_post(s_baik, s_func, baik_mk_number(NULL, i));
+    baik_sleep_ms(1);
+  }
+  __atomic_fetch_sub(&s_producing, 1, __ATOMIC_RELEASE);
+  return arg;
+}
+
+/* Polls until the producers are done and the queue is empty */
+static void consume(void) {
+  while (__atomic_load_n(&s_producing, __ATOMIC_ACQUIRE) > 0 ||
+         !baik_ev_empty(s_baik)) {
+    unsigned long wait_ms;
+    baik_poll(s_baik, &wait_ms);
+  }
+}
+
+static void bench_throughput(void) {
+  pthread_t t[PRODUCERS];
+  double t0, ms;
+  int i;
+
+  s_producing = PRODUCERS;
+  t0 = host_now_ms();
+  for (i = 0; i < PRODUCERS; i++) {
+    pthread_create(&t[i], NULL, flood, NULL);
+  }
+  consume();
+  ms = host_now_ms() - t0;
+  for (i = 0; i < PRODUCERS; i++) {
+    pthread_join(t[i], NULL);
+  }
+  CHECK(s_cb_runs == PRODUCERS * PER_PRODUCER);
+  printf("throughput: %d C events from %d threads in %.0f ms, %.0f/s\n",
+         s_cb_runs, PRODUCERS, ms, s_cb_runs / (ms / 1000));
+}
+
+static void bench_latency(void) {
+  struct baik_event_stats st;
+  pthread_t t;
+
+  memset(&s_baik->ev_stats, 0, sizeof(s_baik->ev_stats));
+  host_eval(s_baik, "isi p = setiap(5, fungsi() {});");
+  s_producing = 1;
+  pthread_create(&t, NULL, paced, NULL);
+  consume();
+  pthread_join(t, NULL);
+  host_eval(s_baik, "batalkan(p);");
+
+  baik_get_event_stats(s_baik, &st);
+  CHECK(host_eval(s_baik, "jml;") == PACED_EVENTS);
+  printf("queue latency (%lu script events): avg %llu us, max %lu us\n",
+         st.events, st.latency_sum_us / (st.events ? st.events : 1),
+         st.latency_max_us);
+  printf("timer jitter (5 ms period, %lu runs): avg %llu us, max %lu us\n",
+         st.timers, st.jitter_sum_us / (st.timers ? st.timers : 1),
+         st.jitter_max_us);
+}
+
+int main(void) {
+  s_baik = baik_create();
+  host_eval(s_baik, "isi jml = 0; fungsi h(x) { jml = jml + 1; }");
+  baik_exec(s_baik, "h;", &s_func);
+  baik_own(s_baik, &s_func);
+
+  bench_throughput();
+  bench_latency();
+
+  baik_disown(s_baik, &s_func);
+  baik_destroy(s_baik);
+  return s_failed != 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Channels: messages per second for numbers, strings and objects, first
+ * sent and received by the same thread, then from one thread to another
+ * through a small ring that is mostly full or mostly empty.
+ */
+#include "host.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#define MESSAGES 200000
+#define CAPACITY 64
+
+enum kind { NUMBER, STRING, OBJECT };
+static const char *s_kind_names[] = {"number", "string", "object"};
+
+struct stream {
+  struct baik_chan *ch;
+  enum kind kind;
+  int count;
+};
+
+static baik_val_t make(struct baik *baik, enum kind kind, int i) {
+  baik_val_t v;
+  switch (kind) {
+    case NUMBER:
+      return baik_mk_number(baik, i);
+    case STRING:
+      return baik_mk_string(baik, "suhu=23.5;lembab=61", ~0, 1);
+    default:
+      baik_exec(baik, "({id: 7, nilai: [1, 2, 3], ok: benar});", &v);
+      return v;
+  }
+}
+
+/* The object is made once; sending it costs the stringify either way */
+static void send_all(struct baik *baik, struct stream *s) {
+  baik_val_t v = make(baik, s->kind, 0);
+  int i;
+  baik_own(baik, &v);
+  for (i = 0; i < s->count; i++) {
+    if (s->kind == NUMBER) v = make(baik, NUMBER, i);
+    while (!baik_chan_send(baik, s->ch, v)) sched_yield();
+  }
+  baik_disown(baik, &v);
+}
+
+static void *producer(void *arg) {
+  struct baik *baik = baik_create();
+  send_all(baik, (struct stream *) arg);
+  baik_destroy(baik);
+  return NULL;
+}
+
+static double same_thread(enum kind kind) {
+  struct baik *baik = baik_create();
+  struct stream s = {baik_chan_create(CAPACITY), kind, CAPACITY};
+  baik_val_t v;
+  double t0 = host_now_ms();
+  int i, got = 0;
+
+  for (i = 0; i < MESSAGES / CAPACITY; i++) {
+    send_all(baik, &s);
+    while (baik_chan_recv(baik, s.ch, &v)) got++;
+    if (kind != NUMBER) baik_gc(baik, 0);
+  }
+  CHECK(got == MESSAGES / CAPACITY * CAPACITY);
+  baik_chan_destroy(s.ch);
+  baik_destroy(baik);
+  return host_now_ms() - t0;
+}
+
+static double two_threads(enum kind kind) {
+  struct baik *baik = baik_create();
+  struct stream s = {baik_chan_create(CAPACITY), kind, MESSAGES};
+  baik_val_t v;
+  pthread_t t;
+  double t0 = host_now_ms();
+  int got = 0;
+
+  pthread_create(&t, NULL, producer, &s);
+  while (got < MESSAGES) {
+    if (!baik_chan_recv(baik, s.ch, &v)) {
+      sched_yield();
+    } else if (++got % 4096 == 0 && kind != NUMBER) {
+      baik_gc(baik, 0);
+    }
+  }
+  pthread_join(t, NULL);
+  baik_chan_destroy(s.ch);
+  baik_destroy(baik);
+  return host_now_ms() - t0;
+}
+
+int main(void) {
+  int k;
+  for (k = NUMBER; k <= OBJECT; k++) {
+    double one = same_thread((enum kind) k);
+    double two = two_threads((enum kind) k);
+    printf("%-6s: one thread %.2f M/s, two threads %.2f M/s\n",
+           s_kind_names[k], MESSAGES / one / 1000, MESSAGES / two / 1000);
+  }
+  return s_failed != 0;
+}
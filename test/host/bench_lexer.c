@@ -0,0 +1,63 @@
+/*
+ * Lexer: tokens per second of a pnext() loop over a large generated
+ * script, and the share of a whole compile of it that goes to lexing.
+ */
+#include "host.h"
+
+#define COPIES 20000
+#define RUNS 8
+
+static const char *s_chunk =
+    "// hitung rata-rata bacaan yang masuk akal\n"
+    "fungsi rata%d(data, batas) {\n"
+    "  isi jumlah = 0, n = 0;\n"
+    "  untuk (isi i = 0; i < data.panjang; i++) {\n"
+    "    jika (data[i] >= batas.bawah && data[i] <= batas.atas) {\n"
+    "      jumlah += data[i]; n++;\n"
+    "    } lainnya jika (data[i] === kosong) { teruskan; }\n"
+    "  }\n"
+    "  balik n > 0 ? jumlah / n : takterdefinisi; /* %d */\n"
+    "}\n"
+    "isi hasil%d = rata%d([21.5, 0x16, 23.25e0, 'x'], {bawah: 0, atas: 40});\n";
+
+int main(void) {
+  struct mbuf m;
+  struct baik *baik = baik_create();
+  struct baik_code *code;
+  double best = 1e9, t0, parse_ms;
+  long tokens = 0;
+  char s[1024];
+  int i;
+
+  mbuf_init(&m, 0);
+  for (i = 0; i < COPIES; i++) {
+    snprintf(s, sizeof(s), s_chunk, i, i, i, i);
+    mbuf_append(&m, s, strlen(s));
+  }
+  mbuf_append(&m, "", 1);
+
+  for (i = 0; i < RUNS; i++) {
+    struct pstate p;
+    double t;
+    tokens = 0;
+    t0 = host_now_ms();
+    pinit("bench", m.buf, &p);
+    while (pnext(&p) != TOK_EOF) tokens++;
+    t = host_now_ms() - t0;
+    if (t < best) best = t;
+    CHECK(p.line_no == COPIES * 11 + 1);
+  }
+
+  t0 = host_now_ms();
+  CHECK(baik_compile(baik, "bench", m.buf, &code) == BAIK_OK);
+  parse_ms = host_now_ms() - t0;
+  baik_code_unref(code);
+
+  printf("%ld tokens in %.1f MB: %.1f ms, %.1f Mtok/s\n", tokens,
+         m.len / 1e6, best, tokens / best / 1e3);
+  printf("whole compile: %.1f ms, lexing is %.0f%% of it\n", parse_ms,
+         best * 100 / parse_ms);
+  mbuf_free(&m);
+  baik_destroy(baik);
+  return s_failed != 0;
+}
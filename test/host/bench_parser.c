@@ -0,0 +1,101 @@
+/*
+ * Parser: compile throughput of expression-heavy scripts, one of random
+ * expressions mixing every precedence level and one of long same-level
+ * chains.
+ */
+#include "host.h"
+
+#define RUNS 8
+
+static const char *s_ops[] = {"*",  "/",  "%",  "+",   "-",  "<<", ">>",
+                              ">>>", "<", "<=", ">",   ">=", "===", "!==",
+                              "&",  "^",  "|",  "&&",  "||"};
+static const char *s_atoms[] = {"a", "b.x", "f(1)", "7", "2.5", "'s'",
+                                "c[2]", "-d", "!e"};
+
+static unsigned long s_seed = 42;
+
+static int rnd(int n) {
+  s_seed = s_seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (int) ((s_seed >> 33) % (unsigned long) n);
+}
+
+static void gen_expr(struct mbuf *m, int depth) {
+  const char *s;
+  if (depth == 0 || rnd(4) == 0) {
+    s = s_atoms[rnd(ARRAY_SIZE(s_atoms))];
+    mbuf_append(m, s, strlen(s));
+  } else if (rnd(6) == 0) {
+    mbuf_append(m, "(", 1);
+    gen_expr(m, depth - 1);
+    mbuf_append(m, " ? ", 3);
+    gen_expr(m, depth - 1);
+    mbuf_append(m, " : ", 3);
+    gen_expr(m, depth - 1);
+    mbuf_append(m, ")", 1);
+  } else {
+    int paren = rnd(3) == 0;
+    if (paren) mbuf_append(m, "(", 1);
+    gen_expr(m, depth - 1);
+    s = s_ops[rnd(ARRAY_SIZE(s_ops))];
+    mbuf_append(m, " ", 1);
+    mbuf_append(m, s, strlen(s));
+    mbuf_append(m, " ", 1);
+    gen_expr(m, depth - 1);
+    if (paren) mbuf_append(m, ")", 1);
+  }
+}
+
+static void gen_random(struct mbuf *m, size_t size) {
+  char s[32];
+  int i;
+  for (i = 0; m->len < size; i++) {
+    snprintf(s, sizeof(s), "isi e%d = ", i);
+    mbuf_append(m, s, strlen(s));
+    gen_expr(m, 7);
+    mbuf_append(m, ";\n", 2);
+  }
+}
+
+static void gen_chains(struct mbuf *m, size_t size) {
+  char s[32];
+  int i, k;
+  for (i = 0; m->len < size; i++) {
+    snprintf(s, sizeof(s), "isi s%d = a", i);
+    mbuf_append(m, s, strlen(s));
+    for (k = 0; k < 100; k++) mbuf_append(m, k % 2 ? " + b" : " - 3", 4);
+    mbuf_append(m, ";\n", 2);
+  }
+}
+
+static void report(const char *what, struct mbuf *m) {
+  struct baik *baik = baik_create();
+  double best = 1e9;
+  int i;
+
+  mbuf_append(m, "", 1);
+  for (i = 0; i < RUNS; i++) {
+    struct baik_code *code;
+    double t0 = host_now_ms(), t;
+    CHECK(baik_compile(baik, "bench", m->buf, &code) == BAIK_OK);
+    t = host_now_ms() - t0;
+    if (t < best) best = t;
+    baik_code_unref(code);
+  }
+  printf("%-22s %5.1f MB %7.1f ms %6.1f MB/s\n", what, m->len / 1e6, best,
+         m->len / 1e3 / best);
+  baik_destroy(baik);
+  mbuf_free(m);
+}
+
+int main(void) {
+  struct mbuf m;
+
+  mbuf_init(&m, 0);
+  gen_random(&m, 2000000);
+  report("random expressions", &m);
+  mbuf_init(&m, 0);
+  gen_chains(&m, 2000000);
+  report("100-term chains", &m);
+  return s_failed != 0;
+}
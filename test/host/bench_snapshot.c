@@ -0,0 +1,62 @@
+/*
+ * Snapshots: boot time of an instance set up by running its script from
+ * source, against one loaded from the snapshot of the same set-up.
+ */
+#include "host.h"
+
+#define OBJECTS 300
+#define BOOTS 50
+
+static char *setup_script(void) {
+  size_t size = OBJECTS * 160 + 256, n = 0;
+  char *src = (char *) malloc(size);
+  int i;
+
+  n += snprintf(src + n, size - n, "isi alat = [];");
+  for (i = 0; i < OBJECTS; i++) {
+    n += snprintf(src + n, size - n,
+                  "fungsi baca%d(x) { balik x * %d + 1; }"
+                  "alat.push({id: %d, nama: 'sensor %d', baca: baca%d,"
+                  " batas: [%d, %d]});",
+                  i, i, i, i, i, i, i + 10);
+  }
+  return src;
+}
+
+int main(void) {
+  char *src = setup_script(), *img;
+  double t0, from_source, from_image;
+  size_t len;
+  int i;
+
+  t0 = host_now_ms();
+  for (i = 0; i < BOOTS; i++) {
+    struct baik *baik = baik_create();
+    host_eval(baik, src);
+    if (i == BOOTS - 1) {
+      CHECK(baik_snapshot_save_buf(baik, &img, &len) == BAIK_OK);
+    }
+    baik_destroy(baik);
+  }
+  from_source = (host_now_ms() - t0) / BOOTS;
+
+  t0 = host_now_ms();
+  for (i = 0; i < BOOTS; i++) {
+    struct baik *baik = baik_create();
+    CHECK(baik_snapshot_load_buf(baik, img, len) == BAIK_OK);
+    if (i == BOOTS - 1) {
+      CHECK(host_eval(baik, "alat[299].baca(2) + alat.panjang;") == 899);
+    }
+    baik_destroy(baik);
+  }
+  from_image = (host_now_ms() - t0) / BOOTS;
+
+  printf("%d objects, script %lu bytes, image %lu bytes\n", OBJECTS,
+         (unsigned long) strlen(src), (unsigned long) len);
+  printf("boot from source: %.3f ms\n", from_source);
+  printf("boot from image:  %.3f ms (%.1fx)\n", from_image,
+         from_source / from_image);
+  free(src);
+  free(img);
+  return s_failed != 0;
+}
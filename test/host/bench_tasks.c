@@ -0,0 +1,48 @@
+/*
+ * Cooperative tasks: 100 tasks each yield 1000 times. The same script with
+ * the yield swapped for a call to another builtin gives the cost of the
+ * loop itself, so the difference is what the switches cost.
+ */
+#include "host.h"
+
+#define TASKS 100
+#define YIELDS 1000
+
+static const char *s_script =
+    "isi n = 0;"
+    "fungsi kerja() {"
+    "  isi k = 0;"
+    "  ulang (k < %d) { k++; n++; w(0); }"
+    "}"
+    "untuk (isi j = 0; j < %d; j++) tugas(kerja);";
+
+/* Milliseconds to run every task to the end, `w` being `yield` */
+static double run(const char *yield, long *polls) {
+  struct baik *baik = baik_create();
+  char src[512], w[64];
+  double t0, ms;
+
+  snprintf(w, sizeof(w), "isi w = %s;", yield);
+  host_eval(baik, w);
+  snprintf(src, sizeof(src), s_script, YIELDS, TASKS);
+  host_eval(baik, src);
+  t0 = host_now_ms();
+  *polls = host_drain(baik);
+  ms = host_now_ms() - t0;
+  CHECK(host_eval(baik, "n;") == TASKS * YIELDS);
+  baik_destroy(baik);
+  return ms;
+}
+
+int main(void) {
+  long polls, polls_base;
+  double ms = run("tunggu", &polls);
+  double base = run("isNaN", &polls_base);
+  double switches = (double) TASKS * YIELDS;
+
+  printf("%d tasks x %d yields: %.1f ms in %ld polls\n", TASKS, YIELDS, ms,
+         polls);
+  printf("same loop without yielding: %.1f ms\n", base);
+  printf("per switch: %.0f ns\n", (ms - base) * 1e6 / switches);
+  return s_failed != 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Shared bits of the Linux host tests and benchmarks. Every program pulls
+ * in the whole interpreter, so it can look at internals and any BAIK_*
+ * tunable given in CFLAGS applies to it.
+ */
+#ifndef BAIK_TEST_HOST_H_
+#define BAIK_TEST_HOST_H_
+
+#include "../../src/baik.c"
+
+static int s_failed;
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,  \
+              #cond);                                                   \
+      s_failed++;                                                       \
+    }                                                                   \
+  } while (0)
+
+static double host_now_ms(void) {
+  return baik_uptime_us() / 1000.0;
+}
+
+/* Runs `src`, returning its value as a number; NaN if it failed */
+static double host_eval(struct baik *baik, const char *src) {
+  baik_val_t res = BAIK_UNDEFINED;
+  baik_err_t err = baik_exec(baik, src, &res);
+  if (err != BAIK_OK) {
+    fprintf(stderr, "error in \"%s\": %s\n", src, baik_strerror(baik, err));
+    return NAN;
+  }
+  return baik_get_double(baik, res);
+}
+
+/* Runs timers, events and tasks until there are none left */
+static long host_drain(struct baik *baik) {
+  long polls = 0;
+  while (baik_events_pending(baik)) {
+    unsigned long wait_ms;
+    baik_poll(baik, &wait_ms);
+    if (baik_events_pending(baik) && wait_ms > 0) baik_sleep_ms(wait_ms);
+    polls++;
+  }
+  return polls;
+}
+
+static int host_done(const char *name) {
+  printf("%s: %s\n", name, s_failed ? "FAILED" : "ok");
+  return s_failed != 0;
+}
+
+#endif
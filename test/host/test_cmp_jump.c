@@ -0,0 +1,224 @@
+/*
+ * Fused compare-and-branch: a condition ending in a comparison jumps the
+ * way the comparison and OP_JMP_FALSE would. NaN compares false, strings
+ * and other non-numbers read as NaN except to === and !==, and a condition
+ * built with ?:, && or || is fused only where no jump lands after its
+ * comparison.
+ */
+static int s_cmp_jump = 1;
+#define BAIK_ENABLE_CMP_JUMP s_cmp_jump
+#include "host.h"
+
+/* Fused jumps in the code of a compiled part */
+static int count_fused(const struct baik_code *code) {
+  const uint8_t *c = (const uint8_t *) code->p;
+  baik_header_item_t start, end;
+  int i, n = 0;
+  memcpy(&start, c + 1 + sizeof(start) * BAIK_HDR_ITEM_BCODE_OFFSET,
+         sizeof(start));
+  memcpy(&end, c + 1 + sizeof(end) * BAIK_HDR_ITEM_MAP_OFFSET, sizeof(end));
+  for (i = start; i < (int) end; i += bcode_insn_len(c, i)) {
+    n += c[i] >= OP_JMP_FALSE_LT && c[i] <= OP_JMP_FALSE_NE;
+  }
+  return n;
+}
+
+/* What running src gives, as text, and how many of its jumps were fused */
+static void run(const char *src, int fuse, struct mbuf *out, int *fused) {
+  struct baik *baik = baik_create();
+  struct baik_code *code;
+  baik_val_t v = BAIK_UNDEFINED;
+  baik_err_t err;
+  const char *s;
+  size_t len;
+
+  out->len = 0;
+  *fused = 0;
+  s_cmp_jump = fuse;
+  err = baik_compile(baik, "t", src, &code);
+  s_cmp_jump = 1;
+  if (err == BAIK_OK) {
+    *fused = count_fused(code);
+    err = baik_exec_code(baik, code, &v);
+    baik_code_unref(code);
+  }
+  if (err != BAIK_OK) {
+    s = baik->error_msg != NULL ? baik->error_msg : "";
+    mbuf_append(out, "galat ", 6);
+    mbuf_append(out, s, strlen(s));
+  } else if ((s = baik_get_string(baik, &v, &len)) != NULL) {
+    mbuf_append(out, s, len);
+  } else {
+    s = baik_typeof(v);
+    mbuf_append(out, s, strlen(s));
+  }
+  mbuf_append(out, "", 1);
+  baik_destroy(baik);
+}
+
+/*
+ * Runs src fused and not and wants the same outcome, equal to `want`, with
+ * `fused` of its conditions compiled to a fused jump.
+ */
+static void same(const char *src, const char *want, int fused) {
+  struct mbuf a, b;
+  int fa, fb;
+  mbuf_init(&a, 0);
+  mbuf_init(&b, 0);
+  run(src, 1, &a, &fa);
+  run(src, 0, &b, &fb);
+  if (strcmp(a.buf, b.buf) != 0 || strcmp(a.buf, want) != 0) {
+    printf("%s\n  fused: %s\n  not:   %s\n  want:  %s\n", src, a.buf, b.buf,
+           want);
+    s_failed++;
+  }
+  if (fa != fused || fb != 0) {
+    printf("%s\n  %d fused jumps, want %d\n", src, fa, fused);
+    s_failed++;
+  }
+  mbuf_free(&a);
+  mbuf_free(&b);
+}
+
+/*
+ * Every comparison between `a` and `b`, as a jika, a ?: and an ulang;
+ * `want` has a 1 for each operator, in order, that holds.
+ */
+static void all_ops(const char *a, const char *b, const char *want) {
+  static const char *ops[] = {"<", ">", "<=", ">=", "===", "!=="};
+  char src[512], w[8];
+  size_t i;
+  int holds;
+  for (i = 0; i < ARRAY_SIZE(ops); i++) {
+    snprintf(src, sizeof(src),
+             "isi a = %s, b = %s, r = '', n = 0;\n"
+             "jika (a %s b) { r = r + 'J'; } lainnya { r = r + 'j'; }\n"
+             "r = r + (a %s b ? 'T' : 't');\n"
+             "ulang (a %s b) { n++; jika (n === 2) berhenti; }\n"
+             "r + JSON.stringify(n);",
+             a, b, ops[i], ops[i], ops[i]);
+    holds = want[i] == '1';
+    snprintf(w, sizeof(w), "%s%s%d", holds ? "J" : "j", holds ? "T" : "t",
+             holds ? 2 : 0);
+    same(src, w, 4);
+  }
+}
+
+static void test_nan(void) {
+  all_ops("0 / 0", "1", "000001");
+  all_ops("1", "0 / 0", "000001");
+  all_ops("0 / 0", "0 / 0", "000001");
+  /* === on numbers compares their bits, so -0 is not 0 */
+  all_ops("-0", "0", "001101");
+  /* Only the comparison jumps; a negated one is a plain condition */
+  same("isi a = 0 / 0;\njika (!(a < 1)) { 'ya'; } lainnya { 'tidak'; }",
+       "ya", 0);
+  same("isi a = 0 / 0, n = 0;\n"
+       "untuk (isi i = 0; i < a; i++) n++;\n"
+       "untuk (isi i = 0; !(i >= a) && i < 3; i++) n++;\n"
+       "JSON.stringify(n);",
+       "3", 1);
+}
+
+static void test_strings(void) {
+  /* As numbers strings are NaN, so only === and !== tell them apart */
+  all_ops("'a'", "'b'", "000001");
+  all_ops("'a'", "'a'", "000010");
+  all_ops("'1'", "1", "000001");
+  all_ops("'2'", "'10'", "000001");
+  all_ops("''", "0", "000001");
+  all_ops("'ab'", "'a' + 'b'", "000010");
+  same("isi s = 'x', n = 0;\n"
+       "ulang (s !== 'xxxx') { s = s + 'x'; n++; }\n"
+       "JSON.stringify(n);",
+       "3", 1);
+}
+
+static void test_mixed(void) {
+  all_ops("kosong", "takterdefinisi", "000001");
+  all_ops("kosong", "kosong", "000010");
+  all_ops("kosong", "0", "000001");
+  all_ops("takterdefinisi", "0", "000001");
+  all_ops("benar", "1", "000001");
+  all_ops("benar", "benar", "000010");
+  all_ops("[]", "[]", "000001");
+  all_ops("{}", "0", "000001");
+  same("isi o = {}, p = o;\n"
+       "jika (o === p) { 'sama'; } lainnya { 'beda'; }",
+       "sama", 1);
+  same("isi o = {a: 1};\n"
+       "jika (o.a === 1) { o.b = 2; }\n"
+       "jika (o.b > o.a) { 'lebih'; } lainnya { 'kurang'; }",
+       "lebih", 2);
+}
+
+static void test_ternary(void) {
+  /* Comparisons picked by ?: land on the jump's target; not fused */
+  same("isi x = 1, y = 2;\n"
+       "jika (x < y ? y < x : x < y) { 'ya'; } lainnya { 'tidak'; }",
+       "tidak", 1);
+  same("isi x = 1, y = 2;\n"
+       "jika (x > y ? benar : y === 2) { 'ya'; } lainnya { 'tidak'; }",
+       "ya", 1);
+  same("isi x = 0 / 0, y = 2;\n"
+       "jika (x < y ? salah : x >= y) { 'ya'; } lainnya { 'tidak'; }",
+       "tidak", 1);
+  /* Nested, each ?: fused */
+  same("isi x = 1, y = 2;\n"
+       "(x < y ? (y < x ? 'a' : 'b') : 'c') + (x === 1 ? 'd' : 'e');",
+       "bd", 3);
+  same("isi x = 1, y = 2;\n"
+       "jika ((x < y) ? 1 : 0) { 'ya'; } lainnya { 'tidak'; }",
+       "ya", 1);
+  /* A loop condition of ?: runs until its comparison fails */
+  same("isi i = 0, n = 0;\n"
+       "ulang (i < 5 ? i !== 3 : salah) { i++; n++; }\n"
+       "JSON.stringify(n);",
+       "3", 1);
+}
+
+static void test_logical(void) {
+  /* The && and || jumps land after the last comparison; not fused */
+  same("isi x = 1, y = 2;\n"
+       "jika (x < y && y < x) { 'ya'; } lainnya { 'tidak'; }",
+       "tidak", 0);
+  same("isi x = 1, y = 2;\n"
+       "jika (x > y || y > x) { 'ya'; } lainnya { 'tidak'; }",
+       "ya", 0);
+  same("isi x = 0 / 0, y = 2;\n"
+       "jika (x < y || x >= y) { 'ya'; } lainnya { 'tidak'; }",
+       "tidak", 0);
+  same("isi x = 1;\n"
+       "jika (salah || x === 1) { 'ya'; } lainnya { 'tidak'; }",
+       "ya", 0);
+  same("isi x = 1;\n"
+       "jika (benar && x !== 1) { 'ya'; } lainnya { 'tidak'; }",
+       "tidak", 0);
+  /* Parenthesised comparisons under && still leave the last one unfused */
+  same("isi x = 1, y = 2;\n"
+       "jika ((x < y) && (y === 2)) { 'ya'; } lainnya { 'tidak'; }",
+       "ya", 0);
+  /* && and || picking the condition of ?: */
+  same("isi x = 1, y = 2;\n"
+       "(x < y && y < 3 ? 'a' : 'b') + (x > y || y !== 2 ? 'c' : 'd');",
+       "ad", 0);
+  /* ... and ?: inside them, fused on its own */
+  same("isi x = 1, y = 2;\n"
+       "jika (x === 1 && (y < x ? salah : benar)) { 'ya'; } "
+       "lainnya { 'tidak'; }",
+       "ya", 1);
+  same("isi i = 0, s = 0;\n"
+       "ulang (i < 10 && s !== 6) { i++; s += i; }\n"
+       "untuk (isi k = 0; k < 2 || salah; k++) s += 100;\n"
+       "JSON.stringify(i) + ',' + JSON.stringify(s);",
+       "3,206", 0);
+}
+
+int main(void) {
+  test_nan();
+  test_strings();
+  test_mixed();
+  test_ternary();
+  test_logical();
+  return host_done("test_cmp_jump");
+}
@@ -0,0 +1,117 @@
+/*
+ * Shared code objects: one compiled baik_code runs in several instances,
+ * also at the same time, without being written to. Destroying one instance
+ * leaves the code, and the functions the others made from it, working.
+ */
+#include "host.h"
+
+#include <pthread.h>
+
+static const char s_src[] =
+    "fungsi jumlah(n) {"
+    "  isi s = 0, o = {a: 1};"
+    "  untuk (isi i = 0; i < n; i++) s += i + o.a;"
+    "  balik s;"
+    "}"
+    "fungsi pembuat() { balik fungsi(x) { balik x * 3; }; }"
+    "isi kali3 = pembuat();"
+    "jumlah(100);";
+
+static int refs(const struct baik_code *code) {
+  return __atomic_load_n(&code->refs, __ATOMIC_ACQUIRE);
+}
+
+static void test_destroy_one(void) {
+  struct baik *c = baik_create(), *a = baik_create(), *b = baik_create();
+  struct baik_code *code;
+  char *copy;
+  baik_val_t v;
+
+  CHECK(baik_compile(c, "<stdin>", s_src, &code) == BAIK_OK);
+  baik_destroy(c);
+  copy = malloc(code->len);
+  memcpy(copy, code->p, code->len);
+
+  CHECK(baik_exec_code(a, code, &v) == BAIK_OK &&
+        baik_get_double(a, v) == 5050);
+  CHECK(baik_exec_code(b, code, &v) == BAIK_OK &&
+        baik_get_double(b, v) == 5050);
+  CHECK(refs(code) == 3);
+  CHECK(host_eval(a, "jumlah(10) + kali3(2);") == 55 + 6);
+
+  /* b keeps using what it made from the code after a and the handle go */
+  baik_destroy(a);
+  CHECK(refs(code) == 2);
+  baik_code_unref(code);
+  CHECK(refs(code) == 1);
+  CHECK(host_eval(b, "jumlah(20) + kali3(5) + pembuat()(2);") ==
+        210 + 15 + 6);
+  CHECK(host_eval(b, "isi t = 0; untuk (isi i = 0; i < 50; i++) t += jumlah(3);"
+                     "t;") == 50 * 6);
+  /* Hot loops ran in both instances, yet the shared bytes never changed */
+  CHECK(memcmp(copy, code->p, code->len) == 0);
+  free(copy);
+  baik_destroy(b);
+}
+
+/* Once nothing in b points into the code, reclaim drops b's reference */
+static void test_reclaim(void) {
+  struct baik *b = baik_create();
+  struct baik_code *code;
+  char src[64];
+  int i;
+
+  CHECK(baik_compile(b, "<stdin>", s_src, &code) == BAIK_OK);
+  CHECK(baik_exec_code(b, code, NULL) == BAIK_OK);
+  CHECK(refs(code) == 2);
+  host_eval(b, "jumlah = kosong; pembuat = kosong; kali3 = kosong; 0;");
+  for (i = 0; i < 200 && refs(code) > 1; i++) {
+    snprintf(src, sizeof(src), "isi t = [%d, 2, 3]; t[0];", i);
+    CHECK(host_eval(b, src) == i);
+  }
+  CHECK(refs(code) == 1);
+  baik_destroy(b);
+  CHECK(refs(code) == 1);
+  baik_code_unref(code);
+}
+
+static void *run_code(void *arg) {
+  struct baik_code *code = (struct baik_code *) arg;
+  struct baik *baik = baik_create();
+  baik_val_t v;
+  long ok = 1;
+  int i;
+  for (i = 0; i < 20; i++) {
+    ok &= baik_exec_code(baik, code, &v) == BAIK_OK &&
+          baik_get_double(baik, v) == 5050;
+    ok &= host_eval(baik, "jumlah(30) + kali3(4);") == 465 + 12;
+  }
+  baik_destroy(baik);
+  return (void *) ok;
+}
+
+/* Instances on their own threads run the same code at once */
+static void test_threads(void) {
+  struct baik *c = baik_create();
+  struct baik_code *code;
+  pthread_t t[4];
+  void *ok;
+  int i;
+
+  CHECK(baik_compile(c, "t", s_src, &code) == BAIK_OK);
+  baik_destroy(c);
+  for (i = 0; i < 4; i++) pthread_create(&t[i], NULL, run_code, code);
+  for (i = 0; i < 4; i++) {
+    pthread_join(t[i], &ok);
+    CHECK(ok != NULL);
+  }
+  CHECK(refs(code) == 1);
+  baik_code_unref(code);
+}
+
+int main(void) {
+  test_destroy_one();
+  test_reclaim();
+  test_threads();
+  return host_done("test_code");
+}
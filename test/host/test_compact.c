@@ -0,0 +1,109 @@
+/*
+ * Compaction: gc(benar) copies what is alive into as few blocks as it
+ * takes and the values read back the same, also when it runs inside a
+ * for-in loop whose iterator points into the property heap.
+ */
+#define BAIK_GC_COMPACT 1
+#include "host.h"
+
+static size_t count_blocks(const struct gc_arena *a) {
+  struct gc_block *b;
+  size_t n = 0;
+  for (b = a->blocks; b != NULL; b = b->next) n++;
+  return n;
+}
+
+/* Cells in use: all of them minus the free list */
+static size_t count_used(const struct gc_arena *a) {
+  struct gc_block *b;
+  struct gc_cell *c;
+  size_t n = 0;
+  for (b = a->blocks; b != NULL; b = b->next) n += b->size;
+  for (c = a->free; c != NULL; c = NEXT_FREE(c)) n--;
+  return n;
+}
+
+/* After a compaction only the last block of an arena has room left */
+static int dense(const struct gc_arena *a) {
+  size_t inc = a->size_increment;
+  return count_blocks(a) == (count_used(a) + inc - 1) / inc;
+}
+
+static void test_values(void) {
+  struct baik *baik = baik_create();
+  size_t objs, props;
+  double sum = 0;
+  int i;
+
+  host_eval(baik,
+            "isi semua = [], simpan = [];"
+            "untuk (isi i = 0; i < 700; i++) {"
+            "  isi nama = 'b' + JSON.stringify(i);"
+            "  semua.push({n: i, nama: nama, anak: {x: i * 2}});"
+            "}"
+            "untuk (isi i = 0; i < 700; i += 7) simpan.push(semua[i]);"
+            "semua = kosong;");
+  for (i = 0; i < 700; i += 7) sum += i + i * 2;
+  objs = count_blocks(&baik->object_arena);
+  props = count_blocks(&baik->property_arena);
+
+  CHECK(host_eval(baik, "gc(benar); 0;") == 0);
+  CHECK(dense(&baik->object_arena));
+  CHECK(dense(&baik->property_arena));
+  CHECK(count_blocks(&baik->object_arena) < objs / 2);
+  CHECK(count_blocks(&baik->property_arena) < props / 2);
+
+  CHECK(host_eval(baik,
+                  "isi t = 0;"
+                  "untuk (isi k = 0; k < simpan.panjang; k++) {"
+                  "  t += simpan[k].n + simpan[k].anak.x;"
+                  "}"
+                  "t;") == sum);
+  CHECK(host_eval(baik, "simpan[3].nama === 'b21' ? 1 : 0;") == 1);
+  /* A second compaction of an already dense heap changes nothing */
+  objs = count_blocks(&baik->object_arena);
+  CHECK(host_eval(baik, "gc(benar); simpan[99].anak.x;") == 1386);
+  CHECK(count_blocks(&baik->object_arena) == objs);
+  baik_destroy(baik);
+}
+
+static void test_for_in(void) {
+  struct baik *baik = baik_create();
+
+  host_eval(baik,
+            "isi obj = {}, arr = [];"
+            "untuk (isi i = 0; i < 60; i++) {"
+            "  obj['k' + JSON.stringify(i)] = i;"
+            "  arr.push(i);"
+            "}"
+            "fungsi buang() {"
+            "  isi s = [];"
+            "  untuk (isi j = 0; j < 40; j++) s.push({j: j});"
+            "  gc(benar);"
+            "}");
+  CHECK(host_eval(baik,
+                  "isi jumlah = 0, n = 0;"
+                  "untuk (isi q in obj) { buang(); jumlah += obj[q]; n++; }"
+                  "jumlah * 100 + n;") == 1770 * 100 + 60);
+  CHECK(host_eval(baik,
+                  "isi jumlah = 0;"
+                  "untuk (isi q in arr) { buang(); jumlah += arr[q]; }"
+                  "jumlah;") == 1770);
+  /* Nested loops over the same object, each step compacting */
+  CHECK(host_eval(baik,
+                  "isi n = 0;"
+                  "untuk (isi a in obj) {"
+                  "  jika (obj[a] % 20 !== 0) teruskan;"
+                  "  untuk (isi b in obj) { gc(benar); n++; }"
+                  "}"
+                  "n;") == 3 * 60);
+  CHECK(dense(&baik->object_arena));
+  CHECK(dense(&baik->property_arena));
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_values();
+  test_for_in();
+  return host_done("test_compact");
+}
@@ -0,0 +1,154 @@
+/*
+ * Event loop: timers fire in deadline order, can be cancelled, periodic
+ * ones keep their period, and every event posted from other threads runs
+ * exactly once.
+ */
+#include "host.h"
+
+#include <pthread.h>
+
+#define PRODUCERS 4
+#define PER_PRODUCER 5000
+
+static struct baik *s_baik;
+static baik_val_t s_func;
+static int s_cb_runs;
+
+static void count_cb(struct baik *baik, void *user_data) {
+  (void) baik;
+  s_cb_runs += (int) (intptr_t) user_data;
+}
+
+static void *producer(void *arg) {
+  int i;
+  for (i = 0; i < PER_PRODUCER; i++) {
+    if (i & 1) {
+      baik_post(s_baik, s_func, baik_mk_number(NULL, i));
+    } else {
+      baik_post_cb(s_baik, count_cb, (void *) (intptr_t) 1);
+    }
+  }
+  return arg;
+}
+
+static void test_timer_order(void) {
+  struct baik *baik = baik_create();
+  host_eval(baik,
+            "isi urut = '';"
+            "setelah(30, fungsi() { urut = urut + 'c'; });"
+            "setelah(0, fungsi() { urut = urut + 'a'; });"
+            "setelah(15, fungsi() { urut = urut + 'b'; });"
+            "setelah(45, fungsi() { urut = urut + 'd'; });");
+  host_drain(baik);
+  CHECK(host_eval(baik, "urut === 'abcd' ? 1 : 0;") == 1);
+  baik_destroy(baik);
+}
+
+static void test_timer_cancel(void) {
+  struct baik *baik = baik_create();
+  host_eval(baik,
+            "isi jalan = 0, kali = 0;"
+            "isi t = setelah(10, fungsi() { jalan = 1; });"
+            "batalkan(t);"
+            "isi p = setiap(5, fungsi() { kali++; jika (kali === 3) batalkan(p); });");
+  host_drain(baik);
+  CHECK(host_eval(baik, "jalan;") == 0);
+  CHECK(host_eval(baik, "kali;") == 3);
+  CHECK(baik_events_pending(baik) == 0);
+  baik_destroy(baik);
+}
+
+/* Timers that fall due together fire in one poll, in deadline order */
+static void test_timer_batch(void) {
+  struct baik *baik = baik_create();
+  host_eval(baik,
+            "isi urut = '';"
+            "setelah(8, fungsi() { urut = urut + 'd'; });"
+            "setelah(2, fungsi() { urut = urut + 'a'; });"
+            "setelah(5, fungsi() { urut = urut + 'b'; });"
+            "setelah(5, fungsi() { urut = urut + 'c'; });");
+  baik_sleep_ms(30);
+  CHECK(baik_poll(baik, NULL) == 4);
+  CHECK(host_eval(baik, "urut === 'abcd' ? 1 : 0;") == 1);
+  baik_destroy(baik);
+}
+
+/* A callback cancels timers due in the same batch, later than itself */
+static void test_timer_batch_cancel(void) {
+  struct baik *baik = baik_create();
+  host_eval(baik,
+            "isi kali = 0, jalan = 0, batal = 0, p, t;"
+            "setelah(2, fungsi() {"
+            "  jika (batalkan(p)) { batal++; }"
+            "  jika (batalkan(t)) { batal++; }"
+            "});"
+            "p = setiap(5, fungsi() { kali++; });"
+            "t = setelah(5, fungsi() { jalan = 1; });");
+  baik_sleep_ms(30);
+  CHECK(baik_poll(baik, NULL) == 1);
+  CHECK(host_eval(baik, "batal;") == 2);
+  CHECK(baik_events_pending(baik) == 0);
+  baik_sleep_ms(30);
+  baik_poll(baik, NULL);
+  CHECK(host_eval(baik, "kali + jalan;") == 0);
+  baik_destroy(baik);
+}
+
+static void test_timer_period(void) {
+  struct baik *baik = baik_create();
+  double t0 = host_now_ms(), t;
+  host_eval(baik,
+            "isi kali = 0;"
+            "isi p = setiap(20, fungsi() { kali++; jika (kali === 5) batalkan(p); });");
+  host_drain(baik);
+  t = host_now_ms() - t0;
+  CHECK(host_eval(baik, "kali;") == 5);
+  /* Five periods, each at most a wheel tick late */
+  CHECK(t >= 100 && t < 100 + 5 * BAIK_TIMER_TICK_MS + 50);
+  baik_destroy(baik);
+}
+
+static void test_wait_ms(void) {
+  struct baik *baik = baik_create();
+  unsigned long wait_ms = 0;
+  host_eval(baik, "setelah(500, fungsi() {});");
+  baik_poll(baik, &wait_ms);
+  CHECK(wait_ms > 400 && wait_ms <= 500);
+  baik_destroy(baik);
+}
+
+static void test_post_threads(void) {
+  pthread_t t[PRODUCERS];
+  struct baik_event_stats st;
+  int i;
+
+  s_baik = baik_create();
+  s_cb_runs = 0;
+  host_eval(s_baik, "isi jml = 0; fungsi h(x) { jml = jml + 1; }");
+  baik_exec(s_baik, "h;", &s_func);
+  baik_own(s_baik, &s_func);
+  for (i = 0; i < PRODUCERS; i++) {
+    pthread_create(&t[i], NULL, producer, NULL);
+  }
+  for (i = 0; i < PRODUCERS; i++) {
+    pthread_join(t[i], NULL);
+  }
+  host_drain(s_baik);
+  CHECK(host_eval(s_baik, "jml;") == PRODUCERS * PER_PRODUCER / 2);
+  CHECK(s_cb_runs == PRODUCERS * PER_PRODUCER / 2);
+  baik_get_event_stats(s_baik, &st);
+  CHECK(st.events == PRODUCERS * PER_PRODUCER);
+  baik_disown(s_baik, &s_func);
+  baik_destroy(s_baik);
+}
+
+int main(void) {
+  test_timer_order();
+  test_timer_cancel();
+  test_timer_batch();
+  test_timer_batch_cancel();
+  test_timer_period();
+  test_wait_ms();
+  test_post_threads();
+  return host_done("test_events");
+}
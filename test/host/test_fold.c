@@ -0,0 +1,238 @@
+/*
+ * Constant folding: an expression of constants gives the same value, or
+ * the same error on the same line, whether the compiler folded it or left
+ * it to the operators at run time. That covers NaN and -0, strings that
+ * may only be joined with strings, and operands a jump lands between,
+ * which are never folded.
+ */
+static int s_fold = 1;
+#define BAIK_ENABLE_FOLD s_fold
+#include "host.h"
+
+/* Passed to same() when the whole expression should fold */
+#define FOLDS OP_NOP
+
+/*
+ * Instructions in the code of a compiled part, and how many of them are
+ * opcode `op`.
+ */
+static int count_insns(const struct baik_code *code, int op, int *nop) {
+  const uint8_t *c = (const uint8_t *) code->p;
+  baik_header_item_t start, end;
+  int i, n = 0;
+  memcpy(&start, c + 1 + sizeof(start) * BAIK_HDR_ITEM_BCODE_OFFSET,
+         sizeof(start));
+  memcpy(&end, c + 1 + sizeof(end) * BAIK_HDR_ITEM_MAP_OFFSET, sizeof(end));
+  *nop = 0;
+  for (i = start; i < (int) end; i += bcode_insn_len(c, i)) {
+    *nop += c[i] == op;
+    n++;
+  }
+  return n;
+}
+
+/* What running src gives, as text: every bit of a number, or the error */
+static void run(struct baik *baik, const char *src, int fold, struct mbuf *out,
+                int op, int *insns, int *nop) {
+  struct baik_code *code;
+  baik_val_t v = BAIK_UNDEFINED;
+  baik_err_t err;
+  char buf[64];
+  const char *s;
+  size_t len;
+
+  out->len = 0;
+  s_fold = fold;
+  err = baik_compile(baik, "t", src, &code);
+  s_fold = 1;
+  *insns = *nop = 0;
+  if (err == BAIK_OK) {
+    *insns = count_insns(code, op, nop);
+    err = baik_exec_code(baik, code, &v);
+    baik_code_unref(code);
+  }
+  if (err != BAIK_OK) {
+    snprintf(buf, sizeof(buf), "galat %d: ", (int) err);
+    mbuf_append(out, buf, strlen(buf));
+    s = baik->error_msg != NULL ? baik->error_msg : "";
+    mbuf_append(out, s, strlen(s));
+    s = baik->stack_trace != NULL ? baik->stack_trace : "";
+    mbuf_append(out, s, strlen(s));
+  } else if (baik_is_number(v)) {
+    snprintf(buf, sizeof(buf), "angka %a", baik_get_double(baik, v));
+    mbuf_append(out, buf, strlen(buf));
+  } else if (baik_is_string(v)) {
+    s = baik_get_string(baik, &v, &len);
+    mbuf_append(out, "teks ", 5);
+    mbuf_append(out, s, len);
+  } else {
+    s = baik_typeof(v);
+    mbuf_append(out, s, strlen(s));
+    if (baik_is_boolean(v)) {
+      mbuf_append(out, baik_get_bool(baik, v) ? " benar" : " salah", 6);
+    }
+  }
+}
+
+/*
+ * Runs src folded and unfolded and wants the same outcome, equal to `want`
+ * when given. Folding should leave fewer instructions, or with `keep` other
+ * than FOLDS, an operator `keep` that stays for run time.
+ */
+static void same(struct baik *baik, const char *src, const char *want,
+                 int keep) {
+  struct mbuf a, b;
+  int la, lb, ka, kb;
+  mbuf_init(&a, 0);
+  mbuf_init(&b, 0);
+  run(baik, src, 1, &a, keep, &la, &ka);
+  run(baik, src, 0, &b, keep, &lb, &kb);
+  mbuf_append(&a, "", 1);
+  mbuf_append(&b, "", 1);
+  if (strcmp(a.buf, b.buf) != 0 || (want != NULL && strcmp(a.buf, want) != 0)) {
+    printf("%s\n  folded:   %s\n  unfolded: %s\n", src, a.buf, b.buf);
+    s_failed++;
+  }
+  if (keep == FOLDS ? la >= lb : ka == 0) {
+    printf("%s\n  %s: %d instructions folded, %d not\n", src,
+           keep == FOLDS ? "not folded" : "folded", la, lb);
+    s_failed++;
+  }
+  mbuf_free(&a);
+  mbuf_free(&b);
+}
+
+static void test_nan(void) {
+  struct baik *baik = baik_create();
+  same(baik, "0 / 0;", NULL, FOLDS);
+  same(baik, "0 / 0 + 1;", NULL, FOLDS);
+  same(baik, "-(0 / 0);", NULL, FOLDS);
+  same(baik, "(0 / 0) * 0;", NULL, FOLDS);
+  same(baik, "(0 / 0) % 2;", NULL, FOLDS);
+  same(baik, "5 % 0;", NULL, FOLDS);
+  same(baik, "(0 / 0) | 0;", NULL, FOLDS);
+  same(baik, "(0 / 0) >> 1;", NULL, FOLDS);
+  same(baik, "(0 / 0) < 1;", "boolean salah", FOLDS);
+  same(baik, "(0 / 0) >= (0 / 0);", "boolean salah", FOLDS);
+  same(baik, "(0 / 0) === (0 / 0);", NULL, FOLDS);
+  same(baik, "(0 / 0) !== (0 / 0);", NULL, FOLDS);
+  same(baik, "!(0 / 0);", "boolean benar", FOLDS);
+  same(baik, "tipe (0 / 0);", NULL, FOLDS);
+  /* ~NaN converts NaN to an integer, so it stays for run time */
+  same(baik, "~(0 / 0);", NULL, OP_BIT_NOT);
+  same(baik, "1 / 0 - 1 / 0;", NULL, FOLDS);
+  same(baik, "1e308 * 10 === 1e308 * 100;", "boolean benar", FOLDS);
+  baik_destroy(baik);
+}
+
+static void test_negative_zero(void) {
+  struct baik *baik = baik_create();
+  same(baik, "-0;", "angka -0x0p+0", FOLDS);
+  same(baik, "1 / -0;", NULL, FOLDS);
+  same(baik, "-(-0);", "angka 0x0p+0", FOLDS);
+  same(baik, "0 * -1;", "angka -0x0p+0", FOLDS);
+  same(baik, "-0 + 0;", "angka 0x0p+0", FOLDS);
+  same(baik, "-0 - 0;", "angka -0x0p+0", FOLDS);
+  same(baik, "-0 * -0;", "angka 0x0p+0", FOLDS);
+  same(baik, "-5 % 5;", NULL, FOLDS);
+  same(baik, "1 / (-5 % 5);", NULL, FOLDS);
+  same(baik, "-0 | 0;", NULL, FOLDS);
+  same(baik, "-0 === 0;", NULL, FOLDS);
+  same(baik, "-0 < 0;", "boolean salah", FOLDS);
+  same(baik, "!-0;", "boolean benar", FOLDS);
+  same(baik, "tipe -0;", NULL, FOLDS);
+  baik_destroy(baik);
+}
+
+static void test_strings(void) {
+  struct baik *baik = baik_create();
+  char src[600];
+  int i;
+
+  same(baik, "'pre' + 'fix';", "teks prefix", FOLDS);
+  same(baik, "'' + '';", "teks ", FOLDS);
+  same(baik, "'a' + 'b' + 'c' + '';", "teks abc", FOLDS);
+  same(baik, "'a' === 'a';", "boolean benar", FOLDS);
+  same(baik, "'a' !== 'a' + '';", "boolean salah", FOLDS);
+  same(baik, "'1' === 1;", "boolean salah", FOLDS);
+  same(baik, "!'';", "boolean benar", FOLDS);
+  same(baik, "!'x';", "boolean salah", FOLDS);
+  same(baik, "tipe 'x';", NULL, FOLDS);
+  same(baik, "tipe ('x' + 'y') === 'string';", NULL, FOLDS);
+  /* Only strings join; any other mix is the run time's error */
+  same(baik, "'a' + 1;", NULL, OP_ADD);
+  same(baik, "1 + 'a';", NULL, OP_ADD);
+  same(baik, "'a' + benar;", NULL, OP_ADD);
+  same(baik, "'a' + kosong;", NULL, OP_ADD);
+  same(baik, "'a' + takterdefinisi;", NULL, OP_ADD);
+  same(baik, "'a' - 'b';", NULL, OP_SUB);
+  same(baik, "'a' < 'b';", NULL, OP_LT);
+  same(baik, "-'a';", NULL, OP_NEG);
+  same(baik, "('a' + 'b') + 1;", NULL, OP_ADD);
+  /* Joined strings crossing the one-byte length of a push */
+  for (i = 0; i < 3; i++) {
+    int n = 60 + i * 8, k;
+    char *s = src;
+    s += sprintf(s, "'");
+    for (k = 0; k < n; k++) *s++ = 'a' + k % 26;
+    s += sprintf(s, "' + '");
+    for (k = 0; k < n; k++) *s++ = 'A' + k % 26;
+    s += sprintf(s, "' + 'z';");
+    same(baik, src, NULL, FOLDS);
+  }
+  baik_destroy(baik);
+}
+
+static void test_limits(void) {
+  struct baik *baik = baik_create();
+  /* Integer conversions with no defined result are not folded */
+  same(baik, "1 << 40;", NULL, OP_LSHIFT);
+  same(baik, "1 << 31;", NULL, FOLDS);
+  same(baik, "-1 >>> 0;", NULL, OP_URSHIFT);
+  same(baik, "4294967295 >>> 1;", NULL, FOLDS);
+  same(baik, "1e19 | 0;", NULL, OP_OR);
+  same(baik, "7 % 3000000000;", NULL, OP_REM);
+  same(baik, "~1e19;", NULL, OP_BIT_NOT);
+  same(baik, "~5;", "angka -0x1.8p+2", FOLDS);
+  /* A run of constants longer than the compiler keeps still folds */
+  same(baik, "1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9 + 10 + 11 + 12;", NULL, FOLDS);
+  same(baik, "1 - (2 - (3 - (4 - (5 - (6 - (7 - (8 - (9 - 10))))))));",
+       NULL, FOLDS);
+  same(baik, "60 * 60 * 1000;", "angka 0x1.b774p+21", FOLDS);
+  baik_destroy(baik);
+}
+
+static void test_jump_targets(void) {
+  struct baik *baik = baik_create();
+  /* A jump lands after the first operand: 1 + 3, never 2 + 3 */
+  same(baik, "(benar ? 1 : 2) + 3;", "angka 0x1p+2", OP_ADD);
+  same(baik, "(salah ? 1 : 2) * 3;", "angka 0x1.8p+2", OP_MUL);
+  same(baik, "(benar ? 'a' : 'b') + 'c';", "teks ac", OP_ADD);
+  same(baik, "(benar && 2) + 3;", "angka 0x1.4p+2", OP_ADD);
+  same(baik, "(salah || 4) - 1;", "angka 0x1.8p+1", OP_SUB);
+  same(baik, "-(benar ? 1 : 2);", "angka -0x1p+0", OP_NEG);
+  same(baik, "!(salah ? 0 : 1);", "boolean salah", OP_NOT);
+  /* Inside the branches and after the join, folding goes on */
+  same(baik, "benar ? 2 * 3 : 4 * 5;", "angka 0x1.8p+2", FOLDS);
+  same(baik, "(benar ? 1 : 2) + (3 + 4);", "angka 0x1p+3", FOLDS);
+  baik_destroy(baik);
+}
+
+/* Errors after folded operands point at the same line */
+static void test_lines(void) {
+  struct baik *baik = baik_create();
+  same(baik, "isi q = 1 +\n 2 *\n 3;\nq.x.y;", NULL, FOLDS);
+  same(baik, "isi s = 'a' +\n'b';\n\ns + 1;", NULL, FOLDS);
+  same(baik, "isi n = -\n0;\n(60 * 60) +\n'x';", NULL, FOLDS);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_nan();
+  test_negative_zero();
+  test_strings();
+  test_limits();
+  test_jump_targets();
+  test_lines();
+  return host_done("test_fold");
+}
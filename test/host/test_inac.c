@@ -0,0 +1,92 @@
+/*
+ * Old .inac images: those in inac/ were compiled from the .ina next to
+ * them by the compiler from before operators had opcodes of their own, so
+ * every operator is an OP_EXPR and every fraction a decimal OP_PUSH_DBL.
+ * They must still give what the source gives today, also once a snapshot
+ * has made their code writable and quickening may rewrite it.
+ */
+#include "host.h"
+
+static const char *s_images[] = {"umum", "fungsi"};
+
+/* The script's result, a string, or its error */
+static char *result(struct baik *baik, baik_err_t err, baik_val_t v) {
+  const char *s;
+  size_t len;
+  char *r;
+  if (err != BAIK_OK) return strdup(baik_strerror(baik, err));
+  s = baik_get_string(baik, &v, &len);
+  r = (char *) malloc(len + 1);
+  memcpy(r, s, len);
+  r[len] = '\0';
+  return r;
+}
+
+static char *read_file(const char *name, const char *ext, size_t *size) {
+  char path[64];
+  snprintf(path, sizeof(path), "inac/%s%s", name, ext);
+  return BAIK_EM_read_file(path, size);
+}
+
+static void test_image(const char *name) {
+  struct baik *old = baik_create(), *now = baik_create();
+  size_t size;
+  char *src = read_file(name, ".ina", &size);
+  char *img = read_file(name, ".inac", &size);
+  struct baik_code *code = baik_code_from_rom(img, size), *fresh;
+  char *want, *got;
+  baik_err_t err;
+  baik_val_t v;
+
+  CHECK(src != NULL && code != NULL);
+  err = baik_exec(now, src, &v);
+  want = result(now, err, v);
+  err = baik_exec_code(old, code, &v);
+  got = result(old, err, v);
+  if (strcmp(want, got) != 0) {
+    printf("%s.inac gives\n  %s\nwant\n  %s\n", name, got, want);
+    s_failed++;
+  }
+  /* Today's compiler does not write the same image */
+  CHECK(baik_compile(now, "x", src, &fresh) == BAIK_OK);
+  CHECK(fresh->len != size || memcmp(fresh->p, img, size) != 0);
+
+  baik_code_unref(fresh);
+  baik_code_unref(code);
+  baik_destroy(old);
+  baik_destroy(now);
+  free(want);
+  free(got);
+  free(src);
+  free(img);
+}
+
+static void test_snapshot(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  size_t size, len;
+  char *img = read_file("fungsi", ".inac", &size), *snap;
+  struct baik_code *code = baik_code_from_rom(img, size);
+  baik_val_t v;
+  int i;
+
+  CHECK(baik_exec_code(a, code, &v) == BAIK_OK);
+  CHECK(baik_snapshot_save_buf(a, &snap, &len) == BAIK_OK);
+  CHECK(baik_snapshot_load_buf(b, snap, len) == BAIK_OK);
+  /* Runs enough times for every operator to be quickened if it could be */
+  for (i = 0; i < 4; i++) {
+    CHECK(host_eval(b, "hitung(4, 2) + alat.skala(3);") == 14 + 6.5);
+  }
+
+  free(snap);
+  baik_destroy(a);
+  baik_destroy(b);
+  baik_code_unref(code);
+  free(img);
+}
+
+int main(void) {
+  size_t i;
+  for (i = 0; i < ARRAY_SIZE(s_images); i++) test_image(s_images[i]);
+  test_snapshot();
+  return host_done("test_inac");
+}
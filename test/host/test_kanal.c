@@ -0,0 +1,171 @@
+/*
+ * Channels: a full channel refuses values and an empty one has none to
+ * give, values arrive intact and in order, also across threads and
+ * through kanal.kirim/kanal.terima. A value with no encoding is refused
+ * as an error, not as a full channel.
+ */
+#include "host.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#define STREAM 100000
+
+static void test_full_empty(void) {
+  struct baik *baik = baik_create();
+  struct baik_chan *ch = baik_chan_create(6); /* rounded up to 8 */
+  baik_val_t v;
+  int i, round;
+
+  CHECK(baik_chan_recv(baik, ch, &v) == 0);
+  /* Enough rounds for the indices to wrap the ring many times */
+  for (round = 0; round < 100; round++) {
+    for (i = 0; i < 8; i++) {
+      CHECK(baik_chan_send(baik, ch, baik_mk_number(baik, round * 8 + i)));
+    }
+    CHECK(baik_chan_send(baik, ch, baik_mk_number(baik, -1)) == 0);
+    for (i = 0; i < 8; i++) {
+      CHECK(baik_chan_recv(baik, ch, &v) && baik_get_double(baik, v) == round * 8 + i);
+    }
+    CHECK(baik_chan_recv(baik, ch, &v) == 0);
+  }
+  /* Whatever is left in the ring is freed with it */
+  baik_chan_send(baik, ch, baik_mk_string(baik, "sisa pesan panjang", ~0, 1));
+  baik_chan_destroy(ch);
+  baik_destroy(baik);
+}
+
+static void test_values(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  struct baik_chan *ch = baik_chan_create(16);
+  const char bin[] = "ab\0cd\xff";
+  double nums[] = {0.1 + 0.2, -0.0, 1e308, -5e-324, 123456789012345.0};
+  baik_val_t v, obj;
+  size_t i, len;
+  const char *s;
+
+  for (i = 0; i < ARRAY_SIZE(nums); i++) {
+    baik_chan_send(a, ch, baik_mk_number(a, nums[i]));
+  }
+  baik_chan_send(a, ch, baik_mk_string(a, bin, sizeof(bin) - 1, 1));
+  baik_chan_send(a, ch, BAIK_UNDEFINED);
+  baik_exec(a, "({nama: 'sensor', nilai: [1, 2.5, 'tiga'], ok: benar});",
+            &obj);
+  baik_chan_send(a, ch, obj);
+
+  for (i = 0; i < ARRAY_SIZE(nums); i++) {
+    CHECK(baik_chan_recv(b, ch, &v) && baik_is_number(v));
+    CHECK(memcmp(&nums[i], &(double){baik_get_double(b, v)}, 8) == 0);
+  }
+  CHECK(baik_chan_recv(b, ch, &v) && baik_is_string(v));
+  s = baik_get_string(b, &v, &len);
+  CHECK(len == sizeof(bin) - 1 && memcmp(s, bin, len) == 0);
+  CHECK(baik_chan_recv(b, ch, &v) && baik_is_undefined(v));
+  CHECK(baik_chan_recv(b, ch, &v) && baik_is_object(v));
+  baik_set(b, baik_get_global(b), "o", ~0, v);
+  CHECK(host_eval(b, "o.nama === 'sensor' && o.nilai[1] === 2.5 && "
+                     "o.nilai[2] === 'tiga' && o.ok ? 1 : 0;") == 1);
+
+  baik_chan_destroy(ch);
+  baik_destroy(a);
+  baik_destroy(b);
+}
+
+static void test_script(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  struct baik_chan *ab = baik_chan_create(4), *ba = baik_chan_create(4);
+
+  baik_set_kanal(a, ab, ba);
+  baik_set_kanal(b, ba, ab);
+  CHECK(host_eval(a, "isi n = 0; ulang (kanal.kirim(n)) n++; n;") == 4);
+  CHECK(host_eval(b,
+                  "isi s = 0, v = kanal.terima();"
+                  "ulang (v !== takterdefinisi) {"
+                  "  s += v; kanal.kirim({v: v * 2}); v = kanal.terima();"
+                  "}"
+                  "s;") == 0 + 1 + 2 + 3);
+  CHECK(host_eval(a, "isi t = 0, v = kanal.terima();"
+                     "ulang (v !== takterdefinisi) { t += v.v; v = kanal.terima(); }"
+                     "t;") == 12);
+
+  baik_chan_destroy(ab);
+  baik_chan_destroy(ba);
+  baik_destroy(a);
+  baik_destroy(b);
+}
+
+static void test_unsendable(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  struct baik_chan *ch = baik_chan_create(4);
+  baik_val_t f, o, v;
+
+  baik_exec(a, "fungsi() { balik 1; };", &f);
+  CHECK(baik_chan_send(a, ch, f) == -1);
+  baik_exec(a, "isi o = {a: {b: 1}}; o.a.c = o; o;", &o);
+  CHECK(baik_chan_send(a, ch, o) == -1);
+  CHECK(baik_chan_recv(a, ch, &v) == 0);
+  /* The same object without the cycle goes through */
+  baik_exec(a, "o.a.c = 2; o;", &o);
+  CHECK(baik_chan_send(a, ch, o) == 1);
+  /* Objects met twice on different paths are not a cycle */
+  baik_exec(a, "isi p = {x: 1}; ({a: p, b: [p, p]});", &o);
+  CHECK(baik_chan_send(a, ch, o) == 1);
+
+  baik_set_kanal(b, ch, ch);
+  CHECK(host_eval(b, "kanal.terima().a.c;") == 2);
+  CHECK(host_eval(b, "isi m = kanal.terima(); m.b[1].x + m.a.x;") == 2);
+  CHECK(baik_exec(b, "kanal.kirim(fungsi() {});", &v) == BAIK_TYPE_ERROR);
+  CHECK(baik_exec(b, "isi d = {}; d.d = d; kanal.kirim(d);", &v) ==
+        BAIK_TYPE_ERROR);
+  /* Nothing was queued and the instance carries on */
+  CHECK(host_eval(b, "kanal.terima() === takterdefinisi ? 1 : 0;") == 1);
+  CHECK(host_eval(b, "kanal.kirim([1, 2]) ? kanal.terima()[1] : 0;") == 2);
+
+  baik_chan_destroy(ch);
+  baik_destroy(a);
+  baik_destroy(b);
+}
+
+static void *stream_send(void *arg) {
+  struct baik_chan *ch = (struct baik_chan *) arg;
+  struct baik *baik = baik_create();
+  int i;
+  for (i = 0; i < STREAM; i++) {
+    baik_val_t v = (i % 3 == 0) ? baik_mk_number(baik, i)
+                                : baik_mk_string(baik, "pesan", ~0, 1);
+    while (!baik_chan_send(baik, ch, v)) sched_yield();
+  }
+  baik_destroy(baik);
+  return NULL;
+}
+
+static void test_threads(void) {
+  struct baik *baik = baik_create();
+  struct baik_chan *ch = baik_chan_create(64);
+  pthread_t t;
+  int i, in_order = 1;
+
+  pthread_create(&t, NULL, stream_send, ch);
+  for (i = 0; i < STREAM; i++) {
+    baik_val_t v;
+    while (!baik_chan_recv(baik, ch, &v)) sched_yield();
+    if (i % 3 == 0) {
+      in_order &= baik_is_number(v) && baik_get_double(baik, v) == i;
+    } else {
+      in_order &= baik_is_string(v);
+    }
+  }
+  pthread_join(t, NULL);
+  CHECK(in_order);
+  baik_chan_destroy(ch);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_full_empty();
+  test_values();
+  test_script();
+  test_unsendable();
+  test_threads();
+  return host_done("test_kanal");
+}
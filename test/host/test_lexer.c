@@ -0,0 +1,135 @@
+/*
+ * Lexer: every keyword is found and nothing else is taken for one,
+ * punctuators take the longest match, and numbers, strings, comments and
+ * line numbers come out right.
+ */
+#include "host.h"
+
+/* Lexes src and compares the token kinds with want, ended by TOK_EOF */
+static int lexes_as(const char *src, const int *want) {
+  struct pstate p;
+  int i = 0, ok = 1;
+  pinit("test", src, &p);
+  do {
+    int tok = pnext(&p);
+    if (tok != want[i]) {
+      printf("\"%s\": token %d is %d, want %d\n", src, i, tok, want[i]);
+      ok = 0;
+      break;
+    }
+  } while (want[i++] != TOK_EOF);
+  mbuf_free(&p.offset_lineno_map);
+  mbuf_free(&p.relocs);
+  return ok;
+}
+
+static void test_keywords(void) {
+  static const struct {
+    const char *word;
+    int tok;
+  } kw[] = {
+      {"berhenti", TOK_KEYWORD_BERHENTI}, {"sama", TOK_KEYWORD_SAMA},
+      {"teruskan", TOK_KEYWORD_TERUSKAN}, {"standar", TOK_KEYWORD_STANDAR},
+      {"kerjakan", TOK_KEYWORD_KERJAKAN}, {"lainnya", TOK_KEYWORD_LAINNYA},
+      {"salah", TOK_KEYWORD_FALSE},       {"untuk", TOK_KEYWORD_UNTUK},
+      {"fungsi", TOK_KEYWORD_FUNGSI},     {"jika", TOK_KEYWORD_JIKA},
+      {"in", TOK_KEYWORD_IN},             {"kosong", TOK_KEYWORD_KOSONG},
+      {"balik", TOK_KEYWORD_BALIK},       {"pilih", TOK_KEYWORD_PILIH},
+      {"benar", TOK_KEYWORD_TRUE},        {"tipe", TOK_KEYWORD_TIPE},
+      {"ulang", TOK_KEYWORD_ULANG},       {"isi", TOK_KEYWORD_ISI},
+      {"takterdefinisi", TOK_KEYWORD_TAKTERDEFINISI},
+      {"catch", TOK_KEYWORD_CATCH},       {"debugger", TOK_KEYWORD_DEBUGGER},
+      {"delete", TOK_KEYWORD_DELETE},     {"finally", TOK_KEYWORD_FINALLY},
+      {"instanceof", TOK_KEYWORD_INSTANCEOF}, {"new", TOK_KEYWORD_NEW},
+      {"this", TOK_KEYWORD_THIS},         {"throw", TOK_KEYWORD_THROW},
+      {"try", TOK_KEYWORD_TRY},           {"var", TOK_KEYWORD_VAR},
+      {"void", TOK_KEYWORD_VOID},         {"with", TOK_KEYWORD_WITH},
+  };
+  /* Prefixes, extensions and other cases of keywords are identifiers */
+  static const char *idents[] = {"isian", "is",   "jik",   "Jika", "balikan",
+                                 "_isi",  "$isi", "isi2",  "untukmu",
+                                 "benarr", "tulis", "x"};
+  size_t i;
+
+  CHECK(ARRAY_SIZE(kw) == TOK_KEYWORD_TAKTERDEFINISI - TOK_KEYWORD_BERHENTI + 1);
+  for (i = 0; i < ARRAY_SIZE(kw); i++) {
+    int want[] = {kw[i].tok, TOK_EOF};
+    CHECK(lexes_as(kw[i].word, want));
+  }
+  for (i = 0; i < ARRAY_SIZE(idents); i++) {
+    int want[] = {TOK_IDENT, TOK_EOF};
+    CHECK(lexes_as(idents[i], want));
+  }
+}
+
+/* Each keyword sits where keyword_hash() looks for it, once */
+static void test_keyword_table(void) {
+  int seen[TOK_KEYWORD_TAKTERDEFINISI + 1] = {0};
+  size_t i, n = 0;
+  int tok;
+
+  for (i = 0; i < ARRAY_SIZE(s_keywords); i++) {
+    const struct baik_keyword *k = &s_keywords[i];
+    if (k->name == NULL) {
+      CHECK(k->len == 0 && k->tok == 0);
+      continue;
+    }
+    n++;
+    CHECK(k->len == (int) strlen(k->name));
+    CHECK(k->len >= KEYWORD_MIN_LEN && k->len <= KEYWORD_MAX_LEN);
+    CHECK(keyword_hash(k->name, k->len) == (int) i);
+    CHECK(k->tok >= TOK_KEYWORD_BERHENTI && k->tok <= TOK_KEYWORD_TAKTERDEFINISI);
+    CHECK(is_reserved_word_token(k->name, k->len) == k->tok - TOK_IDENT);
+    seen[k->tok]++;
+  }
+  CHECK(n == TOK_KEYWORD_TAKTERDEFINISI - TOK_KEYWORD_BERHENTI + 1);
+  for (tok = TOK_KEYWORD_BERHENTI; tok <= TOK_KEYWORD_TAKTERDEFINISI; tok++) {
+    CHECK(seen[tok] == 1);
+  }
+}
+
+static void test_punctuators(void) {
+  static const int want[] = {
+      TOK_URSHIFT_ASSIGN, TOK_URSHIFT,        TOK_RSHIFT_ASSIGN,
+      TOK_RSHIFT,         TOK_GE,             TOK_GT,
+      TOK_NE_NE,          TOK_NE,             TOK_NOT,
+      TOK_EQ_EQ,          TOK_EQ,             TOK_ASSIGN,
+      TOK_LSHIFT_ASSIGN,  TOK_LSHIFT,         TOK_LE,
+      TOK_LOGICAL_AND,    TOK_AND_ASSIGN,     TOK_AND,
+      TOK_PLUS_PLUS,      TOK_PLUS_ASSIGN,    TOK_MINUS_MINUS,
+      TOK_MINUS_ASSIGN,   TOK_LOGICAL_OR,     TOK_OR_ASSIGN,
+      TOK_XOR_ASSIGN,     TOK_REM_ASSIGN,     TOK_MUL_ASSIGN,
+      TOK_DIV_ASSIGN,     TOK_TILDA,          TOK_QUESTION,
+      TOK_EOF};
+  static const int glued[] = {TOK_NE_NE, TOK_EQ_EQ, TOK_PLUS_PLUS, TOK_PLUS,
+                              TOK_EOF};
+  CHECK(lexes_as(">>>= >>> >>= >> >= > !== != ! === == = <<= << <= "
+                 "&& &= & ++ += -- -= || |= ^= %= *= /= ~ ?",
+                 want));
+  CHECK(lexes_as("!=====+++", glued));
+}
+
+static void test_literals(void) {
+  static const int want[] = {TOK_NUM, TOK_NUM, TOK_NUM, TOK_STR, TOK_DOT,
+                             TOK_IDENT, TOK_EOF};
+  struct pstate p;
+
+  CHECK(lexes_as("12 0x1f 2.5e3 'a\\'b'.panjang", want));
+
+  pinit("test", "// satu\n  /* dua\n tiga */ 0x1f\n\n 2.5e3 \"x y\"", &p);
+  CHECK(pnext(&p) == TOK_NUM && p.tok.num == 31 && p.line_no == 3);
+  CHECK(pnext(&p) == TOK_NUM && p.tok.num == 2500 && p.line_no == 5);
+  CHECK(pnext(&p) == TOK_STR && p.tok.len == 3 &&
+        memcmp(p.tok.ptr, "x y", 3) == 0);
+  CHECK(pnext(&p) == TOK_EOF);
+  mbuf_free(&p.offset_lineno_map);
+  mbuf_free(&p.relocs);
+}
+
+int main(void) {
+  test_keywords();
+  test_keyword_table();
+  test_punctuators();
+  test_literals();
+  return host_done("test_lexer");
+}
@@ -0,0 +1,567 @@
+/*
+ * Parser: random expressions written with only the parentheses that
+ * precedence asks for compile to the same bytecode as when every operator
+ * is parenthesised, and evaluate to what C computes for the same tree.
+ * Long operator chains parse, and nesting too deep for the parser is an
+ * error rather than a crash. Random programs, broken ones too, and the
+ * scripts in the tree compile to the same bytecode, or the same error, as
+ * with the one-function-per-level parser it replaced.
+ */
+#define BAIK_PARSER_CHAIN 1
+#include "host.h"
+
+#define EXPRS 3000
+#define PROGRAMS 4000
+#define MAX_DEPTH 6
+#define SRC_SIZE 8192
+
+enum { E_LIT, E_VAR, E_NEG, E_NOT, E_BIN, E_COND };
+
+struct expr {
+  int kind;
+  int op; /* TOK_* of an E_BIN */
+  double num;
+  const char *name;
+  struct expr *a, *b, *c;
+};
+
+/*
+ * Operators on numbers, comparisons, then operators on benar/salah, with
+ * their precedence as the language defines it.
+ */
+static const struct {
+  int tok;
+  const char *text;
+  int prec;
+} s_ops[] = {
+    {TOK_MUL, "*", 10},         {TOK_DIV, "/", 10},
+    {TOK_REM, "%", 10},         {TOK_PLUS, "+", 9},
+    {TOK_MINUS, "-", 9},        {TOK_LSHIFT, "<<", 8},
+    {TOK_RSHIFT, ">>", 8},      {TOK_URSHIFT, ">>>", 8},
+    {TOK_AND, "&", 5},          {TOK_XOR, "^", 4},
+    {TOK_OR, "|", 3},           {TOK_LT, "<", 7},
+    {TOK_LE, "<=", 7},          {TOK_GT, ">", 7},
+    {TOK_GE, ">=", 7},          {TOK_EQ_EQ, "===", 6},
+    {TOK_NE_NE, "!==", 6},      {TOK_LOGICAL_AND, "&&", 2},
+    {TOK_LOGICAL_OR, "||", 1},
+};
+#define NUM_OPS 11
+#define CMP_OPS 6
+
+static const struct {
+  const char *name;
+  double num;
+} s_vars[] = {{"a", 7}, {"b", -3}, {"c", 0.5}};
+
+static unsigned long s_seed = 12345;
+
+static int rnd(int n) {
+  s_seed = s_seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (int) ((s_seed >> 33) % (unsigned long) n);
+}
+
+static struct expr *node(int kind) {
+  struct expr *e = (struct expr *) calloc(1, sizeof(*e));
+  e->kind = kind;
+  return e;
+}
+
+static void expr_free(struct expr *e) {
+  if (e == NULL) return;
+  expr_free(e->a);
+  expr_free(e->b);
+  expr_free(e->c);
+  free(e);
+}
+
+static int op_index(int tok) {
+  int i;
+  for (i = 0; s_ops[i].tok != tok; i++) {
+  }
+  return i;
+}
+
+static struct expr *gen_bool(int depth);
+
+/* An expression of numbers */
+static struct expr *gen_num(int depth) {
+  struct expr *e;
+  int r = depth <= 0 ? rnd(2) : rnd(10);
+  if (r == 0) {
+    static const double lits[] = {0, 1, 2, 3, 5, 9, 31, 100, 2.5, 0.125};
+    e = node(E_LIT);
+    e->num = lits[rnd(ARRAY_SIZE(lits))];
+  } else if (r == 1) {
+    int v = rnd(ARRAY_SIZE(s_vars));
+    e = node(E_VAR);
+    e->num = s_vars[v].num;
+    e->name = s_vars[v].name;
+  } else if (r == 2) {
+    e = node(E_NEG);
+    e->a = gen_num(depth - 1);
+  } else if (r == 3) {
+    e = node(E_COND);
+    e->a = gen_bool(depth - 1);
+    e->b = gen_num(depth - 1);
+    e->c = gen_num(depth - 1);
+  } else {
+    e = node(E_BIN);
+    e->op = s_ops[rnd(NUM_OPS)].tok;
+    e->a = gen_num(depth - 1);
+    e->b = gen_num(depth - 1);
+  }
+  return e;
+}
+
+/* An expression of benar/salah */
+static struct expr *gen_bool(int depth) {
+  struct expr *e;
+  int r = depth <= 0 ? 0 : rnd(5);
+  if (r <= 2) {
+    e = node(E_BIN);
+    e->op = s_ops[NUM_OPS + rnd(CMP_OPS)].tok;
+    e->a = gen_num(depth - 1);
+    e->b = gen_num(depth - 1);
+  } else if (r == 3) {
+    e = node(E_NOT);
+    e->a = gen_bool(depth - 1);
+  } else {
+    e = node(E_BIN);
+    e->op = s_ops[NUM_OPS + CMP_OPS + rnd(2)].tok;
+    e->a = gen_bool(depth - 1);
+    e->b = gen_bool(depth - 1);
+  }
+  return e;
+}
+
+/* Integer operands of %, shifts and bitwise operators that C can convert */
+static int fits(double d, double lo, double hi) {
+  return d >= lo && d < hi;
+}
+
+/*
+ * What the script should compute, with the interpreter's own arithmetic:
+ * dividing by zero gives NaN, and %, shifts and bitwise operators work on
+ * int64. benar/salah come out as 1/0. Sets *bad where the C conversions
+ * or shifts the interpreter uses would be undefined.
+ */
+static double eval(const struct expr *e, int *bad) {
+  double l, r;
+  switch (e->kind) {
+    case E_LIT:
+    case E_VAR:
+      return e->num;
+    case E_NEG:
+      return -eval(e->a, bad);
+    case E_NOT:
+      return !eval(e->a, bad);
+    case E_COND:
+      return eval(e->a, bad) ? eval(e->b, bad) : eval(e->c, bad);
+  }
+  l = eval(e->a, bad);
+  if (e->op == TOK_LOGICAL_AND) return l ? eval(e->b, bad) : 0;
+  if (e->op == TOK_LOGICAL_OR) return l ? 1 : eval(e->b, bad);
+  r = eval(e->b, bad);
+  switch (e->op) {
+    case TOK_LT: return l < r;
+    case TOK_LE: return l <= r;
+    case TOK_GT: return l > r;
+    case TOK_GE: return l >= r;
+    case TOK_EQ_EQ: return l == r;
+    case TOK_NE_NE: return l != r;
+  }
+  if (isnan(l) || isnan(r)) return NAN;
+  switch (e->op) {
+    case TOK_MUL: return l * r;
+    case TOK_DIV: return r != 0 ? l / r : NAN;
+    case TOK_PLUS: return l + r;
+    case TOK_MINUS: return l - r;
+  }
+  if (!fits(l, -9e15, 9e15) || !fits(r, -9e15, 9e15)) {
+    *bad = 1;
+    return 0;
+  }
+  switch (e->op) {
+    case TOK_REM:
+      *bad |= !fits(r, -2147483648.0, 2147483648.0);
+      if (*bad || (int) r == 0) return NAN;
+      return (l < 0 ? -1 : 1) *
+             (double) ((int64_t) fabs(l) % (int64_t) fabs((int) r));
+    case TOK_AND: return (double) ((int64_t) l & (int64_t) r);
+    case TOK_XOR: return (double) ((int64_t) l ^ (int64_t) r);
+    case TOK_OR: return (double) ((int64_t) l | (int64_t) r);
+    case TOK_LSHIFT:
+      *bad |= !fits(l, 0, 4294967296.0) || !fits(r, 0, 32);
+      return *bad ? 0 : (double) ((int64_t) l << (int64_t) r);
+    case TOK_RSHIFT:
+      *bad |= !fits(r, 0, 64);
+      return *bad ? 0 : (double) ((int64_t) l >> (int64_t) r);
+    default:
+      *bad |= !fits(l, 0, 4294967296.0) || !fits(r, 0, 32);
+      return *bad ? 0 : (double) ((uint32_t) l >> (uint32_t) r);
+  }
+}
+
+static int prec(const struct expr *e) {
+  switch (e->kind) {
+    case E_BIN:
+      return s_ops[op_index(e->op)].prec;
+    case E_COND:
+      return 0;
+    case E_NEG:
+    case E_NOT:
+      return 11;
+    default:
+      return 12;
+  }
+}
+
+static void put(char **out, const char *s) {
+  size_t n = strlen(s);
+  memcpy(*out, s, n);
+  *out += n;
+}
+
+/*
+ * Writes e out. With `full` every operator gets its parentheses, otherwise
+ * only where precedence needs them. && and || group to the right, like the
+ * parser does, everything else to the left.
+ */
+static void render(const struct expr *e, int full, char **out) {
+  char num[32];
+  int p = prec(e), right_group, pa, pb;
+  switch (e->kind) {
+    case E_LIT:
+      snprintf(num, sizeof(num), "%g", e->num);
+      put(out, num);
+      return;
+    case E_VAR:
+      put(out, e->name);
+      return;
+    case E_NEG:
+    case E_NOT:
+      put(out, e->kind == E_NEG ? "-" : "!");
+      pa = full ? e->a->kind >= E_NEG : prec(e->a) < p || e->a->kind == E_NEG;
+      if (pa) put(out, "(");
+      render(e->a, full, out);
+      if (pa) put(out, ")");
+      return;
+    case E_COND:
+      pa = full ? e->a->kind >= E_NEG : prec(e->a) < 1;
+      if (pa) put(out, "(");
+      render(e->a, full, out);
+      put(out, pa ? ") ? " : " ? ");
+      render(e->b, full, out);
+      put(out, " : ");
+      render(e->c, full, out);
+      return;
+  }
+  right_group = e->op == TOK_LOGICAL_AND || e->op == TOK_LOGICAL_OR;
+  if (full) {
+    pa = e->a->kind >= E_NEG;
+    pb = e->b->kind >= E_NEG;
+  } else {
+    pa = prec(e->a) < p || (prec(e->a) == p && right_group);
+    pb = prec(e->b) < p || (prec(e->b) == p && !right_group);
+  }
+  if (pa) put(out, "(");
+  render(e->a, full, out);
+  put(out, pa ? ") " : " ");
+  put(out, s_ops[op_index(e->op)].text);
+  put(out, pb ? " (" : " ");
+  render(e->b, full, out);
+  if (pb) put(out, ")");
+}
+
+static int same_code(struct baik *baik, const char *x, const char *y) {
+  struct baik_code *cx, *cy;
+  int same;
+  if (baik_compile(baik, "t", x, &cx) != BAIK_OK) return 0;
+  if (baik_compile(baik, "t", y, &cy) != BAIK_OK) {
+    baik_code_unref(cx);
+    return 0;
+  }
+  same = cx->len == cy->len && memcmp(cx->p, cy->p, cx->len) == 0;
+  baik_code_unref(cx);
+  baik_code_unref(cy);
+  return same;
+}
+
+static void test_random(void) {
+  struct baik *baik = baik_create();
+  char *min = (char *) malloc(SRC_SIZE), *full = (char *) malloc(SRC_SIZE);
+  int i, bad, code_diffs = 0, value_diffs = 0;
+
+  host_eval(baik, "isi a = 7, b = -3, c = 0.5;");
+  for (i = 0; i < EXPRS; i++) {
+    struct expr *e = gen_num(1 + rnd(MAX_DEPTH));
+    char *m = min, *f = full;
+    double want, got;
+    bad = 0;
+    want = eval(e, &bad);
+    if (bad) {
+      expr_free(e);
+      i--;
+      continue;
+    }
+    render(e, 0, &m);
+    render(e, 1, &f);
+    put(&m, ";");
+    put(&f, ";");
+    *m = *f = '\0';
+    if (!same_code(baik, min, full) && code_diffs++ < 3) {
+      printf("different code:\n  %s\n  %s\n", min, full);
+    }
+    got = host_eval(baik, min);
+    if (!(got == want || (isnan(got) && isnan(want))) && value_diffs++ < 3) {
+      printf("%s\n  is %.17g, want %.17g\n", min, got, want);
+    }
+    expr_free(e);
+  }
+  CHECK(code_diffs == 0);
+  CHECK(value_diffs == 0);
+  free(min);
+  free(full);
+  baik_destroy(baik);
+}
+
+/* Compiles src with the old parser or the new one, keeping code or error */
+static baik_err_t compile(struct baik *baik, const char *src, int chain,
+                          struct mbuf *out) {
+  struct baik_code *c;
+  baik_err_t err;
+  s_parser_chain = chain;
+  err = baik_compile(baik, "t", src, &c);
+  s_parser_chain = 0;
+  out->len = 0;
+  if (err == BAIK_OK) {
+    mbuf_append(out, c->p, c->len);
+    baik_code_unref(c);
+  } else {
+    const char *msg = baik->error_msg != NULL ? baik->error_msg : "";
+    mbuf_append(out, msg, strlen(msg));
+  }
+  return err;
+}
+
+static int same_as_chain(struct baik *baik, const char *src) {
+  struct mbuf a, b;
+  int same;
+  mbuf_init(&a, 0);
+  mbuf_init(&b, 0);
+  same = compile(baik, src, 1, &a) == compile(baik, src, 0, &b) &&
+         a.len == b.len && memcmp(a.buf, b.buf, a.len) == 0;
+  mbuf_free(&a);
+  mbuf_free(&b);
+  return same;
+}
+
+static const char *s_any_ops[] = {
+    "*",  "/",  "%",   "+",  "-",   "<<",  ">>", ">>>", "<", "<=",
+    ">",  ">=", "===", "!==", "==", "!=",  "&",  "^",   "|", "&&",
+    "||"};
+static const char *s_any_assign[] = {"=",  "+=", "-=",  "*=",   "/=", "%=",
+                                     "<<=", ">>=", ">>>=", "&=", "|=", "^="};
+static const char *s_any_leaves[] = {
+    "a", "b", "c", "0", "1", "2.5", "0x1f", "1e3", "'kata'", "benar",
+    "salah", "kosong", "takterdefinisi", "o.p", "o['q']", "d[1]", "f(a)",
+    "f()", "[1, a]", "{p: 1}"};
+static const char *s_lvals[] = {"a", "b", "o.p", "d[0]", "o['q']"};
+
+/* Any expression at all, whatever it would do when run */
+static void gen_any(char **out, int depth) {
+  int r = depth <= 0 ? 0 : rnd(12);
+  switch (r) {
+    case 0:
+    case 1:
+      put(out, s_any_leaves[rnd(ARRAY_SIZE(s_any_leaves))]);
+      break;
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+      gen_any(out, depth - 1 - rnd(2));
+      put(out, " ");
+      put(out, s_any_ops[rnd(ARRAY_SIZE(s_any_ops))]);
+      put(out, " ");
+      gen_any(out, depth - 1 - rnd(2));
+      break;
+    case 6: {
+      static const char *unary[] = {"!", "~", "-", "+", "tipe ", "- -", "!!"};
+      put(out, unary[rnd(ARRAY_SIZE(unary))]);
+      if (rnd(2)) {
+        put(out, s_any_leaves[rnd(ARRAY_SIZE(s_any_leaves))]);
+        break;
+      }
+    } /* fallthrough */
+    case 7:
+      put(out, "(");
+      gen_any(out, depth - 1);
+      put(out, ")");
+      break;
+    case 8:
+      gen_any(out, depth - 1);
+      put(out, " ? ");
+      gen_any(out, depth - 1);
+      put(out, " : ");
+      gen_any(out, depth - 1);
+      break;
+    case 9:
+      put(out, s_lvals[rnd(ARRAY_SIZE(s_lvals))]);
+      put(out, " ");
+      put(out, s_any_assign[rnd(ARRAY_SIZE(s_any_assign))]);
+      put(out, " ");
+      gen_any(out, depth - 1);
+      break;
+    case 10: {
+      static const char *incdec[] = {"a++", "b--", "++a", "--o.p", "d[0]++"};
+      put(out, incdec[rnd(ARRAY_SIZE(incdec))]);
+      break;
+    }
+    default:
+      put(out, "f(");
+      gen_any(out, depth - 1);
+      put(out, ", ");
+      gen_any(out, depth - 1);
+      put(out, ").p");
+      break;
+  }
+}
+
+/* A statement with an expression in each place the parser takes one */
+static void gen_stmt(char **out, int depth) {
+  switch (rnd(7)) {
+    case 0:
+      put(out, "jika (");
+      gen_any(out, depth);
+      put(out, ") { a = ");
+      gen_any(out, depth);
+      put(out, "; } lainnya { b = 1; }\n");
+      break;
+    case 1:
+      put(out, "ulang (");
+      gen_any(out, depth);
+      put(out, ") { berhenti; }\n");
+      break;
+    case 2:
+      put(out, "untuk (isi i = 0; ");
+      gen_any(out, depth);
+      put(out, "; i++) { teruskan; }\n");
+      break;
+    case 3:
+      put(out, "fungsi g(x) {\n  balik ");
+      gen_any(out, depth);
+      put(out, ";\n}\n");
+      break;
+    case 4:
+      put(out, "isi e = ");
+      gen_any(out, depth);
+      put(out, ", h = ");
+      gen_any(out, depth);
+      put(out, ";\n");
+      break;
+    default:
+      gen_any(out, depth);
+      put(out, ";\n");
+      break;
+  }
+}
+
+static void test_against_chain(void) {
+  struct baik *baik = baik_create();
+  struct baik_code *code;
+  char *src = (char *) malloc(SRC_SIZE * 4);
+  int i, k, n, diffs = 0, broken = 0, failed = 0;
+
+  for (i = 0; i < PROGRAMS; i++) {
+    char *s = src;
+    n = 1 + rnd(3);
+    for (k = 0; k < n; k++) gen_stmt(&s, 1 + rnd(MAX_DEPTH));
+    *s = '\0';
+    /* Every eighth program loses a character or its tail */
+    if (i % 8 == 7) {
+      size_t len = strlen(src), at = rnd((int) len);
+      if (rnd(2)) {
+        memmove(src + at, src + at + 1, len - at);
+      } else {
+        src[at] = '\0';
+      }
+      broken++;
+    }
+    if (!same_as_chain(baik, src)) {
+      if (diffs++ < 3) printf("differs from the old parser:\n%s\n", src);
+    }
+    if (baik_compile(baik, "t", src, &code) == BAIK_OK) {
+      baik_code_unref(code);
+    } else {
+      failed++;
+    }
+  }
+  CHECK(diffs == 0);
+  /* The broken programs, and only a few others, are syntax errors */
+  CHECK(failed >= broken / 2 && failed < broken * 2);
+  free(src);
+  baik_destroy(baik);
+}
+
+static void test_scripts_against_chain(void) {
+  static const char *paths[] = {"inac/umum.ina", "inac/fungsi.ina",
+                                "../../data/baik.ina"};
+  struct baik *baik = baik_create();
+  size_t i, size;
+
+  for (i = 0; i < ARRAY_SIZE(paths); i++) {
+    char *src = BAIK_EM_read_file(paths[i], &size);
+    CHECK(src != NULL);
+    if (src == NULL) continue;
+    CHECK(same_as_chain(baik, src));
+    free(src);
+  }
+  baik_destroy(baik);
+}
+
+static void test_long_and_deep(void) {
+  struct baik *baik = baik_create();
+  struct mbuf m;
+  baik_val_t v;
+  char s[16];
+  int i;
+
+  /* A long chain is one precedence level, however many operators */
+  mbuf_init(&m, 0);
+  for (i = 1; i <= 600; i++) {
+    snprintf(s, sizeof(s), i > 1 ? " + %d" : "%d", i);
+    mbuf_append(&m, s, strlen(s));
+  }
+  mbuf_append(&m, ";", 2);
+  CHECK(host_eval(baik, m.buf) == 600 * 601 / 2);
+  /* Unlike other operators, && and || nest to the right */
+  m.len = 0;
+  for (i = 0; i < 400; i++) mbuf_append(&m, "benar && ", 9);
+  mbuf_append(&m, "salah ? 1 : 2;", 15);
+  CHECK(host_eval(baik, m.buf) == 2);
+
+  /* Nesting is bounded by the parser stack */
+  m.len = 0;
+  for (i = 0; i < 100; i++) mbuf_append(&m, "(", 1);
+  mbuf_append(&m, "1", 1);
+  for (i = 0; i < 100; i++) mbuf_append(&m, ")", 1);
+  mbuf_append(&m, ";", 2);
+  CHECK(host_eval(baik, m.buf) == 1);
+  m.len = 0;
+  for (i = 0; i < 100000; i++) mbuf_append(&m, "(-", 2);
+  mbuf_append(&m, "", 1);
+  CHECK(baik_exec(baik, m.buf, &v) == BAIK_SYNTAX_ERROR);
+  CHECK(host_eval(baik, "1 + 1;") == 2);
+
+  mbuf_free(&m);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_random();
+  test_against_chain();
+  test_scripts_against_chain();
+  test_long_and_deep();
+  return host_done("test_parser");
+}
@@ -0,0 +1,443 @@
+/*
+ * Peephole pass: code after balik/berhenti/teruskan is gone, no jump lands
+ * on another jump, errors keep their line numbers, and the bytes the pass
+ * reports as saved are the ones missing from the code. Random programs
+ * give the same log, or the same error on the same line, with the pass
+ * on and off.
+ */
+static int s_peephole = 1;
+#define BAIK_ENABLE_PEEPHOLE s_peephole
+#include "host.h"
+
+#define PROGRAMS 1500
+
+/*
+ * What running src gives, the result or the error with its trace, and its
+ * code into `code` if given. Returns the bytes the pass reported saved.
+ */
+static size_t run(const char *src, int peephole, struct mbuf *out,
+                  struct mbuf *code) {
+  struct baik *baik = baik_create();
+  struct baik_code *c;
+  baik_val_t v = BAIK_UNDEFINED;
+  baik_err_t err;
+  size_t saved;
+  const char *s;
+  size_t len;
+
+  out->len = 0;
+  if (code != NULL) code->len = 0;
+  s_peephole = peephole;
+  err = baik_compile(baik, "t", src, &c);
+  s_peephole = 1;
+  saved = baik->bcode_optimized;
+  if (err == BAIK_OK) {
+    if (code != NULL) mbuf_append(code, c->p, c->len);
+    err = baik_exec_code(baik, c, &v);
+    baik_code_unref(c);
+  }
+  if (err != BAIK_OK) {
+    s = baik->error_msg != NULL ? baik->error_msg : "";
+    mbuf_append(out, s, strlen(s));
+    s = baik->stack_trace != NULL ? baik->stack_trace : "";
+    mbuf_append(out, s, strlen(s));
+  } else if ((s = baik_get_string(baik, &v, &len)) != NULL) {
+    mbuf_append(out, s, len);
+  } else {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", baik_get_double(baik, v));
+    mbuf_append(out, buf, strlen(buf));
+  }
+  mbuf_append(out, "", 1);
+  baik_destroy(baik);
+  return saved;
+}
+
+static int contains(const struct mbuf *m, const char *s) {
+  size_t i, n = strlen(s);
+  for (i = 0; i + n <= m->len; i++) {
+    if (memcmp(m->buf + i, s, n) == 0) return 1;
+  }
+  return 0;
+}
+
+/* Where the instructions of a part start and end */
+static void code_range(const struct mbuf *m, int *start, int *end) {
+  baik_header_item_t a, b;
+  memcpy(&a, m->buf + 1 + sizeof(a) * BAIK_HDR_ITEM_BCODE_OFFSET, sizeof(a));
+  memcpy(&b, m->buf + 1 + sizeof(b) * BAIK_HDR_ITEM_MAP_OFFSET, sizeof(b));
+  *start = a;
+  *end = b;
+}
+
+/*
+ * Bytes of the instructions of a part as the pass saw them, before the
+ * jump offsets grew from their one-byte placeholders.
+ */
+static size_t code_size(const struct mbuf *m) {
+  const uint8_t *c = (const uint8_t *) m->buf;
+  int i, start, end, llen;
+  size_t n = 0;
+  code_range(m, &start, &end);
+  for (i = start; i < end; i += bcode_insn_len(c, i)) {
+    n += bcode_insn_len(c, i);
+    if (peep_has_reloc(c[i])) {
+      BAIK_EM_varint_decode_unsafe(c + i + 1, &llen);
+      n -= llen - 1;
+    }
+  }
+  return n;
+}
+
+/* Jumps in the code of a part, and how many of them land on an OP_JMP */
+static int count_jumps(const struct mbuf *m, int *to_jmp) {
+  const uint8_t *c = (const uint8_t *) m->buf;
+  int i, start, end, n = 0;
+  code_range(m, &start, &end);
+  *to_jmp = 0;
+  for (i = start; i < end; i += bcode_insn_len(c, i)) {
+    int llen, dist;
+    if (!peep_is_jump(c[i])) continue;
+    dist = (int) BAIK_EM_varint_decode_unsafe(c + i + 1, &llen);
+    *to_jmp += c[i + 1 + llen + dist] == OP_JMP;
+    n++;
+  }
+  return n;
+}
+
+static void test_dead_code(void) {
+  static const char *srcs[] = {
+      "fungsi f() { balik 1; isi mati = 'kodemati'; }\nf();",
+      "isi i = 0;\nulang (i < 3) { i++; berhenti; 'kodemati'; }\ni;",
+      "untuk (isi i = 0; i < 3; i++) { teruskan; isi x = 'kodemati'; }\n1;",
+      "jika (salah) { 'kodemati'; }\n2;",
+      "ulang (salah) { 'kodemati'; }\n3;"};
+  struct mbuf on, off, con, coff;
+  size_t i;
+
+  mbuf_init(&on, 0);
+  mbuf_init(&off, 0);
+  mbuf_init(&con, 0);
+  mbuf_init(&coff, 0);
+  for (i = 0; i < ARRAY_SIZE(srcs); i++) {
+    run(srcs[i], 1, &on, &con);
+    run(srcs[i], 0, &off, &coff);
+    CHECK(strcmp(on.buf, off.buf) == 0);
+    CHECK(contains(&coff, "kodemati"));
+    if (contains(&con, "kodemati")) {
+      printf("dead code kept: %s\n", srcs[i]);
+      s_failed++;
+    }
+  }
+  mbuf_free(&on);
+  mbuf_free(&off);
+  mbuf_free(&con);
+  mbuf_free(&coff);
+}
+
+static void test_threading(void) {
+  static const char *src =
+      "isi n = 0, i = 0;\n"
+      "ulang (i < 10) {\n"
+      "  i++;\n"
+      "  jika (i % 2 === 0) { jika (i > 4) { n += 10; } lainnya { n++; } }\n"
+      "  lainnya { jika (i < 3) { teruskan; } }\n"
+      "}\n"
+      "n = n + (benar && salah || i > 5 ? 1 : 2);\n"
+      "n;";
+  struct mbuf on, off, con, coff;
+  int jon, joff, ton, toff;
+
+  mbuf_init(&on, 0);
+  mbuf_init(&off, 0);
+  mbuf_init(&con, 0);
+  mbuf_init(&coff, 0);
+  run(src, 1, &on, &con);
+  run(src, 0, &off, &coff);
+  CHECK(strcmp(on.buf, "33") == 0 && strcmp(off.buf, on.buf) == 0);
+  jon = count_jumps(&con, &ton);
+  joff = count_jumps(&coff, &toff);
+  /* Nested blocks end in jumps to jumps until the pass threads them */
+  CHECK(toff > 0);
+  CHECK(ton == 0);
+  CHECK(jon <= joff);
+  mbuf_free(&on);
+  mbuf_free(&off);
+  mbuf_free(&con);
+  mbuf_free(&coff);
+}
+
+/* The bytes the pass reports as saved are exactly the ones missing */
+static void test_saved(void) {
+  static const char *src =
+      "fungsi f(a) {\n"
+      "  jika (a) { balik 1; } lainnya { balik 2; }\n"
+      "  balik 3;\n"
+      "}\n"
+      "isi s = 0;\n"
+      "untuk (isi i = 0; i < 5; i++) { jika (benar) { s += f(i); } }\n"
+      "s;";
+  struct mbuf on, off, con, coff;
+  size_t saved_on, saved_off;
+
+  mbuf_init(&on, 0);
+  mbuf_init(&off, 0);
+  mbuf_init(&con, 0);
+  mbuf_init(&coff, 0);
+  saved_on = run(src, 1, &on, &con);
+  saved_off = run(src, 0, &off, &coff);
+  CHECK(strcmp(on.buf, "6") == 0 && strcmp(off.buf, on.buf) == 0);
+  CHECK(saved_off == 0);
+  CHECK(saved_on > 0 && saved_on == code_size(&coff) - code_size(&con));
+  mbuf_free(&on);
+  mbuf_free(&off);
+  mbuf_free(&con);
+  mbuf_free(&coff);
+}
+
+/* Errors after rewritten code point at the same line */
+static void test_lines(void) {
+  static const char *srcs[][2] = {
+      {"isi x = 1;\njika (benar) { x = 2; }\n\ntidakada + x;", "  at t:4\n"},
+      {"fungsi f() {\n  balik 1;\n  x = 3;\n}\nf();\nisi o;\no.a.b;",
+       "  at t:7\n"},
+      {"isi i = 0;\nulang (i < 2) {\n  i++;\n  teruskan;\n  i--;\n}\n"
+       "jika (benar ? 1 : 2) {\n}\ntidakada;\ni = 1;",
+       "  at t:9\n"},
+      {"fungsi g(o) {\n  jika (salah) { balik; }\n  balik o.x.y;\n  o;\n}\n"
+       "untuk (isi i = 0; i < 3; i++) {\n  jika (i === 2) {\n    g(i);\n  }\n}",
+       "  at t:3\n  at t:8\n"}};
+  struct mbuf on, off;
+  size_t i;
+
+  mbuf_init(&on, 0);
+  mbuf_init(&off, 0);
+  for (i = 0; i < ARRAY_SIZE(srcs); i++) {
+    run(srcs[i][0], 1, &on, NULL);
+    run(srcs[i][0], 0, &off, NULL);
+    if (strstr(on.buf, srcs[i][1]) == NULL || strcmp(on.buf, off.buf) != 0) {
+      printf("%s\n  on:  %s\n  off: %s\n", srcs[i][0], on.buf, off.buf);
+      s_failed++;
+    }
+  }
+  mbuf_free(&on);
+  mbuf_free(&off);
+}
+
+static unsigned long s_seed = 4242;
+
+static int rnd(int n) {
+  s_seed = s_seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (int) ((s_seed >> 33) % (unsigned long) n);
+}
+
+static void put(struct mbuf *m, const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  mbuf_append(m, buf, strlen(buf));
+}
+
+static void gen_expr(struct mbuf *m, int depth);
+
+static void gen_cond(struct mbuf *m, int depth) {
+  static const char *leaves[] = {"benar", "salah", "x", "x < y", "y === 2",
+                                 "!x"};
+  switch (depth <= 0 ? 0 : rnd(5)) {
+    case 0:
+      put(m, "%s", leaves[rnd(ARRAY_SIZE(leaves))]);
+      break;
+    case 1:
+      put(m, "!(");
+      gen_cond(m, depth - 1);
+      put(m, ")");
+      break;
+    case 2:
+      gen_cond(m, depth - 1);
+      put(m, rnd(2) ? " && " : " || ");
+      gen_cond(m, depth - 1);
+      break;
+    default:
+      gen_expr(m, depth - 1);
+      put(m, " %s ", rnd(2) ? "<" : "===");
+      gen_expr(m, depth - 1);
+      break;
+  }
+}
+
+static void gen_expr(struct mbuf *m, int depth) {
+  static const char *leaves[] = {"x", "y", "1", "2", "0", "10"};
+  switch (depth <= 0 ? 0 : rnd(6)) {
+    case 0:
+      put(m, "%s", leaves[rnd(ARRAY_SIZE(leaves))]);
+      break;
+    case 1:
+      put(m, "(");
+      gen_cond(m, depth - 1);
+      put(m, " ? ");
+      gen_expr(m, depth - 1);
+      put(m, " : ");
+      gen_expr(m, depth - 1);
+      put(m, ")");
+      break;
+    case 2:
+      put(m, "[");
+      gen_expr(m, depth - 1);
+      put(m, ", 1].panjang");
+      break;
+    case 3:
+      put(m, "({a: ");
+      gen_expr(m, depth - 1);
+      put(m, "}).a");
+      break;
+    default:
+      gen_expr(m, depth - 1);
+      put(m, " %s ", rnd(2) ? "+" : "-");
+      gen_expr(m, depth - 1);
+      break;
+  }
+}
+
+static int s_ids;
+
+/* Statements on lines of their own, so that errors name a line */
+static void gen_block(struct mbuf *m, int depth, int in_loop, int in_fn);
+
+static void gen_stmt(struct mbuf *m, int depth, int in_loop, int in_fn) {
+  int id = s_ids++, r = depth <= 0 ? rnd(3) : rnd(14);
+  switch (r) {
+    case 0:
+      put(m, "catat(");
+      gen_expr(m, 2);
+      put(m, ");\n");
+      break;
+    case 1:
+      put(m, "%s = ", rnd(2) ? "x" : "y");
+      gen_expr(m, 2);
+      put(m, ";\n");
+      break;
+    case 2:
+      put(m, rnd(4) == 0 ? "catat(tidakada);\n" : ";\n");
+      break;
+    case 3:
+    case 4:
+      put(m, "jika (");
+      gen_cond(m, 2);
+      put(m, ") {\n");
+      gen_block(m, depth - 1, in_loop, in_fn);
+      if (rnd(2)) {
+        put(m, "} lainnya {\n");
+        gen_block(m, depth - 1, in_loop, in_fn);
+      }
+      put(m, "}\n");
+      break;
+    case 5:
+      put(m, "isi k%d = 0;\nulang (k%d < 3) {\nk%d++;\n", id, id, id);
+      gen_block(m, depth - 1, 1, in_fn);
+      put(m, "}\n");
+      break;
+    case 6:
+      put(m, "untuk (isi i%d = 0; i%d < 3; i%d++) {\n", id, id, id);
+      gen_block(m, depth - 1, 1, in_fn);
+      put(m, "}\n");
+      break;
+    case 7:
+      put(m, "fungsi f%d(a) {\n", id);
+      gen_block(m, depth - 1, 0, 1);
+      put(m, "balik a + 1;\n}\ncatat(f%d(x));\n", id);
+      break;
+    case 8:
+      if (in_loop) {
+        put(m, "jika (");
+        gen_cond(m, 1);
+        put(m, ") { %s; }\n", rnd(2) ? "berhenti" : "teruskan");
+      }
+      break;
+    case 9:
+      /* The rest of the block is dead */
+      if (in_loop) {
+        put(m, "%s;\n", rnd(2) ? "berhenti" : "teruskan");
+      } else if (in_fn) {
+        put(m, "balik ");
+        gen_expr(m, 1);
+        put(m, ";\n");
+      }
+      break;
+    case 10:
+      put(m, "jika (%s) {\n", rnd(2) ? "benar" : "salah");
+      gen_block(m, depth - 1, in_loop, in_fn);
+      put(m, "}\n");
+      break;
+    case 11:
+      put(m, "ulang (salah) {\n");
+      gen_block(m, depth - 1, 1, in_fn);
+      put(m, "}\n");
+      break;
+    case 12:
+      put(m, "{\n");
+      gen_block(m, depth - 1, in_loop, in_fn);
+      put(m, "}\n");
+      break;
+    default:
+      put(m, "isi v%d = ", id);
+      gen_cond(m, 2);
+      put(m, ";\ncatat(v%d);\n", id);
+      break;
+  }
+}
+
+static void gen_block(struct mbuf *m, int depth, int in_loop, int in_fn) {
+  int i, n = rnd(4);
+  for (i = 0; i < n; i++) gen_stmt(m, depth, in_loop, in_fn);
+}
+
+static void test_random(void) {
+  struct mbuf src, on, off, con, coff;
+  size_t saved, total_on = 0, total_off = 0;
+  int i, diffs = 0, errors = 0, bad_saved = 0;
+
+  mbuf_init(&src, 0);
+  mbuf_init(&on, 0);
+  mbuf_init(&off, 0);
+  mbuf_init(&con, 0);
+  mbuf_init(&coff, 0);
+  for (i = 0; i < PROGRAMS; i++) {
+    src.len = 0;
+    put(&src, "isi L = '', x = 1, y = 2;\n"
+              "fungsi catat(v) { L = L + JSON.stringify(v) + ','; }\n");
+    gen_block(&src, 3, 0, 0);
+    put(&src, "L;");
+    mbuf_append(&src, "", 1);
+    saved = run(src.buf, 1, &on, &con);
+    run(src.buf, 0, &off, &coff);
+    if (strcmp(on.buf, off.buf) != 0 && diffs++ < 3) {
+      printf("%s\n  on:  %s\n  off: %s\n", src.buf, on.buf, off.buf);
+    }
+    bad_saved += saved != code_size(&coff) - code_size(&con);
+    errors += strstr(on.buf, "  at t:") != NULL;
+    total_on += con.len;
+    total_off += coff.len;
+  }
+  CHECK(diffs == 0);
+  CHECK(bad_saved == 0);
+  /* Some end in an error, to compare where it was raised */
+  CHECK(errors > PROGRAMS / 20);
+  /* The pass finds something to remove in this kind of code */
+  CHECK(total_on < total_off);
+  mbuf_free(&src);
+  mbuf_free(&on);
+  mbuf_free(&off);
+  mbuf_free(&con);
+  mbuf_free(&coff);
+}
+
+int main(void) {
+  test_dead_code();
+  test_threading();
+  test_saved();
+  test_lines();
+  test_random();
+  return host_done("test_peephole");
+}
@@ -0,0 +1,232 @@
+/*
+ * Quickening: hot sites rewrite themselves to OP_ADD_NUM, OP_GET_OWN_CACHED
+ * and OP_GET_ARRAY_INDEX, go back to the generic opcode when their guard
+ * fails, and give the same results either way. A non-number operand or a
+ * non-array deopts the site; an index the array does not hold takes the
+ * generic path once and keeps the site specialized.
+ */
+#define BAIK_QUICKEN_STATS 1
+#include "host.h"
+
+/* Sites holding opcode `op` in all the code of the instance */
+static int count_op(struct baik *baik, int op) {
+  int p, i, n = 0;
+  for (p = 0; p < baik_bcode_parts_cnt(baik); p++) {
+    const uint8_t *c = (const uint8_t *) baik_bcode_part_get(baik, p)->data.p;
+    baik_header_item_t start, end;
+    memcpy(&start, c + 1 + sizeof(start) * BAIK_HDR_ITEM_BCODE_OFFSET,
+           sizeof(start));
+    memcpy(&end, c + 1 + sizeof(end) * BAIK_HDR_ITEM_MAP_OFFSET, sizeof(end));
+    for (i = start; i < (int) end; i += bcode_insn_len(c, i)) n += c[i] == op;
+  }
+  return n;
+}
+
+/* The counts since the last call */
+static struct baik_quicken_stats delta(struct baik *baik,
+                                       struct baik_quicken_stats *last) {
+  struct baik_quicken_stats st, d;
+  baik_get_quicken_stats(baik, &st);
+  d.generic = st.generic - last->generic;
+  d.specialized = st.specialized - last->specialized;
+  d.deopts = st.deopts - last->deopts;
+  *last = st;
+  return d;
+}
+
+static void test_installed(void) {
+  struct baik *baik = baik_create();
+  struct baik_quicken_stats last, d;
+
+  memset(&last, 0, sizeof(last));
+  CHECK(host_eval(baik,
+                  "isi o = {a: 2}, d = [1, 2, 3], s = 0;\n"
+                  "fungsi f(n) {\n"
+                  "  untuk (isi i = 0; i < n; i++) s = s + d[i % 3] * o.a;\n"
+                  "  balik s;\n"
+                  "}\n"
+                  "f(300);") == 1200);
+  CHECK(count_op(baik, OP_ADD_NUM) == 1);
+  CHECK(count_op(baik, OP_MUL_NUM) == 1);
+  CHECK(count_op(baik, OP_GET_ARRAY_INDEX) == 1);
+  CHECK(count_op(baik, OP_GET_OWN_CACHED) >= 5);
+  /* Only o.a, a property by name, stays generic in the loop */
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0);
+  CHECK(d.generic >= 300 && d.generic < 320 && d.specialized > 5 * d.generic);
+
+  /* Then only the new call site of f starts generic */
+  CHECK(host_eval(baik, "s = 0; f(3);") == 12);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0 && d.generic == 1 + 3);
+  baik_destroy(baik);
+}
+
+static void test_operand(void) {
+  struct baik *baik = baik_create();
+  struct baik_quicken_stats last, d;
+
+  memset(&last, 0, sizeof(last));
+  CHECK(host_eval(baik, "fungsi tambah(a, b) { balik a + b; } tambah(1, 2);") ==
+        3);
+  CHECK(count_op(baik, OP_ADD_NUM) == 1 && count_op(baik, OP_ADD) == 0);
+  delta(baik, &last);
+  /* tambah and the reads of a and b, then the addition */
+  CHECK(host_eval(baik, "tambah(2, 3);") == 5);
+  d = delta(baik, &last);
+  CHECK(d.generic == 1 && d.specialized == 3 && d.deopts == 0);
+
+  /* NaN is still a number */
+  CHECK(host_eval(baik, "isi r = tambah(0 / 0, 1); r === r ? 0 : 1;") == 1);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0 && count_op(baik, OP_ADD_NUM) == 1);
+
+  /* Strings deopt the site, which adds them the generic way */
+  CHECK(host_eval(baik, "tambah('x', 'y') === 'xy' ? 1 : 0;") == 1);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 1);
+  CHECK(count_op(baik, OP_ADD_NUM) == 0 && count_op(baik, OP_ADD) == 1);
+  CHECK(host_eval(baik, "tambah('a', 'b') === 'ab' ? 1 : 0;") == 1);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0 && count_op(baik, OP_ADD) == 1);
+
+  /* Numbers again make it specialize once more */
+  CHECK(host_eval(baik, "tambah(4, 5);") == 9);
+  CHECK(count_op(baik, OP_ADD_NUM) == 1);
+  CHECK(host_eval(baik, "tambah(-0, 0) === 0 ? tambah(1, 1) : 0;") == 2);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0);
+
+  /* One operand not a number is the generic path's error, either side */
+  CHECK(baik_exec(baik, "tambah(1, benar);", NULL) == BAIK_TYPE_ERROR);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 1 && count_op(baik, OP_ADD_NUM) == 0);
+  CHECK(host_eval(baik, "tambah(2, 2);") == 4);
+  CHECK(baik_exec(baik, "tambah(kosong, 1);", NULL) == BAIK_TYPE_ERROR);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 1);
+  CHECK(host_eval(baik, "tambah(3, 3);") == 6);
+  baik_destroy(baik);
+}
+
+static void test_shape(void) {
+  struct baik *baik = baik_create();
+  struct baik_quicken_stats last, d;
+
+  memset(&last, 0, sizeof(last));
+  CHECK(host_eval(baik,
+                  "isi a = [5, 6, 7];\n"
+                  "fungsi ambil(x, k) { balik x[k]; }\n"
+                  "ambil(a, 1);") == 6);
+  CHECK(count_op(baik, OP_GET_ARRAY_INDEX) == 1);
+  CHECK(host_eval(baik, "ambil(a, 2);") == 7);
+  delta(baik, &last);
+
+  /* An object where the array was deopts the site */
+  CHECK(host_eval(baik, "isi o = {}; o[1] = 9; ambil(o, 1);") == 9);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 1 && count_op(baik, OP_GET_ARRAY_INDEX) == 0);
+  CHECK(host_eval(baik, "ambil(o, 1);") == 9);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0);
+
+  /* An array brings it back; a string key deopts it again */
+  CHECK(host_eval(baik, "ambil(a, 0);") == 5);
+  CHECK(count_op(baik, OP_GET_ARRAY_INDEX) == 1);
+  CHECK(host_eval(baik, "ambil(a, '2');") == 7);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 1 && count_op(baik, OP_GET_ARRAY_INDEX) == 0);
+  CHECK(host_eval(baik, "ambil(a, 0) + ambil(a, 1);") == 11);
+  CHECK(host_eval(baik, "ambil(a, 'panjang');") == 3);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 1);
+  baik_destroy(baik);
+}
+
+static void test_out_of_bounds(void) {
+  static const char *keys[] = {"3", "-1", "1.5", "1e10", "0 / 0", "4294967295"};
+  struct baik *baik = baik_create();
+  struct baik_quicken_stats last, d;
+  char src[64];
+  size_t i;
+
+  memset(&last, 0, sizeof(last));
+  CHECK(host_eval(baik,
+                  "isi a = [5, 6, 7], h = [];\n"
+                  "h[2] = 1;\n"
+                  "fungsi ambil(x, k) { balik x[k]; }\n"
+                  "ambil(a, 0);") == 5);
+  CHECK(count_op(baik, OP_GET_ARRAY_INDEX) == 1);
+  delta(baik, &last);
+  /*
+   * Missing elements take the generic path and the site stays. The new
+   * line reads ambil and a generic too, and x and k specialized.
+   */
+  for (i = 0; i < ARRAY_SIZE(keys); i++) {
+    snprintf(src, sizeof(src), "ambil(a, %s) === takterdefinisi ? 1 : 0;",
+             keys[i]);
+    CHECK(host_eval(baik, src) == 1);
+    d = delta(baik, &last);
+    CHECK(d.generic == 2 + 1 && d.specialized == 2 && d.deopts == 0);
+    CHECK(count_op(baik, OP_GET_ARRAY_INDEX) == 1);
+  }
+  CHECK(host_eval(baik, "ambil(h, 0) === takterdefinisi ? ambil(h, 2) : 0;") ==
+        1);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0);
+  CHECK(count_op(baik, OP_GET_ARRAY_INDEX) == 1);
+  CHECK(host_eval(baik, "ambil(a, 1);") == 6);
+  baik_destroy(baik);
+}
+
+/*
+ * Cached variable reads see every new value, and the scope a read finds
+ * the variable in may change: a function sees the locals of its caller.
+ */
+static void test_cached_reads(void) {
+  struct baik *baik = baik_create();
+  struct baik_quicken_stats last, d;
+
+  memset(&last, 0, sizeof(last));
+  CHECK(host_eval(baik, "isi g = 1; fungsi baca() { balik g; } baca();") == 1);
+  CHECK(host_eval(baik, "g = 2; baca();") == 2);
+  CHECK(host_eval(baik, "g = 'x'; baca() === 'x' ? 3 : 0;") == 3);
+  CHECK(host_eval(baik, "fungsi luar(g) { balik g + baca(); } g = 1; luar(5);") ==
+        10);
+  CHECK(host_eval(baik, "baca() + luar(7);") == 1 + 14);
+  d = delta(baik, &last);
+  CHECK(d.deopts == 0 && d.specialized > 0);
+  CHECK(count_op(baik, OP_GET_OWN_CACHED) > 0);
+  baik_destroy(baik);
+}
+
+/* Shared code is never rewritten, so it only runs the generic opcodes */
+static void test_shared(void) {
+  struct baik *c = baik_create(), *baik = baik_create();
+  struct baik_quicken_stats st;
+  struct baik_code *code;
+  baik_val_t v;
+
+  CHECK(baik_compile(c, "t",
+                     "isi s = 0, d = [1, 2];\n"
+                     "untuk (isi i = 0; i < 100; i++) s = s + d[i % 2];\n"
+                     "s;",
+                     &code) == BAIK_OK);
+  baik_destroy(c);
+  CHECK(baik_exec_code(baik, code, &v) == BAIK_OK &&
+        baik_get_double(baik, v) == 150);
+  baik_get_quicken_stats(baik, &st);
+  CHECK(st.specialized == 0 && st.deopts == 0 && st.generic > 0);
+  baik_code_unref(code);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_installed();
+  test_operand();
+  test_shape();
+  test_out_of_bounds();
+  test_cached_reads();
+  test_shared();
+  return host_done("test_quicken");
+}
@@ -0,0 +1,84 @@
+/*
+ * Bytecode reclaim: parts run one line at a time, the way the REPL does,
+ * are freed once nothing points into them, while the functions defined in
+ * earlier parts keep working.
+ */
+#include "host.h"
+
+#define LINES 3000
+
+static void test_repl(void) {
+  struct baik *baik = baik_create();
+  size_t most = 0;
+  char src[160];
+  int i, n;
+
+  host_eval(baik,
+            "fungsi satu(x) { balik x + 1; }"
+            "isi alat = {kali: fungsi(x) { balik x * 10; }};"
+            "isi daftar = [];");
+  for (i = 0; i < LINES; i++) {
+    baik_val_t v;
+    const char *s;
+    size_t len;
+    if (i % 500 == 250) {
+      /* Functions kept only in a global, an array and an object */
+      snprintf(src, sizeof(src),
+               "isi f%d = fungsi() { balik %d; };"
+               "daftar.push(fungsi(x) { balik x + %d; });"
+               "alat.m%d = fungsi() { balik 'm' + JSON.stringify(%d); };",
+               i, i, i, i, i);
+      CHECK(baik_exec(baik, src, NULL) == BAIK_OK);
+    } else {
+      /* A throwaway line, its result a string made by the line itself */
+      snprintf(src, sizeof(src),
+               "isi t = [%d, 2, 3]; 's' + JSON.stringify(t[0] + satu(1));", i);
+      CHECK(baik_exec(baik, src, &v) == BAIK_OK);
+      s = baik_get_string(baik, &v, &len);
+      snprintf(src, sizeof(src), "s%d", i + 2);
+      CHECK(s != NULL && len == strlen(src) && memcmp(s, src, len) == 0);
+    }
+    n = baik_bcode_parts_cnt(baik);
+    if ((size_t) n > most) most = n;
+  }
+  /* Parts come and go instead of piling up, one per line */
+  CHECK(most < LINES / 10);
+  CHECK(baik_bcode_parts_cnt(baik) < LINES / 10);
+
+  CHECK(host_eval(baik, "satu(41);") == 42);
+  CHECK(host_eval(baik, "alat.kali(4);") == 40);
+  for (i = 250; i < LINES; i += 500) {
+    snprintf(src, sizeof(src),
+             "f%d() + daftar[%d](1000) + (alat.m%d() === 'm%d' ? 1 : 0);", i,
+             i / 500, i, i);
+    CHECK(host_eval(baik, src) == i + 1000 + i + 1);
+  }
+  baik_destroy(baik);
+}
+
+/* A function that only the result of a line refers to outlives the line */
+static void test_result(void) {
+  struct baik *baik = baik_create();
+  char src[64];
+  int i;
+
+  for (i = 0; i < LINES; i++) {
+    baik_val_t f = BAIK_UNDEFINED, r = BAIK_UNDEFINED;
+    snprintf(src, sizeof(src), "isi t = [1, 2]; fungsi(a) { balik a * %d; };",
+             i);
+    CHECK(baik_exec(baik, src, &f) == BAIK_OK && baik_is_function(f));
+    baik_own(baik, &f);
+    CHECK(baik_call(baik, &r, f, BAIK_UNDEFINED, 1, baik_mk_number(baik, 3)) ==
+              BAIK_OK &&
+          baik_get_double(baik, r) == 3 * i);
+    baik_disown(baik, &f);
+  }
+  CHECK(baik_bcode_parts_cnt(baik) < LINES / 10);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_repl();
+  test_result();
+  return host_done("test_reclaim");
+}
@@ -0,0 +1,100 @@
+/*
+ * baik_reset: whatever a script left behind, globals, timers, tasks,
+ * posted events and bytecode, is gone afterwards, the arena blocks it grew
+ * are kept, and the instance runs new scripts like a fresh one.
+ */
+#include "host.h"
+
+static size_t count_blocks(const struct gc_arena *a) {
+  struct gc_block *b;
+  size_t n = 0;
+  for (b = a->blocks; b != NULL; b = b->next) n++;
+  return n;
+}
+
+static int s_cb_runs;
+
+static void count_cb(struct baik *baik, void *user_data) {
+  (void) baik;
+  (void) user_data;
+  s_cb_runs++;
+}
+
+/* Leaves a bit of everything behind */
+static void dirty(struct baik *baik) {
+  baik_val_t res;
+  CHECK(host_eval(baik,
+                  "isi x = 42, daftar = [];"
+                  "fungsi f(a) { balik a + x; }"
+                  "untuk (isi i = 0; i < 200; i++) daftar.push({i: i});"
+                  "setelah(10, fungsi() { x = 1; });"
+                  "setiap(5, fungsi() { x++; });"
+                  "tugas(fungsi() { ulang (benar) tunggu(0); });"
+                  "f(0);") == 42);
+  baik_post_cb(baik, count_cb, NULL);
+  /* A top-level run suspended in tunggu() */
+  CHECK(baik_exec(baik, "tunggu(1000); x = 0;", &res) == BAIK_SUSPENDED);
+}
+
+static void test_cleared(void) {
+  struct baik *baik = baik_create();
+  size_t objs, props;
+  baik_val_t kept;
+
+  dirty(baik);
+  baik_exec(baik, "({a: 1});", &kept);
+  baik_own(baik, &kept);
+  CHECK(baik_events_pending(baik) > 0);
+  CHECK(baik_bcode_parts_cnt(baik) > 0);
+  objs = count_blocks(&baik->object_arena);
+  props = count_blocks(&baik->property_arena);
+
+  CHECK(baik_reset(baik) == BAIK_OK);
+  CHECK(baik_events_pending(baik) == 0);
+  CHECK(baik->timers_cnt == 0 && baik->tasks == NULL);
+  CHECK(!baik->suspended && !baik->parked.saved);
+  CHECK(baik_bcode_parts_cnt(baik) == 0 && baik->bcode_len == 0);
+  CHECK(baik->owned_values.len == 0);
+  CHECK(count_blocks(&baik->object_arena) == objs);
+  CHECK(count_blocks(&baik->property_arena) == props);
+  CHECK(baik_get(baik, baik_get_global(baik), "x", ~0) == BAIK_UNDEFINED);
+  CHECK(baik_get(baik, baik_get_global(baik), "f", ~0) == BAIK_UNDEFINED);
+  CHECK(baik_exec(baik, "x;", NULL) != BAIK_OK);
+  /* Nothing queued before the reset fires later */
+  s_cb_runs = 0;
+  CHECK(host_drain(baik) == 0);
+  CHECK(s_cb_runs == 0);
+  baik_destroy(baik);
+}
+
+static void test_reusable(void) {
+  struct baik *baik = baik_create();
+  baik_val_t res;
+  int round;
+
+  for (round = 0; round < 5; round++) {
+    dirty(baik);
+    CHECK(baik_reset(baik) == BAIK_OK);
+    /* Timers, tasks and suspension work from scratch again */
+    CHECK(host_eval(baik,
+                    "isi log = '';"
+                    "setelah(1, fungsi() { log = log + 't'; });"
+                    "tugas(fungsi() { tunggu(0); log = log + 'k'; });"
+                    "fungsi g(a) { balik a * 2; } g(21);") == 42);
+    host_drain(baik);
+    CHECK(host_eval(baik, "log.panjang;") == 2);
+    CHECK(host_eval(baik, "isi o = {}; o.a = [1, 2, 3]; o.a[2] + g(1);") == 5);
+    CHECK(baik_exec(baik, "tunggu(1); g(20);", &res) == BAIK_SUSPENDED);
+    while (baik_resume(baik, &res) == BAIK_SUSPENDED) baik_sleep_ms(1);
+    CHECK(baik_get_double(baik, res) == 40);
+    CHECK(baik_bcode_parts_cnt(baik) > 0);
+    CHECK(baik_reset(baik) == BAIK_OK);
+  }
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_cleared();
+  test_reusable();
+  return host_done("test_reset");
+}
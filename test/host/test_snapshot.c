@@ -0,0 +1,124 @@
+/*
+ * Snapshots: an instance loaded from an image has the same globals,
+ * objects, strings, functions and timers as the one saved. Truncated or
+ * foreign images and images from another build are refused and leave a
+ * usable instance behind, and a busy instance cannot be saved.
+ */
+#include "host.h"
+
+static const char *s_setup =
+    "isi nama = 'stasiun cuaca', hitung = 0;"
+    "isi data = {suhu: [21.5, 22, 23.25], lokasi: {kota: 'Bandung'}};"
+    "data.diri = data;"
+    "fungsi tambah(n) { hitung += n; balik hitung; }"
+    "isi t = setelah(30, fungsi() { hitung = 1000; });";
+
+static void test_round_trip(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  baik_val_t v;
+  char *img;
+  size_t len;
+
+  host_eval(a, s_setup);
+  CHECK(baik_snapshot_save_buf(a, &img, &len) == BAIK_OK);
+  baik_destroy(a);
+
+  host_eval(b, "isi lama = 1;");
+  CHECK(baik_snapshot_load_buf(b, img, len) == BAIK_OK);
+  CHECK(host_eval(b, "nama === 'stasiun cuaca' ? 1 : 0;") == 1);
+  CHECK(host_eval(b, "data.suhu[2] + data.suhu.panjang;") == 26.25);
+  CHECK(host_eval(b, "data.lokasi.kota === 'Bandung' ? 1 : 0;") == 1);
+  CHECK(host_eval(b, "data.diri.diri === data ? 1 : 0;") == 1);
+  CHECK(baik_exec(b, "lama;", &v) != BAIK_OK); /* wiped by the load */
+  CHECK(host_eval(b, "tambah(2); tambah(3);") == 5);
+  /* The timer is still pending and fires on its own */
+  CHECK(baik_events_pending(b) == 1);
+  host_drain(b);
+  CHECK(host_eval(b, "hitung;") == 1000);
+  /* New code compiles after the loaded parts */
+  CHECK(host_eval(b, "fungsi kali(x) { balik x * 3; } kali(tambah(1));") ==
+        3003);
+
+  free(img);
+  baik_destroy(b);
+}
+
+static void test_bad_images(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  char *img;
+  size_t len, cut;
+  int all_refused = 1;
+
+  host_eval(a, s_setup);
+  CHECK(baik_snapshot_save_buf(a, &img, &len) == BAIK_OK);
+
+  for (cut = 0; cut < len; cut += (cut < 256 ? 1 : 61)) {
+    all_refused &= baik_snapshot_load_buf(b, img, cut) == BAIK_FILE_READ_ERROR;
+  }
+  CHECK(all_refused);
+  img[0] ^= 1;
+  CHECK(baik_snapshot_load_buf(b, img, len) == BAIK_FILE_READ_ERROR);
+  img[0] ^= 1;
+  /* Still usable after all that */
+  CHECK(host_eval(b, "isi z = 40; z + 2;") == 42);
+  CHECK(baik_snapshot_load_buf(b, img, len) == BAIK_OK);
+  CHECK(host_eval(b, "tambah(7);") == 7);
+
+  free(img);
+  baik_destroy(a);
+  baik_destroy(b);
+}
+
+static void test_other_build(void) {
+  struct baik *a = baik_create(), *b = baik_create();
+  struct baik_snap_hdr *hdr;
+  uint8_t id[32], zeros[32] = {0};
+  char *img;
+  size_t len, i;
+  int all_refused = 1;
+
+  host_eval(a, s_setup);
+  CHECK(baik_snapshot_save_buf(a, &img, &len) == BAIK_OK);
+  hdr = (struct baik_snap_hdr *) img;
+  snap_build_id(id);
+  CHECK(memcmp(id, zeros, sizeof(id)) != 0);
+  CHECK(memcmp(hdr->build_id, id, sizeof(id)) == 0);
+
+  /* Any byte of the id differing means a different program */
+  for (i = 0; i < sizeof(id); i++) {
+    hdr->build_id[i] ^= 0x20;
+    all_refused &= baik_snapshot_load_buf(b, img, len) == BAIK_FILE_READ_ERROR;
+    hdr->build_id[i] ^= 0x20;
+  }
+  CHECK(all_refused);
+  CHECK(b->error_msg != NULL &&
+        strcmp(b->error_msg, "snapshot bukan untuk program ini") == 0);
+  CHECK(host_eval(b, "isi z = 40; z + 2;") == 42);
+  CHECK(baik_snapshot_load_buf(b, img, len) == BAIK_OK);
+  CHECK(host_eval(b, "tambah(7);") == 7);
+
+  free(img);
+  baik_destroy(a);
+  baik_destroy(b);
+}
+
+static void test_busy(void) {
+  struct baik *baik = baik_create();
+  char *img;
+  size_t len;
+
+  host_eval(baik, "tugas(fungsi() { tunggu(0); });");
+  CHECK(baik_snapshot_save_buf(baik, &img, &len) != BAIK_OK);
+  host_drain(baik);
+  CHECK(baik_snapshot_save_buf(baik, &img, &len) == BAIK_OK);
+  free(img);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_round_trip();
+  test_bad_images();
+  test_other_build();
+  test_busy();
+  return host_done("test_snapshot");
+}
@@ -0,0 +1,78 @@
+/*
+ * Cooperative tasks: tasks take turns at each tunggu() in spawn order, keep
+ * their own stacks across switches, sleep for as long as they ask, and a
+ * top-level run suspended in tunggu() resumes where it stopped.
+ */
+#include "host.h"
+
+static void test_interleave(void) {
+  struct baik *baik = baik_create();
+  host_eval(baik,
+            "isi log = '', nama = ['a', 'b', 'c'], ambil = 0;"
+            "fungsi kerja() {"
+            "  isi c = nama[ambil++];"
+            "  untuk (isi i = 0; i < 3; i++) { log = log + c; tunggu(0); }"
+            "}"
+            "tugas(kerja); tugas(kerja); tugas(kerja);");
+  CHECK(baik_events_pending(baik) == 3);
+  host_drain(baik);
+  CHECK(host_eval(baik, "log === 'abcabcabc' ? 1 : 0;") == 1);
+  CHECK(baik_events_pending(baik) == 0);
+  baik_destroy(baik);
+}
+
+static void test_own_stacks(void) {
+  struct baik *baik = baik_create();
+  /* Each task is suspended deep in its own calls and scopes */
+  host_eval(baik,
+            "isi hasil = [], ambil = 0;"
+            "fungsi turun(n, k) {"
+            "  isi lokal = n * 10;"
+            "  jika (n === 0) { tunggu(0); balik k; }"
+            "  balik lokal + turun(n - 1, k);"
+            "}"
+            "fungsi kerja() { isi k = ambil++; hasil.push(turun(5, k)); }"
+            "untuk (isi j = 0; j < 10; j++) tugas(kerja);");
+  host_drain(baik);
+  CHECK(host_eval(baik, "hasil.panjang;") == 10);
+  CHECK(host_eval(baik,
+                  "isi s = 0; untuk (isi j = 0; j < 10; j++) s += hasil[j];"
+                  "s;") == 10 * 150 + 45);
+  baik_destroy(baik);
+}
+
+static void test_sleep(void) {
+  struct baik *baik = baik_create();
+  double t0 = host_now_ms(), t;
+  host_eval(baik,
+            "isi urut = '';"
+            "tugas(fungsi() { tunggu(60); urut = urut + 'lambat'; });"
+            "tugas(fungsi() { tunggu(20); urut = urut + 'cepat,'; });");
+  host_drain(baik);
+  t = host_now_ms() - t0;
+  CHECK(host_eval(baik, "urut === 'cepat,lambat' ? 1 : 0;") == 1);
+  CHECK(t >= 60 && t < 200);
+  baik_destroy(baik);
+}
+
+static void test_top_level(void) {
+  struct baik *baik = baik_create();
+  baik_val_t res;
+  CHECK(baik_exec(baik, "isi x = 1; tunggu(10); x = 2; x + 40;", &res) ==
+        BAIK_SUSPENDED);
+  /* Only the suspended run may go on */
+  CHECK(baik_exec(baik, "x;", &res) != BAIK_OK);
+  while (baik_resume(baik, &res) == BAIK_SUSPENDED) {
+    baik_sleep_ms(1);
+  }
+  CHECK(baik_get_double(baik, res) == 42);
+  baik_destroy(baik);
+}
+
+int main(void) {
+  test_interleave();
+  test_own_stacks();
+  test_sleep();
+  test_top_level();
+  return host_done("test_tasks");
+}